@@ -0,0 +1,286 @@
+/**
+ * Measures the time per call of the functions that dominate the evaluation of the loss function
+ * and reports it in JSON format.
+ * 
+ * The benchmarks only use the numerical core and run on synthetic inputs generated in memory
+ * from a fixed seed, so that no input files or ROOT are needed and results of different versions
+ * of the code can be compared directly. Each benchmark is calibrated to run for at least the
+ * given minimal time, and the measurement is repeated several times. The median time per call
+ * is reported together with the fastest repetition.
+ */
+
+#include <FitBase.hpp>
+#include <JetCorrDefinitions.hpp>
+#include <MultijetBinnedSum.hpp>
+#include <Nuisances.hpp>
+#include <PhotonJetBinnedSum.hpp>
+#include <Rebin.hpp>
+#include <SyntheticInputs.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+namespace
+{
+/// Number of repetitions of each calibrated measurement
+unsigned const numRepetitions = 5;
+
+
+/// Sink for results of benchmarked functions, which prevents the compiler from eliding calls
+double volatile sink;
+
+
+/// Result of a single benchmark
+struct BenchResult
+{
+    /// Name of the benchmark
+    std::string name;
+    
+    /// Number of calls in each repetition
+    unsigned long numCalls;
+    
+    /// Median and minimal time per call over repetitions, in ns
+    double nsPerCall, nsPerCallMin;
+};
+
+
+/**
+ * \brief Measures the time per call of the given function
+ * 
+ * The number of calls per repetition is doubled until a repetition takes at least the given
+ * time, in seconds.
+ */
+BenchResult RunBenchmark(std::string const &name, std::function<double()> const &func,
+  double minTime)
+{
+    using Clock = std::chrono::steady_clock;
+    
+    auto const timeCalls = [&func](unsigned long numCalls)
+    {
+        double sum = 0.;
+        auto const start = Clock::now();
+        
+        for (unsigned long i = 0; i < numCalls; ++i)
+            sum += func();
+        
+        double const duration = std::chrono::duration<double>(Clock::now() - start).count();
+        sink = sum;
+        return duration;
+    };
+    
+    
+    // Warm up caches and calibrate the number of calls
+    unsigned long numCalls = 1;
+    timeCalls(numCalls);
+    
+    while (timeCalls(numCalls) < minTime and numCalls < (1ul << 40))
+        numCalls *= 2;
+    
+    std::vector<double> nsPerCall;
+    
+    for (unsigned i = 0; i < numRepetitions; ++i)
+        nsPerCall.emplace_back(timeCalls(numCalls) / numCalls * 1e9);
+    
+    std::sort(nsPerCall.begin(), nsPerCall.end());
+    
+    return {name, numCalls, nsPerCall[numRepetitions / 2], nsPerCall.front()};
+}
+
+
+/// Constructs a binning with the given number of logarithmically spaced bins
+std::vector<double> MakeLogBinning(double min, double max, unsigned numBins)
+{
+    std::vector<double> edges;
+    
+    for (unsigned i = 0; i <= numBins; ++i)
+        edges.emplace_back(min * std::pow(max / min, double(i) / numBins));
+    
+    return edges;
+}
+
+
+/// Writes results in JSON format
+void WriteResults(std::ostream &out, std::vector<BenchResult> const &results, double minTime)
+{
+    out << std::setprecision(6);
+    out << "{\"version\":1,\"minTime\":" << minTime << ",\"repetitions\":" << numRepetitions <<
+      ",\n\"benchmarks\":[";
+    
+    for (unsigned i = 0; i < results.size(); ++i)
+    {
+        auto const &r = results[i];
+        out << ((i > 0) ? ",\n" : "\n");
+        out << "{\"name\":\"" << r.name << "\",\"numCalls\":" << r.numCalls <<
+          ",\"nsPerCall\":" << r.nsPerCall << ",\"nsPerCallMin\":" << r.nsPerCallMin <<
+          ",\"callsPerSecond\":" << 1e9 / r.nsPerCall << "}";
+    }
+    
+    out << "]}\n";
+}
+}
+
+
+int main(int argc, char **argv)
+{
+    using namespace std;
+    
+    
+    // Parse arguments
+    double minTime = 0.1;
+    string filter, outputName;
+    
+    for (int i = 1; i < argc; ++i)
+    {
+        string const arg(argv[i]);
+        
+        if (arg == "--help" or arg == "-h")
+        {
+            cerr << "Usage: bench [--min-time seconds] [--filter substring] [--output file]\n";
+            cerr << "Runs micro-benchmarks of the numerical core and reports time per call in " <<
+              "JSON format.\n";
+            return EXIT_FAILURE;
+        }
+        
+        if (i + 1 == argc)
+        {
+            cerr << "Option \"" << arg << "\" requires a value.\n";
+            return EXIT_FAILURE;
+        }
+        
+        if (arg == "--min-time")
+            minTime = stod(argv[++i]);
+        else if (arg == "--filter")
+            filter = argv[++i];
+        else if (arg == "--output" or arg == "-o")
+            outputName = argv[++i];
+        else
+        {
+            cerr << "Unknown option \"" << arg << "\".\n";
+            return EXIT_FAILURE;
+        }
+    }
+    
+    vector<BenchResult> results;
+    
+    auto const run = [&](string const &name, function<double()> const &func)
+    {
+        if (name.find(filter) == string::npos)
+            return;
+        
+        results.emplace_back(RunBenchmark(name, func, minTime));
+        cerr << setw(40) << left << name << " " << results.back().nsPerCall << " ns\n";
+    };
+    
+    
+    // Jet corrections, evaluated on a fixed set of points
+    vector<double> const ptValues(MakeLogBinning(15., 3000., 1023));
+    vector<pair<string, shared_ptr<JetCorrBase>>> correctors;
+    correctors.emplace_back("StableLogLin", make_shared<JetCorrStableLogLin>());
+    correctors.emplace_back("Std2P", make_shared<JetCorrStd2P>());
+    correctors.emplace_back("Std3P", make_shared<JetCorrStd3P>());
+    
+    for (auto const &c: correctors)
+    {
+        JetCorrBase const &corrector = *c.second;
+        unsigned i = 0;
+        
+        run("JetCorr" + c.first + "::Eval", [&]()
+        {
+            i = (i + 1) & 1023;
+            return corrector.Eval(ptValues[i]);
+        });
+        
+        run("JetCorr" + c.first + "::UndoCorr", [&]()
+        {
+            i = (i + 1) & 1023;
+            return corrector.UndoCorr(ptValues[i]);
+        });
+    }
+    
+    
+    // Mapping of binnings. The target binning is coarser and its edges do not align with the
+    //source one, so that interpolation is exercised.
+    for (unsigned numBins: {10u, 100u, 1000u, 10000u})
+    {
+        vector<double> const source(MakeLogBinning(10., 5000., numBins));
+        vector<double> const target(MakeLogBinning(11., 4500., max(numBins / 4, 1u)));
+        
+        run("mapBinning/" + to_string(numBins), [&]()
+        {
+            return mapBinning(source, target).size();
+        });
+    }
+    
+    
+    // Measurements and the combined loss function
+    Nuisances const nuisances;
+    JetCorrStd2P corrector;
+    corrector.SetParams({0.01, 0.002});
+    SyntheticInputGenerator const generator(corrector, 20240101);
+    
+    vector<pair<string, shared_ptr<MeasurementBase>>> measurements;
+    
+    for (auto method: {MultijetBinnedSum::Method::PtBal, MultijetBinnedSum::Method::MPF})
+    {
+        string const label((method == MultijetBinnedSum::Method::PtBal) ? "PtBal" : "MPF");
+        measurements.emplace_back("MultijetBinnedSum::Eval/" + label,
+          make_shared<MultijetBinnedSum>(generator.GenerateMultijet(method), method));
+    }
+    
+    for (auto method: {PhotonJetBinnedSum::Method::PtBal, PhotonJetBinnedSum::Method::MPF})
+    {
+        string const label((method == PhotonJetBinnedSum::Method::PtBal) ? "PtBal" : "MPF");
+        measurements.emplace_back("PhotonJetBinnedSum::Eval/" + label,
+          make_shared<PhotonJetBinnedSum>(generator.GeneratePhotonJet(method), method));
+    }
+    
+    for (auto const &m: measurements)
+    {
+        MeasurementBase const &measurement = *m.second;
+        run(m.first, [&]()
+        {
+            return measurement.Eval(corrector, nuisances);
+        });
+    }
+    
+    CombLossFunction lossFunc(unique_ptr<JetCorrBase>(new JetCorrStd2P));
+    
+    for (auto const &m: measurements)
+        lossFunc.AddMeasurement(m.second.get());
+    
+    vector<double> const x{0.01, 0.002};
+    run("CombLossFunction::EvalRawInput", [&]()
+    {
+        return lossFunc.EvalRawInput(x.data());
+    });
+    
+    
+    // Report the results
+    if (outputName.empty())
+        WriteResults(cout, results, minTime);
+    else
+    {
+        ofstream out(outputName);
+        
+        if (not out)
+        {
+            cerr << "Failed to open file \"" << outputName << "\" for writing.\n";
+            return EXIT_FAILURE;
+        }
+        
+        WriteResults(out, results, minTime);
+    }
+    
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <Fitter.hpp>
+#include <MultiEtaLossFunction.hpp>
+
+#include <vector>
+
+
+/**
+ * \struct BlockFitResult
+ * \brief Outcome of a minimization with BlockSparseMinimizer
+ * 
+ * The full covariance matrix is not computed. Instead, diagonal blocks of the covariance matrix,
+ * which describe parameters within individual bins in eta, are provided. Accordingly, the field
+ * covariance inherited from FitResult is left empty.
+ */
+struct BlockFitResult: public FitResult
+{
+    /// Default constructor
+    BlockFitResult();
+    
+    /// Covariance matrices for parameters of individual bins in eta, in row-major order
+    std::vector<std::vector<double>> blockCovariances;
+    
+    /// Number of performed Newton iterations
+    unsigned numIterations;
+};
+
+
+/**
+ * \class BlockSparseMinimizer
+ * \brief Minimizes MultiEtaLossFunction exploiting the block structure of its Hessian
+ * 
+ * The minimization is performed with Newton's method with Levenberg-Marquardt damping. In every
+ * iteration the gradient and the Hessian of the loss function for each bin in eta are computed
+ * with finite differences, varying only the parameters of that bin. Bins are processed in
+ * parallel. Derivatives of the constraints, which couple adjacent bins, are added analytically.
+ * The resulting Hessian is block-tridiagonal, and the Newton step is found with a block version
+ * of the Thomas algorithm. The cost of an iteration thus scales linearly with the number of bins,
+ * the same as for independent fits in each bin.
+ * 
+ * The loss function is assumed to be a chi^2, i.e. the uncertainties correspond to a change of
+ * the loss function by one unit. Diagonal blocks of the covariance matrix are computed with the
+ * same recursion without building the full inverse of the Hessian.
+ */
+class BlockSparseMinimizer
+{
+public:
+    /**
+     * \brief Constructor
+     * 
+     * The loss function is not owned by this and must outlive the object.
+     */
+    BlockSparseMinimizer(MultiEtaLossFunction const &lossFunc);
+    
+public:
+    /**
+     * \brief Performs the minimization
+     * 
+     * The status of the returned result is 0 in case of convergence, 1 if the maximal number of
+     * iterations has been reached, and 2 if the minimizer failed to make a step that decreases the
+     * loss function.
+     */
+    BlockFitResult Minimize();
+    
+    /// Sets the maximal number of Newton iterations
+    void SetMaxIterations(unsigned maxIterations);
+    
+    /// Sets verbosity level; if positive, a summary of each iteration is printed
+    void SetPrintLevel(int printLevel);
+    
+    /**
+     * \brief Sets the starting point
+     * 
+     * By default all parameters are set to zero.
+     */
+    void SetStartingPoint(std::vector<double> const &start);
+    
+    /// Sets step used to compute derivatives with finite differences
+    void SetStepSize(double stepSize);
+    
+    /**
+     * \brief Sets tolerance on the estimated distance to the minimum
+     * 
+     * The minimization stops when the expected decrease of the loss function, as estimated from
+     * the quadratic approximation, falls below the given value. The default value is 1e-4.
+     */
+    void SetTolerance(double tolerance);
+    
+private:
+    /**
+     * \brief Computes the loss function and its derivatives at the given point
+     * 
+     * Blocks of the Hessian are described in the same way as in
+     * MultiEtaLossFunction::AddConstraintDerivatives. The number of evaluations of the loss
+     * function is added to the given counter.
+     */
+    double ComputeDerivatives(std::vector<double> const &x, std::vector<double> &gradient,
+      std::vector<std::vector<double>> &diagBlocks,
+      std::vector<std::vector<double>> &offDiagBlocks, unsigned &numCalls) const;
+    
+private:
+    /// Loss function to be minimized
+    MultiEtaLossFunction const &lossFunc;
+    
+    /// Starting point
+    std::vector<double> start;
+    
+    /// Step for finite differences
+    double stepSize;
+    
+    /// Tolerance on the estimated distance to the minimum
+    double tolerance;
+    
+    /// Maximal number of iterations
+    unsigned maxIterations;
+    
+    /// Verbosity level
+    int printLevel;
+};
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+
+/**
+ * \class CounterRng
+ * \brief Counter-based generator of pseudo-random numbers
+ * 
+ * Implements the Philox4x32-10 generator [1]. Its output is a bijective function of a 128-bit
+ * counter, which is scrambled with a 64-bit key given by the seed. Two 32-bit components of the
+ * counter identify independent streams, and the remaining 64 bits enumerate numbers within a
+ * stream. Thus the sequence for a given pair of stream indices is fully determined by the seed and
+ * does not depend on the order in which different streams are generated, e.g. from different
+ * threads. This allows reproducible pseudo-experiments executed in parallel.
+ * 
+ * [1] J. K. Salmon et al., "Parallel random numbers: as easy as 1, 2, 3", SC'11,
+ * https://doi.org/10.1145/2063384.2063405
+ */
+class CounterRng
+{
+public:
+    /// Constructor from the seed and indices of the stream
+    CounterRng(std::uint64_t seed, std::uint32_t stream0 = 0, std::uint32_t stream1 = 0);
+    
+public:
+    /// Returns a random number from a normal distribution with the given mean and width
+    double Gaus(double mean = 0., double sigma = 1.);
+    
+    /// Returns the next 32-bit number from the stream
+    std::uint32_t Next();
+    
+    /**
+     * \brief Returns a random number from a Poisson distribution with the given mean
+     * 
+     * Small means are treated with the multiplication method, and for large means the
+     * transformed rejection method PTRS [1] is used.
+     * [1] W. Hörmann, "The transformed rejection method for generating Poisson random variables",
+     * Insurance: Mathematics and Economics 12 (1993) 39
+     */
+    unsigned long Poisson(double mean);
+    
+    /// Returns a random number uniformly distributed in (0, 1)
+    double Uniform();
+    
+private:
+    /// Computes the next block of four numbers and advances the counter
+    void Refill();
+    
+private:
+    /// Key derived from the seed
+    std::array<std::uint32_t, 2> key;
+    
+    /// Current counter
+    std::array<std::uint32_t, 4> counter;
+    
+    /// Last computed block of numbers
+    std::array<std::uint32_t, 4> block;
+    
+    /// Number of numbers from the current block that have already been used
+    unsigned numUsed;
+};
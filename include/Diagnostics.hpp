@@ -0,0 +1,101 @@
+/**
+ * Provides a sink for problems encountered during the evaluation of the loss function, such as
+ * NaN in individual bins. Occurrences are counted in memory without any output, and a summary is
+ * printed once, at the end of the fit.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <initializer_list>
+#include <ostream>
+#include <string>
+#include <vector>
+
+
+/**
+ * \class DiagnosticCounter
+ * \brief Counts occurrences of a kind of problem separately in each bin
+ * 
+ * Bins are identified by arbitrary integer keys, e.g. combinations of indices. For the first
+ * occurrence in each bin, a context is saved, which consists of a few numbers with names given
+ * at the construction (e.g. the index of the bin and the value of the observable).
+ * 
+ * Each thread counts occurrences in its own storage, which is only locked by other threads while
+ * a summary is being produced. Thus, recording an occurrence performs no I/O and does not
+ * serialize threads. When a thread exits, its occurrences are merged into a common total, and the
+ * storage is reused by later threads. Only counters obtained with GetDiagnosticCounter are
+ * included in the summary.
+ */
+class DiagnosticCounter
+{
+public:
+    /// Maximal number of fields in the context of an occurrence
+    static unsigned const maxNumFields = 4;
+    
+    /// Numbers that describe an occurrence
+    using Context = std::array<double, maxNumFields>;
+    
+public:
+    /**
+     * \brief Constructor
+     * 
+     * The source identifies the code that reports the problem, and the description explains the
+     * problem. Throws an exception if more than maxNumFields field names are given.
+     */
+    DiagnosticCounter(std::string const &source, std::string const &description,
+      std::vector<std::string> const &fieldNames);
+    
+public:
+    /// Returns the description of the problem
+    std::string const &GetDescription() const;
+    
+    /// Returns names of fields of the context
+    std::vector<std::string> const &GetFieldNames() const;
+    
+    /// Returns the identifier of the source of the problem
+    std::string const &GetSource() const;
+    
+    /**
+     * \brief Records an occurrence in the bin with the given key
+     * 
+     * The given values are saved as the context if this is the first occurrence in the bin in
+     * the calling thread. They must follow the order of names of fields; missing values are set
+     * to NaN and extra ones are ignored.
+     */
+    void Record(std::uint64_t key, std::initializer_list<double> values) const;
+    
+private:
+    /// Source and description of the problem
+    std::string source, description;
+    
+    /// Names of fields of the context
+    std::vector<std::string> fieldNames;
+};
+
+
+/**
+ * \brief Returns the counter for the given source and description
+ * 
+ * The counter is created on the first call, with the given names of fields, and then lives until
+ * the end of the program. Access involves a lock, so the returned reference should be cached,
+ * e.g. in a static variable.
+ */
+DiagnosticCounter const &GetDiagnosticCounter(std::string const &source,
+  std::string const &description, std::vector<std::string> const &fieldNames);
+
+
+/// Returns the total number of recorded occurrences of all problems
+std::uint64_t GetNumDiagnosticEvents();
+
+
+/**
+ * \brief Prints a summary of all recorded problems
+ * 
+ * For each kind of problem, the total number of occurrences and the number of affected bins are
+ * printed. To keep the output short, only the bins affected first are listed individually, with
+ * their numbers of occurrences and the context of the earliest occurrence. Nothing is printed if
+ * no problems have been recorded.
+ */
+void PrintDiagnosticsSummary(std::ostream &out);
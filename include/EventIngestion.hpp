@@ -0,0 +1,136 @@
+/**
+ * Provides tools to build inputs of the multijet measurement directly from event-level ntuples.
+ */
+
+#pragma once
+
+#include <HistFlattening.hpp>
+#include <MultijetBinnedSum.hpp>
+
+#include <string>
+#include <vector>
+
+
+/**
+ * \struct IngestionBinning
+ * \brief Binnings and thresholds used to aggregate events
+ */
+struct IngestionBinning
+{
+    /// Binnings for a single trigger bin
+    struct TriggerBin
+    {
+        /// Label of the trigger bin
+        std::string label;
+        
+        /// Binnings in pt of the leading jet in data and simulation
+        std::vector<double> binning, simBinning;
+    };
+    
+    /// Jet pt threshold
+    double minPt;
+    
+    /// Binning in pt of other jets, common for all trigger bins
+    std::vector<double> ptJetBinning;
+    
+    /// Trigger bins, in the order of their indices in the ntuples
+    std::vector<TriggerBin> triggerBins;
+};
+
+
+/**
+ * \brief Reads binnings from a text file
+ * 
+ * Each non-empty line that is not a comment (starts with '#') contains a keyword followed by its
+ * values. Keyword "min-pt" sets the jet pt threshold, "pt-jet-binning" sets the binning in pt of
+ * other jets as a comma-separated list of edges, and each line "trigger label binning simBinning"
+ * adds a trigger bin, e.g.
+ *   min-pt 15
+ *   pt-jet-binning 15,20,30,50,100,200,500
+ *   trigger PFJet140 200,220,250,300 200,300
+ * Throws an exception if the file cannot be parsed or a binning is not increasing.
+ */
+IngestionBinning ReadIngestionBinning(std::string const &fileName);
+
+
+/**
+ * \class MultijetIngestion
+ * \brief Builds inputs of the multijet measurement from event-level ntuples
+ * 
+ * Events are read from flat trees and aggregated into exactly the sums that are otherwise read
+ * from preprocessed histograms. A tree in data must contain the following branches:
+ *   TriggerBin (Int_t): index of the trigger bin, events outside of the valid range are skipped;
+ *   Weight (Float_t): weight of the event;
+ *   PtLead (Float_t): pt of the leading jet;
+ *   PtBal or MPF (Float_t): balance observable for the chosen method;
+ *   NumJets (Int_t): number of other jets;
+ *   JetPt[NumJets], JetPtProj[NumJets] (Float_t): pt of other jets and its projection onto the
+ *     direction of the leading jet, as used to fill histograms PtJetSumProj.
+ * A tree in simulation contains only the first four branches, with pt of the leading jet
+ * corrected. Other branches are not read.
+ * 
+ * Files are streamed in chunks of events. Each file is split into a fixed number of contiguous
+ * partitions, and each partition is aggregated into its own accumulator, possibly in parallel.
+ * The accumulators are then added in the order of the partitions. Thus the memory footprint does
+ * not depend on the size of the input files, and the result does not depend on the number of
+ * threads.
+ */
+class MultijetIngestion
+{
+public:
+    /// Constructor
+    MultijetIngestion(IngestionBinning const &binning, MultijetBinnedSum::Method method);
+    
+public:
+    /**
+     * \brief Reads the given files and aggregates events
+     * 
+     * Files in data and simulation can be given with weights, which are applied on top of the
+     * per-event weights. Up to the given number of threads are used. Reading with multiple
+     * threads requires that thread safety has been enabled in ROOT with ROOT::EnableThreadSafety.
+     */
+    MultijetBinnedSum::InputSums Run(std::vector<WeightedFile> const &dataFiles,
+      std::vector<WeightedFile> const &simFiles, unsigned numThreads = 1) const;
+    
+    /// Sets the number of events read at a time
+    void SetChunkSize(unsigned chunkSize);
+    
+    /**
+     * \brief Sets the number of partitions of each file
+     * 
+     * This limits the number of threads that can be exploited. Each partition holds a copy of
+     * all sums.
+     */
+    void SetNumPartitions(unsigned numPartitions);
+    
+    /// Sets the name of the trees to read
+    void SetTreeName(std::string const &treeName);
+    
+private:
+    /// Returns sums for all trigger bins with all bins empty
+    MultijetBinnedSum::InputSums CreateEmptySums() const;
+    
+    /**
+     * \brief Aggregates events from the given partition of the given file
+     * 
+     * The sums are updated. Events are read in chunks.
+     */
+    void ProcessPartition(WeightedFile const &file, bool isData, unsigned partition,
+      MultijetBinnedSum::InputSums &sums) const;
+    
+private:
+    /// Binnings and thresholds
+    IngestionBinning binning;
+    
+    /// Label of the method of computation, which defines the name of the balance branch
+    std::string methodLabel;
+    
+    /// Name of the trees
+    std::string treeName;
+    
+    /// Number of events read at a time
+    unsigned chunkSize;
+    
+    /// Number of partitions of each file
+    unsigned numPartitions;
+};
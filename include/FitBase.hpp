@@ -1,8 +1,11 @@
 #pragma once
 
+#include <CounterRng.hpp>
 #include <Nuisances.hpp>
+#include <Parallel.hpp>
 
 #include <memory>
+#include <string>
 #include <vector>
 
 
@@ -22,6 +25,13 @@ public:
     virtual ~JetCorrBase() noexcept;
     
 public:
+    /**
+     * \brief Creates a copy of this object
+     * 
+     * To be implemented in a derived class.
+     */
+    virtual std::unique_ptr<JetCorrBase> Clone() const = 0;
+    
     /// Returns number of parameters of the correction
     unsigned GetNumParams() const;
     
@@ -62,6 +72,51 @@ protected:
 };
 
 
+/**
+ * \struct ResidualBin
+ * \brief Comparison of data and expectation in a single bin of a measurement
+ * 
+ * Quantities that are not defined for a given measurement are set to NaN.
+ */
+struct ResidualBin
+{
+    /// Boundaries of the bin in pt
+    double ptMin, ptMax;
+    
+    /// Mean balance observable in data as given in the inputs and its uncertainty
+    double data, dataUnc;
+    
+    /// Mean balance observable in data recomputed for the jet correction and nuisances
+    double recomputed;
+    
+    /// Mean balance observable in simulation and its uncertainty
+    double sim, simUnc;
+    
+    /// Uncertainty on the difference between data and simulation used in the loss function
+    double totalUnc;
+    
+    /// Pull, (recomputed - sim) / totalUnc
+    double pull;
+};
+
+
+/**
+ * \struct ResidualGroup
+ * \brief Contribution of a group of bins, such as a trigger bin, to the loss function
+ */
+struct ResidualGroup
+{
+    /// Label of the group; empty if the measurement is not split into groups
+    std::string label;
+    
+    /// Contribution to the loss function
+    double chi2;
+    
+    /// Individual bins; can be empty if the measurement does not provide them
+    std::vector<ResidualBin> bins;
+};
+
+
 /**
  * \class MeasurementBase
  * \brief Base class to describe an analysis
@@ -70,10 +125,38 @@ protected:
  * deviation of data (with a hypothesized jet correction applied) from expectation, which is
  * intended to be used to construct the loss function for the fit. A derived class should implement
  * computation of the deviation in a single analysis.
+ * 
+ * Evaluation of the deviation must not modify the object, so that it can be performed from
+ * multiple threads concurrently. Inputs of the analysis, which are typically large, are expected
+ * to be shared among clones of the measurement.
  */
 class MeasurementBase
 {
 public:
+    /// Trivial virtual destructor
+    virtual ~MeasurementBase() noexcept;
+    
+public:
+    /**
+     * \brief Creates a copy of this measurement
+     * 
+     * The copy should share immutable inputs with the original object so that its construction is
+     * cheap in terms of both time and memory.
+     * 
+     * To be implemented in a derived class.
+     */
+    virtual std::unique_ptr<MeasurementBase> Clone() const = 0;
+    
+    /**
+     * \brief Creates a pseudo-experiment by fluctuating inputs of this measurement
+     * 
+     * The returned object is an independent measurement whose inputs in data have been fluctuated
+     * within their statistical uncertainties, using the given generator. Expectation from
+     * simulation and uncertainties are taken from the nominal inputs. The default implementation
+     * throws an exception.
+     */
+    virtual std::unique_ptr<MeasurementBase> CloneFluctuated(CounterRng &rng) const;
+    
     /**
      * \brief Returns dimensionality of the deviation
      * 
@@ -89,6 +172,32 @@ public:
      * To be implemented in a derived class.
      */
     virtual double Eval(JetCorrBase const &corrector, Nuisances const &nuisances) const = 0;
+    
+    /**
+     * \brief Evaluates the deviation with a breakdown into groups of bins
+     * 
+     * The contributions of all groups sum up to the value returned by Eval. The default
+     * implementation returns a single unlabelled group without bins.
+     */
+    virtual std::vector<ResidualGroup> EvalResiduals(JetCorrBase const &corrector,
+      Nuisances const &nuisances) const;
+    
+    /**
+     * \brief Saves preprocessed inputs into a snapshot file
+     * 
+     * A snapshot contains exactly the arrays needed to evaluate the deviation, and the measurement
+     * can be reconstructed from it without reading the original inputs (see function
+     * CreateMeasurement). The default implementation throws an exception.
+     */
+    virtual void SaveSnapshot(std::string const &fileName) const;
+    
+    /**
+     * \brief Provides a pool of threads that can be used to parallelize the evaluation
+     * 
+     * The pool may be shared with other objects. A null pointer requests serial evaluation. The
+     * default implementation ignores the pool.
+     */
+    virtual void SetThreadPool(std::shared_ptr<ThreadPool> const &threadPool);
 };
 
 
@@ -106,6 +215,10 @@ public:
  * external parameters. They are not modified with EvalRawInput and should instead be set using
  * method SetExternalNuisances. In this implementation no marginalized nuisances are included; they
  * can be added in a derived class.
+ * 
+ * Measurements can be evaluated concurrently using a persistent pool of threads (see method
+ * SetNumThreads). Contributions of individual measurements are always summed in the order in which
+ * the measurements have been added, so the result does not depend on the number of threads.
  */
 class CombLossFunction
 {
@@ -125,6 +238,35 @@ public:
      */
     void AddMeasurement(MeasurementBase const *measurement);
     
+    /**
+     * \brief Adds a new measurement that will contribute to the loss function
+     * 
+     * Provided object is owned by this.
+     */
+    void AddMeasurement(std::unique_ptr<MeasurementBase> &&measurement);
+    
+    /**
+     * \brief Creates an independent copy of this loss function
+     * 
+     * The copy has its own jet corrector, external nuisances, and clones of all measurements, which
+     * are owned by the copy. Since clones of measurements share their inputs, the copy is cheap.
+     * The original object and its copies can be evaluated in different threads concurrently. The
+     * copy shares the pool of threads with the original object.
+     */
+    virtual std::unique_ptr<CombLossFunction> Clone() const;
+    
+    /**
+     * \brief Creates a copy of this loss function for a pseudo-experiment
+     * 
+     * Similar to method Clone, but measurements are replaced by their fluctuated replicas (see
+     * MeasurementBase::CloneFluctuated). Each measurement is fluctuated with its own stream of
+     * random numbers, which is identified by the seed, the index of the pseudo-experiment, and the
+     * index of the measurement. Thus the replica is reproducible and does not depend on the order
+     * in which pseudo-experiments are generated.
+     */
+    virtual std::unique_ptr<CombLossFunction> CloneFluctuated(std::uint64_t seed,
+      unsigned toyIndex) const;
+    
     /**
      * \brief Retrieve vector of measurements included in the CombLossFunction
      */
@@ -144,6 +286,20 @@ public:
      */
     virtual unsigned GetNumParams() const;
     
+    /// Returns values of nuisances used for externalized nuisance parameters
+    Nuisances const &GetExternalNuisances() const;
+    
+    /// Returns the number of threads used to evaluate measurements
+    unsigned GetNumThreads() const;
+    
+    /**
+     * \brief Returns the pool of threads used to evaluate measurements
+     * 
+     * Null if measurements are evaluated serially. The pool can be given to measurements, which
+     * then parallelize their own evaluation with the same threads.
+     */
+    std::shared_ptr<ThreadPool> GetThreadPool() const;
+    
     /**
      * \brief Returns the number of degrees of freedom
      * 
@@ -178,9 +334,35 @@ public:
      */
     virtual double EvalRawInput(double const *x) const;
     
+    /**
+     * \brief Evaluates all measurements with a breakdown into groups of bins
+     * 
+     * The argument is interpreted as in method EvalRawInput. The outer vector is indexed with
+     * measurements in the order in which they have been added. Measurements are evaluated in
+     * parallel if a pool of threads is available.
+     */
+    virtual std::vector<std::vector<ResidualGroup>> EvalResiduals(double const *x) const;
+    
     /// Updates stored nuisances
     void SetExternalNuisances(Nuisances const &nuisances) const;
     
+    /**
+     * \brief Sets the number of threads used to evaluate measurements
+     * 
+     * The number includes the thread that evaluates the loss function. With a single thread (the
+     * default) measurements are evaluated serially, and no pool of threads is created.
+     */
+    void SetNumThreads(unsigned numThreads);
+    
+protected:
+    /**
+     * \brief Sums up deviations for all measurements
+     * 
+     * Uses the current state of the jet corrector and nuisances. Measurements are evaluated in
+     * parallel if a pool of threads is available.
+     */
+    double EvalMeasurements() const;
+    
 protected:
     /// Jet corrector object
     std::unique_ptr<JetCorrBase> corrector;
@@ -194,4 +376,14 @@ protected:
     
     /// Non-owning pointers to individual contributing measurements
     std::vector<MeasurementBase const *> measurements;
+    
+    /// Measurements owned by this, which are also included in the vector above
+    std::vector<std::unique_ptr<MeasurementBase>> ownedMeasurements;
+    
+    /**
+     * \brief Pool of threads to evaluate measurements
+     * 
+     * Null if measurements are evaluated serially. Shared with clones of this object.
+     */
+    std::shared_ptr<ThreadPool> threadPool;
 };
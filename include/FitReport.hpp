@@ -0,0 +1,31 @@
+/**
+ * Provides a structured summary of a fit, which is written in a machine-readable format.
+ */
+
+#pragma once
+
+#include <FitBase.hpp>
+#include <Fitter.hpp>
+
+#include <string>
+#include <vector>
+
+
+/**
+ * \brief Saves a complete summary of a fit in JSON format
+ * 
+ * The summary includes the status of the minimization, the fitted parameters and their
+ * covariance matrix, the minimal value of the loss function with the number of degrees of
+ * freedom and the p-value, and, for each measurement, its contribution to the loss function
+ * broken down into groups of bins (such as trigger bins) together with per-bin data, recomputed,
+ * and simulated balance observables and pulls. The breakdown is obtained from a single call to
+ * CombLossFunction::EvalResiduals at the fitted point, so no further evaluations are needed to
+ * plot results of the fit.
+ * 
+ * Measurements are labelled with the given strings, whose number must match the number of
+ * measurements in the loss function. Undefined numbers are written as null. As with
+ * SaveFitResult, the file is first written under a temporary name and then renamed. Throws an
+ * exception if the file cannot be written.
+ */
+void SaveFitReport(FitResult const &result, CombLossFunction const &lossFunc,
+  std::vector<std::string> const &measurementLabels, std::string const &fileName);
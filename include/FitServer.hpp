@@ -0,0 +1,128 @@
+#pragma once
+
+#include <FitBase.hpp>
+#include <Fitter.hpp>
+
+#include <atomic>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+/**
+ * \class FitServer
+ * \brief Serves requests to evaluate and fit a loss function over a Unix-domain socket
+ * 
+ * Intended to avoid repeated start-up costs (initialization of ROOT, reading of inputs) in tools
+ * that issue many small requests. The loss function is constructed once, and the server then
+ * answers requests from local clients. Each connection is served in its own thread with its own
+ * copy of the loss function (see CombLossFunction::Clone), so independent connections are served
+ * concurrently while requests within a connection are processed in order.
+ * 
+ * The protocol is line-based. Each request is a single line of whitespace-separated tokens, and
+ * the response is a single line that starts with "ok" followed by the results, or with "error"
+ * followed by a description of the problem. Supported requests are:
+ *   eval v_0 ... v_{n-1}
+ *     Evaluates the loss function for the given parameters. Response: the value of the loss.
+ *   fit [v_0 ... v_{n-1}]
+ *     Minimizes the loss function starting from the given point or, if no point is given, from the
+ *     result of the last fit in the same connection (zeros initially). Response: the status,
+ *     the minimal value, the number of degrees of freedom, and the value and uncertainty of each
+ *     parameter. The result is remembered in the connection.
+ *   scan [profile] name:min:max:numPoints ...
+ *     Scans the loss function on a grid as done by LossScan. Parameters that are not scanned are
+ *     taken from the last fit in the same connection or set to zero. Response: the number of
+ *     points followed by values of the loss in row-major order.
+ *   balance index type v_0 ... v_{n-1}
+ *     Returns a histogram with the mean balance for the multijet measurement with the given index,
+ *     as computed by MultijetBinnedSum::GetRecompBalance. The type is "bal", "recompBal", or
+ *     "simBal". Response: the number of bins followed by the bin edges, contents, and errors.
+ *   band index numSamples [p_0 ... p_{k-1}]
+ *     Computes an uncertainty band for the recomputed mean balance in the multijet measurement
+ *     with the given index (see MultijetBinnedSum::ComputeBalanceBand). Parameters are sampled
+ *     from the result of the last fit in the same connection, which must provide the covariance
+ *     matrix. Any number of probabilities in (0, 1) can be given; they default to 0.16, 0.5, and
+ *     0.84. Response: the number of bins followed by the bin edges and, for each probability,
+ *     the quantiles in all bins.
+ *   shutdown
+ *     Stops the server after the response has been sent.
+ */
+class FitServer
+{
+public:
+    /**
+     * \brief Constructor
+     * 
+     * The loss function is not owned by this and must outlive the object.
+     */
+    FitServer(CombLossFunction const &lossFunc);
+    
+public:
+    /**
+     * \brief Listens on the given socket and serves requests until a shutdown request is received
+     * 
+     * An existing file with the same path is removed. The socket file is removed when the server
+     * stops. Before returning, waits for all connections to finish.
+     */
+    void Serve(std::string const &socketPath);
+    
+private:
+    /// State of a connection
+    struct Session
+    {
+        /// Copy of the loss function used in this connection
+        std::unique_ptr<CombLossFunction> lossFunc;
+        
+        /// Result of the last fit in this connection
+        FitResult lastFit;
+    };
+    
+private:
+    /// Parses values of parameters starting from the given token
+    std::vector<double> ParseParams(std::vector<std::string> const &tokens, unsigned first) const;
+    
+    /**
+     * \brief Processes a single request and returns the response
+     * 
+     * Throws an exception if the request cannot be processed.
+     */
+    std::string ProcessRequest(Session &session, std::vector<std::string> const &tokens) const;
+    
+    /**
+     * \brief Joins threads of connections that have been closed
+     * 
+     * Called whenever a new connection is accepted, so that the number of threads kept by the
+     * server does not grow with the number of served connections.
+     */
+    void ReapConnections();
+    
+    /// Serves a single connection until it is closed
+    void ServeConnection(int socket);
+    
+    /// Requests the server to stop and unblocks all connections
+    void Stop();
+    
+private:
+    /// Loss function to be served
+    CombLossFunction const &lossFunc;
+    
+    /// Listening socket
+    int listenSocket;
+    
+    /// Indicates that the server should stop
+    std::atomic<bool> stopRequested;
+    
+    /// Sockets of open connections
+    std::set<int> clientSockets;
+    
+    /// Threads serving connections that have not been joined yet
+    std::vector<std::thread> connectionThreads;
+    
+    /// Identifiers of threads whose connections have been closed but that have not been joined
+    std::set<std::thread::id> finishedThreads;
+    
+    /// Protects clientSockets, connectionThreads, and finishedThreads
+    std::mutex mutex;
+};
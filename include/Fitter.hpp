@@ -0,0 +1,189 @@
+#pragma once
+
+#include <FitBase.hpp>
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+
+/**
+ * \struct FitResult
+ * \brief Outcome of a minimization of the loss function
+ * 
+ * Besides the fitted parameters, aggregates their covariance matrix and the summary of the state
+ * of the minimizer. The same structure describes checkpoints, which are written while the fit is
+ * running and can be used to warm-start another fit.
+ */
+struct FitResult
+{
+    /// Default constructor
+    FitResult();
+    
+    /**
+     * \brief Status of the minimization as reported by Minuit2
+     * 
+     * A negative value indicates that the minimization has not finished. This is the case for
+     * periodic checkpoints.
+     */
+    int status;
+    
+    /// Status of the covariance matrix as reported by Minuit2
+    int covStatus;
+    
+    /// Value of the loss function at the (current) minimum
+    double minValue;
+    
+    /// Estimated distance to the minimum
+    double edm;
+    
+    /// Number of evaluations of the loss function performed by the minimizer
+    unsigned numCalls;
+    
+    /// Names of the parameters
+    std::vector<std::string> names;
+    
+    /// Values of the parameters and their uncertainties
+    std::vector<double> values, errors;
+    
+    /**
+     * \brief Covariance matrix of the parameters
+     * 
+     * Stored in row-major order. Left empty if the covariance matrix is not known.
+     */
+    std::vector<double> covariance;
+};
+
+
+/**
+ * \brief Saves results of a fit to a text file
+ * 
+ * The file is first written under a temporary name, which is unique to the calling process and
+ * call, and then renamed. Because of this, an existing file is never left in a partially written
+ * state, even if the program is killed or several fits write the same file concurrently.
+ */
+void SaveFitResult(FitResult const &result, std::string const &fileName);
+
+
+/**
+ * \brief Reads results of a fit from a text file written with SaveFitResult
+ * 
+ * Throws an exception if the file cannot be read or its format is not recognized.
+ */
+FitResult LoadFitResult(std::string const &fileName);
+
+
+/**
+ * \brief Samples parameters from the multivariate normal distribution given by a fit result
+ * 
+ * The distribution is centred at the fitted values and has the covariance matrix of the fit.
+ * Parameters with zero variance, such as fixed ones, are set to their fitted values. Sample k
+ * uses stream k of a counter-based generator with the given seed, so the samples are
+ * reproducible. Throws an exception if the covariance matrix is not available or not
+ * positive-definite.
+ */
+std::vector<std::vector<double>> SampleParameters(FitResult const &result, unsigned numSamples,
+  std::uint64_t seed);
+
+
+/**
+ * \class Fitter
+ * \brief Minimizes a CombLossFunction with Minuit2
+ * 
+ * By default the minimization starts with all parameters set to zero. Alternatively, results of a
+ * previous fit can be provided as the starting point. In that case the uncertainties of the
+ * parameters define the initial step sizes, and the covariance matrix, if available, is used to
+ * seed the approximation of the inverse Hessian in Minuit2. When the minimum does not move much,
+ * such a warm-started fit converges in a few iterations.
+ * 
+ * Optionally, the best point found so far is saved periodically to a checkpoint file, from which
+ * an interrupted fit can be resumed. The progress of the fit can also be followed with a
+ * user-provided monitor.
+ */
+class Fitter
+{
+public:
+    /**
+     * \brief Constructor
+     * 
+     * The loss function is not owned by this and must outlive the object.
+     */
+    Fitter(CombLossFunction const &lossFunc);
+    
+public:
+    /**
+     * \brief Performs the minimization
+     * 
+     * If periodic checkpoints are requested, the final result is also saved to the checkpoint
+     * file.
+     */
+    FitResult Fit();
+    
+    /**
+     * \brief Fixes a parameter to the given value
+     * 
+     * The parameter is not varied in the minimization, and its uncertainty is reported as zero.
+     * If any parameter is fixed, the covariance matrix from the starting point is not used.
+     */
+    void FixParameter(unsigned index, double value);
+    
+    /**
+     * \brief Requests periodic checkpoints
+     * 
+     * The best point found so far is written to the given file after every period evaluations
+     * of the loss function. A period of zero disables periodic checkpoints but the final result is
+     * still saved. Only the final result carries a covariance matrix; periodic checkpoints have
+     * none, and the uncertainties in them are the step sizes the minimization has started with.
+     */
+    void SetCheckpoint(std::string const &fileName, unsigned period);
+    
+    /**
+     * \brief Sets a function to be called after each evaluation of the loss function
+     * 
+     * The monitor receives the best point found so far, with the status set to -1. It can abort
+     * the fit by throwing an exception, which is then propagated from method Fit.
+     */
+    void SetMonitor(std::function<void(FitResult const &)> const &monitor);
+    
+    /// Sets verbosity level of Minuit2
+    void SetPrintLevel(int printLevel);
+    
+    /**
+     * \brief Sets the starting point from results of a previous fit
+     * 
+     * Throws an exception if the number of parameters does not match the loss function.
+     */
+    void SetStartingPoint(FitResult const &start);
+    
+    /// Sets the strategy of Minuit2
+    void SetStrategy(unsigned strategy);
+    
+private:
+    /// Loss function to be minimized
+    CombLossFunction const &lossFunc;
+    
+    /// Starting point of the minimization
+    FitResult start;
+    
+    /**
+     * \brief Name of the file to save checkpoints
+     * 
+     * Checkpoints are disabled if it is empty.
+     */
+    std::string checkpointFileName;
+    
+    /// Number of evaluations of the loss function between periodic checkpoints
+    unsigned checkpointPeriod;
+    
+    /// Optional function to follow the progress of the fit
+    std::function<void(FitResult const &)> monitor;
+    
+    /// Fixed parameters and their values
+    std::map<unsigned, double> fixedParams;
+    
+    /// Settings for Minuit2
+    unsigned strategy;
+    int printLevel;
+};
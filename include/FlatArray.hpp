@@ -0,0 +1,117 @@
+/**
+ * Provides a read-only array of numbers that can refer to external memory, together with
+ * functions to treat such an array as a binning.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+
+/**
+ * \class FlatArray
+ * \brief Read-only contiguous array of doubles
+ * 
+ * The array either owns its storage or refers to memory managed elsewhere, such as a
+ * memory-mapped file. In the latter case the external memory must outlive the array and all its
+ * copies. Copying an owning array copies its content while a copy of a non-owning array refers to
+ * the same memory.
+ * 
+ * The interface mimics that of standard containers, so that the array can be used in range-based
+ * loops and standard algorithms.
+ */
+class FlatArray
+{
+public:
+    /// Constructs an empty array
+    FlatArray();
+    
+    /// Constructs an array that takes ownership of the given values
+    FlatArray(std::vector<double> &&values);
+    
+    /// Constructs an array that refers to external memory
+    FlatArray(double const *data, std::size_t size);
+    
+    /// Copy constructor
+    FlatArray(FlatArray const &src);
+    
+    /// Move constructor
+    FlatArray(FlatArray &&src) noexcept;
+    
+    /// Assignment operator
+    FlatArray &operator=(FlatArray const &src);
+    
+    /// Move assignment operator
+    FlatArray &operator=(FlatArray &&src) noexcept;
+    
+public:
+    /// Provides access to an element; no range check is performed
+    double operator[](std::size_t index) const
+    {
+        return ptr[index];
+    }
+    
+    /// Returns a pointer to the first element
+    double const *begin() const;
+    
+    /// Returns a pointer to the first element
+    double const *data() const;
+    
+    /// Returns a pointer past the last element
+    double const *end() const;
+    
+    /// Checks if the array refers to external memory
+    bool IsView() const;
+    
+    /// Returns the number of elements
+    std::size_t size() const;
+    
+    /// Returns a copy of the content as a vector
+    std::vector<double> ToVector() const;
+    
+private:
+    /// Storage for an owning array; unused if the array refers to external memory
+    std::vector<double> storage;
+    
+    /// Pointer to the first element
+    double const *ptr;
+    
+    /// Number of elements
+    std::size_t length;
+};
+
+
+/**
+ * \brief Finds the bin that contains the given value
+ * 
+ * The binning is given by its edges. Bins are numbered following the convention of ROOT, i.e. the
+ * underflow bin has index 0, and the overflow bin has index equal to the number of edges.
+ */
+unsigned FindBin(FlatArray const &edges, double x);
+
+
+/**
+ * \brief Returns the lower edge of the given bin
+ * 
+ * For the under- and overflow bins, ROOT's convention is followed, which extends the binning
+ * with bins of the mean width.
+ */
+double GetBinLowEdge(FlatArray const &edges, unsigned bin);
+
+
+/**
+ * \brief Returns the centre of the given bin
+ * 
+ * Under- and overflow bins are treated in the same way as in GetBinLowEdge.
+ */
+double GetBinCenter(FlatArray const &edges, unsigned bin);
+
+
+/**
+ * \brief Returns the width of the given bin
+ * 
+ * Under- and overflow bins are assigned widths of the first and the last bins respectively, as
+ * done in ROOT.
+ */
+double GetBinWidth(FlatArray const &edges, unsigned bin);
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <CounterRng.hpp>
+
+#include <vector>
+
+
+/**
+ * \brief Fluctuates inputs of a binned balance measurement
+ * 
+ * The inputs are the number of events in bins of pt of the reference object, the mean balance
+ * observable and its uncertainty in the same bins, and a sum of projections of pt of jets in bins
+ * of pt of the reference object and jets. The sum of projections is stored in row-major order,
+ * with rows corresponding to bins in pt of the reference object, and each row contains the given
+ * number of elements. All arrays include the under- and overflow bins. The number of events, the
+ * mean balance observable, and the sum of projections are modified in place.
+ * 
+ * Each bin in pt of the reference object is fluctuated independently. The number of events is
+ * drawn from a Poisson distribution, and the corresponding row of the sum of projections is
+ * rescaled accordingly. The mean balance observable is shifted by a Gaussian random number with a
+ * width given by its statistical uncertainty. For the pt balance method, which computes the
+ * balance from the sum of projections, the row is rescaled further to reproduce the shifted mean
+ * balance. Statistical uncertainties are not altered.
+ */
+void FluctuateBalanceInputs(CounterRng &rng, bool isPtBal, std::vector<double> &numEvents,
+  std::vector<double> &meanBal, std::vector<double> const &meanBalUnc,
+  std::vector<double> &ptJetSumProj, unsigned rowLength);
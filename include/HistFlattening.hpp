@@ -0,0 +1,97 @@
+/**
+ * Provides functions to convert ROOT histograms into flat arrays of numbers and back. These are
+ * the only places where the binned-sum measurements depend on ROOT types.
+ */
+
+#pragma once
+
+#include <ProfileSums.hpp>
+#include <WeightedFile.hpp>
+
+#include <TAxis.h>
+#include <TH1.h>
+#include <TH2.h>
+#include <TProfile.h>
+#include <TProfile2D.h>
+
+#include <string>
+#include <vector>
+
+
+/**
+ * \brief Returns edges of all bins of the given axis
+ * 
+ * The returned vector contains one more element than the number of bins.
+ */
+std::vector<double> GetBinEdges(TAxis const &axis);
+
+
+/**
+ * \brief Returns contents of all bins of a one-dimensional histogram
+ * 
+ * If requested, the under- and overflow bins are included, so that the indices coincide with
+ * ROOT's bin numbering. Otherwise the first element corresponds to the first bin within the
+ * range.
+ */
+std::vector<double> GetBinContents(TH1 const &hist, bool includeUnderOverflow = true);
+
+
+/**
+ * \brief Returns contents of all bins of a two-dimensional histogram
+ * 
+ * The contents are stored in row-major order, with rows corresponding to bins along the x axis.
+ * The under- and overflow bins are included along both axes. Thus the content of bin (i, j) is
+ * found at index i * (ny + 2) + j, where ny is the number of bins along the y axis.
+ */
+std::vector<double> GetBinContents2D(TH2 const &hist);
+
+
+/**
+ * \brief Reads sums stored in a one-dimensional profile, scaling them with the given weight
+ * 
+ * The error option of the profile is remembered. Options "" (uncertainty of the mean) and "s"
+ * (spread) are supported. The under- and overflow bins are included.
+ */
+ProfileSums ReadProfileSums(TProfile const &profile, double weight = 1.);
+
+
+/**
+ * \brief Reads sums stored in a two-dimensional profile, scaling them with the given weight
+ * 
+ * Bins are ordered as in GetBinContents2D.
+ */
+ProfileSums ReadProfileSums(TProfile2D const &profile, double weight = 1.);
+
+
+/**
+ * \brief Sets contents of all bins of a one-dimensional histogram
+ * 
+ * The given vector must include the under- and overflow bins, as returned by GetBinContents.
+ * Errors of the bins are not set, so that ROOT treats the contents as counts of events.
+ */
+void SetBinContents(TH1 &hist, std::vector<double> const &contents);
+
+
+/**
+ * \brief Sets contents of all bins of a two-dimensional histogram
+ * 
+ * The given vector must be ordered as in GetBinContents2D. Errors are not set.
+ */
+void SetBinContents2D(TH2 &hist, std::vector<double> const &contents);
+
+
+/**
+ * \brief Stores the given sums in a one-dimensional profile
+ * 
+ * This is the inverse of ReadProfileSums. The profile must have the same number of bins as the
+ * sums, and its previous content is overwritten. The error option is set according to the sums.
+ */
+void SetProfileSums(TProfile &profile, ProfileSums const &sums);
+
+
+/**
+ * \brief Stores the given sums in a two-dimensional profile
+ * 
+ * Bins are ordered as in GetBinContents2D.
+ */
+void SetProfileSums(TProfile2D &profile, ProfileSums const &sums);
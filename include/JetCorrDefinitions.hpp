@@ -30,6 +30,13 @@ public:
     JetCorrStableLogLin(double ptMin = 15.);
     
 public:
+    /**
+     * \brief Creates a copy of this object
+     * 
+     * Implemented from JetCorrBase.
+     */
+    virtual std::unique_ptr<JetCorrBase> Clone() const override;
+    
     /**
      * \brief Computes correction for a jet with given pt
      * 
@@ -69,6 +76,13 @@ public:
     JetCorrStd2P();
     
 public:
+    /**
+     * \brief Creates a copy of this object
+     * 
+     * Implemented from JetCorrBase.
+     */
+    virtual std::unique_ptr<JetCorrBase> Clone() const override;
+    
     /**
      * \brief Computes correction for a jet with given pt
      * 
@@ -124,6 +138,13 @@ public:
     JetCorrStd3P();
     
 public:
+    /**
+     * \brief Creates a copy of this object
+     * 
+     * Reimplemented from JetCorrStd2P.
+     */
+    virtual std::unique_ptr<JetCorrBase> Clone() const override;
+    
     /**
      * \brief Computes correction for a jet with given pt
      * 
@@ -0,0 +1,78 @@
+/**
+ * Provides minimal tools for linear algebra with small dense matrices.
+ * 
+ * Matrices are stored in std::vector<double> in row-major order.
+ */
+
+#pragma once
+
+#include <vector>
+
+
+/**
+ * \brief Computes Cholesky decomposition of a symmetric positive-definite matrix
+ * 
+ * The decomposition A = L L^T is performed in place. On exit, the lower triangle of the given
+ * matrix contains L, while the strict upper triangle is set to zero. Only the lower triangle of
+ * the input matrix is used. Returns false if the matrix is not positive-definite, in which case
+ * its content is unspecified.
+ */
+bool CholeskyDecompose(std::vector<double> &matrix, unsigned n);
+
+
+/**
+ * \brief Solves system L L^T x = b given Cholesky decomposition computed with CholeskyDecompose
+ * 
+ * The right-hand side is overwritten with the solution.
+ */
+void CholeskySolve(std::vector<double> const &decomposition, unsigned n, double *b);
+
+
+/**
+ * \brief Inverts a symmetric positive-definite matrix
+ * 
+ * Throws an exception if the matrix is not positive-definite.
+ */
+std::vector<double> InvertSymmetric(std::vector<double> const &matrix, unsigned n);
+
+
+/**
+ * \brief Solves linear least squares problem
+ * 
+ * Finds coefficients c that minimize |A c - y|^2, where A is a design matrix with the given number
+ * of rows and columns. The problem is solved with normal equations. A small Tikhonov regularization
+ * proportional to the diagonal of A^T A is added to cope with nearly degenerate designs. Throws an
+ * exception if the problem is underdetermined.
+ */
+std::vector<double> SolveLeastSquares(std::vector<double> const &designMatrix,
+  std::vector<double> const &y, unsigned numCols);
+
+
+/**
+ * \brief Multiplies two matrices
+ * 
+ * Computes product of matrices A and B of sizes rows x inner and inner x cols respectively.
+ */
+std::vector<double> MultiplyMatrices(std::vector<double> const &a, std::vector<double> const &b,
+  unsigned rows, unsigned inner, unsigned cols);
+
+
+/**
+ * \brief Solves a linear system with a symmetric block-tridiagonal matrix
+ * 
+ * The matrix is given by the sizes of its diagonal blocks, the diagonal blocks themselves, the
+ * upper off-diagonal blocks, and a damping parameter lambda, which scales the diagonal as
+ * (1 + lambda). Off-diagonal block k couples blocks k and k + 1 and has the dimensions
+ * blockSizes[k] x blockSizes[k + 1]. The system is solved with a block version of the Thomas
+ * algorithm. On success, the right-hand side is overwritten with the solution. If requested, the
+ * diagonal blocks of the inverse of the matrix are also computed. Returns false if the matrix is
+ * not positive-definite.
+ */
+bool SolveBlockTridiagonal(std::vector<unsigned> const &blockSizes,
+  std::vector<std::vector<double>> const &diagBlocks,
+  std::vector<std::vector<double>> const &offDiagBlocks, double lambda, std::vector<double> &rhs,
+  std::vector<std::vector<double>> *inverseBlocks = nullptr);
+
+
+/// Transposes a matrix with the given numbers of rows and columns
+std::vector<double> Transpose(std::vector<double> const &matrix, unsigned rows, unsigned cols);
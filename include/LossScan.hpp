@@ -0,0 +1,183 @@
+#pragma once
+
+#include <FitBase.hpp>
+#include <Fitter.hpp>
+
+#include <string>
+#include <vector>
+
+
+/**
+ * \struct ScanAxis
+ * \brief Axis of a grid in a scan of the loss function
+ * 
+ * Points are equidistant and include both end points of the range.
+ */
+struct ScanAxis
+{
+    /// Returns the value at the point with the given index
+    double GetPoint(unsigned index) const;
+    
+    /// Name of the scanned parameter
+    std::string name;
+    
+    /// Range of the scan
+    double min, max;
+    
+    /// Number of points
+    unsigned numPoints;
+};
+
+
+/**
+ * \struct ScanResult
+ * \brief Values of the loss function on a grid
+ * 
+ * Points of the grid are stored in row-major order, i.e. the index along the last axis changes
+ * the fastest.
+ */
+struct ScanResult
+{
+    /// Returns the total number of points in the grid
+    unsigned GetNumPoints() const;
+    
+    /// Axes of the grid
+    std::vector<ScanAxis> axes;
+    
+    /// Names of parameters that have been profiled
+    std::vector<std::string> profiledNames;
+    
+    /// Values of the loss function at all points
+    std::vector<double> losses;
+    
+    /**
+     * \brief Values of profiled parameters that minimize the loss function
+     * 
+     * Contains profiledNames.size() values for each point.
+     */
+    std::vector<double> profiledValues;
+    
+    /**
+     * \brief Status of the minimization for each point
+     * 
+     * Empty if no parameters have been profiled.
+     */
+    std::vector<int> statuses;
+    
+    /**
+     * \brief Number of points whose losses have been computed with the surrogate
+     * 
+     * Not saved in files.
+     */
+    unsigned numSurrogatePoints = 0;
+};
+
+
+/**
+ * \brief Saves results of a scan to a binary file
+ * 
+ * The file starts with the 8-byte signature "JECSCAN1". It is followed by the number of axes and,
+ * for each of them, the length of the name, the name, the range, and the number of points. Then
+ * the number of profiled parameters and their names are written in the same manner. The header is
+ * followed by the array of values of the loss function, the array of values of profiled
+ * parameters, and the array of statuses of the minimization. Integers are stored as 32-bit
+ * unsigned numbers (signed for statuses) and real numbers in double precision, all with the
+ * native byte order.
+ */
+void SaveScanResult(ScanResult const &result, std::string const &fileName);
+
+
+/**
+ * \brief Reads results of a scan from a binary file written with SaveScanResult
+ * 
+ * Throws an exception if the file cannot be read or its format is not recognized.
+ */
+ScanResult LoadScanResult(std::string const &fileName);
+
+
+/**
+ * \class LossScan
+ * \brief Evaluates a loss function on a multidimensional grid
+ * 
+ * Scanned parameters can be parameters of the jet correction, referred to as "p0", "p1", etc.,
+ * and external nuisances, referred to by their names (e.g. "photonScale" or "MJB_JEC"). Parameters
+ * of the jet correction that are not scanned either are fixed to their central values or, if
+ * profiling is requested, are minimized at each point of the grid with Fitter. Nuisances that are
+ * not scanned keep the values set in the loss function.
+ * 
+ * Optionally, losses within the trust region of a LossSurrogate built around the central values
+ * are computed from the polynomial instead of the exact loss function. The surrogate is only
+ * refined while it is built, so that each point is still computed independently.
+ * 
+ * Points of the grid are distributed dynamically among threads in small chunks. Each thread
+ * evaluates its own copy of the loss function created with CombLossFunction::Clone, which shares
+ * the inputs with the original one. Every point is computed independently of the others, so the
+ * result does not depend on the number of threads.
+ */
+class LossScan
+{
+public:
+    /**
+     * \brief Constructor
+     * 
+     * The loss function is not owned by this and must outlive the object.
+     */
+    LossScan(CombLossFunction const &lossFunc);
+    
+public:
+    /**
+     * \brief Adds a new axis to the grid
+     * 
+     * Throws an exception if the name does not refer to a parameter of the jet correction or a
+     * nuisance, or if the parameter is already scanned.
+     */
+    void AddAxis(std::string const &name, double min, double max, unsigned numPoints);
+    
+    /// Performs the scan
+    ScanResult Run() const;
+    
+    /**
+     * \brief Sets central values of parameters of the jet correction
+     * 
+     * They are used for parameters that are not scanned, and they also serve as the starting point
+     * for profiling. Typically this is the result of a fit. By default all parameters are zero.
+     * Throws an exception if the number of parameters does not match the loss function.
+     */
+    void SetCentralValues(FitResult const &central);
+    
+    /// Sets the number of threads
+    void SetNumThreads(unsigned numThreads);
+    
+    /// Requests that parameters of the jet correction that are not scanned are profiled
+    void SetProfiling(bool enable);
+    
+    /**
+     * \brief Requests that the surrogate of the loss function is used
+     * 
+     * The surrogate is built in Run around the central values with the given tolerance (see
+     * LossSurrogate::SetTolerance). This requires that the central values include the covariance
+     * matrix, only parameters of the jet correction are scanned, and no profiling is requested;
+     * otherwise Run throws an exception. A non-positive tolerance disables the surrogate, which is
+     * the default.
+     */
+    void SetSurrogate(double tolerance);
+    
+private:
+    /// Loss function to be scanned
+    CombLossFunction const &lossFunc;
+    
+    /// Axes of the grid
+    std::vector<ScanAxis> axes;
+    
+    /// Central values of parameters of the jet correction
+    FitResult central;
+    
+    /// Number of threads
+    unsigned numThreads;
+    
+    /// Indicates whether remaining parameters of the jet correction should be profiled
+    bool profile;
+    
+    /// Tolerance of the surrogate, or a non-positive value if the surrogate is not used
+    double surrogateTolerance;
+};
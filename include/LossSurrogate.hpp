@@ -0,0 +1,217 @@
+#pragma once
+
+#include <FitBase.hpp>
+
+#include <vector>
+
+
+/**
+ * \class LossSurrogate
+ * \brief Local polynomial approximation of a loss function around its minimum
+ * 
+ * Intended to speed up tasks that evaluate the loss function many times close to the minimum,
+ * such as likelihood scans or studies of impacts of nuisances. The surrogate is built in the
+ * coordinates
+ *   u = L^{-1} (x - x0),
+ * where x0 is the minimum and L is the Cholesky factor of the covariance matrix C = L L^T. For a
+ * chi^2 loss function the difference from the minimum is then approximately |u|^2. The loss
+ * function is approximated with a polynomial that includes all terms up to the second order and,
+ * in addition, pure cubic terms u_i^3, which capture the leading asymmetry along each direction.
+ * 
+ * The coefficients of the polynomial are fitted to exact evaluations of the loss function. They
+ * are sampled adaptively: starting from an initial design, the polynomial is validated on
+ * quasi-random points, and the trust region (a ball in coordinates u) is shrunk until the largest
+ * deviation on validation points falls within the tolerance. Inside the trust region the loss is
+ * computed from the polynomial. Outside of it the exact loss function is evaluated. If such a point
+ * lies close to the trust region, it is added to the sample. If the polynomial describes it well
+ * enough, the polynomial is also checked on points spread over the sphere through it, and the
+ * trust region is extended to this sphere only if all of them agree within the tolerance.
+ * 
+ * Because of the refinement, methods Eval and EvalRawInput are not const, and an object must not
+ * be used from multiple threads concurrently.
+ */
+class LossSurrogate
+{
+public:
+    /**
+     * \brief Constructor
+     * 
+     * The loss function is not owned by this and must outlive the object.
+     */
+    LossSurrogate(CombLossFunction const &lossFunc);
+    
+public:
+    /**
+     * \brief Builds the surrogate around the given point
+     * 
+     * The point should be a (local) minimum of the loss function. The covariance matrix, which is
+     * stored in row-major order, defines the scale in each direction. Throws an exception if the
+     * covariance matrix is not positive-definite or a surrogate with the requested tolerance
+     * cannot be built even in a very small trust region.
+     */
+    void Build(std::vector<double> const &center, std::vector<double> const &covariance);
+    
+    /// Wrapper for EvalRawInput that checks the size of the given vector
+    double Eval(std::vector<double> const &x);
+    
+    /**
+     * \brief Evaluates the polynomial at the given point without refining the surrogate
+     * 
+     * The point is given in the same format as for CombLossFunction::EvalRawInput. The result is
+     * only reliable within the trust region (see IsInTrustRegion). Unlike EvalRawInput, this
+     * method does not modify the object and can be called from multiple threads concurrently.
+     */
+    double EvalPolynomialRawInput(double const *x) const;
+    
+    /**
+     * \brief Evaluates the (approximated) loss function for the given point
+     * 
+     * The point is given in the same format as for CombLossFunction::EvalRawInput. Must be called
+     * after the surrogate has been built.
+     */
+    double EvalRawInput(double const *x);
+    
+    /**
+     * \brief Returns estimated uncertainty of the surrogate within the trust region
+     * 
+     * Computed as the root-mean-square deviation from the exact loss function on points that were
+     * not used in the fit of the polynomial compared to them. These are the validation points for
+     * the final trust radius found in Build, each compared to the polynomial refitted without it,
+     * and points evaluated later close to the trust region.
+     */
+    double GetErrorEstimate() const;
+    
+    /// Returns the number of evaluations of the exact loss function, including the sampling
+    unsigned GetNumExactEvals() const;
+    
+    /// Returns the number of evaluations answered with the polynomial
+    unsigned GetNumSurrogateEvals() const;
+    
+    /**
+     * \brief Returns radius of the trust region
+     * 
+     * The radius is given in scaled coordinates u. For a chi^2 loss function it roughly
+     * corresponds to the square root of the difference from the minimum.
+     */
+    double GetTrustRadius() const;
+    
+    /// Checks if the given point is within the trust region
+    bool IsInTrustRegion(double const *x) const;
+    
+    /**
+     * \brief Sets the initial radius of the trust region
+     * 
+     * Must be called before the surrogate is built. The default value is 3.
+     */
+    void SetInitialRadius(double radius);
+    
+    /**
+     * \brief Sets tolerance on absolute deviation of the polynomial from the exact loss function
+     * 
+     * Must be called before the surrogate is built. The default value is 0.05.
+     */
+    void SetTolerance(double tolerance);
+    
+private:
+    /// An exact evaluation of the loss function
+    struct Sample
+    {
+        /// Point in scaled coordinates u
+        std::vector<double> u;
+        
+        /// Norm of u
+        double radius;
+        
+        /// Value of the loss function
+        double loss;
+    };
+    
+private:
+    /**
+     * \brief Evaluates the exact loss function at the given point in scaled coordinates
+     * 
+     * The result is added to the sample if requested.
+     */
+    Sample EvalExact(std::vector<double> const &u, bool store = true);
+    
+    /// Evaluates the polynomial at the given point in scaled coordinates
+    double EvalPolynomial(double const *u) const;
+    
+    /// Evaluates the polynomial with the given coefficients
+    double EvalPolynomial(double const *u, std::vector<double> const &coefficients) const;
+    
+    /**
+     * \brief Fits coefficients of the polynomial and returns them
+     * 
+     * Only samples with radius not exceeding the given one are used. The sample with the given
+     * index is excluded.
+     */
+    std::vector<double> FitCoefficients(double maxRadius, unsigned excluded = -1) const;
+    
+    /// Fits coefficients of the polynomial with FitCoefficients and stores them
+    void FitPolynomial(double maxRadius);
+    
+    /// Computes basis functions of the polynomial at the given point
+    void FillBasis(double const *u, double *basis) const;
+    
+    /// Translates a point into scaled coordinates
+    std::vector<double> ToScaled(double const *x) const;
+    
+    /// Updates the error estimate with a new deviation observed on an independent point
+    void UpdateErrorEstimate(double deviation);
+    
+    /**
+     * \brief Checks the polynomial on points spread over the sphere with the given radius
+     * 
+     * The points are placed along both directions of each axis and of the diagonals in each pair
+     * of axes in scaled coordinates. They are evaluated exactly and added to the sample. Returns
+     * true if the polynomial describes all of them within the tolerance.
+     */
+    bool ValidateShell(double radius);
+    
+private:
+    /// Loss function to be approximated
+    CombLossFunction const &lossFunc;
+    
+    /// Number of parameters
+    unsigned dim;
+    
+    /// Number of basis functions in the polynomial
+    unsigned numBasis;
+    
+    /// Centre of the surrogate in the original coordinates
+    std::vector<double> center;
+    
+    /// Cholesky factor of the covariance matrix, lower-triangular
+    std::vector<double> cholesky;
+    
+    /// Fitted coefficients of the polynomial
+    std::vector<double> coeffs;
+    
+    /// All exact evaluations of the loss function
+    std::vector<Sample> samples;
+    
+    /// Radius of the trust region in scaled coordinates
+    double trustRadius;
+    
+    /// Initial radius of the trust region
+    double initialRadius;
+    
+    /**
+     * \brief Smallest radius for which the validation of a shell has failed
+     * 
+     * The trust region is not extended to this radius or beyond, which avoids repeating costly
+     * validations that are expected to fail.
+     */
+    double failedShellRadius;
+    
+    /// Allowed absolute deviation from the exact loss function
+    double tolerance;
+    
+    /// Sum of squared deviations observed on independent points and the number of such points
+    double sumDev2;
+    unsigned numDev;
+    
+    /// Counters of evaluations
+    unsigned numExactEvals, numSurrogateEvals;
+};
@@ -0,0 +1,67 @@
+/**
+ * Provides tools to construct measurements and jet corrections from their names.
+ */
+
+#pragma once
+
+#include <FitBase.hpp>
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+/**
+ * \brief Returns names and descriptions of supported types of measurements
+ * 
+ * The names are used as keys in configuration files and as names of command line options.
+ */
+std::vector<std::pair<std::string, std::string>> const &GetMeasurementTypes();
+
+
+/**
+ * \brief Constructs a measurement of the given type from the given input file
+ * 
+ * For binned-sum measurements, the file name can be a comma-separated list of files with optional
+ * weights, as understood by ParseFileList; histograms from all files are then combined. The given
+ * number of threads is used to read the input files if the measurement supports it. If a single
+ * file without a weight is given and it is a snapshot, it is loaded with LoadMeasurementSnapshot
+ * instead. Throws an exception if the type is not supported.
+ */
+std::unique_ptr<MeasurementBase> CreateMeasurement(std::string const &type,
+  std::string const &fileName, bool useMPF, unsigned numThreads = 1);
+
+
+/**
+ * \brief Constructs several measurements concurrently
+ * 
+ * Each measurement is described by a pair of its type and the name of the input file. The
+ * measurements are returned in the same order. Up to the given number of threads are used, and
+ * ROOT::EnableThreadSafety must have been called if it exceeds one.
+ */
+std::vector<std::unique_ptr<MeasurementBase>> CreateMeasurements(
+  std::vector<std::pair<std::string, std::string>> const &descriptions, bool useMPF,
+  unsigned numThreads);
+
+
+/**
+ * \brief Constructs a measurement of the given type from a snapshot
+ * 
+ * Snapshots are supported for types "photonjet-binnedsum" and "multijet-binnedsum". The file is
+ * mapped into memory, and the measurement uses the mapped arrays directly. Throws an exception if
+ * the type is not supported, the snapshot is invalid or contains a different type of measurement,
+ * or the method of computation recorded in it does not match the requested one.
+ */
+std::unique_ptr<MeasurementBase> LoadMeasurementSnapshot(std::string const &type,
+  std::string const &fileName, bool useMPF);
+
+
+/**
+ * \brief Constructs a jet correction with the given name
+ * 
+ * Supported names are "Std2P", "Std3P", and "StableLogLin", which correspond to classes
+ * JetCorrStd2P, JetCorrStd3P, and JetCorrStableLogLin. Comparison is case-insensitive. Throws an
+ * exception if the name is not recognized.
+ */
+std::unique_ptr<JetCorrBase> CreateJetCorr(std::string const &name);
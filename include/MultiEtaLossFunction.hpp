@@ -0,0 +1,146 @@
+#pragma once
+
+#include <FitBase.hpp>
+#include <Parallel.hpp>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+
+/**
+ * \class MultiEtaLossFunction
+ * \brief Loss function for a simultaneous fit of jet corrections in multiple bins in eta
+ * 
+ * Each bin in eta is described with an independent CombLossFunction, which includes its own jet
+ * correction and set of measurements. The full vector of parameters is a concatenation of the
+ * parameters of individual bins, in the order in which the bins have been added. The combined
+ * loss function is the sum of loss functions for all bins, plus optional constraints that couple
+ * adjacent bins in eta. A smoothness constraint for a given parameter of the correction adds a
+ * penalty
+ *   sum_k (p_{k+1} - p_k)^2 / sigma^2,
+ * where p_k is the value of the parameter in bin k.
+ * 
+ * Since every bin depends only on its own parameters and the constraints only couple neighbouring
+ * bins, the gradient is block-sparse and the Hessian is block-tridiagonal. This structure is
+ * exploited by BlockSparseMinimizer. Loss functions for different bins are evaluated in parallel.
+ */
+class MultiEtaLossFunction
+{
+public:
+    /// Parameters of a smoothness constraint
+    struct Constraint
+    {
+        /// Index of the constrained parameter of the jet correction
+        unsigned paramIndex;
+        
+        /// Allowed scale of the difference between adjacent bins
+        double sigma;
+    };
+    
+public:
+    /// Constructor
+    MultiEtaLossFunction();
+    
+public:
+    /**
+     * \brief Adds a new bin in eta
+     * 
+     * The bins must be added in the order in eta. The given loss function is owned by this.
+     */
+    void AddEtaBin(std::string const &label, std::unique_ptr<CombLossFunction> &&lossFunc);
+    
+    /**
+     * \brief Adds a smoothness constraint for the parameter with the given index
+     * 
+     * The constraint couples every pair of adjacent bins in eta. Throws an exception if some of the
+     * bins has too few parameters or the given scale is not positive.
+     */
+    void AddSmoothnessConstraint(unsigned paramIndex, double sigma);
+    
+    /**
+     * \brief Adds the gradient and the Hessian of the constraints at the given point
+     * 
+     * The gradient has the size of the full vector of parameters. The Hessian is described by
+     * its diagonal blocks, one per bin in eta, and upper off-diagonal blocks, which couple bins k
+     * and k + 1. All blocks are stored in row-major order, and off-diagonal block k has the
+     * dimensions GetBlockSize(k) x GetBlockSize(k + 1).
+     */
+    void AddConstraintDerivatives(double const *x, std::vector<double> &gradient,
+      std::vector<std::vector<double>> &diagBlocks,
+      std::vector<std::vector<double>> &offDiagBlocks) const;
+    
+    /// Evaluates loss function for a single bin in eta given its parameters
+    double EvalBlock(unsigned etaBin, double const *blockParams) const;
+    
+    /// Evaluates the penalty from all constraints
+    double EvalConstraints(double const *x) const;
+    
+    /**
+     * \brief Evaluates the combined loss function for the given full vector of parameters
+     * 
+     * Bins in eta are evaluated in parallel, and their contributions are summed in a fixed order.
+     * Has the same interface as CombLossFunction::EvalRawInput and can be used with Minuit2.
+     */
+    double EvalRawInput(double const *x) const;
+    
+    /// Returns position of parameters of the given bin in the full vector of parameters
+    unsigned GetBlockOffset(unsigned etaBin) const;
+    
+    /// Returns the number of parameters in the given bin
+    unsigned GetBlockSize(unsigned etaBin) const;
+    
+    /// Returns loss function for the given bin in eta
+    CombLossFunction const &GetEtaBin(unsigned etaBin) const;
+    
+    /// Returns label of the given bin in eta
+    std::string const &GetLabel(unsigned etaBin) const;
+    
+    /**
+     * \brief Returns the number of degrees of freedom
+     * 
+     * Each constraint on a pair of adjacent bins is counted as an additional measurement.
+     */
+    unsigned GetNDF() const;
+    
+    /// Returns the number of bins in eta
+    unsigned GetNumEtaBins() const;
+    
+    /// Returns the total number of parameters
+    unsigned GetNumParams() const;
+    
+    /// Returns the number of threads used to evaluate bins in eta
+    unsigned GetNumThreads() const;
+    
+    /**
+     * \brief Returns the pool of threads used to evaluate bins in eta
+     * 
+     * Null if bins are evaluated serially. The pool is also used by BlockSparseMinimizer to compute
+     * derivatives in different bins in parallel.
+     */
+    std::shared_ptr<ThreadPool> GetThreadPool() const;
+    
+    /**
+     * \brief Sets the number of threads used to evaluate bins in eta
+     * 
+     * The threads are started once here and reused in all subsequent evaluations. With a single
+     * thread, bins are evaluated serially in the calling thread.
+     */
+    void SetNumThreads(unsigned numThreads);
+    
+private:
+    /// Labels of bins in eta
+    std::vector<std::string> labels;
+    
+    /// Loss functions for individual bins in eta
+    std::vector<std::unique_ptr<CombLossFunction>> etaBins;
+    
+    /// Offsets of parameters of individual bins in the full vector of parameters
+    std::vector<unsigned> offsets;
+    
+    /// Smoothness constraints
+    std::vector<Constraint> constraints;
+    
+    /// Pool of threads to evaluate bins in eta, or null if they are evaluated serially
+    std::shared_ptr<ThreadPool> threadPool;
+};
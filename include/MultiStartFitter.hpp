@@ -0,0 +1,143 @@
+#pragma once
+
+#include <FitBase.hpp>
+#include <Fitter.hpp>
+
+#include <vector>
+
+
+/**
+ * \struct MultiStartResult
+ * \brief Outcome of a minimization from multiple starting points
+ */
+struct MultiStartResult
+{
+    /// Outcome of a single run of the minimizer
+    struct Run
+    {
+        /// Starting point
+        std::vector<double> start;
+        
+        /**
+         * \brief Result of the run
+         * 
+         * For a cancelled run this is the best point found before the cancellation, and the
+         * status is -1.
+         */
+        FitResult result;
+        
+        /// Indicates whether the run has been cancelled
+        bool cancelled;
+    };
+    
+    /// Returns result of the run that has reached the lowest minimum
+    FitResult const &GetBest() const;
+    
+    /**
+     * \brief Returns indices of runs that have found distinct local minima
+     * 
+     * Only runs that have not been cancelled are considered. Two minima are considered the same
+     * if values of the loss function in them differ by less than the given tolerance. For each
+     * distinct minimum the run with the lowest value is chosen, and the indices are ordered by
+     * the value of the loss function, starting from the global minimum.
+     */
+    std::vector<unsigned> GetDistinctMinima(double tolerance = 1e-3) const;
+    
+    /// Returns the number of cancelled runs
+    unsigned GetNumCancelled() const;
+    
+    /// Index of the run that has reached the lowest minimum
+    unsigned bestIndex;
+    
+    /// All runs, in the order of their starting points
+    std::vector<Run> runs;
+};
+
+
+/**
+ * \class MultiStartFitter
+ * \brief Minimizes a CombLossFunction starting from multiple points
+ * 
+ * A loss function with shallow valleys may have several local minima, and a single run of the
+ * minimizer can end up in a poor one. This class launches independent runs of Fitter from a
+ * number of starting points and reports the lowest minimum found. The first starting point is the
+ * centre of the search region, and the others are distributed in a box around it following a
+ * Halton sequence. Thus the set of starting points is deterministic and covers the box uniformly.
+ * 
+ * Runs are executed in parallel. Each of them uses its own copy of the loss function produced
+ * with CombLossFunction::Clone, so that all runs share the same inputs. To save time, a run
+ * is cancelled if, after a number of evaluations of the loss function that allows it to approach
+ * a minimum, the best value it has found exceeds the best value found by any run by more than a
+ * given margin. Which runs are cancelled depends on the relative timing of threads, but a run that
+ * reaches the global minimum is never cancelled after it has got there.
+ */
+class MultiStartFitter
+{
+public:
+    /**
+     * \brief Constructor
+     * 
+     * The loss function is not owned by this and must outlive the object.
+     */
+    MultiStartFitter(CombLossFunction const &lossFunc);
+    
+public:
+    /// Performs the minimization from all starting points
+    MultiStartResult Fit();
+    
+    /**
+     * \brief Sets margin in the value of the loss function used to cancel runs
+     * 
+     * The default value is 10. An infinite margin disables the cancellation.
+     */
+    void SetCancelMargin(double margin);
+    
+    /**
+     * \brief Sets the centre of the search region
+     * 
+     * Uncertainties of the parameters define the initial step sizes in all runs. By default the
+     * centre is at zero. Throws an exception if the number of parameters does not match the loss
+     * function.
+     */
+    void SetCenter(FitResult const &center);
+    
+    /// Sets the number of starting points
+    void SetNumStarts(unsigned numStarts);
+    
+    /// Sets the maximal number of threads used to run the minimizer
+    void SetNumThreads(unsigned numThreads);
+    
+    /// Sets verbosity level of Minuit2 in each run
+    void SetPrintLevel(int printLevel);
+    
+    /// Sets the strategy of Minuit2
+    void SetStrategy(unsigned strategy);
+    
+    /**
+     * \brief Sets half-width of the search region
+     * 
+     * Starting points are placed in a box with the given half-width along each parameter. The
+     * default value is 0.1.
+     */
+    void SetWidth(double width);
+    
+private:
+    /// Loss function to be minimized
+    CombLossFunction const &lossFunc;
+    
+    /// Centre of the search region
+    FitResult center;
+    
+    /// Half-width of the search region
+    double width;
+    
+    /// Margin in the value of the loss function used to cancel runs
+    double cancelMargin;
+    
+    /// Number of starting points and threads
+    unsigned numStarts, numThreads;
+    
+    /// Settings for Minuit2
+    unsigned strategy;
+    int printLevel;
+};
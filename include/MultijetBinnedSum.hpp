@@ -1,18 +1,23 @@
 #pragma once
 
 #include <FitBase.hpp>
+#include <FlatArray.hpp>
+#include <Parallel.hpp>
+#include <ProfileSums.hpp>
+#include <Snapshot.hpp>
+#include <WeightedFile.hpp>
 
-#include <TH1.h>
-#include <TH1D.h>
-#include <TH2.h>
-#include <TProfile.h>
-
+#include <atomic>
+#include <cstddef>
+#include <functional>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 
 
 struct FracBin;
+class TH1D;
 
 
 /**
@@ -26,6 +31,17 @@ struct FracBin;
  * correction following the method described in [1-2].
  * [1] https://indico.cern.ch/event/646599/#50-on-the-way-to-an-updated-mu
  * [2] https://indico.cern.ch/event/656050/#65-comparison-of-different-app
+ * 
+ * If a pool of threads is provided, different trigger bins, as well as chunks of bins within each
+ * trigger bin, are processed in parallel. The result is identical to the serial computation.
+ * 
+ * Inputs are kept in an immutable block shared among clones of the measurement, so that a clone
+ * only costs a few bytes of memory. They can be saved into a snapshot file and loaded back from it
+ * without any preprocessing.
+ * 
+ * The computation operates on plain arrays and does not depend on ROOT. Constructors from ROOT
+ * files, as well as GetRecompBalance, are implemented in a separate translation unit
+ * (MultijetBinnedSumIO.cpp), which is only built as a part of library jecfit.
  */
 class MultijetBinnedSum: public MeasurementBase
 {
@@ -36,7 +52,7 @@ public:
         PtBal,
         MPF
     };
-
+    
     /// Supported ReturnTypes for retrieving histograms over full range
     enum class HistReturnType
     {
@@ -44,9 +60,80 @@ public:
 	recompBal,
         simBal
     };
-  
+    
+    /**
+     * \brief Accumulated histograms for a single trigger bin
+     * 
+     * Unlike TriggerBin, it stores sums rather than means, which are additive. This allows to
+     * accumulate inputs from several sources, such as weighted files or chunks of events, before
+     * the measurement is constructed. Arrays are indexed in the same way as in TriggerBin.
+     */
+    struct TriggerBinSums
+    {
+        /// Binnings in pt of the leading jet in data, of other jets, and of the leading jet in sim
+        std::vector<double> binning, ptJetBinning, simBinning;
+        
+        /// Number of events in data, including the under- and overflow bins
+        std::vector<double> numEvents;
+        
+        /// Sum of projections of pt of jets, stored as TriggerBin::ptJetSumProj
+        std::vector<double> ptJetSumProj;
+        
+        /// Profiles of pt of the leading jet and balance observable in data
+        ProfileSums ptLead, bal;
+        
+        /// Profile of the balance observable in simulation
+        ProfileSums simBal;
+    };
+    
+    /**
+     * \brief Uncertainty band for the recomputed mean balance observable
+     * 
+     * Bins from all selected trigger bins are ordered by their lower edges, in the same way as in
+     * the histograms built with GetRecompBalance. Per-bin arrays are indexed with the position of
+     * the bin in this order.
+     */
+    struct BalanceBand
+    {
+        /// Lower edges of all bins followed by the largest upper edge
+        std::vector<double> edges;
+        
+        /// Mean balance observable in data rebinned to simBinning and its uncertainty
+        std::vector<double> data, dataUnc;
+        
+        /// Mean balance observable in simulation and its uncertainty
+        std::vector<double> sim, simUnc;
+        
+        /// Probabilities for which the quantiles have been computed
+        std::vector<double> probabilities;
+        
+        /**
+         * \brief Quantiles of the recomputed mean balance observable
+         * 
+         * Indexed with the probability and then with the bin. Values that are not defined for
+         * some of the samples are ignored. A quantile is NaN if no sample gives a defined value.
+         */
+        std::vector<std::vector<double>> quantiles;
+    };
+    
+    /// Accumulated inputs for all trigger bins
+    struct InputSums
+    {
+        /// Sums for individual trigger bins
+        std::vector<TriggerBinSums> triggerBins;
+        
+        /// Jet pt threshold
+        double minPt;
+    };
+    
 private:
-    /// Auxiliary structure to aggregate data related to a single trigger bin
+    /**
+     * \brief Auxiliary structure to aggregate data related to a single trigger bin
+     * 
+     * Histograms read from the input file are converted into flat arrays, which contain exactly
+     * the information needed to recompute the balance observable. The arrays may refer to a
+     * memory-mapped snapshot.
+     */
     struct TriggerBin
     {
         /**
@@ -54,56 +141,210 @@ private:
          * 
          * The same binning is used for all data histograms and profiles.
          */
-        std::vector<double> binning;
+        FlatArray binning;
         
         /**
-         * \brief Profiles of the balance observable in data and simulation
+         * \brief Number of events and mean pt of the leading jet in data
          * 
-         * Binning of the profile in simulation defines bins to compute chi^2.
+         * Indexed with bins of the data binning, including the under- and overflow bins.
          */
-        std::unique_ptr<TProfile> balProfile, simBalProfile;
+        FlatArray numEvents, meanPtLead;
+        
+        /// Mean balance observable in data and its uncertainty, indexed as numEvents
+        FlatArray meanBal, meanBalUnc;
         
-        /// Distribution of pt of the leading jet in data
-        std::unique_ptr<TH1> ptLead;
+        /// Binning in pt of other jets
+        FlatArray ptJetBinning;
         
         /**
-         * \brief Profile of pt of the leading jet in data
+         * \brief Sum of projections of pt of jets in bins of pt of the leading and other jets
          * 
-         * Used to obtain true mean pt in each bin.
+         * Stored in row-major order, with rows corresponding to bins in pt of the leading jet.
+         * Under- and overflow bins are included along both axes.
          */
-        std::unique_ptr<TProfile> ptLeadProfile;
+        FlatArray ptJetSumProj;
         
-        /// Sum of projections of pt of jets in bins of pt of the leading and other jets
-        std::unique_ptr<TH2> ptJetSumProj;
+        /// Binning in pt of the leading jet in simulation, which defines bins to compute chi^2
+        FlatArray simBinning;
+        
+        /**
+         * \brief Mean balance observable in simulation and its uncertainty
+         * 
+         * Indexed with bins of simBinning, starting from zero.
+         */
+        FlatArray simMeanBal, simMeanBalUnc;
+        
+        /**
+         * \brief Mean balance observable in data and its uncertainty rebinned to simBinning
+         * 
+         * Only used to build histograms with method GetRecompBalance. It is not updated when
+         * inputs are fluctuated.
+         */
+        FlatArray rebinnedMeanBal, rebinnedMeanBalUnc;
         
         /**
          * \brief Squared uncertainty on the difference between mean balance observables in data
          * and simulation
          * 
-         * Computed in the binning of simBalProfile.
+         * Indexed as simMeanBal.
+         */
+        FlatArray totalUnc2;
+    };
+    
+    /// Synchronization of lazy loading of a single trigger bin
+    struct LoadState
+    {
+        /// Ensures that the trigger bin is loaded exactly once
+        std::once_flag flag;
+        
+        /// Indicates that the trigger bin has been loaded
+        std::atomic<bool> loaded{false};
+    };
+    
+    /**
+     * \brief Inputs read from the file
+     * 
+     * They are shared among clones of a measurement. When constructed from ROOT files, trigger
+     * bins are only read when they are accessed for the first time, which is done in a
+     * thread-safe manner. Apart from this, the inputs are not modified after construction.
+     */
+    struct Inputs
+    {
+        /**
+         * \brief Data for different trigger bins
+         * 
+         * If the inputs are loaded lazily, an element is only valid after it has been loaded.
          */
-        std::vector<double> totalUnc2;
+        mutable std::vector<TriggerBin> triggerBins;
+        
+        /// States of lazy loading of trigger bins; empty if all bins have been loaded eagerly
+        mutable std::vector<LoadState> loadStates;
+        
+        /// Names of directories in the input files that correspond to trigger bins
+        std::vector<std::string> directoryNames;
         
         /**
-         * \brief Recomputed mean balance observable in data
+         * \brief Reads accumulated inputs for the trigger bin with the given index
          * 
-         * Computed in the binning of simBalProfile.
+         * Only set if the trigger bins are loaded lazily. It must be safe to call it from
+         * multiple threads concurrently.
          */
-        mutable std::vector<double> recompBal;
-    };
+        std::function<TriggerBinSums(unsigned)> loadTriggerBin;
+        
+        /// Maximal number of threads to read trigger bins
+        unsigned numThreads;
         
+        /// Jet pt threshold
+        double minPt;
+        
+        /// Mapped snapshot that stores the arrays, if they have been loaded from one
+        std::shared_ptr<SnapshotFile const> snapshot;
+    };
+    
 public:
-    /// Constructor
-    MultijetBinnedSum(std::string const &fileName, Method method);
+    /**
+     * \brief Constructor
+     * 
+     * Only the list of trigger bins and the jet pt threshold are read on construction. Each
+     * trigger bin is read when it is accessed for the first time, i.e. normally when it is
+     * selected with SetTriggerBinRange and the measurement is evaluated, and thus the file must
+     * remain available. Histograms are released as soon as they have been converted into flat
+     * arrays. Selected trigger bins are read using up to the given number of threads, each of
+     * which opens the file on its own. Reading with multiple threads, or from clones used in
+     * different threads, requires that thread safety has been enabled in ROOT with
+     * ROOT::EnableThreadSafety.
+     */
+    MultijetBinnedSum(std::string const &fileName, Method method, unsigned numThreads = 1);
+    
+    /**
+     * \brief Constructs the measurement from several weighted files
+     * 
+     * Histograms from all files are added with the given weights, e.g. to combine run periods
+     * with weights proportional to their integrated luminosities. Profiles are combined through
+     * their underlying sums, so that the resulting means and uncertainties are the same as if the
+     * profiles had been merged in ROOT. All files must contain the same trigger bins with the
+     * same binnings and the same jet pt threshold; otherwise an exception is thrown, possibly only
+     * when the offending trigger bin is read. Trigger bins are read lazily and in parallel as in
+     * the single-file version, and the result does not depend on the number of threads.
+     */
+    MultijetBinnedSum(std::vector<WeightedFile> const &files, Method method,
+      unsigned numThreads = 1);
+    
+    /**
+     * \brief Constructs the measurement from accumulated inputs
+     * 
+     * Means and uncertainties are computed from the given sums, which are consumed. This is used,
+     * in particular, to build the measurement directly from event-level inputs.
+     */
+    MultijetBinnedSum(InputSums &&sums, Method method);
+    
+    /**
+     * \brief Constructs the measurement with trigger bins provided on demand
+     * 
+     * The given function is called to produce sums for a trigger bin when the bin is accessed for
+     * the first time, in the same way as trigger bins are read lazily from ROOT files. It must be
+     * safe to call it from multiple threads concurrently. Bins are loaded using up to the given
+     * number of threads.
+     */
+    MultijetBinnedSum(unsigned numTriggerBins, double minPt,
+      std::function<TriggerBinSums(unsigned)> const &loadTriggerBin, Method method,
+      unsigned numThreads = 1);
+    
+    /**
+     * \brief Constructs the measurement from a snapshot
+     * 
+     * The arrays are not copied but refer to the mapped file directly. The method of computation
+     * is read from the snapshot.
+     */
+    MultijetBinnedSum(std::shared_ptr<SnapshotFile const> const &snapshot);
     
 public:
+    /**
+     * \brief Creates a copy of this measurement that shares its inputs
+     * 
+     * Implemented from MeasurementBase.
+     */
+    virtual std::unique_ptr<MeasurementBase> Clone() const override;
+    
+    /**
+     * \brief Creates a pseudo-experiment by fluctuating inputs in data
+     * 
+     * The number of events, the mean balance observable, and the sum of projections in data are
+     * fluctuated with function FluctuateBalanceInputs. Other inputs are copied.
+     * 
+     * Reimplemented from MeasurementBase.
+     */
+    virtual std::unique_ptr<MeasurementBase> CloneFluctuated(CounterRng &rng) const override;
+    
     /**
      * \brief Returns dimensionality of the deviation
      * 
+     * Selected trigger bins are loaded if needed.
+     * 
      * Implemented from MeasurementBase.
      */
     virtual unsigned GetDim() const override;
     
+    /**
+     * \brief Computes an uncertainty band for the recomputed mean balance observable
+     * 
+     * The mean balance observable is recomputed, including shifts from the nuisances, for each of
+     * the given vectors of parameters of the jet correction, which would normally be sampled from
+     * the covariance matrix of a fit (see SampleParameters). The given corrector is only used as a
+     * prototype and is not modified. The ordering of bins, inputs in data and simulation, and the
+     * shifts from nuisances are computed once, and the samples are processed in parallel with up
+     * to the given number of threads. If more than one thread is requested, each sample is
+     * evaluated serially; otherwise the pool set with SetThreadPool is used for each sample. Only
+     * selected trigger bins are included. The quantiles are computed with linear interpolation
+     * between order statistics. Throws an exception if a probability is outside of [0, 1].
+     */
+    BalanceBand ComputeBalanceBand(JetCorrBase const &corrector, Nuisances const &nuisances,
+      std::vector<std::vector<double>> const &paramSamples,
+      std::vector<double> const &probabilities, unsigned numThreads = 1) const;
+    
+    /// Returns the number of trigger bins available in the inputs
+    unsigned GetNumTriggerBins() const;
+    
     /**
      * \brief Builds a histogram of recomputed mean balance observable in data
      * 
@@ -118,6 +359,41 @@ public:
      */
     virtual double Eval(JetCorrBase const &corrector, Nuisances const &nuisances) const override;
     
+    /**
+     * \brief Evaluates the deviation with a breakdown into selected trigger bins
+     * 
+     * Groups are labelled with names of the directories in the input file or, if the inputs have
+     * not been read from ROOT files, with indices of the trigger bins. Bins follow simBinning.
+     * Data values are rebinned from the inputs and do not reflect fluctuations of inputs.
+     * 
+     * Reimplemented from MeasurementBase.
+     */
+    virtual std::vector<ResidualGroup> EvalResiduals(JetCorrBase const &corrector,
+      Nuisances const &nuisances) const override;
+    
+    /// Returns the method of computation
+    Method GetMethod() const;
+    
+    /**
+     * \brief Returns the amount of memory used by arrays of the given trigger bin, in bytes
+     * 
+     * Only arrays owned by the measurement are counted. Zero is returned for a bin that has not
+     * been loaded yet or whose arrays refer to a mapped snapshot.
+     */
+    std::size_t GetTriggerBinMemory(unsigned index) const;
+    
+    /// Checks if the given trigger bin has been loaded
+    bool IsTriggerBinLoaded(unsigned index) const;
+    
+    /**
+     * \brief Saves preprocessed inputs into a snapshot file
+     * 
+     * All trigger bins are loaded if needed.
+     * 
+     * Reimplemented from MeasurementBase.
+     */
+    virtual void SaveSnapshot(std::string const &fileName) const override;
+    
     /**
      * \brief Selects a subrange of trigger bins to use
      * 
@@ -130,24 +406,66 @@ public:
      */
     void SetTriggerBinRange(unsigned begin, unsigned end = -1);
     
+    /**
+     * \brief Sets a pool of threads to parallelize the evaluation
+     * 
+     * Reimplemented from MeasurementBase.
+     */
+    virtual void SetThreadPool(std::shared_ptr<ThreadPool> const &threadPool) override;
+    
 private:
     /// Recomputes MPF in data for given trigger bin, 2D pt window, and jet correction
     static double ComputeMPF(TriggerBin const &triggerBin, FracBin const &ptLeadStart,
       FracBin const &ptLeadEnd, FracBin const &ptJetStart, JetCorrBase const &corrector);
     
+    /**
+     * \brief Computes the total shift of the balance observable due to nuisances
+     * 
+     * Only nuisances that correspond to the method of computation are included.
+     */
+    double ComputeNuisanceShift(double ptLead, Nuisances const &nuisances) const;
+    
     /// Recomputes pt balance in data for given trigger bin, 2D pt window, and jet correction
     static double ComputePtBal(TriggerBin const &triggerBin, FracBin const &ptLeadStart,
       FracBin const &ptLeadEnd, FracBin const &ptJetStart, JetCorrBase const &corrector);
     
-    /// Recomputes mean balance observable in all trigger bins for the given jet correction
-    void UpdateBalance(JetCorrBase const &corrector, Nuisances const &) const;
+    /// Computes means and uncertainties from accumulated sums for a single trigger bin
+    static TriggerBin FinalizeTriggerBin(TriggerBinSums &&sums);
+    
+    /**
+     * \brief Ensures that trigger bins in the range [begin, end) are loaded
+     * 
+     * Bins that have not been loaded yet are read in parallel. Thread-safe.
+     */
+    void LoadTriggerBins(unsigned begin, unsigned end) const;
+    
+    /**
+     * \brief Reads and accumulates histograms for a single trigger bin from the given files
+     * 
+     * The files are opened on every call, which allows to call this method from multiple
+     * threads. Histograms from different files are added in the order of the files.
+     */
+    static TriggerBinSums ReadTriggerBin(std::vector<WeightedFile> const &files,
+      std::string const &directoryName, Method method);
+    
+    /**
+     * \brief Recomputes mean balance observable in all trigger bins for the given jet correction
+     * 
+     * Results are written into the provided buffer, which is indexed with the trigger bin and
+     * then the bin of simBinning (starting from zero). Only selected trigger bins are filled.
+     * Trigger bins and chunks of bins are processed in parallel with the given pool of threads;
+     * a null pointer requests serial evaluation. Since no internal state is modified, this method
+     * can be called from multiple threads concurrently.
+     */
+    void UpdateBalance(JetCorrBase const &corrector, Nuisances const &,
+      std::vector<std::vector<double>> &recompBal, ThreadPool *pool) const;
     
 private:
     /// Method of computation
     Method method;
     
-    /// Inputs for different trigger bins
-    std::vector<TriggerBin> triggerBins;
+    /// Inputs shared among clones
+    std::shared_ptr<Inputs const> inputs;
     
     /**
      * \brief Selected subrange of trigger bins
@@ -156,9 +474,6 @@ private:
      */
     unsigned selectedTriggerBinsBegin, selectedTriggerBinsEnd;
     
-    /// Jet pt threshold
-    double minPt;
-    
-    /// Dimensionality of the deviation
-    unsigned dimensionality;
+    /// Optional pool of threads to parallelize the evaluation
+    std::shared_ptr<ThreadPool> threadPool;
 };
@@ -1,8 +1,60 @@
 #pragma once
 
-#include <TF1.h>
+#include <cmath>
 #include <iostream>
 #include <sstream>
+#include <string>
+#include <tuple>
+#include <vector>
+
+
+/**
+ * \class NuisanceShape
+ * \brief Dependence of a shift in the balance observable on pt
+ * 
+ * Two analytic forms are supported, both expressed in terms of x = pt / (200 GeV) and given in
+ * per cent:
+ *   LogQuadratic: 0.01 * (p0 + p1 * log(x) + p2 * log(x)^2),
+ *   Power: 0.01 * (p0 + p1 * x^p2).
+ * The shape is evaluated in the innermost loops of the fit, so method Eval is defined in the
+ * header to allow inlining.
+ */
+class NuisanceShape
+{
+public:
+    /// Supported analytic forms
+    enum class Form
+    {
+        LogQuadratic,
+        Power
+    };
+    
+public:
+    /// Constructor from the form and its three parameters
+    NuisanceShape(Form form, double p0, double p1, double p2);
+    
+public:
+    /// Evaluates the shape for the given pt
+    double Eval(double pt) const
+    {
+        double const x = pt / 200.;
+        
+        if (form == Form::LogQuadratic)
+        {
+            double const l = std::log(x);
+            return 0.01 * (p0 + p1 * l + p2 * l * l);
+        }
+        else
+            return 0.01 * (p0 + p1 * std::pow(x, p2));
+    }
+    
+private:
+    /// Analytic form
+    Form form;
+    
+    /// Parameters of the form
+    double p0, p1, p2;
+};
 
 /**
  * \struct Nuisances
@@ -21,17 +73,32 @@ struct Nuisances
      */
     Nuisances();
     
+    /**
+     * \brief Copy constructor
+     * 
+     * Collections of nuisances in the new object refer to its own data members.
+     */
+    Nuisances(Nuisances const &src);
+    
+    /**
+     * \brief Assignment operator
+     * 
+     * Copies values of nuisance parameters and their functions. Collections of nuisances are not
+     * modified as they refer to data members of this object.
+     */
+    Nuisances &operator=(Nuisances const &src);
+    
     /**
      * \brief Relative difference between photon pt scale in data and simulation
      * 
      * Defined such that ptData = (1 + photonScale) * ptSim.
      */
     double photonScale;
-
-
+    
+    
     /**
-     *
-     *
+     * 
+     * 
      */
   double MPF_JEC;
   double MJB_JEC;
@@ -39,23 +106,26 @@ struct Nuisances
   double MJB_JER;
   double MPF_PU;
   double MJB_PU;
-
+  
   double MPF_FSR;
   double MJB_FSR;
-
-  TF1 MPF_JECFunc;
-  TF1 MJB_JECFunc;
-  TF1 MPF_JERFunc;
-  TF1 MJB_JERFunc;
-  TF1 MPF_PUFunc;
-  TF1 MJB_PUFunc;
-
-  TF1 MPF_FSRFunc;
-  TF1 MJB_FSRFunc;
-  std::vector<std::tuple<std::string, double*, TF1*> > MJB_NuisanceCollection;
-
-  std::vector<std::tuple<std::string, double*, TF1*> > MPF_NuisanceCollection;
-
-  std::vector<std::tuple<std::string, double*, TF1*> > Multijet_NuisanceCollection;
   
+  NuisanceShape MPF_JECFunc;
+  NuisanceShape MJB_JECFunc;
+  NuisanceShape MPF_JERFunc;
+  NuisanceShape MJB_JERFunc;
+  NuisanceShape MPF_PUFunc;
+  NuisanceShape MJB_PUFunc;
+  
+  NuisanceShape MPF_FSRFunc;
+  NuisanceShape MJB_FSRFunc;
+  std::vector<std::tuple<std::string, double*, NuisanceShape*> > MJB_NuisanceCollection;
+  
+  std::vector<std::tuple<std::string, double*, NuisanceShape*> > MPF_NuisanceCollection;
+  
+  std::vector<std::tuple<std::string, double*, NuisanceShape*> > Multijet_NuisanceCollection;
+  
+private:
+    /// Fills collections of nuisances with pointers to data members of this object
+    void BuildCollections();
 };
@@ -0,0 +1,188 @@
+/**
+ * Provides simple tools for parallel execution of independent tasks.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+/**
+ * \brief Executes a task for each index from the range [0, numTasks)
+ * 
+ * Up to the given number of threads are used, including the calling one. Indices are distributed
+ * dynamically, so tasks of different durations are balanced. The function returns when all tasks
+ * have finished. If some tasks throw exceptions, the remaining tasks that have not started yet are
+ * skipped and the first exception is rethrown in the calling thread.
+ * 
+ * This function starts new threads on each call and is intended for coarse-grained tasks.
+ */
+void ParallelFor(unsigned numTasks, unsigned numThreads,
+  std::function<void(unsigned)> const &task);
+
+
+class ThreadPool;
+
+
+/**
+ * \brief Executes a task for each index from the range [0, numTasks) with the given pool
+ * 
+ * If the pool is null, the tasks are executed serially in the calling thread.
+ */
+void RunTasks(ThreadPool *threadPool, unsigned numTasks,
+  std::function<void(unsigned)> const &task);
+
+
+/**
+ * \class ThreadPool
+ * \brief A persistent pool of worker threads to execute fine-grained parallel loops
+ * 
+ * Unlike ParallelFor, threads are started once, in the constructor, and then wait for new tasks.
+ * Idle workers spin for a short time before going to sleep, which keeps the latency low when
+ * parallel loops are executed in rapid succession, as is the case in repeated evaluations of a
+ * loss function.
+ * 
+ * Tasks are distributed with work stealing. Each thread that takes part in a loop owns a
+ * contiguous range of indices and executes them in order. Initially the whole range belongs to
+ * the calling thread. A thread that has run out of work steals the upper half of the largest
+ * remaining range of another thread. This balances tasks of very different durations while
+ * keeping the overhead per task low, and neighbouring tasks tend to be executed by the same
+ * thread.
+ * 
+ * Method Run can be called concurrently from multiple threads, including from within tasks that
+ * are being executed by the pool. The calling thread always takes part in the execution of its
+ * own loop, so nested loops cannot deadlock even if all workers are busy.
+ */
+class ThreadPool
+{
+public:
+    /**
+     * \brief Constructor
+     * 
+     * The given number of threads includes the thread that calls Run. Thus, numThreads - 1
+     * workers are started.
+     */
+    ThreadPool(unsigned numThreads);
+    
+    /// Stops and joins all workers
+    ~ThreadPool() noexcept;
+    
+public:
+    /// Returns the number of threads, including the calling one
+    unsigned GetNumThreads() const;
+    
+    /**
+     * \brief Executes a task for each index from the range [0, numTasks)
+     * 
+     * Has the same semantics as ParallelFor. Returns when all tasks have finished.
+     */
+    void Run(unsigned numTasks, std::function<void(unsigned)> const &task);
+    
+private:
+    /// Range of task indices owned by a thread taking part in a loop
+    struct Range
+    {
+        /// Protects the boundaries
+        std::mutex mutex;
+        
+        /// Boundaries of the range; the upper one is not included
+        unsigned begin, end;
+    };
+    
+    /// A parallel loop submitted to the pool
+    struct Job
+    {
+        /// Task to execute for each index
+        std::function<void(unsigned)> const *task;
+        
+        /// Total number of tasks
+        unsigned numTasks;
+        
+        /**
+         * \brief Ranges of indices owned by participating threads
+         * 
+         * The range with index 0 belongs to the thread that has submitted the job.
+         */
+        std::unique_ptr<Range[]> ranges;
+        
+        /// Number of ranges
+        unsigned numRanges;
+        
+        /// Number of ranges already assigned to participating threads
+        std::atomic<unsigned> numParticipants;
+        
+        /// Number of finished tasks
+        unsigned numFinished;
+        
+        /// Number of workers currently participating in the job
+        unsigned numHelpers;
+        
+        /// Indicates that some task has thrown an exception
+        std::atomic<bool> failed;
+        
+        /// The first exception thrown by a task
+        std::exception_ptr exception;
+        
+        /// Protects numFinished, numHelpers, and exception
+        std::mutex mutex;
+        
+        /**
+         * \brief Notifies the submitting thread about progress
+         * 
+         * The job is complete when all tasks have finished and no worker refers to it any more.
+         */
+        std::condition_variable finishedCondition;
+    };
+    
+private:
+    /// Executes a claimed task of the given job and updates the counter of finished tasks
+    static void Execute(Job &job, unsigned taskIndex);
+    
+    /**
+     * \brief Executes tasks from the given range of the job until no work can be found
+     * 
+     * When the range is exhausted, work is stolen from other ranges.
+     */
+    static void Participate(Job &job, unsigned rangeIndex);
+    
+    /**
+     * \brief Steals half of the largest range of other participants
+     * 
+     * The stolen indices are placed into the range with the given index. Returns false if all
+     * other ranges are empty.
+     */
+    static bool Steal(Job &job, unsigned rangeIndex);
+    
+    /// Removes the job from the queue if it is still there; the mutex must be locked
+    void Dequeue(Job *job);
+    
+    /// Main loop of a worker thread
+    void WorkerLoop();
+    
+private:
+    /// Worker threads
+    std::vector<std::thread> workers;
+    
+    /// Jobs that might still have tasks to share
+    std::deque<Job *> jobs;
+    
+    /// Number of jobs in the queue, for lock-free polling by idle workers
+    std::atomic<unsigned> numQueued;
+    
+    /// Protects the queue and the stop flag
+    std::mutex mutex;
+    
+    /// Wakes up sleeping workers
+    std::condition_variable wakeCondition;
+    
+    /// Indicates that the workers should exit
+    bool stop;
+};
@@ -1,12 +1,13 @@
 #pragma once
 
 #include <FitBase.hpp>
+#include <FlatArray.hpp>
+#include <ProfileSums.hpp>
+#include <Snapshot.hpp>
+#include <WeightedFile.hpp>
 
-#include <TH1.h>
-#include <TH2.h>
-#include <TProfile.h>
-#include <TProfile2D.h>
-
+#include <memory>
+#include <string>
 #include <vector>
 
 struct FracBin;
@@ -23,6 +24,9 @@ struct FracBin;
  * correction following an approach similar to the multijet analysis.
  * 
  * Changes of photon pt scale in data are propagated into the pt of the photon.
+ * 
+ * Reading of ROOT files is confined to PhotonJetBinnedSumIO.cpp, so that the rest of the class
+ * can be used without ROOT.
  */
 class PhotonJetBinnedSum: public MeasurementBase
 {
@@ -34,11 +38,148 @@ public:
         MPF
     };
     
+    /**
+     * \brief Accumulated content of input histograms
+     * 
+     * Contents of histograms are scaled with the weights of the files. Profiles are represented
+     * with their sums, which can be added across files.
+     */
+    struct InputSums
+    {
+        /// Binnings of data histograms, pt of other jets, and simulation
+        std::vector<double> binning, ptJetBinning, simBinning;
+        
+        /// Number of events in data, including the under- and overflow bins
+        std::vector<double> numEvents;
+        
+        /**
+         * \brief Sum of projections of pt of jets
+         * 
+         * Stored in row-major order, with rows corresponding to bins in pt of the photon. Under-
+         * and overflow bins are included along both axes.
+         */
+        std::vector<double> ptJetSumProj;
+        
+        /// Sums of profiles of pt of the photon, balance observable in data and simulation
+        ProfileSums ptPhoton, bal, simBal;
+        
+        /// Sums of two-dimensional profile of pt of jets
+        ProfileSums ptJet;
+        
+        /// Jet pt threshold
+        double jetPtMin;
+    };
+    
+private:
+    /**
+     * \brief Inputs read from the file
+     * 
+     * Histograms are converted into flat arrays, which may refer to a memory-mapped snapshot.
+     * The inputs are not modified after construction and are shared among clones of a
+     * measurement.
+     */
+    struct Inputs
+    {
+        /**
+         * \brief Binning in pt of the photon in data
+         * 
+         * The same binning is used for all data histograms and profiles.
+         */
+        FlatArray binning;
+        
+        /**
+         * \brief Number of events and mean pt of the photon in data
+         * 
+         * Indexed with bins of the data binning, including the under- and overflow bins.
+         */
+        FlatArray numEvents, meanPtPhoton;
+        
+        /// Mean balance observable in data and its uncertainty, indexed as numEvents
+        FlatArray meanBal, meanBalUnc;
+        
+        /// Binning in pt of jets
+        FlatArray ptJetBinning;
+        
+        /**
+         * \brief Sum of projections of pt of jets and mean pt of jets in bins of pt of the photon
+         * and jets
+         * 
+         * Stored in row-major order, with rows corresponding to bins in pt of the photon. Under-
+         * and overflow bins are included along both axes.
+         */
+        FlatArray ptJetSumProj, meanPtJet;
+        
+        /// Binning in pt of the photon in simulation, which defines bins to compute chi^2
+        FlatArray simBinning;
+        
+        /// Mean balance observable in simulation, indexed with bins of simBinning from zero
+        FlatArray simMeanBal;
+        
+        /**
+         * \brief Squared uncertainty on the difference between mean balance observables in data
+         * and simulation
+         * 
+         * Indexed as simMeanBal.
+         */
+        FlatArray totalUnc2;
+        
+        /// Jet pt threshold
+        double jetPtMin;
+        
+        /// Mapped snapshot that stores the arrays, if they have been loaded from one
+        std::shared_ptr<SnapshotFile const> snapshot;
+    };
+    
 public:
     /// Constructor
     PhotonJetBinnedSum(std::string const &fileName, Method method);
     
+    /**
+     * \brief Constructs the measurement from several weighted files
+     * 
+     * Histograms from all files are added with the given weights. Profiles are combined through
+     * their underlying sums, so that the resulting means and uncertainties are the same as if the
+     * profiles had been merged in ROOT. Files are read in parallel using up to the given number of
+     * threads, which requires that thread safety has been enabled in ROOT. All files must have the
+     * same binnings and jet pt threshold; otherwise an exception is thrown.
+     */
+    PhotonJetBinnedSum(std::vector<WeightedFile> const &files, Method method,
+      unsigned numThreads = 1);
+    
+    /**
+     * \brief Constructs the measurement from accumulated inputs
+     * 
+     * Means and uncertainties are computed from the given sums, which are consumed. This allows
+     * to build the measurement without reading ROOT files.
+     */
+    PhotonJetBinnedSum(InputSums &&sums, Method method);
+    
+    /**
+     * \brief Constructs the measurement from a snapshot
+     * 
+     * The arrays are not copied but refer to the mapped file directly. The method of computation
+     * is read from the snapshot.
+     */
+    PhotonJetBinnedSum(std::shared_ptr<SnapshotFile const> const &snapshot);
+    
 public:
+    /**
+     * \brief Creates a copy of this measurement that shares its inputs
+     * 
+     * Implemented from MeasurementBase.
+     */
+    virtual std::unique_ptr<MeasurementBase> Clone() const override;
+    
+    /**
+     * \brief Creates a pseudo-experiment by fluctuating inputs in data
+     * 
+     * The number of events, the mean balance observable, and the sum of projections in data are
+     * fluctuated with function FluctuateBalanceInputs. Other inputs are copied.
+     * 
+     * Reimplemented from MeasurementBase.
+     */
+    virtual std::unique_ptr<MeasurementBase> CloneFluctuated(CounterRng &rng) const override;
+    
     /**
      * \brief Returns dimensionality of the deviation
      * 
@@ -53,6 +194,16 @@ public:
      */
     virtual double Eval(JetCorrBase const &corrector, Nuisances const &nuisances) const override;
     
+    /// Returns the method of computation
+    Method GetMethod() const;
+    
+    /**
+     * \brief Saves preprocessed inputs into a snapshot file
+     * 
+     * Reimplemented from MeasurementBase.
+     */
+    virtual void SaveSnapshot(std::string const &fileName) const override;
+    
 private:
     /// Recomputes MPF in data for given photon pt bin, 2D pt window, and jet correction
     double ComputeMPF(FracBin const &ptPhotonStart, FracBin const &ptPhotonEnd,
@@ -62,40 +213,30 @@ private:
     double ComputePtBal(FracBin const &ptPhotonStart, FracBin const &ptPhotonEnd,
       JetCorrBase const &corrector, Nuisances const &nuisances) const;
     
-    /// Recomputes mean balance observable in all photon pt bins for the given jet correction
-    void UpdateBalance(JetCorrBase const &corrector, Nuisances const &nuisances) const;
-    
-private:
-    /// Profiles of the balance observable in data and simulation
-    std::unique_ptr<TProfile> balProfile, simBalProfile;
-    
-    /// Distribution of the pt of the photon in data
-    std::unique_ptr<TH1> ptPhoton;
-    
-    /// Profile of the pt of the photon in data
-    std::unique_ptr<TProfile> ptPhotonProfile;
-    
-    /// Sum of projections of pt of jets in bins of pt of the photon and jets
-    std::unique_ptr<TH2> ptJetSumProj;
-    
-    /// 2D profile of pt of jets
-    std::unique_ptr<TProfile2D> ptJet2DProfile; 
+    /// Computes means and uncertainties from accumulated sums
+    static std::shared_ptr<Inputs const> FinalizeInputs(InputSums &&sums);
     
     /**
-     * \brief Squared uncertainty on the difference between mean balance observables in data
-     * and simulation
+     * \brief Reads histograms from the given file and scales them with the given weight
+     * 
+     * The label of the method is used to construct names of histograms. Thread-safe provided that
+     * thread safety has been enabled in ROOT.
      */
-    std::vector<double> totalUnc2;
-
-    //Jet pt threshold
-    double jetPtMin;
-
+    static InputSums ReadFile(std::string const &fileName, double weight,
+      std::string const &methodLabel);
+    
     /**
-    * \brief Recomputed mean balance observable in data
-    * 
-    * Computed in the binning of simBalProfile.
-    */
-    mutable std::vector<double> recompBal;
+     * \brief Recomputes mean balance observable in all photon pt bins for the given jet correction
+     * 
+     * Results are written into the provided buffer in simBinning. Since no
+     * internal state is modified, this method can be called from multiple threads concurrently.
+     */
+    void UpdateBalance(JetCorrBase const &corrector, Nuisances const &nuisances,
+      std::vector<double> &recompBal) const;
+    
+private:
+    /// Shared inputs read from the file
+    std::shared_ptr<Inputs const> inputs;
     
     /// Method of computation
     Method method;
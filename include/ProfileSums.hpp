@@ -0,0 +1,126 @@
+/**
+ * Provides additive statistics of profiles stored in flat arrays.
+ */
+
+#pragma once
+
+#include <FlatArray.hpp>
+
+#include <vector>
+
+
+/**
+ * \brief Removes the first and the last elements of an array
+ * 
+ * Intended to drop the under- and overflow bins.
+ */
+std::vector<double> StripUnderOverflow(std::vector<double> const &values);
+
+
+/**
+ * \brief Adds scaled contents of one array to another one
+ * 
+ * An empty destination array is initialized with the scaled source. Otherwise the sizes of the
+ * arrays must agree, which is not checked.
+ */
+void AddScaled(std::vector<double> &dest, std::vector<double> const &src, double scale);
+
+
+/**
+ * \class ProfileSums
+ * \brief Flattened statistics of a profile
+ * 
+ * For each bin of a profile, ROOT stores sums of weights, their squares, weighted values, and
+ * weighted squares of values. Unlike means and uncertainties, these sums are additive, and thus
+ * they allow to combine profiles from several inputs, possibly with additional weights, and to
+ * merge bins. Bins are stored in the same order as returned by GetBinContents (for
+ * one-dimensional profiles) and GetBinContents2D (for two-dimensional ones), including the under-
+ * and overflow bins. This class does not depend on ROOT.
+ */
+class ProfileSums
+{
+public:
+    /// Constructs an object without bins
+    ProfileSums();
+    
+    /**
+     * \brief Constructs an object with the given number of empty bins
+     * 
+     * The number includes the under- and overflow bins. The flag chooses between uncertainties
+     * of the mean and the spread, as the error option of a profile.
+     */
+    explicit ProfileSums(unsigned numBins, bool spreadErrors = false);
+    
+    /**
+     * \brief Constructs from given sums
+     * 
+     * All arrays must have the same size, which is not checked. ROOT profiles are converted with
+     * function ReadProfileSums (see HistFlattening.hpp).
+     */
+    ProfileSums(std::vector<double> &&sumW, std::vector<double> &&sumW2,
+      std::vector<double> &&sumWY, std::vector<double> &&sumWY2, bool spreadErrors);
+    
+public:
+    /**
+     * \brief Adds sums from another object
+     * 
+     * If this object has no bins, it becomes a copy of the other one. Otherwise the numbers of
+     * bins must agree; an exception is thrown if they do not.
+     */
+    void Add(ProfileSums const &other);
+    
+    /**
+     * \brief Adds a value with the given weight to the given bin
+     * 
+     * Equivalent to TProfile::Fill. No range check is performed on the index of the bin.
+     */
+    void Fill(unsigned bin, double y, double weight = 1.);
+    
+    /**
+     * \brief Returns uncertainties in all bins
+     * 
+     * Computed in the same way as in ROOT, without the approximation for bins with a small
+     * spread.
+     */
+    std::vector<double> GetErrors() const;
+    
+    /// Returns mean values in all bins, with zeros for empty bins
+    std::vector<double> GetMeans() const;
+    
+    /// Returns the number of bins, including the under- and overflow ones
+    unsigned GetNumBins() const;
+    
+    /// Returns sums of weights in all bins
+    std::vector<double> const &GetSumW() const;
+    
+    /// Returns sums of squared weights in all bins
+    std::vector<double> const &GetSumW2() const;
+    
+    /// Returns sums of weighted values in all bins
+    std::vector<double> const &GetSumWY() const;
+    
+    /// Returns sums of weighted squared values in all bins
+    std::vector<double> const &GetSumWY2() const;
+    
+    /// Checks if the uncertainty is given by the spread rather than the error of the mean
+    bool HasSpreadErrors() const;
+    
+    /**
+     * \brief Merges bins of a one-dimensional profile
+     * 
+     * Each source bin is added to the target bin that contains its centre. Edges of the two
+     * binnings are expected to be aligned. The returned object includes the under- and overflow
+     * bins of the target binning.
+     */
+    ProfileSums Rebin(FlatArray const &sourceEdges, FlatArray const &targetEdges) const;
+    
+private:
+    /// Sums of weights and squared weights
+    std::vector<double> sumW, sumW2;
+    
+    /// Sums of weighted values and weighted squared values
+    std::vector<double> sumWY, sumWY2;
+    
+    /// Indicates that the uncertainty is given by the spread rather than the error of the mean
+    bool spreadErrors;
+};
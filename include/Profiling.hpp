@@ -0,0 +1,218 @@
+/**
+ * Provides instrumentation that counts calls and measures wall time of stages of the evaluation
+ * of the loss function.
+ * 
+ * The timers are only compiled in when macro JECFIT_PROFILING is defined, which is done with CMake
+ * option JECFIT_PROFILING. Otherwise macro JECFIT_PROFILE_SCOPE expands to nothing, so it can be
+ * placed in hot loops. Spans for the tracer (see Tracing.hpp) are opened separately with macro
+ * JECFIT_TRACE_SCOPE, which is always compiled in and costs a check of a flag while tracing is not
+ * active; it is intended for coarse stages only, such as a single evaluation of a measurement. The
+ * classes and functions declared here are always available, but nothing is recorded unless they
+ * are used explicitly.
+ */
+
+#pragma once
+
+#include <FitBase.hpp>
+#include <Tracing.hpp>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+
+
+/**
+ * \class TimingStats
+ * \brief Thread-safe accumulator of durations of calls
+ * 
+ * Besides the number of calls and the total duration, durations are histogrammed in logarithmic
+ * buckets, four per factor of two, which allows to estimate quantiles with a relative precision
+ * of about 10% without storing individual calls. All counters are atomic and updated with relaxed
+ * memory ordering, so concurrent calls from several threads are cheap.
+ */
+class TimingStats
+{
+public:
+    /// Constructor
+    TimingStats();
+    
+public:
+    /**
+     * \brief Records a call with the given duration, in ns
+     * 
+     * The weight allows to record a sampled call as representing several calls.
+     */
+    void Add(std::uint64_t duration, std::uint64_t weight = 1);
+    
+    /// Returns the number of recorded calls
+    std::uint64_t GetCount() const;
+    
+    /**
+     * \brief Returns an estimate of the given quantile of durations, in ns
+     * 
+     * Returns zero if no calls have been recorded.
+     */
+    double GetQuantile(double probability) const;
+    
+    /// Returns the total duration of all recorded calls, in ns
+    std::uint64_t GetTotal() const;
+    
+private:
+    /// Returns the index of the bucket that contains the given duration
+    static unsigned FindBucket(std::uint64_t duration);
+    
+    /// Returns the centre of the given bucket
+    static double GetBucketCentre(unsigned bucket);
+    
+private:
+    /// Number of buckets, which covers durations up to 2^44 ns, i.e. about 5 h
+    static unsigned const numBuckets = 176;
+    
+    /// Number of calls and total duration
+    std::atomic<std::uint64_t> count, total;
+    
+    /// Numbers of calls in buckets
+    std::array<std::atomic<std::uint64_t>, numBuckets> buckets;
+};
+
+
+/**
+ * \class ScopedTimer
+ * \brief Measures wall time from its construction to its destruction
+ */
+class ScopedTimer
+{
+public:
+    /// Constructor from statistics in which the duration will be recorded
+    ScopedTimer(TimingStats &stats);
+    
+    /// Destructor that records the duration
+    ~ScopedTimer() noexcept;
+    
+private:
+    /// Statistics to update
+    TimingStats &stats;
+    
+    /// Time at which the timer was started
+    std::chrono::steady_clock::time_point start;
+};
+
+
+/**
+ * \class ProfiledJetCorr
+ * \brief Jet correction that forwards to another one and measures time spent in its Eval
+ * 
+ * Reading the clock for every call would take about as long as the evaluation itself. Instead,
+ * in every 64th call in each thread the wrapped correction is evaluated 16 times in a row, and
+ * the mean time of these evaluations, corrected for the overhead of reading the clock, is
+ * recorded with a weight of 64 in the statistics of component "JetCorrBase", stage "Eval". Thus
+ * the number of calls and the total time are estimates, and the repetitions make the evaluation
+ * of the correction about 25% more expensive. UndoCorr is forwarded to the wrapped correction as
+ * a whole, so that the results are not affected; the time it takes is included in stages
+ * "inversion" of measurements. The wrapped correction must outlive this object.
+ */
+class ProfiledJetCorr: public JetCorrBase
+{
+public:
+    /// Constructor from the correction to wrap
+    ProfiledJetCorr(JetCorrBase const &corrector);
+    
+public:
+    /**
+     * \brief Returns a copy of the wrapped correction
+     * 
+     * The copy is not profiled, and its parameters can be changed independently.
+     * 
+     * Implemented from JetCorrBase.
+     */
+    virtual std::unique_ptr<JetCorrBase> Clone() const override;
+    
+    /**
+     * \brief Evaluates the wrapped correction
+     * 
+     * Implemented from JetCorrBase.
+     */
+    virtual double Eval(double pt) const override;
+    
+    /**
+     * \brief Inverts the wrapped correction
+     * 
+     * Reimplemented from JetCorrBase.
+     */
+    virtual double UndoCorr(double pt, double tolerance = 1e-10) const override;
+    
+private:
+    /// Wrapped correction
+    JetCorrBase const &corrector;
+    
+    /// Statistics for calls of Eval
+    TimingStats &stats;
+    
+    /// Overhead of reading the clock, in ns
+    std::uint64_t clockOverhead;
+};
+
+
+/**
+ * \brief Returns statistics for the given component and stage
+ * 
+ * The statistics are created on the first call and then live until the end of the program.
+ * Access is thread-safe but involves a lock, so the returned reference should be cached.
+ */
+TimingStats &GetTimingStats(std::string const &component, std::string const &stage);
+
+
+/**
+ * \brief Prints a table with statistics of all stages
+ * 
+ * For each component and stage, the number of calls, the total time, and the mean time and its
+ * 50%, 90%, and 99% quantiles per call are printed. Stages executed in parallel are timed in each
+ * thread, so their total time is summed over threads and can exceed the wall time of the fit.
+ */
+void PrintTimingSummary(std::ostream &out);
+
+
+/**
+ * \brief Saves statistics of all stages in JSON format
+ * 
+ * The file contains the same information as printed by PrintTimingSummary. Throws an exception if
+ * the file cannot be written.
+ */
+void SaveTimingSummary(std::string const &fileName);
+
+
+#define JECFIT_PROFILE_CONCAT_IMPL(a, b) a##b
+#define JECFIT_PROFILE_CONCAT(a, b) JECFIT_PROFILE_CONCAT_IMPL(a, b)
+
+/**
+ * \brief Opens a span for the tracer that is named after the component and stage
+ * 
+ * The component and stage must be string literals. Since the span is recorded even if profiling
+ * is disabled, this macro should not be used in hot loops.
+ */
+#define JECFIT_TRACE_SCOPE(component, stage) \
+    TraceSpan const JECFIT_PROFILE_CONCAT(traceSpan_, __LINE__)(component, component ": " stage)
+
+#ifdef JECFIT_PROFILING
+
+/**
+ * \brief Measures wall time until the end of the enclosing scope
+ * 
+ * The statistics are looked up once per call site and cached in a static variable. The component
+ * and stage must be string literals.
+ */
+#define JECFIT_PROFILE_SCOPE(component, stage) \
+    static TimingStats &JECFIT_PROFILE_CONCAT(profileStats_, __LINE__) = \
+      GetTimingStats(component, stage); \
+    ScopedTimer const JECFIT_PROFILE_CONCAT(profileTimer_, __LINE__)( \
+      JECFIT_PROFILE_CONCAT(profileStats_, __LINE__))
+
+#else
+
+#define JECFIT_PROFILE_SCOPE(component, stage)
+
+#endif
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <vector>
+
+
+/**
+ * \class HaltonSequence
+ * \brief Generates a multidimensional Halton sequence
+ * 
+ * The Halton sequence is a deterministic low-discrepancy sequence in the unit hypercube [0, 1)^n.
+ * It covers the hypercube more uniformly than pseudo-random points, which makes it well suited to
+ * explore a parameter space with a small number of points. Coordinates are constructed as radical
+ * inverses of the point index in bases given by consecutive prime numbers.
+ */
+class HaltonSequence
+{
+public:
+    /**
+     * \brief Constructor
+     * 
+     * The given number of leading points of the sequence is skipped. Skipping a few points (as
+     * well as the origin, which is always the zeroth point) improves uniformity of short
+     * sequences in high dimensions.
+     */
+    HaltonSequence(unsigned dim, unsigned skip = 0);
+    
+public:
+    /// Returns dimensionality of the sequence
+    unsigned GetDim() const;
+    
+    /// Returns the next point of the sequence
+    std::vector<double> Next();
+    
+private:
+    /// Bases for individual coordinates
+    std::vector<unsigned> bases;
+    
+    /// Index of the next point
+    unsigned index;
+};
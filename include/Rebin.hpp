@@ -45,3 +45,12 @@ using BinMap = std::map<unsigned, std::array<FracBin, 2>>;
  * boundary is set to zero. Bins are numbered such that the underflow bin is assigned index 0.
  */
 BinMap mapBinning(std::vector<double> const &source, std::vector<double> const &target);
+
+
+/**
+ * \brief Constructs a mapping from one binning to another
+ * 
+ * Overload of the function above for binnings given by plain arrays of their edges.
+ */
+BinMap mapBinning(double const *source, unsigned numSourceEdges, double const *target,
+  unsigned numTargetEdges);
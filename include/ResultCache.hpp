@@ -0,0 +1,106 @@
+/**
+ * Provides a content-addressed cache of fit results, which allows to skip fits whose inputs and
+ * configuration have not changed.
+ */
+
+#pragma once
+
+#include <Fitter.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+
+/**
+ * \brief Computes a digest that identifies the content of the given file
+ * 
+ * For a snapshot, the checksum stored in its header is used, so that the file does not need to be
+ * read in full. Any other file is read and hashed. Throws an exception if the file cannot be
+ * opened, e.g. because it is a remote ROOT file.
+ */
+std::string ComputeFileDigest(std::string const &fileName);
+
+
+/**
+ * \class CacheKey
+ * \brief Accumulates a key that identifies a fit
+ * 
+ * Pieces of the configuration are hashed in the order in which they are added. Each piece is
+ * prefixed with its kind and length, so that different sequences of pieces cannot produce the
+ * same stream of bytes. The hash is 128 bits long but not cryptographic: it guards against
+ * accidental collisions, not against deliberately crafted inputs.
+ */
+class CacheKey
+{
+public:
+    /// Constructor
+    CacheKey();
+    
+public:
+    /// Adds a string
+    void Add(std::string const &text);
+    
+    /// Adds a number
+    void Add(double value);
+    
+    /// Adds a block of raw bytes
+    void AddData(void const *data, std::size_t size);
+    
+    /// Returns the digest of everything added so far as a string of 32 hexadecimal digits
+    std::string GetDigest() const;
+    
+private:
+    /// Adds raw bytes
+    void AddBytes(void const *data, std::size_t size);
+    
+private:
+    /// Two independent 64-bit lanes of the hash
+    std::uint64_t state[2];
+};
+
+
+/**
+ * \class ResultCache
+ * \brief Directory that stores results of fits under their keys
+ * 
+ * Each result is saved with SaveFitResult in a separate file named after the digest of the key,
+ * followed by the number of degrees of freedom of the loss function. The latter allows to report a
+ * cached fit without constructing the loss function.
+ * Since files are written under unique temporary names and then renamed, several threads and
+ * processes can share the same cache directory.
+ */
+class ResultCache
+{
+public:
+    /**
+     * \brief Constructor
+     * 
+     * The directory is created if it does not exist, but its parent must exist. Throws an
+     * exception if the directory cannot be created.
+     */
+    ResultCache(std::string const &directory);
+    
+public:
+    /// Returns the path to the file that stores the result with the given key
+    std::string GetPath(CacheKey const &key) const;
+    
+    /**
+     * \brief Reads the result with the given key and the number of degrees of freedom
+     * 
+     * Returns false if the cache does not contain the result. An entry that cannot be parsed is
+     * treated as missing.
+     */
+    bool Load(CacheKey const &key, FitResult &result, unsigned &ndf) const;
+    
+    /**
+     * \brief Saves the result and the number of degrees of freedom under the given key
+     * 
+     * The existing entry, if any, is replaced.
+     */
+    void Store(CacheKey const &key, FitResult const &result, unsigned ndf) const;
+    
+private:
+    /// Path to the directory
+    std::string directory;
+};
@@ -0,0 +1,183 @@
+/**
+ * Provides tools to store preprocessed inputs of measurements in flat binary files that can be
+ * memory-mapped.
+ */
+
+#pragma once
+
+#include <FlatArray.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+
+/**
+ * \class SnapshotWriter
+ * \brief Writes a snapshot of inputs of a measurement
+ * 
+ * A snapshot is a flat binary file that consists of a fixed-size header and a payload. The header
+ * contains a magic string, the version of the format, a marker to detect a mismatch in the byte
+ * order, the size of the payload, its checksum, and the type of the measurement. The payload is a
+ * sequence of arrays of doubles, each preceded by its length as a 64-bit integer. All fields are
+ * aligned at 8-byte boundaries, and thus the arrays can be accessed in place once the file has
+ * been mapped into memory. The layout of the payload is defined by the measurement, which must
+ * read the arrays in the same order as they have been written.
+ */
+class SnapshotWriter
+{
+public:
+    /**
+     * \brief Constructor
+     * 
+     * The type of the measurement is a short label, e.g. as returned by GetMeasurementTypes. It
+     * must not be longer than 31 characters.
+     */
+    SnapshotWriter(std::string const &type);
+    
+public:
+    /// Appends an array given by a pointer and size
+    void Add(double const *data, std::size_t size);
+    
+    /// Appends an array
+    void Add(FlatArray const &array);
+    
+    /// Appends an array
+    void Add(std::vector<double> const &array);
+    
+    /// Appends a single number, which is stored as an array of length one
+    void Add(double value);
+    
+    /**
+     * \brief Writes the snapshot into a file
+     * 
+     * The file is first written under a temporary name and then renamed, so that processes that
+     * map an existing snapshot with the same name are not affected.
+     */
+    void Write(std::string const &fileName) const;
+    
+private:
+    /// Type of the measurement
+    std::string type;
+    
+    /// Payload encoded as 64-bit words
+    std::vector<std::uint64_t> payload;
+};
+
+
+/**
+ * \class SnapshotFile
+ * \brief Read-only memory mapping of a snapshot
+ * 
+ * The file is mapped with shared pages, so that concurrent processes that use the same snapshot
+ * share physical memory through the page cache. The header and the checksum are verified on
+ * opening. Verification of the checksum touches every page once but is much faster than reading
+ * and preprocessing the original inputs.
+ */
+class SnapshotFile
+{
+public:
+    /// Current version of the format
+    static std::uint32_t const version;
+    
+public:
+    /**
+     * \brief Maps the given file into memory
+     * 
+     * Throws an exception if the file cannot be mapped or is not a valid snapshot of the current
+     * version.
+     */
+    SnapshotFile(std::string const &fileName);
+    
+    SnapshotFile(SnapshotFile const &) = delete;
+    
+    /// Destructor; unmaps the file
+    ~SnapshotFile();
+    
+    SnapshotFile &operator=(SnapshotFile const &) = delete;
+    
+public:
+    /// Returns the name of the file
+    std::string const &GetFileName() const;
+    
+    /// Returns a pointer to the beginning of the payload
+    std::uint64_t const *GetPayload() const;
+    
+    /// Returns the size of the payload, in 64-bit words
+    std::size_t GetPayloadSize() const;
+    
+    /// Returns the type of the measurement stored in the snapshot
+    std::string const &GetType() const;
+    
+    /**
+     * \brief Checks if the given file starts with the magic string of a snapshot
+     * 
+     * Returns false if the file cannot be opened, e.g. because it is a remote ROOT file.
+     */
+    static bool IsSnapshot(std::string const &fileName);
+    
+    /**
+     * \brief Reads the checksum of the payload from the header of the given snapshot
+     * 
+     * Only the header is read, and the checksum is not verified. This allows to identify the
+     * content of a snapshot without reading it in full. Throws an exception if the file cannot be
+     * read or is not a snapshot.
+     */
+    static std::uint64_t ReadChecksum(std::string const &fileName);
+    
+private:
+    /// Name of the file
+    std::string fileName;
+    
+    /// Type of the measurement
+    std::string type;
+    
+    /// Beginning and size of the mapped region, in bytes
+    void *mapping;
+    std::size_t mappingSize;
+};
+
+
+/**
+ * \class SnapshotReader
+ * \brief Sequential reader of arrays stored in a snapshot
+ * 
+ * Arrays are returned as FlatArray objects that refer to the mapped memory without copying. The
+ * reader holds a shared pointer to the mapping, which should be stored alongside the arrays to
+ * keep them valid.
+ */
+class SnapshotReader
+{
+public:
+    /// Constructor
+    SnapshotReader(std::shared_ptr<SnapshotFile const> const &file);
+    
+public:
+    /// Returns the mapped file
+    std::shared_ptr<SnapshotFile const> const &GetFile() const;
+    
+    /// Checks if all arrays have been read
+    bool IsAtEnd() const;
+    
+    /// Reads the next array
+    FlatArray ReadArray();
+    
+    /**
+     * \brief Reads the next array and checks its size
+     * 
+     * Throws an exception if the array does not have the given size.
+     */
+    FlatArray ReadArray(std::size_t expectedSize);
+    
+    /// Reads a single number
+    double ReadValue();
+    
+private:
+    /// Mapped file
+    std::shared_ptr<SnapshotFile const> file;
+    
+    /// Position of the next array in the payload, in 64-bit words
+    std::size_t position;
+};
@@ -0,0 +1,48 @@
+/**
+ * Provides functions to write synthetic inputs into ROOT files with the same layouts as the files
+ * read by the measurements.
+ */
+
+#pragma once
+
+#include <SyntheticInputs.hpp>
+
+#include <string>
+
+
+/**
+ * \brief Writes synthetic inputs for MultijetBinnedSum
+ * 
+ * The file contains inputs for both methods, which are built from the same events. Each trigger
+ * bin is stored in a separate directory. Throws an exception if the file cannot be created.
+ */
+void WriteMultijetFile(SyntheticInputGenerator const &generator, std::string const &fileName);
+
+
+/**
+ * \brief Writes synthetic inputs for PhotonJetBinnedSum
+ * 
+ * The file contains inputs for both methods, which are built from the same events. Throws an
+ * exception if the file cannot be created.
+ */
+void WritePhotonJetFile(SyntheticInputGenerator const &generator, std::string const &fileName);
+
+
+/**
+ * \brief Writes synthetic inputs for PhotonJetRun1
+ * 
+ * The ratios for the two methods are fluctuated independently. Throws an exception if the file
+ * cannot be created.
+ */
+void WritePhotonJetRun1File(SyntheticInputGenerator const &generator,
+  std::string const &fileName);
+
+
+/**
+ * \brief Writes synthetic inputs for ZJetRun1
+ * 
+ * The ratios for the two methods are fluctuated independently. Since ZJetRun1 ignores the last
+ * bin of the histogram, an additional empty bin is appended. Throws an exception if the file
+ * cannot be created.
+ */
+void WriteZJetRun1File(SyntheticInputGenerator const &generator, std::string const &fileName);
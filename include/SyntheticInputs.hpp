@@ -0,0 +1,166 @@
+/**
+ * Provides a generator of synthetic inputs for all measurements, with a known jet correction
+ * injected into the data.
+ */
+
+#pragma once
+
+#include <CounterRng.hpp>
+#include <FitBase.hpp>
+#include <MultijetBinnedSum.hpp>
+#include <PhotonJetBinnedSum.hpp>
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+
+/**
+ * \struct RatioPoints
+ * \brief Points of a data-to-simulation ratio of the balance observable
+ * 
+ * This is the content of inputs of the Run 1 measurements.
+ */
+struct RatioPoints
+{
+    /// Pt of the reference object (photon or Z boson)
+    std::vector<double> pt;
+    
+    /// Ratio of the balance observables and its uncertainty
+    std::vector<double> ratio, ratioUnc;
+    
+    /**
+     * \brief Edges of bins in pt
+     * 
+     * Contain one more element than pt. Only needed to write the ratio as a histogram.
+     */
+    std::vector<double> edges;
+};
+
+
+/**
+ * \class SyntheticInputGenerator
+ * \brief Generates self-consistent inputs for the measurements from a simple event model
+ * 
+ * Each event contains a reference object (the leading jet in the multijet analysis or the photon
+ * in the photon+jet one) that is balanced by a few other jets. The balance observable of an event
+ * is the sum of projections of pt of other jets above the threshold onto the reference object,
+ * divided by its pt, and it has the same distribution in data and simulation. In simulation pt
+ * of jets is exact, while in data it is distorted by the inverse of the given true jet
+ * correction, i.e. measured pt x satisfies x * c(x) = true pt. Thus the balance recomputed in
+ * data with the true correction agrees with simulation within statistical uncertainties, and a
+ * fit of the generated inputs should recover the true correction. The photon pt scale is exact.
+ * 
+ * Data binnings in pt of the reference object are finer than the simulation ones, whose edges
+ * they include, and they extend beyond them by at least 10% so that the balance can be
+ * recomputed for corrections that do not differ from unity by more than that. Events are
+ * generated with counter-based random numbers in streams that depend only on the seed, the
+ * measurement, and the bin. Thus the output is fully determined by the seed and the settings,
+ * and inputs for the two methods of computation are built from the same events.
+ */
+class SyntheticInputGenerator
+{
+public:
+    /// Constructor from the true jet correction and the seed
+    SyntheticInputGenerator(JetCorrBase const &trueCorrection, std::uint64_t seed);
+    
+public:
+    /// Generates inputs of the multijet measurement for the given method
+    MultijetBinnedSum::InputSums GenerateMultijet(MultijetBinnedSum::Method method) const;
+    
+    /// Generates inputs of the photon+jet measurement for the given method
+    PhotonJetBinnedSum::InputSums GeneratePhotonJet(PhotonJetBinnedSum::Method method) const;
+    
+    /**
+     * \brief Generates the ratio of balance observables for a Run 1 measurement
+     * 
+     * The ratio equals 1 / c(pt), as assumed by the Run 1 measurements, and it is smeared
+     * within the given relative uncertainty. The given index distinguishes streams of random
+     * numbers for different measurements. The given range in pt is split into logarithmic bins,
+     * whose number is given by the number of simulation bins, and points are placed at their
+     * centres.
+     */
+    RatioPoints GenerateRatio(unsigned index, double ptMin, double ptMax, double relUnc) const;
+    
+    /**
+     * \brief Sets the binnings
+     * 
+     * The number of simulation bins applies to each trigger bin of the multijet measurement and
+     * to the full range of the photon+jet one. Each simulation bin is split into the given number
+     * of data bins.
+     */
+    void SetBinning(unsigned numSimBins, unsigned rebinFactor, unsigned numPtJetBins);
+    
+    /// Sets the number of events generated per data bin, separately in data and simulation
+    void SetNumEventsPerBin(unsigned numEventsPerBin);
+    
+    /// Sets the number of trigger bins in the multijet measurement
+    void SetNumTriggerBins(unsigned numTriggerBins);
+    
+    /**
+     * \brief Sets the fraction of data bins in pt of the reference object that contain no events
+     * 
+     * The bins are chosen at random, but the first data bin within each simulation bin is always
+     * filled, so that the balance can be recomputed in all simulation bins.
+     */
+    void SetSparsity(double sparsity);
+    
+private:
+    /// An event of the model
+    struct Event
+    {
+        /// Pt of the reference object and the balance observable
+        double ptRef, balance;
+        
+        /// Pt of other jets and their projections onto the reference object
+        std::vector<double> jetPt, jetPtProj;
+    };
+    
+    /**
+     * \brief Generates an event with the given true pt of the reference object
+     * 
+     * Jets have true pt; the balance observable is computed with the given threshold. Jets with
+     * pt below 5 GeV are not reconstructed and thus not included in the event.
+     */
+    static Event GenerateEvent(CounterRng &rng, double ptRef, double jetPtMin);
+    
+    /**
+     * \brief Constructs binnings in pt of the reference object
+     * 
+     * The simulation binning spans the given range with numSimBins logarithmic bins. The data
+     * binning is built as described in the class documentation.
+     */
+    void MakeBinnings(double ptMin, double ptMax, std::vector<double> &binning,
+      std::vector<double> &simBinning) const;
+    
+    /**
+     * \brief Decides which data bins are left empty
+     * 
+     * Returns a flag for each bin of the data binning, including the under- and overflow bins.
+     * Bins whose lower edges are edges of the simulation binning are never empty.
+     */
+    std::vector<bool> ChooseEmptyBins(CounterRng &rng, std::vector<double> const &binning,
+      std::vector<double> const &simBinning) const;
+    
+private:
+    /// True jet correction
+    std::unique_ptr<JetCorrBase> trueCorrection;
+    
+    /// Seed for all random numbers
+    std::uint64_t seed;
+    
+    /// Number of trigger bins in the multijet measurement
+    unsigned numTriggerBins;
+    
+    /// Number of simulation bins and data bins per simulation bin
+    unsigned numSimBins, rebinFactor;
+    
+    /// Number of bins in pt of other jets
+    unsigned numPtJetBins;
+    
+    /// Number of events per data bin
+    unsigned numEventsPerBin;
+    
+    /// Fraction of empty data bins
+    double sparsity;
+};
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <FitBase.hpp>
+#include <Fitter.hpp>
+
+#include <cstdint>
+#include <functional>
+#include <ostream>
+
+
+/**
+ * \class ToyFitter
+ * \brief Fits pseudo-experiments to validate the fit
+ * 
+ * Pseudo-experiments (toys) are replicas of the loss function in which inputs in data have been
+ * fluctuated within their statistical uncertainties (see CombLossFunction::CloneFluctuated). The
+ * replicas are generated from the loaded nominal inputs, so no input files are read again. Each
+ * toy uses its own stream of random numbers identified by the seed and the index of the toy. Thus
+ * a toy can be reproduced independently of the others, and results do not depend on the number of
+ * threads.
+ * 
+ * Toys are fitted in parallel, and each thread takes the toy with the smallest index that has not
+ * been started yet. Each thread holds at most one replica at a time. Results are reported in the
+ * order of indices of toys as soon as all preceding toys have been fitted, which allows to stream
+ * them to a file while the computation is running.
+ */
+class ToyFitter
+{
+public:
+    /**
+     * \brief Constructor
+     * 
+     * The loss function is not owned by this and must outlive the object. All its measurements
+     * must support pseudo-experiments.
+     */
+    ToyFitter(CombLossFunction const &lossFunc);
+    
+public:
+    /**
+     * \brief Fits the given number of toys
+     * 
+     * The consumer is called for each toy, in the order of their indices, and never concurrently.
+     * If the fit of a toy fails with an exception, the reported result has status -2 and no
+     * parameters. Exceptions thrown while generating toys are propagated.
+     */
+    void Run(unsigned numToys,
+      std::function<void(unsigned, FitResult const &)> const &consumer) const;
+    
+    /**
+     * \brief Fits the given number of toys and writes results to a stream
+     * 
+     * The output is a text table with one line per toy, which contains the index of the toy,
+     * status of the fit, the minimal value of the loss function, and the values and uncertainties
+     * of all parameters. It starts with a header line prefixed with '#'. The stream is flushed
+     * after each line.
+     */
+    void Run(unsigned numToys, std::ostream &out) const;
+    
+    /// Sets the index of the first toy, which allows to split toys between several jobs
+    void SetFirstToy(unsigned firstToy);
+    
+    /// Sets the number of threads used to fit toys
+    void SetNumThreads(unsigned numThreads);
+    
+    /// Sets the seed for generation of pseudo-experiments
+    void SetSeed(std::uint64_t seed);
+    
+    /**
+     * \brief Sets the starting point for fits of all toys
+     * 
+     * Typically this is the result of the nominal fit, which is close to the minima for toys.
+     * Throws an exception if the number of parameters does not match the loss function.
+     */
+    void SetStartingPoint(FitResult const &start);
+    
+    /**
+     * \brief Sets the strategy of Minuit2
+     * 
+     * The default value is 1, which trades some precision of uncertainties for speed.
+     */
+    void SetStrategy(unsigned strategy);
+    
+private:
+    /// Nominal loss function
+    CombLossFunction const &lossFunc;
+    
+    /// Starting point for all fits
+    FitResult start;
+    
+    /// Seed for generation of pseudo-experiments
+    std::uint64_t seed;
+    
+    /// Index of the first toy
+    unsigned firstToy;
+    
+    /// Number of threads
+    unsigned numThreads;
+    
+    /// Strategy of Minuit2
+    unsigned strategy;
+};
@@ -0,0 +1,88 @@
+/**
+ * Provides a tracer that records spans of execution in all threads and writes them in the
+ * Chrome trace-event format, which can be viewed in Perfetto or chrome://tracing.
+ * 
+ * Tracing is disabled by default. While it is disabled, constructing a TraceSpan only checks an
+ * atomic flag, so spans can be placed in the evaluation of the loss function permanently.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+
+/**
+ * \brief Starts tracing into the given file
+ * 
+ * The file is created immediately, and recorded spans are written to it periodically by a
+ * background thread. The calling thread is listed as thread 0 in the trace. Throws an exception
+ * if the file cannot be created or tracing is already active.
+ */
+void StartTracing(std::string const &fileName);
+
+
+/**
+ * \brief Stops tracing and completes the file
+ * 
+ * Spans that are still open are not recorded. Does nothing if tracing is not active. Throws an
+ * exception if writing the file has failed. If this function is not called, tracing is stopped
+ * automatically at the exit from the program.
+ */
+void StopTracing();
+
+
+/**
+ * \brief Returns the number of spans that have been dropped because buffers were full
+ * 
+ * Buffers overflow only if spans are recorded faster than the background thread writes them.
+ */
+std::uint64_t GetNumDroppedSpans();
+
+
+/// Checks if tracing is active
+bool IsTracingEnabled();
+
+
+/**
+ * \class TraceSpan
+ * \brief Records a span from its construction to its destruction or a call to Finish
+ * 
+ * The span is written as a complete event ("ph": "X") in the thread that has constructed it.
+ * Category and name are not copied, so they must have static storage duration, e.g. be string
+ * literals. If tracing is not active at the construction, nothing is recorded.
+ * 
+ * Each thread stores its spans in its own fixed-size ring buffer, which it shares only with the
+ * background thread that writes the file, without locks. If the buffer is full, the span is
+ * dropped. When a thread exits, its buffer is handed over to the next thread that records a
+ * span, so the memory used for buffers is bounded by the maximal number of threads alive at the
+ * same time. Threads that reuse a buffer share the same row in the trace.
+ */
+class TraceSpan
+{
+public:
+    /// Constructor from the category and name of the span
+    TraceSpan(char const *category, char const *name);
+    
+    /// Destructor that records the span unless it has been finished already
+    ~TraceSpan() noexcept;
+    
+    TraceSpan(TraceSpan const &) = delete;
+    TraceSpan &operator=(TraceSpan const &) = delete;
+    
+public:
+    /**
+     * \brief Ends the span before the destruction of this object
+     * 
+     * Subsequent calls have no effect.
+     */
+    void Finish() noexcept;
+    
+private:
+    /// Category and name of the span
+    char const *category, *name;
+    
+    /// Time of the start in ns, or zero if the span is not recorded
+    std::uint64_t start;
+};
+
@@ -0,0 +1,33 @@
+/**
+ * Provides a description of input files with weights.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+
+/**
+ * \struct WeightedFile
+ * \brief Input file with a weight to be applied to all its histograms
+ */
+struct WeightedFile
+{
+    /// Name of the file
+    std::string name;
+    
+    /// Weight, e.g. to account for the integrated luminosity of a run period
+    double weight;
+};
+
+
+/**
+ * \brief Parses a comma-separated list of input files with optional weights
+ * 
+ * Each element of the list is a file name, optionally followed by character '@' and the weight,
+ * e.g. "periodA.root@0.4,periodB.root@0.6". The weight defaults to 1. If the text after the last
+ * '@' is not a number, the whole element is interpreted as the file name. Throws an exception if
+ * the list contains no files.
+ */
+std::vector<WeightedFile> ParseFileList(std::string const &list);
@@ -2,6 +2,7 @@
 
 #include <FitBase.hpp>
 
+#include <memory>
 #include <vector>
 
 
@@ -44,6 +45,23 @@ public:
     ZJetRun1(std::string const &fileName, Method method);
     
 public:
+    /**
+     * \brief Creates a copy of this measurement that shares its inputs
+     * 
+     * Implemented from MeasurementBase.
+     */
+    virtual std::unique_ptr<MeasurementBase> Clone() const override;
+    
+    /**
+     * \brief Creates a pseudo-experiment by fluctuating inputs in data
+     * 
+     * Ratios of balance observables are smeared independently with Gaussian distributions
+     * according to their statistical uncertainties.
+     * 
+     * Reimplemented from MeasurementBase.
+     */
+    virtual std::unique_ptr<MeasurementBase> CloneFluctuated(CounterRng &rng) const override;
+    
     /**
      * \brief Returns dimensionality of the deviation
      * 
@@ -59,6 +77,10 @@ public:
     virtual double Eval(JetCorrBase const &corrector, Nuisances const &nuisances) const override;
     
 private:
-    /// Input data in bins of pt of Z boson
-    std::vector<PtBin> bins;
+    /**
+     * \brief Input data in bins of pt of Z boson
+     * 
+     * Shared among clones of the measurement.
+     */
+    std::shared_ptr<std::vector<PtBin> const> bins;
 };
@@ -2,26 +2,697 @@
  * Fits for jet correction combinning multiple analyses.
  */
 
-#include <JetCorrDefinitions.hpp>
+#include <BlockSparseMinimizer.hpp>
+#include <Diagnostics.hpp>
 #include <FitBase.hpp>
+#include <FitReport.hpp>
+#include <FitServer.hpp>
+#include <Fitter.hpp>
+#include <HistFlattening.hpp>
+#include <MeasurementFactory.hpp>
+#include <MultiEtaLossFunction.hpp>
 #include <MultijetBinnedSum.hpp>
-#include <PhotonJetBinnedSum.hpp>
-#include <PhotonJetRun1.hpp>
-#include <ZJetRun1.hpp>
+#include <MultiStartFitter.hpp>
+#include <Parallel.hpp>
+#include <Profiling.hpp>
+#include <ResultCache.hpp>
+#include <ToyFitter.hpp>
+#include <Tracing.hpp>
 
-#include <Minuit2/Minuit2Minimizer.h>
-#include <Math/Functor.h>
 #include <TMath.h>
+#include <TROOT.h>
 
 #include <boost/algorithm/string.hpp>
 #include <boost/program_options.hpp>
 
+#include <algorithm>
+#include <cctype>
 #include <cmath>
+#include <cstdint>
 #include <fstream>
 #include <iostream>
-#include <list>
+#include <map>
 #include <memory>
+#include <sstream>
+#include <stdexcept>
 #include <string>
+#include <vector>
+
+
+/**
+ * \brief Performs a simultaneous fit in multiple bins in eta
+ * 
+ * The configuration file lists measurements included in each bin. Each non-empty line that is not
+ * a comment (starts with '#') contains a label of the bin in eta, the type of the measurement (as
+ * returned by GetMeasurementTypes), and the name of the input file. Bins are ordered in eta in
+ * the order in which their labels first appear in the file.
+ */
+int RunMultiEtaFit(boost::program_options::variables_map const &optionsMap, bool useMPF)
+{
+    using namespace std;
+    
+    
+    // Read the configuration
+    string const configFileName(optionsMap["eta-config"].as<string>());
+    ifstream configFile(configFileName);
+    
+    if (not configFile)
+    {
+        cerr << "Failed to open file \"" << configFileName << "\".\n";
+        return EXIT_FAILURE;
+    }
+    
+    vector<string> labels;
+    
+    // Descriptions of measurements (pairs of the type and the input file) and indices of bins in
+    //eta they belong to
+    vector<pair<string, string>> descriptions;
+    vector<unsigned> etaBinIndices;
+    string line;
+    
+    while (getline(configFile, line))
+    {
+        boost::trim(line);
+        
+        if (line.empty() or line[0] == '#')
+            continue;
+        
+        istringstream lineStream(line);
+        string label, type, fileName;
+        
+        if (not (lineStream >> label >> type >> fileName))
+        {
+            cerr << "Failed to parse line \"" << line << "\" in file \"" << configFileName <<
+              "\".\n";
+            return EXIT_FAILURE;
+        }
+        
+        auto const labelIt = find(labels.begin(), labels.end(), label);
+        unsigned const etaBin = labelIt - labels.begin();
+        
+        if (labelIt == labels.end())
+            labels.emplace_back(label);
+        
+        descriptions.emplace_back(type, fileName);
+        etaBinIndices.emplace_back(etaBin);
+    }
+    
+    if (labels.empty())
+    {
+        cerr << "No bins in eta found in file \"" << configFileName << "\".\n";
+        return EXIT_FAILURE;
+    }
+    
+    
+    // Read all inputs concurrently and distribute the measurements among bins in eta
+    unsigned const numThreads = optionsMap["threads"].as<unsigned>();
+    TraceSpan readingSpan("fit", "fit: reading inputs");
+    auto loadedMeasurements = CreateMeasurements(descriptions, useMPF, numThreads);
+    readingSpan.Finish();
+    vector<vector<unique_ptr<MeasurementBase>>> measurements(labels.size());
+    
+    for (unsigned i = 0; i < loadedMeasurements.size(); ++i)
+        measurements[etaBinIndices[i]].emplace_back(move(loadedMeasurements[i]));
+    
+    
+    // Construct the combined loss function
+    MultiEtaLossFunction lossFunc;
+    lossFunc.SetNumThreads(numThreads);
+    
+    for (unsigned k = 0; k < labels.size(); ++k)
+    {
+        auto etaBinLoss = make_unique<CombLossFunction>(
+          CreateJetCorr(optionsMap["correction"].as<string>()));
+        
+        for (auto const &measurement: measurements[k])
+            etaBinLoss->AddMeasurement(measurement.get());
+        
+        lossFunc.AddEtaBin(labels[k], move(etaBinLoss));
+    }
+    
+    if (optionsMap.count("eta-smoothness"))
+    {
+        for (auto const &constraint: optionsMap["eta-smoothness"].as<vector<string>>())
+        {
+            vector<string> tokens;
+            boost::split(tokens, constraint, boost::is_any_of(":"));
+            
+            if (tokens.size() != 2)
+            {
+                cerr << "Failed to parse smoothness constraint \"" << constraint << "\".\n";
+                return EXIT_FAILURE;
+            }
+            
+            lossFunc.AddSmoothnessConstraint(stoul(tokens[0]), stod(tokens[1]));
+        }
+    }
+    
+    
+    // Run minimization
+    TraceSpan minimizationSpan("fit", "fit: minimization");
+    BlockSparseMinimizer minimizer(lossFunc);
+    minimizer.SetPrintLevel(1);
+    BlockFitResult const fitResult = minimizer.Minimize();
+    minimizationSpan.Finish();
+    
+    
+    // Print results
+    double const pValue = TMath::Prob(fitResult.minValue, lossFunc.GetNDF());
+    
+    cout << "\n\n\e[1mSummary\e[0m:\n";
+    cout << "  Status: " << fitResult.status << '\n';
+    cout << "  Number of iterations: " << fitResult.numIterations << '\n';
+    cout << "  Number of evaluations: " << fitResult.numCalls << '\n';
+    cout << "  Minimal value: " << fitResult.minValue << '\n';
+    cout << "  NDF: " << lossFunc.GetNDF() << '\n';
+    cout << "  p-value: " << pValue << '\n';
+    cout << "  Parameters:\n";
+    
+    for (unsigned i = 0; i < fitResult.values.size(); ++i)
+        cout << "    " << fitResult.names[i] << ":  " << fitResult.values[i] << " +- " <<
+          fitResult.errors[i] << "\n";
+    
+    
+    // Save fit results in a text file
+    string const resFileName(optionsMap["output"].as<string>());
+    ofstream resFile(resFileName);
+    
+    for (unsigned k = 0; k < lossFunc.GetNumEtaBins(); ++k)
+    {
+        unsigned const size = lossFunc.GetBlockSize(k);
+        unsigned const offset = lossFunc.GetBlockOffset(k);
+        
+        resFile << "# Fitted parameters in bin " << lossFunc.GetLabel(k) << "\n";
+        
+        for (unsigned i = 0; i < size; ++i)
+            resFile << fitResult.values[offset + i] << " ";
+        
+        resFile << "\n\n# Covariance matrix in bin " << lossFunc.GetLabel(k) << ":\n";
+        
+        for (unsigned i = 0; i < size; ++i)
+        {
+            for (unsigned j = 0; j < size; ++j)
+                resFile << ((fitResult.blockCovariances.empty()) ? 0. :
+                  fitResult.blockCovariances[k][i * size + j]) << " ";
+            
+            resFile << '\n';
+        }
+        
+        resFile << '\n';
+    }
+    
+    resFile << "# Minimal chi^2, NDF, p-value:\n";
+    resFile << fitResult.minValue << " " << lossFunc.GetNDF() << " " << pValue << '\n';
+    
+    resFile.close();
+    
+    
+    cout << "\nResults saved to file \"" << resFileName << "\".\n";
+    
+    return EXIT_SUCCESS;
+}
+
+
+/**
+ * \brief Computes digests of all input files of the given measurements
+ * 
+ * The measurements are given by pairs of their types and lists of input files, possibly with
+ * weights (see ParseFileList). Each distinct file is hashed once, using up to the given number of
+ * threads. The returned map is indexed with names of the files.
+ */
+std::map<std::string, std::string> ComputeInputDigests(
+  std::vector<std::pair<std::string, std::string>> const &inputs, unsigned numThreads)
+{
+    using namespace std;
+    
+    map<string, string> digests;
+    
+    for (auto const &input: inputs)
+        for (auto const &file: ParseFileList(input.second))
+            digests.emplace(file.name, "");
+    
+    vector<map<string, string>::iterator> toHash;
+    
+    for (auto it = digests.begin(); it != digests.end(); ++it)
+        toHash.emplace_back(it);
+    
+    ParallelFor(toHash.size(), numThreads, [&toHash](unsigned i)
+    {
+        toHash[i]->second = ComputeFileDigest(toHash[i]->first);
+    });
+    
+    return digests;
+}
+
+
+/**
+ * \brief Builds a key of the result cache for a fit
+ * 
+ * The key covers the balance variable, the form of the correction, the range of trigger bins in
+ * the multijet analysis, and, for each measurement, its type and the content and weights of its
+ * input files, as given by the digests computed with ComputeInputDigests. Settings of the
+ * minimizer must be added by the caller.
+ */
+CacheKey CreateCacheKey(std::string const &balance, std::string const &correction,
+  std::string const &triggerBins, std::vector<std::pair<std::string, std::string>> const &inputs,
+  std::map<std::string, std::string> const &digests)
+{
+    CacheKey key;
+    key.Add("jecfit-result-1");
+    key.Add(balance);
+    key.Add(correction);
+    key.Add(triggerBins);
+    key.Add(double(inputs.size()));
+    
+    for (auto const &input: inputs)
+    {
+        auto const files = ParseFileList(input.second);
+        key.Add(input.first);
+        key.Add(double(files.size()));
+        
+        for (auto const &file: files)
+        {
+            key.Add(digests.at(file.name));
+            key.Add(file.weight);
+        }
+    }
+    
+    return key;
+}
+
+
+/**
+ * \brief Selects a range of trigger bins in a multijet measurement
+ * 
+ * The range is given as begin:end, where the end can be omitted to select all trigger bins
+ * starting from the given one. Nothing is done if the range is empty or the measurement is not a
+ * multijet one. Throws an exception if the range cannot be parsed.
+ */
+void ApplyTriggerBinRange(MeasurementBase &measurement, std::string const &range)
+{
+    using namespace std;
+    auto const multijet = dynamic_cast<MultijetBinnedSum *>(&measurement);
+    
+    if (range.empty() or not multijet)
+        return;
+    
+    vector<string> tokens;
+    boost::split(tokens, range, boost::is_any_of(":"));
+    
+    if (tokens.size() > 2 or tokens[0].empty() or
+      not all_of(range.begin(), range.end(), [](char c){return isdigit(c) or c == ':';}))
+    {
+        ostringstream message;
+        message << "Failed to parse range of trigger bins \"" << range << "\".";
+        throw runtime_error(message.str());
+    }
+    
+    multijet->SetTriggerBinRange(stoul(tokens[0]),
+      (tokens.size() > 1 and not tokens[1].empty()) ? stoul(tokens[1]) : -1);
+}
+
+
+/**
+ * \brief Prints memory used by trigger bins of multijet measurements
+ * 
+ * Trigger bins are read lazily, so only the ones that have been accessed, normally the selected
+ * ones, are loaded. For each measurement, given together with its label, the number of loaded
+ * trigger bins and the memory used by each of them are printed. Measurements of other types are
+ * skipped.
+ */
+void ReportTriggerBinMemory(
+  std::vector<std::pair<std::string, MeasurementBase const *>> const &measurements)
+{
+    using namespace std;
+    bool headerPrinted = false;
+    
+    for (auto const &labelledMeasurement: measurements)
+    {
+        auto const *multijet = dynamic_cast<MultijetBinnedSum const *>(labelledMeasurement.second);
+        
+        if (not multijet)
+            continue;
+        
+        if (not headerPrinted)
+        {
+            cout << "\nMemory used by trigger bins of multijet measurements:\n";
+            headerPrinted = true;
+        }
+        
+        unsigned const numTriggerBins = multijet->GetNumTriggerBins();
+        unsigned numLoaded = 0;
+        size_t totalMemory = 0;
+        ostringstream binsReport;
+        
+        for (unsigned i = 0; i < numTriggerBins; ++i)
+        {
+            if (not multijet->IsTriggerBinLoaded(i))
+                continue;
+            
+            size_t const memory = multijet->GetTriggerBinMemory(i);
+            ++numLoaded;
+            totalMemory += memory;
+            binsReport << "    bin " << i << ": " << memory / 1024. << " kB\n";
+        }
+        
+        cout << "  " << labelledMeasurement.first << ": " << numLoaded << " of " <<
+          numTriggerBins << " trigger bins loaded, " << totalMemory / 1024. << " kB\n" <<
+          binsReport.str();
+    }
+}
+
+
+/**
+ * \brief Performs a batch of independent fits with shared inputs
+ * 
+ * Each non-empty line of the configuration file that is not a comment (starts with '#') describes
+ * one fit. It contains a label of the fit followed by settings given as key=value. Supported keys
+ * are "balance" and "correction", which override the corresponding command line options, names of
+ * measurement types (as returned by GetMeasurementTypes) with names of input files as values, and
+ * "trigger-bins", which selects the range begin:end of trigger bins in the multijet analysis.
+ * 
+ * Each distinct input is read only once, and measurements in individual fits are cheap clones of
+ * the loaded ones. If the result cache is used, it is consulted first, and only inputs of fits
+ * that have not been found in it are read. Inputs are read and then the fits are performed in
+ * parallel on a pool of threads. Results of all fits are written into a single file in the order
+ * of the configuration.
+ */
+int RunBatch(boost::program_options::variables_map const &optionsMap)
+{
+    using namespace std;
+    
+    
+    // Description of a single fit
+    struct FitConfig
+    {
+        string label, balance, correction, triggerBins;
+        
+        /// Types of measurements and names of input files
+        vector<pair<string, string>> inputs;
+    };
+    
+    
+    // Parse the configuration
+    string const configFileName(optionsMap["batch"].as<string>());
+    ifstream configFile(configFileName);
+    
+    if (not configFile)
+    {
+        cerr << "Failed to open file \"" << configFileName << "\".\n";
+        return EXIT_FAILURE;
+    }
+    
+    auto const &types = GetMeasurementTypes();
+    vector<FitConfig> configs;
+    string line;
+    
+    while (getline(configFile, line))
+    {
+        boost::trim(line);
+        
+        if (line.empty() or line[0] == '#')
+            continue;
+        
+        istringstream lineStream(line);
+        FitConfig config;
+        config.balance = optionsMap["balance"].as<string>();
+        config.correction = optionsMap["correction"].as<string>();
+        lineStream >> config.label;
+        
+        string token;
+        
+        while (lineStream >> token)
+        {
+            auto const pos = token.find('=');
+            
+            if (pos == string::npos)
+            {
+                cerr << "Failed to parse setting \"" << token << "\" in file \"" <<
+                  configFileName << "\".\n";
+                return EXIT_FAILURE;
+            }
+            
+            string const key(token.substr(0, pos)), value(token.substr(pos + 1));
+            
+            if (key == "balance")
+                config.balance = value;
+            else if (key == "correction")
+                config.correction = value;
+            else if (key == "trigger-bins")
+                config.triggerBins = value;
+            else if (find_if(types.begin(), types.end(),
+              [&key](auto const &type){return type.first == key;}) != types.end())
+                config.inputs.emplace_back(key, value);
+            else
+            {
+                cerr << "Unknown setting \"" << key << "\" in file \"" << configFileName <<
+                  "\".\n";
+                return EXIT_FAILURE;
+            }
+        }
+        
+        boost::to_lower(config.balance);
+        
+        if (config.balance != "ptbal" and config.balance != "mpf")
+        {
+            cerr << "Do not recognize balance variable \"" << config.balance << "\" in fit \"" <<
+              config.label << "\".\n";
+            return EXIT_FAILURE;
+        }
+        
+        if (config.inputs.empty())
+        {
+            cerr << "No measurements requested in fit \"" << config.label << "\".\n";
+            return EXIT_FAILURE;
+        }
+        
+        configs.emplace_back(config);
+    }
+    
+    
+    ThreadPool threadPool(optionsMap["threads"].as<unsigned>());
+    vector<FitResult> results(configs.size());
+    vector<unsigned> ndfs(configs.size(), 0);
+    vector<string> errors(configs.size());
+    
+    
+    // Look up fits in the result cache if requested. This is done before any inputs are read, so
+    //that inputs used only by cached fits are not read at all.
+    unique_ptr<ResultCache> cache;
+    vector<CacheKey> cacheKeys;
+    vector<bool> cached(configs.size(), false);
+    
+    if (optionsMap.count("cache-dir"))
+    {
+        cache = make_unique<ResultCache>(optionsMap["cache-dir"].as<string>());
+        vector<pair<string, string>> allInputs;
+        
+        for (auto const &config: configs)
+            allInputs.insert(allInputs.end(), config.inputs.begin(), config.inputs.end());
+        
+        auto const digests = ComputeInputDigests(allInputs, threadPool.GetNumThreads());
+        
+        for (unsigned iFit = 0; iFit < configs.size(); ++iFit)
+        {
+            auto const &config = configs[iFit];
+            cacheKeys.emplace_back(CreateCacheKey(config.balance, config.correction,
+              config.triggerBins, config.inputs, digests));
+            cacheKeys.back().Add("fitter");
+            
+            if (not optionsMap.count("force-fit"))
+                cached[iFit] = cache->Load(cacheKeys.back(), results[iFit], ndfs[iFit]);
+        }
+        
+        cout << "Found " << count(cached.begin(), cached.end(), true) << " of " <<
+          configs.size() << " fits in the cache." << endl;
+    }
+    
+    
+    // Find distinct inputs of fits that need to be performed. Different balance variables require
+    //separate measurement objects.
+    map<string, unique_ptr<MeasurementBase>> loadedInputs;
+    vector<map<string, unique_ptr<MeasurementBase>>::iterator> toLoad;
+    
+    auto const inputKey = [](string const &balance, pair<string, string> const &input)
+    {
+        return balance + " " + input.first + " " + input.second;
+    };
+    
+    for (unsigned iFit = 0; iFit < configs.size(); ++iFit)
+    {
+        if (cached[iFit])
+            continue;
+        
+        for (auto const &input: configs[iFit].inputs)
+        {
+            auto const res = loadedInputs.emplace(inputKey(configs[iFit].balance, input), nullptr);
+            
+            if (res.second)
+                toLoad.emplace_back(res.first);
+        }
+    }
+    
+    
+    // Read the inputs and run the fits on the same pool of threads
+    cout << "Reading " << toLoad.size() << " distinct inputs for " <<
+      count(cached.begin(), cached.end(), false) << " fits..." << endl;
+    
+    threadPool.Run(toLoad.size(), [&toLoad](unsigned i)
+    {
+        TraceSpan const span("fit", "fit: reading input");
+        istringstream keyStream(toLoad[i]->first);
+        string balance, type, fileName;
+        keyStream >> balance >> type >> fileName;
+        toLoad[i]->second = CreateMeasurement(type, fileName, (balance == "mpf"));
+    });
+    
+    cout << "Running fits..." << endl;
+    
+    threadPool.Run(configs.size(), [&](unsigned iFit)
+    {
+        if (cached[iFit])
+            return;
+        
+        TraceSpan const span("fit", "fit: batch fit");
+        auto const &config = configs[iFit];
+        
+        try
+        {
+            CombLossFunction lossFunc(CreateJetCorr(config.correction));
+            
+            for (auto const &input: config.inputs)
+            {
+                auto measurement = loadedInputs.at(inputKey(config.balance, input))->Clone();
+                ApplyTriggerBinRange(*measurement, config.triggerBins);
+                lossFunc.AddMeasurement(move(measurement));
+            }
+            
+            Fitter fitter(lossFunc);
+            results[iFit] = fitter.Fit();
+            ndfs[iFit] = lossFunc.GetNDF();
+            
+            if (cache)
+                cache->Store(cacheKeys[iFit], results[iFit], ndfs[iFit]);
+        }
+        catch (exception const &e)
+        {
+            errors[iFit] = e.what();
+        }
+    });
+    
+    
+    // Print a summary and save all results into a single file
+    string const resFileName(optionsMap["output"].as<string>());
+    ofstream resFile(resFileName);
+    
+    cout << "\n\e[1mSummary\e[0m:\n";
+    
+    for (unsigned iFit = 0; iFit < configs.size(); ++iFit)
+    {
+        auto const &label = configs[iFit].label;
+        auto const &fitResult = results[iFit];
+        
+        resFile << "# Fit " << label << '\n';
+        
+        if (not errors[iFit].empty())
+        {
+            cout << "  " << label << ": failed: " << errors[iFit] << '\n';
+            resFile << "# Failed: " << errors[iFit] << "\n\n";
+            continue;
+        }
+        
+        double const pValue = TMath::Prob(fitResult.minValue, ndfs[iFit]);
+        cout << "  " << label << ": status " << fitResult.status << ", chi^2 / NDF = " <<
+          fitResult.minValue << " / " << ndfs[iFit] << ((cached[iFit]) ? " (cached)" : "") <<
+          '\n';
+        
+        resFile << "# Status, covariance matrix status, minimal chi^2, NDF, p-value:\n";
+        resFile << fitResult.status << " " << fitResult.covStatus << " " << fitResult.minValue <<
+          " " << ndfs[iFit] << " " << pValue << '\n';
+        
+        unsigned const nPars = fitResult.values.size();
+        resFile << "# Fitted parameters and their uncertainties:\n";
+        
+        for (unsigned i = 0; i < nPars; ++i)
+            resFile << fitResult.names[i] << " " << fitResult.values[i] << " " <<
+              fitResult.errors[i] << '\n';
+        
+        resFile << "# Covariance matrix:\n";
+        
+        for (unsigned i = 0; i < nPars; ++i)
+        {
+            for (unsigned j = 0; j < nPars; ++j)
+                resFile << fitResult.covariance[i * nPars + j] << " ";
+            
+            resFile << '\n';
+        }
+        
+        resFile << '\n';
+    }
+    
+    resFile.close();
+    
+    
+    cout << "\nResults saved to file \"" << resFileName << "\".\n";
+    
+    vector<pair<string, MeasurementBase const *>> labelledInputs;
+    
+    for (auto const &input: loadedInputs)
+        labelledInputs.emplace_back(input.first, input.second.get());
+    
+    ReportTriggerBinMemory(labelledInputs);
+    return EXIT_SUCCESS;
+}
+
+
+/**
+ * \brief Reports problems and timing of the evaluation of the loss function
+ * 
+ * Prints a summary of problems, such as NaN in individual bins, encountered in the evaluation of
+ * the loss function. If tracing has been requested, stops it, which completes the file. If the
+ * package has been built with instrumentation (CMake option JECFIT_PROFILING), prints a summary
+ * of the timing and saves it in JSON format if requested. Otherwise only warns if the output has
+ * been requested. Returns the given exit status.
+ */
+int ReportInstrumentation(boost::program_options::variables_map const &optionsMap, int status)
+{
+    using namespace std;
+    
+    if (GetNumDiagnosticEvents() > 0)
+    {
+        cout << '\n';
+        PrintDiagnosticsSummary(cout);
+    }
+    
+    if (optionsMap.count("trace-output"))
+    {
+        StopTracing();
+        cout << "\nTrace saved to file \"" << optionsMap["trace-output"].as<string>() << "\"";
+        
+        if (GetNumDroppedSpans() > 0)
+            cout << "; " << GetNumDroppedSpans() << " spans have been dropped";
+        
+        cout << ".\n";
+    }
+
+#ifdef JECFIT_PROFILING
+    cout << '\n';
+    PrintTimingSummary(cout);
+    
+    if (optionsMap.count("timing-output"))
+    {
+        string const fileName(optionsMap["timing-output"].as<string>());
+        SaveTimingSummary(fileName);
+        cout << "Timing summary saved to file \"" << fileName << "\".\n";
+    }
+#else
+    if (optionsMap.count("timing-output"))
+        cerr << "Option \"--timing-output\" is ignored because the package has been built " <<
+          "without instrumentation (see CMake option JECFIT_PROFILING).\n";
+#endif
+
+    return status;
+}
 
 
 int main(int argc, char **argv)
@@ -36,13 +707,53 @@ int main(int argc, char **argv)
       ("help,h", "Prints help message")
       ("balance,b", po::value<string>()->default_value("PtBal"),
         "Type of balance variable, PtBal or MPF")
-      ("photonjet-run1", po::value<string>(), "Input file for photon+jet analysis, Run 1 style")
-      ("photonjet-binnedsum", po::value<string>(),
-        "Input file for photon+jet analysis, binned sum")
-      ("zjet-run1", po::value<string>(), "Input file for Z+jet analysis, Run 1 style")
-      ("multijet-binnedsum", po::value<string>(), "Input file for multijet analysis, binned sum")
+      ("correction", po::value<string>()->default_value("Std2P"),
+        "Form of the jet correction, Std2P, Std3P, or StableLogLin")
+      ("trigger-bins", po::value<string>()->default_value(""),
+        "Range begin:end of trigger bins to use in the multijet analysis; the end may be omitted")
       ("output,o", po::value<string>()->default_value("fit.out"),
-        "Name for output file with results of the fit");
+        "Name for output file with results of the fit")
+      ("report", po::value<string>(),
+        "File to save a JSON summary of the fit with contributions to chi^2 and per-bin pulls")
+      ("cache-dir", po::value<string>(),
+        "Directory with cached results; a fit with unchanged inputs and settings is not repeated")
+      ("force-fit", "Perform the fit even if its result is cached, and replace the cached result")
+      ("start-from", po::value<string>(),
+        "Checkpoint of a previous fit to be used as the starting point")
+      ("checkpoint", po::value<string>(),
+        "File to save checkpoints of the fit; the final result is saved there as well")
+      ("checkpoint-period", po::value<unsigned>()->default_value(100),
+        "Number of evaluations of the loss function between periodic checkpoints")
+      ("serve", po::value<string>(),
+        "Instead of fitting, serve requests on the Unix-domain socket with the given path")
+      ("batch", po::value<string>(),
+        "Configuration file with a batch of fits to perform in one process")
+      ("eta-config", po::value<string>(),
+        "Configuration file for a simultaneous fit in multiple bins in eta")
+      ("eta-smoothness", po::value<vector<string>>(),
+        "Smoothness constraint for a simultaneous fit in bins in eta, given as index:sigma")
+      ("multi-start", po::value<unsigned>()->default_value(1),
+        "Number of starting points for the minimization")
+      ("multi-start-width", po::value<double>()->default_value(0.1),
+        "Half-width of the region in which starting points are placed")
+      ("multi-start-margin", po::value<double>()->default_value(10.),
+        "Runs whose loss exceeds the best one found so far by this margin are cancelled")
+      ("toys", po::value<unsigned>()->default_value(0),
+        "Number of pseudo-experiments to fit after the nominal fit")
+      ("toy-seed", po::value<std::uint64_t>()->default_value(1),
+        "Seed for generation of pseudo-experiments")
+      ("first-toy", po::value<unsigned>()->default_value(0),
+        "Index of the first pseudo-experiment, to split them between several jobs")
+      ("toy-output", po::value<string>()->default_value("toys.out"),
+        "Name for output file with results of fits of pseudo-experiments")
+      ("timing-output", po::value<string>(),
+        "File to save a JSON summary of timing of the evaluation (needs JECFIT_PROFILING)")
+      ("trace-output", po::value<string>(),
+        "File to save a timeline of the fit in the Chrome trace-event format")
+      ("threads,j", po::value<unsigned>()->default_value(1), "Number of threads to use");
+    
+    for (auto const &type: GetMeasurementTypes())
+        options.add_options()(type.first.c_str(), po::value<string>(), type.second.c_str());
     
     po::variables_map optionsMap;
     
@@ -74,78 +785,213 @@ int main(int argc, char **argv)
     }
     
     
-    // Construct all requested measurements
-    list<unique_ptr<MeasurementBase>> measurements;
+    // The server handles each connection in a separate thread
+    if (optionsMap["threads"].as<unsigned>() > 1 or optionsMap.count("serve"))
+        ROOT::EnableThreadSafety();
+    
+    if (optionsMap.count("trace-output"))
+        StartTracing(optionsMap["trace-output"].as<string>());
     
-    if (optionsMap.count("photonjet-run1"))
-        measurements.emplace_back(new PhotonJetRun1(optionsMap["photonjet-run1"].as<string>(),
-          (useMPF) ? PhotonJetRun1::Method::MPF : PhotonJetRun1::Method::PtBal));
+    if (optionsMap.count("batch"))
+        return ReportInstrumentation(optionsMap, RunBatch(optionsMap));
     
-    if (optionsMap.count("photonjet-binnedsum"))
-        measurements.emplace_back(new PhotonJetBinnedSum(
-          optionsMap["photonjet-binnedsum"].as<string>(),
-          (useMPF) ? PhotonJetBinnedSum::Method::MPF : PhotonJetBinnedSum::Method::PtBal));
+    if (optionsMap.count("eta-config"))
+        return ReportInstrumentation(optionsMap, RunMultiEtaFit(optionsMap, useMPF));
     
-    if (optionsMap.count("zjet-run1"))
-        measurements.emplace_back(new ZJetRun1(optionsMap["zjet-run1"].as<string>(),
-          (useMPF) ? ZJetRun1::Method::MPF : ZJetRun1::Method::PtBal));
     
-    if (optionsMap.count("multijet-binnedsum"))
-        measurements.emplace_back(new MultijetBinnedSum(
-          optionsMap["multijet-binnedsum"].as<string>(),
-          (useMPF) ? MultijetBinnedSum::Method::MPF : MultijetBinnedSum::Method::PtBal));
+    // Collect descriptions of all requested measurements
+    vector<pair<string, string>> descriptions;
     
-    if (measurements.empty())
+    for (auto const &type: GetMeasurementTypes())
+    {
+        if (optionsMap.count(type.first))
+            descriptions.emplace_back(type.first, optionsMap[type.first].as<string>());
+    }
+    
+    if (descriptions.empty())
     {
         cerr << "No measurements requested.\n";
         return EXIT_FAILURE;
     }
     
+    unsigned const numStarts = optionsMap["multi-start"].as<unsigned>();
+    string const triggerBins(optionsMap["trigger-bins"].as<string>());
     
-    // Construct an object to evaluate the loss function
-    auto jetCorr = make_unique<JetCorrStd2P>();
-    CombLossFunction lossFunc(move(jetCorr));
     
-    for (auto const &measurement: measurements)
-        lossFunc.AddMeasurement(measurement.get());
+    // Look up the result in the cache if requested. The key is computed from digests of the input
+    //files, so this is done before the inputs are read, and on a hit they are only read if the
+    //loss function is needed after the fit. The key includes all settings that affect the
+    //minimization.
+    unique_ptr<ResultCache> cache;
+    CacheKey cacheKey;
+    FitResult fitResult;
+    unsigned ndf = 0;
+    bool cached = false;
+    
+    if (optionsMap.count("cache-dir") and not optionsMap.count("serve"))
+    {
+        cache = make_unique<ResultCache>(optionsMap["cache-dir"].as<string>());
+        cacheKey = CreateCacheKey((useMPF) ? "mpf" : "ptbal",
+          optionsMap["correction"].as<string>(), triggerBins, descriptions,
+          ComputeInputDigests(descriptions, optionsMap["threads"].as<unsigned>()));
+        cacheKey.Add((numStarts > 1) ? "multi-start" : "fitter");
+        
+        if (numStarts > 1)
+        {
+            cacheKey.Add(double(numStarts));
+            cacheKey.Add(optionsMap["multi-start-width"].as<double>());
+            cacheKey.Add(optionsMap["multi-start-margin"].as<double>());
+        }
+        
+        if (optionsMap.count("start-from"))
+            cacheKey.Add(ComputeFileDigest(optionsMap["start-from"].as<string>()));
+        
+        if (not optionsMap.count("force-fit"))
+            cached = cache->Load(cacheKey, fitResult, ndf);
+    }
     
-    unsigned const nPars = lossFunc.GetNumParams();
     
+    // Construct all requested measurements unless the fit is cached and nothing else needs the
+    //loss function. Their inputs are read concurrently.
+    vector<unique_ptr<MeasurementBase>> measurements;
+    unique_ptr<CombLossFunction> lossFunc;
     
-    // Create minimizer
-    ROOT::Minuit2::Minuit2Minimizer minimizer;
-    ROOT::Math::Functor func(&lossFunc, &CombLossFunction::EvalRawInput, nPars);
-    minimizer.SetFunction(func);
-    minimizer.SetStrategy(2);   // high quality
-    minimizer.SetErrorDef(1.);  // error level for a chi2 function
-    minimizer.SetPrintLevel(3);
+    if (not cached or optionsMap.count("report") or optionsMap["toys"].as<unsigned>() > 0)
+    {
+        TraceSpan readingSpan("fit", "fit: reading inputs");
+        measurements = CreateMeasurements(descriptions, useMPF,
+          optionsMap["threads"].as<unsigned>());
+        readingSpan.Finish();
+        
+        for (auto const &measurement: measurements)
+            ApplyTriggerBinRange(*measurement, triggerBins);
+        
+        lossFunc = make_unique<CombLossFunction>(
+          CreateJetCorr(optionsMap["correction"].as<string>()));
+        
+        for (auto const &measurement: measurements)
+            lossFunc->AddMeasurement(measurement.get());
+        
+        // With multiple starting points, the threads are used to run the minimizer from them in
+        //parallel instead
+        if (numStarts <= 1)
+        {
+            lossFunc->SetNumThreads(optionsMap["threads"].as<unsigned>());
+            
+            for (auto const &measurement: measurements)
+                measurement->SetThreadPool(lossFunc->GetThreadPool());
+        }
+        
+        ndf = lossFunc->GetNDF();
+    }
     
     
-    // Initial point
-    for (unsigned i = 0; i < nPars; ++i)
-        minimizer.SetVariable(i, "p" + to_string(i), 0., 1e-2);
+    // In the server mode the loss function is kept in memory, and requests are served until a
+    //client asks to shut down
+    if (optionsMap.count("serve"))
+    {
+        string const socketPath(optionsMap["serve"].as<string>());
+        FitServer server(*lossFunc);
+        cout << "Serving requests on socket \"" << socketPath << "\"." << endl;
+        server.Serve(socketPath);
+        return EXIT_SUCCESS;
+    }
     
     
     // Run minimization
-    minimizer.Minimize();
+    TraceSpan minimizationSpan("fit", "fit: minimization");
+    
+    if (cached)
+    {
+        cout << "Result found in the cache in file \"" << cache->GetPath(cacheKey) << "\".\n";
+        
+        if (optionsMap.count("checkpoint"))
+            SaveFitResult(fitResult, optionsMap["checkpoint"].as<string>());
+    }
+    else if (numStarts > 1)
+    {
+        MultiStartFitter fitter(*lossFunc);
+        fitter.SetNumStarts(numStarts);
+        fitter.SetNumThreads(optionsMap["threads"].as<unsigned>());
+        fitter.SetWidth(optionsMap["multi-start-width"].as<double>());
+        fitter.SetCancelMargin(optionsMap["multi-start-margin"].as<double>());
+        
+        if (optionsMap.count("start-from"))
+            fitter.SetCenter(LoadFitResult(optionsMap["start-from"].as<string>()));
+        
+        MultiStartResult const multiStartResult = fitter.Fit();
+        fitResult = multiStartResult.GetBest();
+        
+        if (optionsMap.count("checkpoint"))
+            SaveFitResult(fitResult, optionsMap["checkpoint"].as<string>());
+        
+        
+        // Print a summary of individual runs
+        cout << "\n\e[1mRuns from " << numStarts << " starting points\e[0m:\n";
+        
+        for (unsigned iRun = 0; iRun < numStarts; ++iRun)
+        {
+            auto const &run = multiStartResult.runs[iRun];
+            cout << "  #" << iRun << ": ";
+            
+            if (run.cancelled)
+                cout << "cancelled, best value " << run.result.minValue;
+            else
+                cout << "status " << run.result.status << ", minimum " << run.result.minValue;
+            
+            cout << " after " << run.result.numCalls << " evaluations\n";
+        }
+        
+        auto const distinctMinima = multiStartResult.GetDistinctMinima();
+        cout << "  Distinct local minima found: " << distinctMinima.size() << '\n';
+        
+        if (not distinctMinima.empty())
+            cout << "  Spread of local minima: " <<
+              multiStartResult.runs[distinctMinima.back()].result.minValue -
+              multiStartResult.runs[distinctMinima.front()].result.minValue << '\n';
+        
+        cout << "  Cancelled runs: " << multiStartResult.GetNumCancelled() << '\n';
+        cout << "  Best run: #" << multiStartResult.bestIndex << '\n';
+    }
+    else
+    {
+        Fitter fitter(*lossFunc);
+        fitter.SetPrintLevel(3);
+        
+        if (optionsMap.count("start-from"))
+            fitter.SetStartingPoint(LoadFitResult(optionsMap["start-from"].as<string>()));
+        
+        if (optionsMap.count("checkpoint"))
+            fitter.SetCheckpoint(optionsMap["checkpoint"].as<string>(),
+              optionsMap["checkpoint-period"].as<unsigned>());
+        
+        fitResult = fitter.Fit();
+    }
+    
+    if (cache and not cached)
+        cache->Store(cacheKey, fitResult, ndf);
+    
+    minimizationSpan.Finish();
     
     
     // Print results
     cout << "\n\n\e[1mSummary\e[0m:\n";
-    cout << "  Status: " << minimizer.Status() << '\n';
-    cout << "  Covariance matrix status: " << minimizer.CovMatrixStatus() << '\n';
-    cout << "  Minimal value: " << minimizer.MinValue() << '\n';
-    cout << "  NDF: " << lossFunc.GetNDF() << '\n';
+    cout << "  Status: " << fitResult.status << '\n';
+    cout << "  Covariance matrix status: " << fitResult.covStatus << '\n';
+    cout << "  Minimal value: " << fitResult.minValue << '\n';
+    cout << "  NDF: " << ndf << '\n';
+    cout << "  Number of evaluations: " << fitResult.numCalls << '\n';
     
-    double const pValue = TMath::Prob(minimizer.MinValue(), lossFunc.GetNDF());
+    double const pValue = TMath::Prob(fitResult.minValue, ndf);
     cout << "  p-value: " << pValue << '\n';
     
-    double const *results = minimizer.X();
-    double const *errors = minimizer.Errors();
+    unsigned const nPars = fitResult.values.size();
+    double const *results = fitResult.values.data();
+    double const *errors = fitResult.errors.data();
     cout << "  Parameters:\n";
     
     for (unsigned i = 0; i < nPars; ++i)
-        cout << "    " << minimizer.VariableName(i) << ":  " << results[i] << " +- " <<
+        cout << "    " << fitResult.names[i] << ":  " << results[i] << " +- " <<
           errors[i] << "\n";
     
     
@@ -163,19 +1009,67 @@ int main(int argc, char **argv)
     for (unsigned i = 0; i < nPars; ++i)
     {
         for (unsigned j = 0; j < nPars; ++j)
-            resFile << minimizer.CovMatrix(i, j) << " ";
+            resFile << fitResult.covariance[i * nPars + j] << " ";
         
         resFile << '\n';
     }
     
     resFile << "\n# Minimal chi^2, NDF, p-value:\n";
-    resFile << minimizer.MinValue() << " " << lossFunc.GetNDF() << " " << pValue << '\n';
+    resFile << fitResult.minValue << " " << ndf << " " << pValue << '\n';
     
     resFile.close();
     
     
     cout << "\nResults saved to file \"" << resFileName << "\".\n";
     
+    if (optionsMap.count("report"))
+    {
+        vector<string> labels;
+        
+        for (auto const &description: descriptions)
+            labels.emplace_back(description.first + ":" + description.second);
+        
+        string const reportFileName(optionsMap["report"].as<string>());
+        SaveFitReport(fitResult, *lossFunc, labels, reportFileName);
+        cout << "Summary with per-bin pulls saved to file \"" << reportFileName << "\".\n";
+    }
     
-    return EXIT_SUCCESS;
+    
+    // Fit pseudo-experiments generated around the nominal inputs
+    unsigned const numToys = optionsMap["toys"].as<unsigned>();
+    
+    if (numToys > 0)
+    {
+        TraceSpan const toysSpan("fit", "fit: toys");
+        
+        // Threads are used to fit different toys in parallel, so each toy is evaluated serially
+        lossFunc->SetNumThreads(1);
+        
+        for (auto const &measurement: measurements)
+            measurement->SetThreadPool(nullptr);
+        
+        ToyFitter toyFitter(*lossFunc);
+        toyFitter.SetStartingPoint(fitResult);
+        toyFitter.SetSeed(optionsMap["toy-seed"].as<std::uint64_t>());
+        toyFitter.SetFirstToy(optionsMap["first-toy"].as<unsigned>());
+        toyFitter.SetNumThreads(optionsMap["threads"].as<unsigned>());
+        
+        string const toyFileName(optionsMap["toy-output"].as<string>());
+        ofstream toyFile(toyFileName);
+        
+        cout << "\nFitting " << numToys << " pseudo-experiments..." << endl;
+        toyFitter.Run(numToys, toyFile);
+        toyFile.close();
+        
+        cout << "Results for pseudo-experiments saved to file \"" << toyFileName << "\".\n";
+    }
+    
+    vector<pair<string, MeasurementBase const *>> labelledMeasurements;
+    
+    for (unsigned i = 0; i < measurements.size(); ++i)
+        labelledMeasurements.emplace_back(descriptions[i].first + " " + descriptions[i].second,
+          measurements[i].get());
+    
+    ReportTriggerBinMemory(labelledMeasurements);
+    return ReportInstrumentation(optionsMap, EXIT_SUCCESS);
 }
@@ -0,0 +1,134 @@
+/**
+ * Generates synthetic inputs for all measurements with a known jet correction injected into the
+ * data.
+ */
+
+#include <MeasurementFactory.hpp>
+#include <SyntheticFiles.hpp>
+#include <SyntheticInputs.hpp>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/program_options.hpp>
+
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+
+int main(int argc, char **argv)
+{
+    using namespace std;
+    namespace po = boost::program_options;
+    
+    
+    // Parse arguments
+    po::options_description options("Allowed options");
+    options.add_options()
+      ("help,h", "Prints help message")
+      ("output-dir,o", po::value<string>()->default_value("."),
+        "Existing directory for the output files")
+      ("seed,s", po::value<uint64_t>()->default_value(1), "Seed for random numbers")
+      ("correction", po::value<string>()->default_value("Std2P"),
+        "Form of the true jet correction, Std2P, Std3P, or StableLogLin")
+      ("truth", po::value<string>()->default_value("0.02,0.005"),
+        "Comma-separated parameters of the true jet correction")
+      ("measurements,m",
+        po::value<string>()->default_value(
+          "multijet-binnedsum,photonjet-binnedsum,photonjet-run1,zjet-run1"),
+        "Comma-separated types of measurements to generate")
+      ("trigger-bins", po::value<unsigned>()->default_value(8),
+        "Number of trigger bins in the multijet measurement")
+      ("sim-bins", po::value<unsigned>()->default_value(10),
+        "Number of simulation bins per trigger bin")
+      ("rebin", po::value<unsigned>()->default_value(4),
+        "Number of data bins per simulation bin")
+      ("pt-jet-bins", po::value<unsigned>()->default_value(60),
+        "Number of bins in pt of other jets")
+      ("events-per-bin", po::value<unsigned>()->default_value(500),
+        "Number of events per data bin")
+      ("sparsity", po::value<double>()->default_value(0.),
+        "Fraction of empty data bins");
+    
+    po::variables_map optionsMap;
+    
+    po::store(
+      po::command_line_parser(argc, argv).options(options).run(),
+      optionsMap);
+    po::notify(optionsMap);
+    
+    if (optionsMap.count("help"))
+    {
+        cerr << "Generates synthetic inputs for the measurements. The data are distorted by " <<
+          "the inverse of the given true jet correction, which should be recovered by a fit.\n";
+        cerr << "Usage: generate [options]\n";
+        cerr << options << endl;
+        return EXIT_FAILURE;
+    }
+    
+    
+    // Construct the true correction
+    auto trueCorrection = CreateJetCorr(optionsMap["correction"].as<string>());
+    vector<string> tokens;
+    boost::split(tokens, optionsMap["truth"].as<string>(), boost::is_any_of(","));
+    vector<double> params;
+    
+    for (auto const &token: tokens)
+        params.emplace_back(stod(token));
+    
+    if (params.size() != trueCorrection->GetNumParams())
+    {
+        cerr << "Jet correction \"" << optionsMap["correction"].as<string>() << "\" has " <<
+          trueCorrection->GetNumParams() << " parameters while " << params.size() <<
+          " are given.\n";
+        return EXIT_FAILURE;
+    }
+    
+    trueCorrection->SetParams(params);
+    
+    
+    // Set up the generator
+    SyntheticInputGenerator generator(*trueCorrection, optionsMap["seed"].as<uint64_t>());
+    generator.SetNumTriggerBins(optionsMap["trigger-bins"].as<unsigned>());
+    generator.SetBinning(optionsMap["sim-bins"].as<unsigned>(),
+      optionsMap["rebin"].as<unsigned>(), optionsMap["pt-jet-bins"].as<unsigned>());
+    generator.SetNumEventsPerBin(optionsMap["events-per-bin"].as<unsigned>());
+    generator.SetSparsity(optionsMap["sparsity"].as<double>());
+    
+    
+    // Write the requested files
+    using Writer = function<void(SyntheticInputGenerator const &, string const &)>;
+    map<string, pair<string, Writer>> const writers{
+      {"multijet-binnedsum", {"multijet_BinnedSum.root", WriteMultijetFile}},
+      {"photonjet-binnedsum", {"photonjet_BinnedSum.root", WritePhotonJetFile}},
+      {"photonjet-run1", {"photonjet_Run1.root", WritePhotonJetRun1File}},
+      {"zjet-run1", {"Zjet_Run1.root", WriteZJetRun1File}}};
+    
+    vector<string> types;
+    boost::split(types, optionsMap["measurements"].as<string>(), boost::is_any_of(","));
+    string const outputDir(optionsMap["output-dir"].as<string>());
+    string fitOptions;
+    
+    for (auto const &type: types)
+    {
+        auto const writerIt = writers.find(type);
+        
+        if (writerIt == writers.end())
+        {
+            cerr << "Unsupported type of measurement \"" << type << "\".\n";
+            return EXIT_FAILURE;
+        }
+        
+        string const fileName(outputDir + "/" + writerIt->second.first);
+        writerIt->second.second(generator, fileName);
+        fitOptions += " --" + type + " " + fileName;
+    }
+    
+    cout << "Inputs written. Fit them with options" << fitOptions << " --correction " <<
+      optionsMap["correction"].as<string>() << "\n";
+    
+    return EXIT_SUCCESS;
+}
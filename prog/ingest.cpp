@@ -0,0 +1,113 @@
+/**
+ * Builds inputs of the multijet measurement directly from event-level ntuples and saves them as a
+ * snapshot that can be given to the fit.
+ */
+
+#include <EventIngestion.hpp>
+#include <HistFlattening.hpp>
+#include <MultijetBinnedSum.hpp>
+
+#include <TROOT.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/program_options.hpp>
+
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+
+
+int main(int argc, char **argv)
+{
+    using namespace std;
+    namespace po = boost::program_options;
+    
+    
+    // Parse arguments
+    po::options_description options("Allowed options");
+    options.add_options()
+      ("help,h", "Prints help message")
+      ("binning", po::value<string>(), "Text file with binnings and jet pt threshold")
+      ("data", po::value<string>(), "Ntuple(s) in data, with optional weights as file@weight")
+      ("sim", po::value<string>(), "Ntuple(s) in simulation, with optional weights")
+      ("balance,b", po::value<string>()->default_value("PtBal"),
+        "Type of balance variable, PtBal or MPF")
+      ("output,o", po::value<string>(), "Name for the snapshot file")
+      ("tree", po::value<string>()->default_value("Events"), "Name of trees in all files")
+      ("chunk-size", po::value<unsigned>()->default_value(10000),
+        "Number of events read at a time")
+      ("partitions", po::value<unsigned>()->default_value(16),
+        "Number of partitions of each file processed independently")
+      ("threads,j", po::value<unsigned>()->default_value(1),
+        "Number of threads to read the input files");
+    
+    po::variables_map optionsMap;
+    
+    po::store(
+      po::command_line_parser(argc, argv).options(options).run(),
+      optionsMap);
+    po::notify(optionsMap);
+    
+    if (optionsMap.count("help"))
+    {
+        cerr << "Aggregates event-level ntuples into inputs of the multijet measurement and " <<
+          "saves them as a snapshot. See include/EventIngestion.hpp for the expected format.\n";
+        cerr << "Usage: ingest [options]\n";
+        cerr << options << endl;
+        return EXIT_FAILURE;
+    }
+    
+    
+    MultijetBinnedSum::Method method;
+    string balanceVar(optionsMap["balance"].as<string>());
+    boost::to_lower(balanceVar);
+    
+    if (balanceVar == "mpf")
+        method = MultijetBinnedSum::Method::MPF;
+    else if (balanceVar == "ptbal")
+        method = MultijetBinnedSum::Method::PtBal;
+    else
+    {
+        cerr << "Do not recognize balance variable \"" <<
+          optionsMap["balance"].as<string>() << "\".\n";
+        return EXIT_FAILURE;
+    }
+    
+    for (auto const &name: {"binning", "data", "sim", "output"})
+    {
+        if (not optionsMap.count(name))
+        {
+            cerr << "Mandatory option \"--" << name << "\" is missing.\n";
+            return EXIT_FAILURE;
+        }
+    }
+    
+    unsigned const numThreads = optionsMap["threads"].as<unsigned>();
+    
+    if (numThreads > 1)
+        ROOT::EnableThreadSafety();
+    
+    
+    // Aggregate the events and save the resulting measurement
+    auto const startTime = chrono::steady_clock::now();
+    
+    MultijetIngestion ingestion(ReadIngestionBinning(optionsMap["binning"].as<string>()), method);
+    ingestion.SetTreeName(optionsMap["tree"].as<string>());
+    ingestion.SetChunkSize(optionsMap["chunk-size"].as<unsigned>());
+    ingestion.SetNumPartitions(optionsMap["partitions"].as<unsigned>());
+    
+    MultijetBinnedSum measurement(ingestion.Run(
+      ParseFileList(optionsMap["data"].as<string>()),
+      ParseFileList(optionsMap["sim"].as<string>()), numThreads), method);
+    
+    string const outputName(optionsMap["output"].as<string>());
+    measurement.SaveSnapshot(outputName);
+    double const duration =
+      chrono::duration<double>(chrono::steady_clock::now() - startTime).count();
+    
+    cout << "Snapshot with " << measurement.GetDim() << " bins written to \"" << outputName <<
+      "\" in " << duration << " s.\n";
+    
+    return EXIT_SUCCESS;
+}
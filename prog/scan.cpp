@@ -0,0 +1,160 @@
+/**
+ * Scans the combined loss function on a grid of parameters of the jet correction and nuisances.
+ */
+
+#include <FitBase.hpp>
+#include <Fitter.hpp>
+#include <LossScan.hpp>
+#include <MeasurementFactory.hpp>
+
+#include <TROOT.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/program_options.hpp>
+
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+int main(int argc, char **argv)
+{
+    using namespace std;
+    namespace po = boost::program_options;
+    
+    
+    // Parse arguments
+    po::options_description options("Allowed options");
+    options.add_options()
+      ("help,h", "Prints help message")
+      ("balance,b", po::value<string>()->default_value("PtBal"),
+        "Type of balance variable, PtBal or MPF")
+      ("correction", po::value<string>()->default_value("Std2P"),
+        "Form of the jet correction, Std2P, Std3P, or StableLogLin")
+      ("axis,a", po::value<vector<string>>(),
+        "Axis of the grid, given as name:min:max:numPoints; the name is p0, p1, etc. for "
+        "parameters of the jet correction or the name of a nuisance")
+      ("profile", "Minimize the loss function with respect to parameters that are not scanned")
+      ("start-from", po::value<string>(),
+        "Results of a fit that define central values of parameters that are not scanned")
+      ("surrogate", po::value<double>(),
+        "Compute losses within the trust region of a polynomial surrogate of the loss function, "
+        "built around the result given with --start-from, with the given tolerance")
+      ("output,o", po::value<string>()->default_value("scan.bin"),
+        "Name for binary output file with results of the scan")
+      ("threads,j", po::value<unsigned>()->default_value(1), "Number of threads to use");
+    
+    for (auto const &type: GetMeasurementTypes())
+        options.add_options()(type.first.c_str(), po::value<string>(), type.second.c_str());
+    
+    po::variables_map optionsMap;
+    
+    po::store(
+      po::command_line_parser(argc, argv).options(options).run(),
+      optionsMap);
+    po::notify(optionsMap);
+    
+    if (optionsMap.count("help"))
+    {
+        cerr << "Scans the combined loss function on a grid.\n";
+        cerr << "Usage: scan [options]\n";
+        cerr << options << endl;
+        return EXIT_FAILURE;
+    }
+    
+    
+    bool useMPF = false;
+    string balanceVar(optionsMap["balance"].as<string>());
+    boost::to_lower(balanceVar);
+    
+    if (balanceVar == "mpf")
+        useMPF = true;
+    else if (balanceVar != "ptbal")
+    {
+        cerr << "Do not recognize balance variable \"" <<
+          optionsMap["balance"].as<string>() << "\".\n";
+        return EXIT_FAILURE;
+    }
+    
+    if (not optionsMap.count("axis"))
+    {
+        cerr << "No axes of the grid given.\n";
+        return EXIT_FAILURE;
+    }
+    
+    unsigned const numThreads = optionsMap["threads"].as<unsigned>();
+    
+    if (numThreads > 1)
+        ROOT::EnableThreadSafety();
+    
+    
+    // Construct all requested measurements and the loss function
+    vector<pair<string, string>> descriptions;
+    
+    for (auto const &type: GetMeasurementTypes())
+    {
+        if (optionsMap.count(type.first))
+            descriptions.emplace_back(type.first, optionsMap[type.first].as<string>());
+    }
+    
+    auto const measurements = CreateMeasurements(descriptions, useMPF, numThreads);
+    
+    if (measurements.empty())
+    {
+        cerr << "No measurements requested.\n";
+        return EXIT_FAILURE;
+    }
+    
+    CombLossFunction lossFunc(CreateJetCorr(optionsMap["correction"].as<string>()));
+    
+    for (auto const &measurement: measurements)
+        lossFunc.AddMeasurement(measurement.get());
+    
+    
+    // Set up the scan
+    LossScan scan(lossFunc);
+    scan.SetNumThreads(numThreads);
+    scan.SetProfiling(optionsMap.count("profile"));
+    
+    if (optionsMap.count("surrogate"))
+        scan.SetSurrogate(optionsMap["surrogate"].as<double>());
+    
+    if (optionsMap.count("start-from"))
+        scan.SetCentralValues(LoadFitResult(optionsMap["start-from"].as<string>()));
+    
+    for (auto const &axisText: optionsMap["axis"].as<vector<string>>())
+    {
+        vector<string> tokens;
+        boost::split(tokens, axisText, boost::is_any_of(":"));
+        
+        if (tokens.size() != 4)
+        {
+            cerr << "Failed to parse axis \"" << axisText << "\".\n";
+            return EXIT_FAILURE;
+        }
+        
+        scan.AddAxis(tokens[0], stod(tokens[1]), stod(tokens[2]), stoul(tokens[3]));
+    }
+    
+    
+    // Run the scan and save results
+    auto const startTime = chrono::steady_clock::now();
+    ScanResult const result = scan.Run();
+    double const duration =
+      chrono::duration<double>(chrono::steady_clock::now() - startTime).count();
+    
+    cout << "Evaluated " << result.GetNumPoints() << " points in " << duration << " s.\n";
+    
+    if (optionsMap.count("surrogate"))
+        cout << result.numSurrogatePoints << " of them computed with the surrogate.\n";
+    
+    string const outputFileName(optionsMap["output"].as<string>());
+    SaveScanResult(result, outputFileName);
+    cout << "Results saved to file \"" << outputFileName << "\".\n";
+    
+    
+    return EXIT_SUCCESS;
+}
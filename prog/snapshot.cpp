@@ -0,0 +1,117 @@
+/**
+ * Converts inputs of a measurement into a snapshot that can be memory-mapped by the fit.
+ */
+
+#include <FitBase.hpp>
+#include <MeasurementFactory.hpp>
+
+#include <TROOT.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/program_options.hpp>
+
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+
+
+int main(int argc, char **argv)
+{
+    using namespace std;
+    namespace po = boost::program_options;
+    
+    
+    // Parse arguments
+    po::options_description options("Allowed options");
+    options.add_options()
+      ("help,h", "Prints help message")
+      ("balance,b", po::value<string>()->default_value("PtBal"),
+        "Type of balance variable, PtBal or MPF")
+      ("output,o", po::value<string>(), "Name for the snapshot file")
+      ("threads,j", po::value<unsigned>()->default_value(1),
+        "Number of threads to read the input file");
+    
+    for (auto const &type: GetMeasurementTypes())
+        options.add_options()(type.first.c_str(), po::value<string>(), type.second.c_str());
+    
+    po::variables_map optionsMap;
+    
+    po::store(
+      po::command_line_parser(argc, argv).options(options).run(),
+      optionsMap);
+    po::notify(optionsMap);
+    
+    if (optionsMap.count("help"))
+    {
+        cerr << "Converts inputs of a single measurement into a snapshot. The snapshot can be " <<
+          "given to the fit in place of the original input file.\n";
+        cerr << "Usage: snapshot [options]\n";
+        cerr << options << endl;
+        return EXIT_FAILURE;
+    }
+    
+    
+    bool useMPF = false;
+    string balanceVar(optionsMap["balance"].as<string>());
+    boost::to_lower(balanceVar);
+    
+    if (balanceVar == "mpf")
+        useMPF = true;
+    else if (balanceVar != "ptbal")
+    {
+        cerr << "Do not recognize balance variable \"" <<
+          optionsMap["balance"].as<string>() << "\".\n";
+        return EXIT_FAILURE;
+    }
+    
+    if (not optionsMap.count("output"))
+    {
+        cerr << "No output file given.\n";
+        return EXIT_FAILURE;
+    }
+    
+    unsigned const numThreads = optionsMap["threads"].as<unsigned>();
+    
+    if (numThreads > 1)
+        ROOT::EnableThreadSafety();
+    
+    
+    // Find the requested measurement. Exactly one must be given.
+    string type, fileName;
+    
+    for (auto const &t: GetMeasurementTypes())
+    {
+        if (not optionsMap.count(t.first))
+            continue;
+        
+        if (not type.empty())
+        {
+            cerr << "Only one measurement can be converted at a time.\n";
+            return EXIT_FAILURE;
+        }
+        
+        type = t.first;
+        fileName = optionsMap[t.first].as<string>();
+    }
+    
+    if (type.empty())
+    {
+        cerr << "No measurement requested.\n";
+        return EXIT_FAILURE;
+    }
+    
+    
+    // Read and preprocess the inputs and save them
+    auto const startTime = chrono::steady_clock::now();
+    auto const measurement = CreateMeasurement(type, fileName, useMPF, numThreads);
+    string const outputName(optionsMap["output"].as<string>());
+    measurement->SaveSnapshot(outputName);
+    double const duration =
+      chrono::duration<double>(chrono::steady_clock::now() - startTime).count();
+    
+    cout << "Snapshot of measurement \"" << type << "\" written to \"" << outputName << "\" in " <<
+      duration << " s.\n";
+    
+    return EXIT_SUCCESS;
+}
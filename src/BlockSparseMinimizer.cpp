@@ -0,0 +1,278 @@
+#include <BlockSparseMinimizer.hpp>
+
+#include <LinearAlgebra.hpp>
+#include <Parallel.hpp>
+
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+
+
+BlockFitResult::BlockFitResult():
+    FitResult(),
+    numIterations(0)
+{}
+
+
+BlockSparseMinimizer::BlockSparseMinimizer(MultiEtaLossFunction const &lossFunc_):
+    lossFunc(lossFunc_),
+    stepSize(1e-3),
+    tolerance(1e-4),
+    maxIterations(100),
+    printLevel(0)
+{}
+
+
+BlockFitResult BlockSparseMinimizer::Minimize()
+{
+    unsigned const nPars = lossFunc.GetNumParams();
+    unsigned const nBins = lossFunc.GetNumEtaBins();
+    
+    std::vector<double> x(start);
+    
+    if (x.empty())
+        x.assign(nPars, 0.);
+    else if (x.size() != nPars)
+    {
+        std::ostringstream message;
+        message << "BlockSparseMinimizer::Minimize: Starting point contains " << x.size() <<
+          " parameters while " << nPars << " are expected.";
+        throw std::runtime_error(message.str());
+    }
+    
+    BlockFitResult result;
+    result.status = 1;
+    
+    std::vector<unsigned> blockSizes(nBins);
+    
+    for (unsigned k = 0; k < nBins; ++k)
+        blockSizes[k] = lossFunc.GetBlockSize(k);
+    
+    std::vector<double> gradient;
+    std::vector<std::vector<double>> diagBlocks, offDiagBlocks;
+    double loss = ComputeDerivatives(x, gradient, diagBlocks, offDiagBlocks, result.numCalls);
+    
+    std::vector<double> step(nPars), xTrial(nPars);
+    double lambda = 0.;
+    
+    for (; result.numIterations < maxIterations; ++result.numIterations)
+    {
+        // Compute the undamped Newton step and estimate the distance to the minimum
+        for (unsigned i = 0; i < nPars; ++i)
+            step[i] = -gradient[i];
+        
+        bool const isPosDef =
+          SolveBlockTridiagonal(blockSizes, diagBlocks, offDiagBlocks, 0., step);
+        result.edm = std::numeric_limits<double>::infinity();
+        
+        if (isPosDef)
+        {
+            result.edm = 0.;
+            
+            for (unsigned i = 0; i < nPars; ++i)
+                result.edm -= 0.5 * gradient[i] * step[i];
+            
+            if (result.edm < tolerance)
+            {
+                result.status = 0;
+                break;
+            }
+        }
+        else if (lambda == 0.)
+            lambda = 1e-3;
+        
+        
+        // Try to make a step that decreases the loss function, increasing the damping if needed
+        bool accepted = false;
+        double lossTrial = loss;
+        
+        for (unsigned attempt = 0; attempt < 20; ++attempt)
+        {
+            if (lambda > 0.)
+            {
+                for (unsigned i = 0; i < nPars; ++i)
+                    step[i] = -gradient[i];
+                
+                if (not SolveBlockTridiagonal(blockSizes, diagBlocks, offDiagBlocks, lambda, step))
+                {
+                    lambda *= 10.;
+                    continue;
+                }
+            }
+            
+            for (unsigned i = 0; i < nPars; ++i)
+                xTrial[i] = x[i] + step[i];
+            
+            lossTrial = lossFunc.EvalRawInput(xTrial.data());
+            result.numCalls += nBins;
+            
+            if (lossTrial < loss)
+            {
+                accepted = true;
+                lambda = (lambda > 1e-5) ? lambda / 10. : 0.;
+                break;
+            }
+            
+            lambda = (lambda > 0.) ? lambda * 10. : 1e-3;
+        }
+        
+        if (not accepted)
+        {
+            result.status = 2;
+            break;
+        }
+        
+        if (printLevel > 0)
+            std::cout << "BlockSparseMinimizer: Iteration " << result.numIterations <<
+              ", loss " << loss << " -> " << lossTrial << ", EDM " << result.edm <<
+              ", damping " << lambda << std::endl;
+        
+        x = xTrial;
+        loss = ComputeDerivatives(x, gradient, diagBlocks, offDiagBlocks, result.numCalls);
+    }
+    
+    
+    // Compute diagonal blocks of the covariance matrix. For a chi^2 loss function it is given by
+    //twice the inverse of the Hessian.
+    result.minValue = loss;
+    result.values = x;
+    result.errors.assign(nPars, 0.);
+    result.covStatus = 0;
+    
+    for (unsigned i = 0; i < nPars; ++i)
+        step[i] = -gradient[i];
+    
+    if (SolveBlockTridiagonal(blockSizes, diagBlocks, offDiagBlocks, 0., step,
+      &result.blockCovariances))
+    {
+        result.covStatus = 3;
+        
+        for (unsigned k = 0; k < nBins; ++k)
+        {
+            unsigned const size = lossFunc.GetBlockSize(k);
+            unsigned const offset = lossFunc.GetBlockOffset(k);
+            
+            for (auto &c: result.blockCovariances[k])
+                c *= 2.;
+            
+            for (unsigned i = 0; i < size; ++i)
+                result.errors[offset + i] = std::sqrt(result.blockCovariances[k][i * size + i]);
+        }
+    }
+    else
+        result.blockCovariances.clear();
+    
+    for (unsigned k = 0; k < nBins; ++k)
+        for (unsigned i = 0; i < lossFunc.GetBlockSize(k); ++i)
+            result.names.emplace_back(lossFunc.GetLabel(k) + "/p" + std::to_string(i));
+    
+    return result;
+}
+
+
+void BlockSparseMinimizer::SetMaxIterations(unsigned maxIterations_)
+{
+    maxIterations = maxIterations_;
+}
+
+
+void BlockSparseMinimizer::SetPrintLevel(int printLevel_)
+{
+    printLevel = printLevel_;
+}
+
+
+void BlockSparseMinimizer::SetStartingPoint(std::vector<double> const &start_)
+{
+    start = start_;
+}
+
+
+void BlockSparseMinimizer::SetStepSize(double stepSize_)
+{
+    stepSize = stepSize_;
+}
+
+
+void BlockSparseMinimizer::SetTolerance(double tolerance_)
+{
+    tolerance = tolerance_;
+}
+
+
+double BlockSparseMinimizer::ComputeDerivatives(std::vector<double> const &x,
+  std::vector<double> &gradient, std::vector<std::vector<double>> &diagBlocks,
+  std::vector<std::vector<double>> &offDiagBlocks, unsigned &numCalls) const
+{
+    unsigned const nBins = lossFunc.GetNumEtaBins();
+    double const h = stepSize;
+    
+    gradient.assign(x.size(), 0.);
+    diagBlocks.resize(nBins);
+    offDiagBlocks.resize((nBins > 0) ? nBins - 1 : 0);
+    
+    for (unsigned k = 0; k + 1 < nBins; ++k)
+        offDiagBlocks[k].assign(lossFunc.GetBlockSize(k) * lossFunc.GetBlockSize(k + 1), 0.);
+    
+    std::vector<double> blockLosses(nBins);
+    std::vector<unsigned> blockCalls(nBins, 0);
+    
+    
+    // Compute derivatives for each bin in eta varying only its own parameters. Use central
+    //differences for both the gradient and the Hessian.
+    RunTasks(lossFunc.GetThreadPool().get(), nBins, [&](unsigned k)
+    {
+        unsigned const size = lossFunc.GetBlockSize(k);
+        unsigned const offset = lossFunc.GetBlockOffset(k);
+        std::vector<double> p(x.begin() + offset, x.begin() + offset + size);
+        
+        auto const evalShifted = [&](unsigned i, double di, unsigned j, double dj)
+        {
+            p[i] += di;
+            p[j] += dj;
+            double const value = lossFunc.EvalBlock(k, p.data());
+            std::copy(x.begin() + offset, x.begin() + offset + size, p.begin());
+            ++blockCalls[k];
+            return value;
+        };
+        
+        double const f0 = lossFunc.EvalBlock(k, p.data());
+        ++blockCalls[k];
+        
+        auto &hessian = diagBlocks[k];
+        hessian.assign(size * size, 0.);
+        
+        for (unsigned i = 0; i < size; ++i)
+        {
+            double const fPlus = evalShifted(i, h, i, 0.);
+            double const fMinus = evalShifted(i, -h, i, 0.);
+            
+            gradient[offset + i] = (fPlus - fMinus) / (2 * h);
+            hessian[i * size + i] = (fPlus - 2 * f0 + fMinus) / (h * h);
+        }
+        
+        for (unsigned i = 0; i < size; ++i)
+            for (unsigned j = i + 1; j < size; ++j)
+            {
+                double const d2 = (evalShifted(i, h, j, h) - evalShifted(i, h, j, -h) -
+                  evalShifted(i, -h, j, h) + evalShifted(i, -h, j, -h)) / (4 * h * h);
+                hessian[i * size + j] = hessian[j * size + i] = d2;
+            }
+        
+        blockLosses[k] = f0;
+    });
+    
+    
+    double loss = 0.;
+    
+    for (unsigned k = 0; k < nBins; ++k)
+    {
+        loss += blockLosses[k];
+        numCalls += blockCalls[k];
+    }
+    
+    lossFunc.AddConstraintDerivatives(x.data(), gradient, diagBlocks, offDiagBlocks);
+    return loss + lossFunc.EvalConstraints(x.data());
+}
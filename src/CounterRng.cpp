@@ -0,0 +1,127 @@
+#include <CounterRng.hpp>
+
+#include <cmath>
+
+
+namespace
+{
+/// Computes the full 64-bit product of two 32-bit numbers and splits it into two halves
+inline void MultiplyHiLo(std::uint32_t a, std::uint32_t b, std::uint32_t &hi, std::uint32_t &lo)
+{
+    std::uint64_t const product = std::uint64_t(a) * b;
+    hi = product >> 32;
+    lo = std::uint32_t(product);
+}
+}
+
+
+CounterRng::CounterRng(std::uint64_t seed, std::uint32_t stream0, std::uint32_t stream1):
+    key{{std::uint32_t(seed), std::uint32_t(seed >> 32)}},
+    counter{{0, 0, stream0, stream1}},
+    numUsed(4)
+{}
+
+
+double CounterRng::Gaus(double mean, double sigma)
+{
+    // Box-Muller transform. Only one of the two produced numbers is used, which keeps the state
+    //of the generator trivial.
+    double const u1 = Uniform();
+    double const u2 = Uniform();
+    
+    return mean + sigma * std::sqrt(-2. * std::log(u1)) * std::cos(2. * M_PI * u2);
+}
+
+
+std::uint32_t CounterRng::Next()
+{
+    if (numUsed == 4)
+        Refill();
+    
+    return block[numUsed++];
+}
+
+
+unsigned long CounterRng::Poisson(double mean)
+{
+    if (mean <= 0.)
+        return 0;
+    
+    if (mean < 10.)
+    {
+        // Multiplication method
+        double const threshold = std::exp(-mean);
+        double product = Uniform();
+        unsigned long k = 0;
+        
+        while (product > threshold)
+        {
+            product *= Uniform();
+            ++k;
+        }
+        
+        return k;
+    }
+    
+    
+    // Transformed rejection method PTRS
+    double const sqrtMean = std::sqrt(mean);
+    double const logMean = std::log(mean);
+    double const b = 0.931 + 2.53 * sqrtMean;
+    double const a = -0.059 + 0.02483 * b;
+    double const invAlpha = 1.1239 + 1.1328 / (b - 3.4);
+    double const vr = 0.9277 - 3.6224 / (b - 2.);
+    
+    while (true)
+    {
+        double const u = Uniform() - 0.5;
+        double const v = Uniform();
+        double const us = 0.5 - std::abs(u);
+        double const k = std::floor((2. * a / us + b) * u + mean + 0.43);
+        
+        if (us >= 0.07 and v <= vr)
+            return k;
+        
+        if (k < 0. or (us < 0.013 and v > us))
+            continue;
+        
+        if (std::log(v) + std::log(invAlpha) - std::log(a / (us * us) + b) <=
+          -mean + k * logMean - std::lgamma(k + 1.))
+            return k;
+    }
+}
+
+
+double CounterRng::Uniform()
+{
+    // Combine two 32-bit numbers into 53 random bits and shift the result away from zero
+    std::uint64_t const hi = Next() >> 5, lo = Next() >> 6;
+    return ((hi << 26 | lo) + 0.5) / 9007199254740992.;  // 2^53
+}
+
+
+void CounterRng::Refill()
+{
+    std::array<std::uint32_t, 4> x(counter);
+    std::array<std::uint32_t, 2> k(key);
+    
+    for (unsigned round = 0; round < 10; ++round)
+    {
+        std::uint32_t hi0, lo0, hi1, lo1;
+        MultiplyHiLo(0xD2511F53, x[0], hi0, lo0);
+        MultiplyHiLo(0xCD9E8D57, x[2], hi1, lo1);
+        
+        x = {{hi1 ^ x[1] ^ k[0], lo1, hi0 ^ x[3] ^ k[1], lo0}};
+        
+        k[0] += 0x9E3779B9;
+        k[1] += 0xBB67AE85;
+    }
+    
+    block = x;
+    numUsed = 0;
+    
+    
+    // Advance the 64-bit part of the counter that enumerates numbers within the stream
+    if (++counter[0] == 0)
+        ++counter[1];
+}
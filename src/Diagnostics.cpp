@@ -0,0 +1,332 @@
+#include <Diagnostics.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+
+
+namespace
+{
+/// Maximal number of bins listed individually for each kind of problem in the summary
+unsigned const maxListedBins = 5;
+
+
+/// Occurrences of a problem in a single bin
+struct BinRecord
+{
+    /// Number of occurrences
+    std::uint64_t count;
+    
+    /// Sequence number of the first occurrence, which orders occurrences from different threads
+    std::uint64_t firstIndex;
+    
+    /// Context of the first occurrence
+    DiagnosticCounter::Context context;
+};
+
+
+/// Records indexed with counters and keys of bins
+using RecordMap = std::map<std::pair<DiagnosticCounter const *, std::uint64_t>, BinRecord>;
+
+
+/// Occurrences recorded in a single thread
+struct ThreadStore
+{
+    /// Mutex that protects the records; it is only contended while a summary is produced
+    std::mutex mutex;
+    
+    /// Records of all counters
+    RecordMap records;
+};
+
+
+/// Registry of all counters and storages of all threads
+struct Registry
+{
+    /// Mutex that protects the vectors and retired records (but not the content of the storages)
+    std::mutex mutex;
+    
+    /// Counters in the order of registration
+    std::vector<std::unique_ptr<DiagnosticCounter>> counters;
+    
+    /// Storages that are owned by threads now or have been owned in the past
+    std::vector<std::unique_ptr<ThreadStore>> stores;
+    
+    /// Storages released by exited threads; they are empty and can be given to new threads
+    std::vector<ThreadStore *> freeStores;
+    
+    /// Records from threads that have exited
+    RecordMap retired;
+};
+
+
+/**
+ * \struct ThreadStoreOwner
+ * \brief Holds the storage of a thread and retires it when the thread exits
+ * 
+ * Records of the exited thread are moved to the registry, and the storage is recycled. Without
+ * this, each short-lived thread would keep a storage for the whole lifetime of the program.
+ */
+struct ThreadStoreOwner
+{
+    /// Destructor that retires the storage
+    ~ThreadStoreOwner() noexcept;
+    
+    /// Storage of the thread, or null if the thread has not recorded any occurrences yet
+    ThreadStore *store = nullptr;
+};
+
+
+/// Returns the global registry
+Registry &GetRegistry()
+{
+    static Registry registry;
+    return registry;
+}
+
+
+/// Sequence number to be given to the next first occurrence in a bin
+std::atomic<std::uint64_t> nextFirstIndex(0);
+
+
+/// Owner of the storage of the calling thread
+thread_local ThreadStoreOwner threadStoreOwner;
+
+
+/// Returns the storage of the calling thread, creating it if needed
+ThreadStore &GetThreadStore()
+{
+    ThreadStore *&threadStore = threadStoreOwner.store;
+    
+    if (not threadStore)
+    {
+        Registry &registry = GetRegistry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        
+        if (not registry.freeStores.empty())
+        {
+            threadStore = registry.freeStores.back();
+            registry.freeStores.pop_back();
+        }
+        else
+        {
+            registry.stores.emplace_back(std::make_unique<ThreadStore>());
+            threadStore = registry.stores.back().get();
+        }
+    }
+    
+    return *threadStore;
+}
+
+
+/**
+ * \brief Adds records to the target map
+ * 
+ * Counts are summed, and the context of each bin is taken from its earliest occurrence.
+ */
+void MergeInto(RecordMap &target, RecordMap const &source)
+{
+    for (auto const &entry: source)
+    {
+        auto const res = target.emplace(entry);
+        
+        if (res.second)
+            continue;
+        
+        BinRecord &record = res.first->second;
+        record.count += entry.second.count;
+        
+        if (entry.second.firstIndex < record.firstIndex)
+        {
+            record.firstIndex = entry.second.firstIndex;
+            record.context = entry.second.context;
+        }
+    }
+}
+
+
+/**
+ * \brief Merges records from all threads, including the ones that have exited
+ * 
+ * The mutex of the registry must be locked by the caller.
+ */
+RecordMap MergeRecords(Registry &registry)
+{
+    RecordMap merged(registry.retired);
+    
+    for (auto const &store: registry.stores)
+    {
+        std::lock_guard<std::mutex> lock(store->mutex);
+        MergeInto(merged, store->records);
+    }
+    
+    return merged;
+}
+
+
+ThreadStoreOwner::~ThreadStoreOwner() noexcept
+{
+    if (not store)
+        return;
+    
+    Registry &registry = GetRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    
+    {
+        std::lock_guard<std::mutex> storeLock(store->mutex);
+        MergeInto(registry.retired, store->records);
+        store->records.clear();
+    }
+    
+    registry.freeStores.emplace_back(store);
+}
+}
+
+
+DiagnosticCounter::DiagnosticCounter(std::string const &source_,
+  std::string const &description_, std::vector<std::string> const &fieldNames_):
+    source(source_), description(description_), fieldNames(fieldNames_)
+{
+    if (fieldNames.size() > maxNumFields)
+    {
+        std::ostringstream message;
+        message << "DiagnosticCounter::DiagnosticCounter: " << fieldNames.size() <<
+          " fields are requested for \"" << description << "\" while at most " << maxNumFields <<
+          " are supported.";
+        throw std::runtime_error(message.str());
+    }
+}
+
+
+std::string const &DiagnosticCounter::GetDescription() const
+{
+    return description;
+}
+
+
+std::vector<std::string> const &DiagnosticCounter::GetFieldNames() const
+{
+    return fieldNames;
+}
+
+
+std::string const &DiagnosticCounter::GetSource() const
+{
+    return source;
+}
+
+
+void DiagnosticCounter::Record(std::uint64_t key, std::initializer_list<double> values) const
+{
+    ThreadStore &store = GetThreadStore();
+    std::lock_guard<std::mutex> lock(store.mutex);
+    auto const recordKey = std::make_pair(this, key);
+    auto it = store.records.find(recordKey);
+    
+    if (it == store.records.end())
+    {
+        BinRecord record{0, nextFirstIndex.fetch_add(1, std::memory_order_relaxed), {}};
+        record.context.fill(std::numeric_limits<double>::quiet_NaN());
+        std::copy_n(values.begin(), std::min<std::size_t>(values.size(), maxNumFields),
+          record.context.begin());
+        it = store.records.emplace(recordKey, record).first;
+    }
+    
+    ++it->second.count;
+}
+
+
+DiagnosticCounter const &GetDiagnosticCounter(std::string const &source,
+  std::string const &description, std::vector<std::string> const &fieldNames)
+{
+    Registry &registry = GetRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    
+    for (auto const &counter: registry.counters)
+    {
+        if (counter->GetSource() == source and counter->GetDescription() == description)
+            return *counter;
+    }
+    
+    registry.counters.emplace_back(
+      std::make_unique<DiagnosticCounter>(source, description, fieldNames));
+    return *registry.counters.back();
+}
+
+
+std::uint64_t GetNumDiagnosticEvents()
+{
+    Registry &registry = GetRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    std::uint64_t numEvents = 0;
+    
+    for (auto const &entry: registry.retired)
+        numEvents += entry.second.count;
+    
+    for (auto const &store: registry.stores)
+    {
+        std::lock_guard<std::mutex> storeLock(store->mutex);
+        
+        for (auto const &entry: store->records)
+            numEvents += entry.second.count;
+    }
+    
+    return numEvents;
+}
+
+
+void PrintDiagnosticsSummary(std::ostream &out)
+{
+    Registry &registry = GetRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    RecordMap const merged(MergeRecords(registry));
+    
+    if (merged.empty())
+        return;
+    
+    out << "Problems encountered in the evaluation of the loss function:\n";
+    
+    for (auto const &counter: registry.counters)
+    {
+        // Records of the same counter are adjacent in the map
+        std::vector<BinRecord const *> bins;
+        std::uint64_t total = 0;
+        
+        for (auto it = merged.lower_bound({counter.get(), 0});
+          it != merged.end() and it->first.first == counter.get(); ++it)
+        {
+            bins.emplace_back(&it->second);
+            total += it->second.count;
+        }
+        
+        if (bins.empty())
+            continue;
+        
+        std::sort(bins.begin(), bins.end(),
+          [](BinRecord const *a, BinRecord const *b){return a->firstIndex < b->firstIndex;});
+        
+        out << "  " << counter->GetSource() << ": " << counter->GetDescription() << ": " <<
+          total << " occurrence(s) in " << bins.size() << " bin(s)\n";
+        auto const &fieldNames = counter->GetFieldNames();
+        
+        for (unsigned i = 0; i < bins.size() and i < maxListedBins; ++i)
+        {
+            out << "    ";
+            
+            for (unsigned iField = 0; iField < fieldNames.size(); ++iField)
+                out << ((iField > 0) ? ", " : "") << fieldNames[iField] << " " <<
+                  bins[i]->context[iField];
+            
+            out << ((fieldNames.empty()) ? "" : ": ") << bins[i]->count << " occurrence(s)\n";
+        }
+        
+        if (bins.size() > maxListedBins)
+            out << "    ... and " << bins.size() - maxListedBins << " more bin(s)\n";
+    }
+}
@@ -0,0 +1,439 @@
+#include <EventIngestion.hpp>
+
+#include <FlatArray.hpp>
+#include <Parallel.hpp>
+
+#include <TBranch.h>
+#include <TFile.h>
+#include <TTree.h>
+
+#include <algorithm>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+
+
+namespace
+{
+/// Maximal number of other jets in an event supported when reading ntuples
+unsigned const maxJets = 256;
+
+
+/**
+ * \brief Parses a number found in the given file
+ * 
+ * Throws an exception if the whole text cannot be parsed.
+ */
+double ParseNumber(std::string const &text, std::string const &fileName)
+{
+    std::size_t numParsed = 0;
+    double value = 0.;
+    
+    try
+    {
+        value = std::stod(text, &numParsed);
+    }
+    catch (std::exception const &)
+    {
+        numParsed = 0;
+    }
+    
+    if (numParsed == 0 or numParsed != text.size())
+    {
+        std::ostringstream message;
+        message << "ReadIngestionBinning: Failed to parse number \"" << text << "\" in file \"" <<
+          fileName << "\".";
+        throw std::runtime_error(message.str());
+    }
+    
+    return value;
+}
+
+
+/**
+ * \brief Parses a comma-separated list of bin edges
+ * 
+ * Throws an exception if the list cannot be parsed or the edges are not increasing.
+ */
+std::vector<double> ParseEdges(std::string const &text, std::string const &fileName)
+{
+    std::vector<double> edges;
+    std::istringstream textStream(text);
+    std::string element;
+    
+    while (std::getline(textStream, element, ','))
+        edges.emplace_back(ParseNumber(element, fileName));
+    
+    if (edges.size() < 2 or std::adjacent_find(edges.begin(), edges.end(),
+      [](double lhs, double rhs){return lhs >= rhs;}) != edges.end())
+    {
+        std::ostringstream message;
+        message << "ReadIngestionBinning: Bin edges \"" << text << "\" in file \"" << fileName <<
+          "\" do not define an increasing binning.";
+        throw std::runtime_error(message.str());
+    }
+    
+    return edges;
+}
+
+
+/**
+ * \struct EventChunk
+ * \brief Buffer with a chunk of events read from a tree
+ * 
+ * Variables of jets in all events are stored contiguously. Jets of event i occupy the range
+ * [jetOffsets[i], jetOffsets[i + 1]).
+ */
+struct EventChunk
+{
+    /// Clears the buffer, preserving the allocated memory
+    void Clear();
+    
+    /// Indices of trigger bins
+    std::vector<int> triggerBin;
+    
+    /// Event weights, pt of the leading jet, and balance observables
+    std::vector<float> weight, ptLead, balance;
+    
+    /// Offsets of jets of each event
+    std::vector<unsigned> jetOffsets;
+    
+    /// Pt of other jets and their projections
+    std::vector<float> jetPt, jetPtProj;
+};
+
+
+void EventChunk::Clear()
+{
+    triggerBin.clear();
+    weight.clear();
+    ptLead.clear();
+    balance.clear();
+    jetOffsets.assign(1, 0);
+    jetPt.clear();
+    jetPtProj.clear();
+}
+}
+
+
+IngestionBinning ReadIngestionBinning(std::string const &fileName)
+{
+    std::ifstream file(fileName);
+    
+    if (not file)
+    {
+        std::ostringstream message;
+        message << "ReadIngestionBinning: Failed to open file \"" << fileName << "\".";
+        throw std::runtime_error(message.str());
+    }
+    
+    IngestionBinning binning;
+    bool minPtFound = false;
+    std::string line;
+    
+    while (std::getline(file, line))
+    {
+        std::istringstream lineStream(line);
+        std::string keyword;
+        lineStream >> keyword;
+        
+        if (keyword.empty() or keyword[0] == '#')
+            continue;
+        
+        std::vector<std::string> values;
+        std::string value;
+        
+        while (lineStream >> value)
+            values.emplace_back(value);
+        
+        if (keyword == "min-pt" and values.size() == 1)
+        {
+            binning.minPt = ParseNumber(values[0], fileName);
+            minPtFound = true;
+        }
+        else if (keyword == "pt-jet-binning" and values.size() == 1)
+            binning.ptJetBinning = ParseEdges(values[0], fileName);
+        else if (keyword == "trigger" and values.size() == 3)
+            binning.triggerBins.emplace_back(IngestionBinning::TriggerBin{values[0],
+              ParseEdges(values[1], fileName), ParseEdges(values[2], fileName)});
+        else
+        {
+            std::ostringstream message;
+            message << "ReadIngestionBinning: Failed to parse line \"" << line << "\" in file \"" <<
+              fileName << "\".";
+            throw std::runtime_error(message.str());
+        }
+    }
+    
+    if (not minPtFound or binning.ptJetBinning.empty() or binning.triggerBins.empty())
+    {
+        std::ostringstream message;
+        message << "ReadIngestionBinning: File \"" << fileName << "\" does not define the jet " <<
+          "pt threshold, the binning in pt of other jets, or trigger bins.";
+        throw std::runtime_error(message.str());
+    }
+    
+    return binning;
+}
+
+
+MultijetIngestion::MultijetIngestion(IngestionBinning const &binning_,
+  MultijetBinnedSum::Method method):
+    binning(binning_),
+    treeName("Events"),
+    chunkSize(10000), numPartitions(16)
+{
+    methodLabel = (method == MultijetBinnedSum::Method::PtBal) ? "PtBal" : "MPF";
+}
+
+
+MultijetBinnedSum::InputSums MultijetIngestion::Run(std::vector<WeightedFile> const &dataFiles,
+  std::vector<WeightedFile> const &simFiles, unsigned numThreads) const
+{
+    if (dataFiles.empty() or simFiles.empty())
+        throw std::runtime_error("MultijetIngestion::Run: No input files given.");
+    
+    
+    // Aggregate partitions of all files, possibly in parallel. Each partition has its own sums.
+    //The memory needed is thus proportional to the number of partitions and not the number of
+    //events.
+    std::vector<MultijetBinnedSum::InputSums> partialSums(numPartitions);
+    
+    ParallelFor(numPartitions, numThreads, [&](unsigned partition)
+    {
+        auto &sums = partialSums[partition];
+        sums = CreateEmptySums();
+        
+        for (auto const &file: dataFiles)
+            ProcessPartition(file, true, partition, sums);
+        
+        for (auto const &file: simFiles)
+            ProcessPartition(file, false, partition, sums);
+    });
+    
+    
+    // Add up the partial sums in a fixed order
+    auto &sums = partialSums.front();
+    
+    for (unsigned partition = 1; partition < numPartitions; ++partition)
+    {
+        for (unsigned iBin = 0; iBin < sums.triggerBins.size(); ++iBin)
+        {
+            auto &bin = sums.triggerBins[iBin];
+            auto const &partialBin = partialSums[partition].triggerBins[iBin];
+            
+            AddScaled(bin.numEvents, partialBin.numEvents, 1.);
+            AddScaled(bin.ptJetSumProj, partialBin.ptJetSumProj, 1.);
+            bin.ptLead.Add(partialBin.ptLead);
+            bin.bal.Add(partialBin.bal);
+            bin.simBal.Add(partialBin.simBal);
+        }
+        
+        // Release memory as soon as possible
+        partialSums[partition] = MultijetBinnedSum::InputSums();
+    }
+    
+    return std::move(sums);
+}
+
+
+void MultijetIngestion::SetChunkSize(unsigned chunkSize_)
+{
+    chunkSize = std::max(chunkSize_, 1u);
+}
+
+
+void MultijetIngestion::SetNumPartitions(unsigned numPartitions_)
+{
+    numPartitions = std::max(numPartitions_, 1u);
+}
+
+
+void MultijetIngestion::SetTreeName(std::string const &treeName_)
+{
+    treeName = treeName_;
+}
+
+
+MultijetBinnedSum::InputSums MultijetIngestion::CreateEmptySums() const
+{
+    MultijetBinnedSum::InputSums sums;
+    sums.minPt = binning.minPt;
+    
+    for (auto const &triggerBin: binning.triggerBins)
+    {
+        MultijetBinnedSum::TriggerBinSums bin;
+        unsigned const numBins = triggerBin.binning.size() + 1;
+        
+        bin.binning = triggerBin.binning;
+        bin.ptJetBinning = binning.ptJetBinning;
+        bin.simBinning = triggerBin.simBinning;
+        bin.numEvents.assign(numBins, 0.);
+        bin.ptJetSumProj.assign(numBins * (binning.ptJetBinning.size() + 1), 0.);
+        bin.ptLead = ProfileSums(numBins);
+        bin.bal = ProfileSums(numBins);
+        bin.simBal = ProfileSums(triggerBin.simBinning.size() + 1);
+        
+        sums.triggerBins.emplace_back(std::move(bin));
+    }
+    
+    return sums;
+}
+
+
+void MultijetIngestion::ProcessPartition(WeightedFile const &file, bool isData,
+  unsigned partition, MultijetBinnedSum::InputSums &sums) const
+{
+    // Each call opens the file on its own since TFile objects cannot be shared among threads
+    std::unique_ptr<TFile> inputFile(TFile::Open(file.name.c_str()));
+    
+    if (not inputFile or inputFile->IsZombie())
+    {
+        std::ostringstream message;
+        message << "MultijetIngestion::ProcessPartition: Failed to open file \"" << file.name <<
+          "\".";
+        throw std::runtime_error(message.str());
+    }
+    
+    // The tree is owned by the file
+    auto *tree = dynamic_cast<TTree *>(inputFile->Get(treeName.c_str()));
+    
+    if (not tree)
+    {
+        std::ostringstream message;
+        message << "MultijetIngestion::ProcessPartition: File \"" << file.name <<
+          "\" does not contain tree \"" << treeName << "\".";
+        throw std::runtime_error(message.str());
+    }
+    
+    
+    // Only read the needed branches
+    std::vector<std::string> branchNames{"TriggerBin", "Weight", "PtLead", methodLabel};
+    
+    if (isData)
+    {
+        for (auto const &name: {"NumJets", "JetPt", "JetPtProj"})
+            branchNames.emplace_back(name);
+    }
+    
+    tree->SetBranchStatus("*", false);
+    
+    for (auto const &name: branchNames)
+    {
+        if (not tree->GetBranch(name.c_str()))
+        {
+            std::ostringstream message;
+            message << "MultijetIngestion::ProcessPartition: Tree \"" << treeName <<
+              "\" in file \"" << file.name << "\" does not contain branch \"" << name << "\".";
+            throw std::runtime_error(message.str());
+        }
+        
+        tree->SetBranchStatus(name.c_str(), true);
+    }
+    
+    int triggerBin, numJets = 0;
+    float weight, ptLead, balance;
+    std::vector<float> jetPt(maxJets), jetPtProj(maxJets);
+    TBranch *numJetsBranch = nullptr;
+    
+    tree->SetBranchAddress("TriggerBin", &triggerBin);
+    tree->SetBranchAddress("Weight", &weight);
+    tree->SetBranchAddress("PtLead", &ptLead);
+    tree->SetBranchAddress(methodLabel.c_str(), &balance);
+    
+    if (isData)
+    {
+        tree->SetBranchAddress("NumJets", &numJets, &numJetsBranch);
+        tree->SetBranchAddress("JetPt", jetPt.data());
+        tree->SetBranchAddress("JetPtProj", jetPtProj.data());
+    }
+    
+    
+    // Find the range of entries for the partition. Limit the read-ahead cache to this range so
+    //that different partitions do not prefetch the same baskets.
+    long long const numEntries = tree->GetEntries();
+    long long const begin = numEntries * partition / numPartitions;
+    long long const end = numEntries * (partition + 1) / numPartitions;
+    
+    if (begin == end)
+        return;
+    
+    tree->SetCacheSize(-1);
+    tree->SetCacheEntryRange(begin, end);
+    tree->AddBranchToCache("*", true);
+    
+    
+    // Read events in chunks. Reading is separated from aggregation so that the inner loops that
+    //update the sums run over contiguous buffers.
+    EventChunk chunk;
+    unsigned const numTriggerBins = sums.triggerBins.size();
+    unsigned const rowLength = binning.ptJetBinning.size() + 1;
+    FlatArray const ptJetBinning(binning.ptJetBinning.data(), binning.ptJetBinning.size());
+    
+    for (long long chunkBegin = begin; chunkBegin < end; chunkBegin += chunkSize)
+    {
+        long long const chunkEnd = std::min<long long>(chunkBegin + chunkSize, end);
+        chunk.Clear();
+        
+        for (long long entry = chunkBegin; entry < chunkEnd; ++entry)
+        {
+            // The number of jets is read and checked before the whole entry so that arrays of
+            //jets never overflow the buffers
+            if (isData)
+            {
+                numJetsBranch->GetEntry(entry);
+                
+                if (numJets < 0 or unsigned(numJets) > maxJets)
+                {
+                    std::ostringstream message;
+                    message << "MultijetIngestion::ProcessPartition: Event " << entry <<
+                      " in file \"" << file.name << "\" contains " << numJets <<
+                      " jets while at most " << maxJets << " are supported.";
+                    throw std::runtime_error(message.str());
+                }
+            }
+            
+            tree->GetEntry(entry);
+            
+            if (triggerBin < 0 or unsigned(triggerBin) >= numTriggerBins)
+                continue;
+            
+            chunk.triggerBin.emplace_back(triggerBin);
+            chunk.weight.emplace_back(weight);
+            chunk.ptLead.emplace_back(ptLead);
+            chunk.balance.emplace_back(balance);
+            chunk.jetPt.insert(chunk.jetPt.end(), jetPt.begin(), jetPt.begin() + numJets);
+            chunk.jetPtProj.insert(chunk.jetPtProj.end(), jetPtProj.begin(),
+              jetPtProj.begin() + numJets);
+            chunk.jetOffsets.emplace_back(chunk.jetPt.size());
+        }
+        
+        for (unsigned i = 0; i < chunk.triggerBin.size(); ++i)
+        {
+            auto &bin = sums.triggerBins[chunk.triggerBin[i]];
+            double const w = file.weight * chunk.weight[i];
+            
+            if (not isData)
+            {
+                FlatArray const simBinning(bin.simBinning.data(), bin.simBinning.size());
+                bin.simBal.Fill(FindBin(simBinning, chunk.ptLead[i]), chunk.balance[i], w);
+                continue;
+            }
+            
+            FlatArray const ptLeadBinning(bin.binning.data(), bin.binning.size());
+            unsigned const iPtLead = FindBin(ptLeadBinning, chunk.ptLead[i]);
+            
+            bin.numEvents[iPtLead] += w;
+            bin.ptLead.Fill(iPtLead, chunk.ptLead[i], w);
+            bin.bal.Fill(iPtLead, chunk.balance[i], w);
+            
+            double *sumProj = bin.ptJetSumProj.data() + iPtLead * rowLength;
+            
+            for (unsigned j = chunk.jetOffsets[i]; j < chunk.jetOffsets[i + 1]; ++j)
+                sumProj[FindBin(ptJetBinning, chunk.jetPt[j])] += w * chunk.jetPtProj[j];
+        }
+    }
+    
+    inputFile->Close();
+}
@@ -1,5 +1,7 @@
 #include <FitBase.hpp>
 
+#include <Profiling.hpp>
+
 #include <algorithm>
 #include <cmath>
 #include <sstream>
@@ -78,6 +80,35 @@ double JetCorrBase::UndoCorr(double pt, double tolerance) const
 }
 
 
+MeasurementBase::~MeasurementBase()
+{}
+
+
+std::unique_ptr<MeasurementBase> MeasurementBase::CloneFluctuated(CounterRng &) const
+{
+    throw std::runtime_error("MeasurementBase::CloneFluctuated: This measurement does not "
+      "support pseudo-experiments.");
+}
+
+
+std::vector<ResidualGroup> MeasurementBase::EvalResiduals(JetCorrBase const &corrector,
+  Nuisances const &nuisances) const
+{
+    return {ResidualGroup{"", Eval(corrector, nuisances), {}}};
+}
+
+
+void MeasurementBase::SaveSnapshot(std::string const &) const
+{
+    throw std::runtime_error("MeasurementBase::SaveSnapshot: This measurement does not "
+      "support snapshots.");
+}
+
+
+void MeasurementBase::SetThreadPool(std::shared_ptr<ThreadPool> const &)
+{}
+
+
 CombLossFunction::CombLossFunction(std::unique_ptr<JetCorrBase> &&corrector_):
     corrector(std::move(corrector_))
 {}
@@ -88,6 +119,46 @@ void CombLossFunction::AddMeasurement(MeasurementBase const *measurement)
     measurements.emplace_back(measurement);
 }
 
+
+void CombLossFunction::AddMeasurement(std::unique_ptr<MeasurementBase> &&measurement)
+{
+    measurements.emplace_back(measurement.get());
+    ownedMeasurements.emplace_back(std::move(measurement));
+}
+
+
+std::unique_ptr<CombLossFunction> CombLossFunction::Clone() const
+{
+    auto clone = std::make_unique<CombLossFunction>(corrector->Clone());
+    
+    for (auto const &m: measurements)
+        clone->AddMeasurement(m->Clone());
+    
+    clone->nuisances = nuisances;
+    clone->threadPool = threadPool;
+    
+    return clone;
+}
+
+
+std::unique_ptr<CombLossFunction> CombLossFunction::CloneFluctuated(std::uint64_t seed,
+  unsigned toyIndex) const
+{
+    auto clone = std::make_unique<CombLossFunction>(corrector->Clone());
+    
+    for (unsigned i = 0; i < measurements.size(); ++i)
+    {
+        CounterRng rng(seed, toyIndex, i);
+        clone->AddMeasurement(measurements[i]->CloneFluctuated(rng));
+    }
+    
+    clone->nuisances = nuisances;
+    clone->threadPool = threadPool;
+    
+    return clone;
+}
+
+
 std::vector<MeasurementBase const *> CombLossFunction::GetMeasurements()
 {
   return measurements;
@@ -115,6 +186,24 @@ unsigned CombLossFunction::GetNumParams() const
 }
 
 
+Nuisances const &CombLossFunction::GetExternalNuisances() const
+{
+    return nuisances;
+}
+
+
+unsigned CombLossFunction::GetNumThreads() const
+{
+    return (threadPool) ? threadPool->GetNumThreads() : 1;
+}
+
+
+std::shared_ptr<ThreadPool> CombLossFunction::GetThreadPool() const
+{
+    return threadPool;
+}
+
+
 double CombLossFunction::Eval(std::vector<double> const &x) const
 {
     if (x.size() != GetNumParams())
@@ -135,12 +224,7 @@ double CombLossFunction::Eval(std::vector<double> const &corrParams, Nuisances c
     corrector->SetParams(corrParams);
     SetExternalNuisances(nuisances_);
     
-    double loss = 0.;
-    
-    for (auto const &m: measurements)
-        loss += m->Eval(*corrector, nuisances);
-    
-    return loss;
+    return EvalMeasurements();
 }
 
 
@@ -149,14 +233,25 @@ double CombLossFunction::EvalRawInput(double const *x) const
     // The input array starts from parameters of the jet correction. It would be followed by
     //values of nuisances to be marginalized, but nuisances are not included in this
     //implementation.
+    JECFIT_PROFILE_SCOPE("CombLossFunction", "EvalRawInput");
+    JECFIT_TRACE_SCOPE("CombLossFunction", "EvalRawInput");
     corrector->SetParams(x);
     
-    double loss = 0.;
+    return EvalMeasurements();
+}
+
+
+std::vector<std::vector<ResidualGroup>> CombLossFunction::EvalResiduals(double const *x) const
+{
+    corrector->SetParams(x);
+    std::vector<std::vector<ResidualGroup>> residuals(measurements.size());
     
-    for (auto const &m: measurements)
-        loss += m->Eval(*corrector, nuisances);
+    RunTasks(threadPool.get(), measurements.size(), [this, &residuals](unsigned i)
+    {
+        residuals[i] = measurements[i]->EvalResiduals(*corrector, nuisances);
+    });
     
-    return loss;
+    return residuals;
 }
 
 
@@ -164,3 +259,51 @@ void CombLossFunction::SetExternalNuisances(Nuisances const &nuisances_) const
 {
     nuisances = nuisances_;
 }
+
+
+void CombLossFunction::SetNumThreads(unsigned numThreads)
+{
+    if (numThreads > 1)
+        threadPool = std::make_shared<ThreadPool>(numThreads);
+    else
+        threadPool.reset();
+}
+
+
+double CombLossFunction::EvalMeasurements() const
+{
+    // When instrumentation is enabled, the measurements are given a wrapper around the corrector
+    //that measures time spent in its evaluation
+#ifdef JECFIT_PROFILING
+    ProfiledJetCorr const profiledCorrector(*corrector);
+    JetCorrBase const &evalCorrector = profiledCorrector;
+#else
+    JetCorrBase const &evalCorrector = *corrector;
+#endif
+    
+    double loss = 0.;
+    
+    if (not threadPool or measurements.size() < 2)
+    {
+        for (auto const &m: measurements)
+            loss += m->Eval(evalCorrector, nuisances);
+        
+        return loss;
+    }
+    
+    
+    // Evaluate measurements in parallel. Measurements only read the corrector and nuisances, so
+    //they can be shared. The partial results are summed up in a fixed order, which reproduces the
+    //serial computation exactly.
+    std::vector<double> partialLosses(measurements.size());
+    
+    threadPool->Run(measurements.size(), [this, &evalCorrector, &partialLosses](unsigned i)
+    {
+        partialLosses[i] = measurements[i]->Eval(evalCorrector, nuisances);
+    });
+    
+    for (auto const &partialLoss: partialLosses)
+        loss += partialLoss;
+    
+    return loss;
+}
@@ -0,0 +1,236 @@
+#include <FitReport.hpp>
+
+#include <TMath.h>
+
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+
+
+namespace
+{
+/// Writes a number, replacing values that cannot be represented in JSON with null
+void WriteNumber(std::ostream &out, double value)
+{
+    if (std::isfinite(value))
+        out << value;
+    else
+        out << "null";
+}
+
+
+/// Writes a string, escaping characters as required in JSON
+void WriteString(std::ostream &out, std::string const &text)
+{
+    out << '"';
+    
+    for (char const c: text)
+    {
+        if (c == '"' or c == '\\')
+            out << '\\' << c;
+        else if (static_cast<unsigned char>(c) < 0x20)
+        {
+            char buffer[8];
+            std::snprintf(buffer, sizeof(buffer), "\\u%04x", c);
+            out << buffer;
+        }
+        else
+            out << c;
+    }
+    
+    out << '"';
+}
+
+
+/**
+ * \brief Writes an array of numbers
+ * 
+ * The given accessor is applied to each element of the vector to obtain the number to write.
+ */
+template<typename T, typename F>
+void WriteArray(std::ostream &out, std::vector<T> const &elements, F accessor)
+{
+    out << '[';
+    
+    for (unsigned i = 0; i < elements.size(); ++i)
+    {
+        if (i > 0)
+            out << ',';
+        
+        WriteNumber(out, accessor(elements[i]));
+    }
+    
+    out << ']';
+}
+
+
+/**
+ * \brief Writes a group of bins
+ * 
+ * Bins are stored column-wise, i.e. as a separate array for each quantity, which is compact and
+ * convenient for plotting.
+ */
+void WriteGroup(std::ostream &out, ResidualGroup const &group)
+{
+    out << "{\"label\":";
+    WriteString(out, group.label);
+    out << ",\"chi2\":";
+    WriteNumber(out, group.chi2);
+    out << ",\"numBins\":" << group.bins.size();
+    
+    if (not group.bins.empty())
+    {
+        auto const &bins = group.bins;
+        out << ",\"ptMin\":";
+        WriteArray(out, bins, [](ResidualBin const &b){return b.ptMin;});
+        out << ",\"ptMax\":";
+        WriteArray(out, bins, [](ResidualBin const &b){return b.ptMax;});
+        out << ",\"data\":";
+        WriteArray(out, bins, [](ResidualBin const &b){return b.data;});
+        out << ",\"dataUnc\":";
+        WriteArray(out, bins, [](ResidualBin const &b){return b.dataUnc;});
+        out << ",\"recomputed\":";
+        WriteArray(out, bins, [](ResidualBin const &b){return b.recomputed;});
+        out << ",\"sim\":";
+        WriteArray(out, bins, [](ResidualBin const &b){return b.sim;});
+        out << ",\"simUnc\":";
+        WriteArray(out, bins, [](ResidualBin const &b){return b.simUnc;});
+        out << ",\"totalUnc\":";
+        WriteArray(out, bins, [](ResidualBin const &b){return b.totalUnc;});
+        out << ",\"pull\":";
+        WriteArray(out, bins, [](ResidualBin const &b){return b.pull;});
+    }
+    
+    out << '}';
+}
+}
+
+
+void SaveFitReport(FitResult const &result, CombLossFunction const &lossFunc,
+  std::vector<std::string> const &measurementLabels, std::string const &fileName)
+{
+    unsigned const nPars = result.values.size();
+    
+    if (nPars != lossFunc.GetNumParams())
+    {
+        std::ostringstream message;
+        message << "SaveFitReport: Fit result contains " << nPars << " parameters while " <<
+          lossFunc.GetNumParams() << " are expected.";
+        throw std::runtime_error(message.str());
+    }
+    
+    
+    // Evaluate contributions of all measurements at the fitted point
+    auto const residuals = lossFunc.EvalResiduals(result.values.data());
+    
+    if (measurementLabels.size() != residuals.size())
+    {
+        std::ostringstream message;
+        message << "SaveFitReport: Received " << measurementLabels.size() <<
+          " labels for " << residuals.size() << " measurements.";
+        throw std::runtime_error(message.str());
+    }
+    
+    
+    std::string const tmpFileName(fileName + ".tmp");
+    std::ofstream file(tmpFileName);
+    
+    if (not file)
+    {
+        std::ostringstream message;
+        message << "SaveFitReport: Failed to open file \"" << tmpFileName << "\" for writing.";
+        throw std::runtime_error(message.str());
+    }
+    
+    file << std::setprecision(std::numeric_limits<double>::max_digits10);
+    
+    unsigned const ndf = lossFunc.GetNDF();
+    file << "{\"version\":1,\n";
+    file << "\"status\":" << result.status << ",\"covStatus\":" << result.covStatus <<
+      ",\"numCalls\":" << result.numCalls << ",\n";
+    file << "\"minValue\":";
+    WriteNumber(file, result.minValue);
+    file << ",\"edm\":";
+    WriteNumber(file, result.edm);
+    file << ",\"ndf\":" << ndf << ",\"pValue\":";
+    WriteNumber(file, TMath::Prob(result.minValue, ndf));
+    file << ",\n";
+    
+    
+    // Parameters and their covariance matrix, which is stored as an array of rows
+    file << "\"parameters\":[";
+    
+    for (unsigned i = 0; i < nPars; ++i)
+    {
+        if (i > 0)
+            file << ',';
+        
+        file << "{\"name\":";
+        WriteString(file, result.names.at(i));
+        file << ",\"value\":";
+        WriteNumber(file, result.values[i]);
+        file << ",\"error\":";
+        WriteNumber(file, result.errors.at(i));
+        file << '}';
+    }
+    
+    file << "],\n\"covariance\":[";
+    
+    if (not result.covariance.empty())
+    {
+        for (unsigned i = 0; i < nPars; ++i)
+        {
+            if (i > 0)
+                file << ',';
+            
+            std::vector<double> const row(result.covariance.begin() + i * nPars,
+              result.covariance.begin() + (i + 1) * nPars);
+            WriteArray(file, row, [](double x){return x;});
+        }
+    }
+    
+    file << "],\n";
+    
+    
+    // Breakdown of the loss function
+    file << "\"measurements\":[";
+    
+    for (unsigned iMeas = 0; iMeas < residuals.size(); ++iMeas)
+    {
+        double chi2 = 0.;
+        
+        for (auto const &group: residuals[iMeas])
+            chi2 += group.chi2;
+        
+        file << ((iMeas > 0) ? ",\n" : "\n");
+        file << "{\"label\":";
+        WriteString(file, measurementLabels[iMeas]);
+        file << ",\"chi2\":";
+        WriteNumber(file, chi2);
+        file << ",\"groups\":[";
+        
+        for (unsigned iGroup = 0; iGroup < residuals[iMeas].size(); ++iGroup)
+        {
+            if (iGroup > 0)
+                file << ",\n";
+            
+            WriteGroup(file, residuals[iMeas][iGroup]);
+        }
+        
+        file << "]}";
+    }
+    
+    file << "]}\n";
+    file.close();
+    
+    if (not file or std::rename(tmpFileName.c_str(), fileName.c_str()) != 0)
+    {
+        std::ostringstream message;
+        message << "SaveFitReport: Failed to write file \"" << fileName << "\".";
+        throw std::runtime_error(message.str());
+    }
+}
@@ -0,0 +1,452 @@
+#include <FitServer.hpp>
+
+#include <LossScan.hpp>
+#include <MultijetBinnedSum.hpp>
+
+#include <TH1D.h>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+
+namespace
+{
+/// Seed for sampling of parameters in requests for uncertainty bands
+std::uint64_t const bandSeed = 1;
+
+
+/**
+ * \brief Returns the multijet measurement with the given index in the loss function
+ * 
+ * Throws an exception if there is no such measurement or it is not a multijet one.
+ */
+MultijetBinnedSum const &GetMultijet(CombLossFunction &lossFunc, unsigned index)
+{
+    auto const measurements = lossFunc.GetMeasurements();
+    auto const *multijet = (index < measurements.size()) ?
+      dynamic_cast<MultijetBinnedSum const *>(measurements[index]) : nullptr;
+    
+    if (not multijet)
+    {
+        std::ostringstream message;
+        message << "Measurement with index " << index << " is not a multijet measurement.";
+        throw std::runtime_error(message.str());
+    }
+    
+    return *multijet;
+}
+
+
+/// Sends the whole buffer to a socket; returns false if the connection has been closed
+bool SendAll(int socket, std::string const &data)
+{
+    std::size_t sent = 0;
+    
+    while (sent < data.size())
+    {
+        ssize_t const n = send(socket, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        
+        if (n < 0 and errno == EINTR)
+            continue;
+        
+        if (n <= 0)
+            return false;
+        
+        sent += n;
+    }
+    
+    return true;
+}
+}
+
+
+FitServer::FitServer(CombLossFunction const &lossFunc_):
+    lossFunc(lossFunc_),
+    listenSocket(-1),
+    stopRequested(false)
+{}
+
+
+void FitServer::Serve(std::string const &socketPath)
+{
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    
+    if (socketPath.size() >= sizeof(address.sun_path))
+    {
+        std::ostringstream message;
+        message << "FitServer::Serve: Path \"" << socketPath << "\" is too long for a socket.";
+        throw std::runtime_error(message.str());
+    }
+    
+    std::strcpy(address.sun_path, socketPath.c_str());
+    std::remove(socketPath.c_str());
+    
+    listenSocket = socket(AF_UNIX, SOCK_STREAM, 0);
+    
+    if (listenSocket < 0 or
+      bind(listenSocket, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 or
+      listen(listenSocket, 16) != 0)
+    {
+        std::ostringstream message;
+        message << "FitServer::Serve: Failed to listen on socket \"" << socketPath << "\": " <<
+          std::strerror(errno) << ".";
+        
+        if (listenSocket >= 0)
+            close(listenSocket);
+        
+        throw std::runtime_error(message.str());
+    }
+    
+    stopRequested = false;
+    
+    
+    // Accept connections until the server is stopped. Stopping shuts down the listening socket,
+    //which makes accept return with an error.
+    while (not stopRequested)
+    {
+        int const clientSocket = accept(listenSocket, nullptr, nullptr);
+        
+        if (clientSocket < 0)
+        {
+            if (errno == EINTR or errno == ECONNABORTED)
+                continue;
+            
+            break;
+        }
+        
+        ReapConnections();
+        std::lock_guard<std::mutex> lock(mutex);
+        
+        if (stopRequested)
+        {
+            close(clientSocket);
+            break;
+        }
+        
+        clientSockets.insert(clientSocket);
+        connectionThreads.emplace_back(&FitServer::ServeConnection, this, clientSocket);
+    }
+    
+    for (auto &thread: connectionThreads)
+        thread.join();
+    
+    connectionThreads.clear();
+    finishedThreads.clear();
+    close(listenSocket);
+    listenSocket = -1;
+    std::remove(socketPath.c_str());
+}
+
+
+std::vector<double> FitServer::ParseParams(std::vector<std::string> const &tokens,
+  unsigned first) const
+{
+    unsigned const nPars = lossFunc.GetNumParams();
+    
+    if (tokens.size() != first + nPars)
+    {
+        std::ostringstream message;
+        message << "Received " << int(tokens.size()) - int(first) << " parameters while " <<
+          nPars << " are expected.";
+        throw std::runtime_error(message.str());
+    }
+    
+    std::vector<double> params;
+    
+    for (unsigned i = first; i < tokens.size(); ++i)
+        params.emplace_back(std::stod(tokens[i]));
+    
+    return params;
+}
+
+
+std::string FitServer::ProcessRequest(Session &session, std::vector<std::string> const &tokens)
+  const
+{
+    auto &localLossFunc = *session.lossFunc;
+    std::string const &command = tokens.front();
+    std::ostringstream response;
+    response << std::setprecision(12);
+    
+    if (command == "eval")
+        response << localLossFunc.Eval(ParseParams(tokens, 1));
+    else if (command == "fit")
+    {
+        FitResult start(session.lastFit);
+        
+        if (tokens.size() > 1)
+        {
+            start.values = ParseParams(tokens, 1);
+            start.covariance.clear();
+        }
+        
+        Fitter fitter(localLossFunc);
+        fitter.SetStartingPoint(start);
+        FitResult const result = fitter.Fit();
+        session.lastFit = result;
+        
+        response << result.status << " " << result.minValue << " " << localLossFunc.GetNDF();
+        
+        for (unsigned i = 0; i < result.values.size(); ++i)
+            response << " " << result.values[i] << " " << result.errors[i];
+    }
+    else if (command == "scan")
+    {
+        LossScan scan(localLossFunc);
+        scan.SetCentralValues(session.lastFit);
+        scan.SetNumThreads(localLossFunc.GetNumThreads());
+        
+        for (unsigned i = 1; i < tokens.size(); ++i)
+        {
+            if (tokens[i] == "profile")
+            {
+                scan.SetProfiling(true);
+                continue;
+            }
+            
+            std::vector<std::string> fields;
+            std::istringstream axisStream(tokens[i]);
+            std::string field;
+            
+            while (std::getline(axisStream, field, ':'))
+                fields.emplace_back(field);
+            
+            if (fields.size() != 4)
+            {
+                std::ostringstream message;
+                message << "Failed to parse axis \"" << tokens[i] << "\".";
+                throw std::runtime_error(message.str());
+            }
+            
+            scan.AddAxis(fields[0], std::stod(fields[1]), std::stod(fields[2]),
+              std::stoul(fields[3]));
+        }
+        
+        ScanResult const result = scan.Run();
+        response << result.GetNumPoints();
+        
+        for (auto const &loss: result.losses)
+            response << " " << loss;
+    }
+    else if (command == "balance")
+    {
+        if (tokens.size() < 3)
+            throw std::runtime_error("Request \"balance\" requires the index of a measurement "
+              "and the type of the histogram.");
+        
+        auto const &multijet = GetMultijet(localLossFunc, std::stoul(tokens[1]));
+        MultijetBinnedSum::HistReturnType type;
+        
+        if (tokens[2] == "bal")
+            type = MultijetBinnedSum::HistReturnType::bal;
+        else if (tokens[2] == "recompBal")
+            type = MultijetBinnedSum::HistReturnType::recompBal;
+        else if (tokens[2] == "simBal")
+            type = MultijetBinnedSum::HistReturnType::simBal;
+        else
+        {
+            std::ostringstream message;
+            message << "Unknown type of histogram \"" << tokens[2] << "\".";
+            throw std::runtime_error(message.str());
+        }
+        
+        auto &corrector = *localLossFunc.GetCorrector();
+        corrector.SetParams(ParseParams(tokens, 3));
+        TH1D const hist = multijet.GetRecompBalance(corrector,
+          localLossFunc.GetExternalNuisances(), type);
+        int const numBins = hist.GetNbinsX();
+        
+        response << numBins;
+        
+        for (int bin = 1; bin <= numBins + 1; ++bin)
+            response << " " << hist.GetBinLowEdge(bin);
+        
+        for (int bin = 1; bin <= numBins; ++bin)
+            response << " " << hist.GetBinContent(bin);
+        
+        for (int bin = 1; bin <= numBins; ++bin)
+            response << " " << hist.GetBinError(bin);
+    }
+    else if (command == "band")
+    {
+        if (tokens.size() < 3)
+            throw std::runtime_error("Request \"band\" requires the index of a measurement and "
+              "the number of samples.");
+        
+        auto const &multijet = GetMultijet(localLossFunc, std::stoul(tokens[1]));
+        unsigned const numSamples = std::stoul(tokens[2]);
+        std::vector<double> probabilities;
+        
+        for (unsigned i = 3; i < tokens.size(); ++i)
+        {
+            double const p = std::stod(tokens[i]);
+            
+            if (not (p > 0. and p < 1.))
+            {
+                std::ostringstream message;
+                message << "Probability " << p << " is outside of the range (0, 1).";
+                throw std::runtime_error(message.str());
+            }
+            
+            probabilities.emplace_back(p);
+        }
+        
+        if (probabilities.empty())
+            probabilities = {0.16, 0.5, 0.84};
+        
+        auto const samples = SampleParameters(session.lastFit, numSamples, bandSeed);
+        auto const band = multijet.ComputeBalanceBand(*localLossFunc.GetCorrector(),
+          localLossFunc.GetExternalNuisances(), samples, probabilities,
+          localLossFunc.GetNumThreads());
+        
+        response << band.edges.size() - 1;
+        
+        for (auto const &edge: band.edges)
+            response << " " << edge;
+        
+        for (auto const &quantiles: band.quantiles)
+            for (auto const &value: quantiles)
+                response << " " << value;
+    }
+    else
+    {
+        std::ostringstream message;
+        message << "Unknown request \"" << command << "\".";
+        throw std::runtime_error(message.str());
+    }
+    
+    return response.str();
+}
+
+
+void FitServer::ReapConnections()
+{
+    // Threads are taken from the list under the lock but joined after it has been released, since
+    //a finishing thread might still be waiting for the lock
+    std::vector<std::thread> finished;
+    
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        
+        for (auto it = connectionThreads.begin(); it != connectionThreads.end();)
+        {
+            if (finishedThreads.erase(it->get_id()) > 0)
+            {
+                finished.emplace_back(std::move(*it));
+                it = connectionThreads.erase(it);
+            }
+            else
+                ++it;
+        }
+    }
+    
+    for (auto &thread: finished)
+        thread.join();
+}
+
+
+void FitServer::ServeConnection(int socket)
+{
+    Session session;
+    session.lossFunc = lossFunc.Clone();
+    
+    unsigned const nPars = lossFunc.GetNumParams();
+    
+    for (unsigned i = 0; i < nPars; ++i)
+        session.lastFit.names.emplace_back("p" + std::to_string(i));
+    
+    session.lastFit.values.assign(nPars, 0.);
+    session.lastFit.errors.assign(nPars, 1e-2);
+    
+    
+    // Read requests line by line
+    std::string buffer;
+    char chunk[4096];
+    
+    while (true)
+    {
+        auto const lineEnd = buffer.find('\n');
+        
+        if (lineEnd == std::string::npos)
+        {
+            ssize_t const n = recv(socket, chunk, sizeof(chunk), 0);
+            
+            if (n < 0 and errno == EINTR)
+                continue;
+            
+            if (n <= 0)
+                break;
+            
+            buffer.append(chunk, n);
+            continue;
+        }
+        
+        std::istringstream lineStream(buffer.substr(0, lineEnd));
+        buffer.erase(0, lineEnd + 1);
+        
+        std::vector<std::string> tokens;
+        std::string token;
+        
+        while (lineStream >> token)
+            tokens.emplace_back(token);
+        
+        if (tokens.empty())
+            continue;
+        
+        
+        // Process the request. Errors are reported to the client, and the connection is kept.
+        bool const isShutdown = (tokens.front() == "shutdown");
+        std::string response;
+        
+        if (isShutdown)
+            response = "ok";
+        else
+        {
+            try
+            {
+                std::string const payload(ProcessRequest(session, tokens));
+                response = (payload.empty()) ? "ok" : "ok " + payload;
+            }
+            catch (std::exception const &e)
+            {
+                response = std::string("error ") + e.what();
+            }
+        }
+        
+        if (not SendAll(socket, response + '\n'))
+            break;
+        
+        if (isShutdown)
+        {
+            Stop();
+            break;
+        }
+    }
+    
+    std::lock_guard<std::mutex> lock(mutex);
+    clientSockets.erase(socket);
+    finishedThreads.insert(std::this_thread::get_id());
+    close(socket);
+}
+
+
+void FitServer::Stop()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    stopRequested = true;
+    ::shutdown(listenSocket, SHUT_RDWR);
+    
+    for (auto const &clientSocket: clientSockets)
+        ::shutdown(clientSocket, SHUT_RDWR);
+}
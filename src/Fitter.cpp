@@ -0,0 +1,409 @@
+#include <Fitter.hpp>
+
+#include <CounterRng.hpp>
+#include <LinearAlgebra.hpp>
+
+#include <Minuit2/Minuit2Minimizer.h>
+#include <Math/Functor.h>
+
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+
+#include <unistd.h>
+
+
+FitResult::FitResult():
+    status(-1), covStatus(-1),
+    minValue(std::numeric_limits<double>::infinity()), edm(0.),
+    numCalls(0)
+{}
+
+
+void SaveFitResult(FitResult const &result, std::string const &fileName)
+{
+    // Several threads or processes can write the same file concurrently, e.g. fits that share a
+    //checkpoint. Each of them writes its own temporary file in the same directory, so that the
+    //renaming is atomic.
+    static std::atomic<unsigned> counter(0);
+    std::string const tmpFileName(fileName + ".tmp" + std::to_string(getpid()) + "." +
+      std::to_string(counter++));
+    std::ofstream file(tmpFileName);
+    
+    if (not file)
+    {
+        std::ostringstream message;
+        message << "SaveFitResult: Failed to open file \"" << tmpFileName << "\" for writing.";
+        throw std::runtime_error(message.str());
+    }
+    
+    unsigned const nPars = result.values.size();
+    file << std::setprecision(std::numeric_limits<double>::max_digits10);
+    
+    file << "# Checkpoint of a fit\n";
+    file << "version 1\n";
+    file << "status " << result.status << '\n';
+    file << "covStatus " << result.covStatus << '\n';
+    file << "minValue " << result.minValue << '\n';
+    file << "edm " << result.edm << '\n';
+    file << "numCalls " << result.numCalls << '\n';
+    
+    file << "parameters " << nPars << '\n';
+    
+    for (unsigned i = 0; i < nPars; ++i)
+        file << result.names.at(i) << " " << result.values[i] << " " << result.errors.at(i) << '\n';
+    
+    file << "covariance " << ((result.covariance.empty()) ? 0 : nPars) << '\n';
+    
+    if (not result.covariance.empty())
+    {
+        for (unsigned i = 0; i < nPars; ++i)
+        {
+            for (unsigned j = 0; j < nPars; ++j)
+                file << result.covariance.at(i * nPars + j) << " ";
+            
+            file << '\n';
+        }
+    }
+    
+    file.close();
+    
+    if (not file or std::rename(tmpFileName.c_str(), fileName.c_str()) != 0)
+    {
+        std::remove(tmpFileName.c_str());
+        std::ostringstream message;
+        message << "SaveFitResult: Failed to write file \"" << fileName << "\".";
+        throw std::runtime_error(message.str());
+    }
+}
+
+
+FitResult LoadFitResult(std::string const &fileName)
+{
+    std::ifstream file(fileName);
+    
+    if (not file)
+    {
+        std::ostringstream message;
+        message << "LoadFitResult: Failed to open file \"" << fileName << "\".";
+        throw std::runtime_error(message.str());
+    }
+    
+    
+    // Skip the header
+    std::string line;
+    std::getline(file, line);
+    
+    auto const readField = [&file, &fileName](std::string const &expectedKey)
+    {
+        std::string key;
+        file >> key;
+        
+        if (key != expectedKey)
+        {
+            std::ostringstream message;
+            message << "LoadFitResult: Expected key \"" << expectedKey << "\" but found \"" <<
+              key << "\" in file \"" << fileName << "\".";
+            throw std::runtime_error(message.str());
+        }
+    };
+    
+    FitResult result;
+    unsigned version;
+    
+    readField("version");
+    file >> version;
+    
+    if (version != 1)
+    {
+        std::ostringstream message;
+        message << "LoadFitResult: Unsupported version " << version << " of file \"" <<
+          fileName << "\".";
+        throw std::runtime_error(message.str());
+    }
+    
+    readField("status");
+    file >> result.status;
+    readField("covStatus");
+    file >> result.covStatus;
+    readField("minValue");
+    file >> result.minValue;
+    readField("edm");
+    file >> result.edm;
+    readField("numCalls");
+    file >> result.numCalls;
+    
+    unsigned nPars;
+    readField("parameters");
+    file >> nPars;
+    
+    result.names.resize(nPars);
+    result.values.resize(nPars);
+    result.errors.resize(nPars);
+    
+    for (unsigned i = 0; i < nPars; ++i)
+        file >> result.names[i] >> result.values[i] >> result.errors[i];
+    
+    unsigned covSize;
+    readField("covariance");
+    file >> covSize;
+    
+    if (covSize != 0 and covSize != nPars)
+    {
+        std::ostringstream message;
+        message << "LoadFitResult: Covariance matrix of size " << covSize << " does not match " <<
+          nPars << " parameters in file \"" << fileName << "\".";
+        throw std::runtime_error(message.str());
+    }
+    
+    result.covariance.resize(covSize * covSize);
+    
+    for (auto &c: result.covariance)
+        file >> c;
+    
+    if (not file)
+    {
+        std::ostringstream message;
+        message << "LoadFitResult: Failed to parse file \"" << fileName << "\".";
+        throw std::runtime_error(message.str());
+    }
+    
+    return result;
+}
+
+
+std::vector<std::vector<double>> SampleParameters(FitResult const &result, unsigned numSamples,
+  std::uint64_t seed)
+{
+    unsigned const nPars = result.values.size();
+    
+    if (result.covariance.size() != nPars * nPars)
+        throw std::runtime_error("SampleParameters: Covariance matrix is not available.");
+    
+    
+    // Decompose the covariance matrix restricted to parameters with non-zero variances
+    std::vector<unsigned> floating;
+    
+    for (unsigned i = 0; i < nPars; ++i)
+    {
+        if (result.covariance[i * nPars + i] > 0.)
+            floating.emplace_back(i);
+    }
+    
+    unsigned const n = floating.size();
+    std::vector<double> decomposition(n * n);
+    
+    for (unsigned i = 0; i < n; ++i)
+        for (unsigned j = 0; j < n; ++j)
+            decomposition[i * n + j] = result.covariance[floating[i] * nPars + floating[j]];
+    
+    if (not CholeskyDecompose(decomposition, n))
+        throw std::runtime_error("SampleParameters: Covariance matrix is not positive-definite.");
+    
+    
+    // Transform independent standard normal numbers with the Cholesky factor
+    std::vector<std::vector<double>> samples(numSamples, result.values);
+    std::vector<double> z(n);
+    
+    for (unsigned k = 0; k < numSamples; ++k)
+    {
+        CounterRng rng(seed, k);
+        
+        for (auto &x: z)
+            x = rng.Gaus();
+        
+        for (unsigned i = 0; i < n; ++i)
+        {
+            double shift = 0.;
+            
+            for (unsigned j = 0; j <= i; ++j)
+                shift += decomposition[i * n + j] * z[j];
+            
+            samples[k][floating[i]] += shift;
+        }
+    }
+    
+    return samples;
+}
+
+
+Fitter::Fitter(CombLossFunction const &lossFunc_):
+    lossFunc(lossFunc_),
+    checkpointPeriod(0),
+    strategy(2),  // high quality
+    printLevel(0)
+{
+    unsigned const nPars = lossFunc.GetNumParams();
+    
+    for (unsigned i = 0; i < nPars; ++i)
+        start.names.emplace_back("p" + std::to_string(i));
+    
+    start.values.assign(nPars, 0.);
+    start.errors.assign(nPars, 1e-2);
+}
+
+
+FitResult Fitter::Fit()
+{
+    unsigned const nPars = lossFunc.GetNumParams();
+    
+    
+    // The best point seen so far. It is saved in periodic checkpoints. Since the covariance
+    //matrix is not accessible before the minimization has finished, the checkpoints carry none,
+    //and their uncertainties are the initial step sizes.
+    FitResult current(start);
+    current.status = -1;
+    current.covStatus = -1;
+    current.minValue = std::numeric_limits<double>::infinity();
+    current.numCalls = 0;
+    current.covariance.clear();
+    
+    auto const evalLoss = [this, nPars, &current](double const *x)
+    {
+        double const loss = lossFunc.EvalRawInput(x);
+        ++current.numCalls;
+        
+        if (loss < current.minValue)
+        {
+            current.minValue = loss;
+            current.values.assign(x, x + nPars);
+        }
+        
+        if (checkpointPeriod > 0 and not checkpointFileName.empty() and
+          current.numCalls % checkpointPeriod == 0)
+            SaveFitResult(current, checkpointFileName);
+        
+        if (monitor)
+            monitor(current);
+        
+        return loss;
+    };
+    
+    
+    // Set up the minimizer
+    ROOT::Minuit2::Minuit2Minimizer minimizer;
+    ROOT::Math::Functor func(evalLoss, nPars);
+    minimizer.SetFunction(func);
+    minimizer.SetStrategy(strategy);
+    minimizer.SetErrorDef(1.);  // error level for a chi2 function
+    minimizer.SetPrintLevel(printLevel);
+    
+    for (unsigned i = 0; i < nPars; ++i)
+    {
+        auto const fixedParam = fixedParams.find(i);
+        
+        if (fixedParam != fixedParams.end())
+        {
+            minimizer.SetFixedVariable(i, start.names[i], fixedParam->second);
+            continue;
+        }
+        
+        double const step = (start.errors[i] > 0.) ? start.errors[i] : 1e-2;
+        minimizer.SetVariable(i, start.names[i], start.values[i], step);
+    }
+    
+    // Minuit2 expects the lower triangle of the covariance matrix packed row by row
+    if (not start.covariance.empty() and fixedParams.empty())
+    {
+        std::vector<double> packedCovariance;
+        packedCovariance.reserve(nPars * (nPars + 1) / 2);
+        
+        for (unsigned i = 0; i < nPars; ++i)
+            for (unsigned j = 0; j <= i; ++j)
+                packedCovariance.emplace_back(start.covariance[i * nPars + j]);
+        
+        minimizer.SetCovariance(packedCovariance, nPars);
+    }
+    
+    
+    // Run minimization and collect the results
+    minimizer.Minimize();
+    
+    FitResult result;
+    result.status = minimizer.Status();
+    result.covStatus = minimizer.CovMatrixStatus();
+    result.minValue = minimizer.MinValue();
+    result.edm = minimizer.Edm();
+    result.numCalls = current.numCalls;
+    result.names = start.names;
+    result.values.assign(minimizer.X(), minimizer.X() + nPars);
+    result.errors.assign(minimizer.Errors(), minimizer.Errors() + nPars);
+    result.covariance.reserve(nPars * nPars);
+    
+    for (unsigned i = 0; i < nPars; ++i)
+        for (unsigned j = 0; j < nPars; ++j)
+            result.covariance.emplace_back(minimizer.CovMatrix(i, j));
+    
+    if (not checkpointFileName.empty())
+        SaveFitResult(result, checkpointFileName);
+    
+    return result;
+}
+
+
+void Fitter::FixParameter(unsigned index, double value)
+{
+    if (index >= lossFunc.GetNumParams())
+    {
+        std::ostringstream message;
+        message << "Fitter::FixParameter: Index " << index << " is out of range for " <<
+          lossFunc.GetNumParams() << " parameters.";
+        throw std::runtime_error(message.str());
+    }
+    
+    fixedParams[index] = value;
+}
+
+
+void Fitter::SetCheckpoint(std::string const &fileName, unsigned period)
+{
+    checkpointFileName = fileName;
+    checkpointPeriod = period;
+}
+
+
+void Fitter::SetMonitor(std::function<void(FitResult const &)> const &monitor_)
+{
+    monitor = monitor_;
+}
+
+
+void Fitter::SetPrintLevel(int printLevel_)
+{
+    printLevel = printLevel_;
+}
+
+
+void Fitter::SetStartingPoint(FitResult const &start_)
+{
+    unsigned const nPars = lossFunc.GetNumParams();
+    
+    if (start_.values.size() != nPars or start_.errors.size() != nPars or
+      start_.names.size() != nPars)
+    {
+        std::ostringstream message;
+        message << "Fitter::SetStartingPoint: Starting point contains " << start_.values.size() <<
+          " parameters while " << nPars << " are expected.";
+        throw std::runtime_error(message.str());
+    }
+    
+    if (not start_.covariance.empty() and start_.covariance.size() != nPars * nPars)
+    {
+        std::ostringstream message;
+        message << "Fitter::SetStartingPoint: Covariance matrix contains " <<
+          start_.covariance.size() << " elements while " << nPars * nPars << " are expected.";
+        throw std::runtime_error(message.str());
+    }
+    
+    start = start_;
+}
+
+
+void Fitter::SetStrategy(unsigned strategy_)
+{
+    strategy = strategy_;
+}
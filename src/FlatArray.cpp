@@ -0,0 +1,140 @@
+#include <FlatArray.hpp>
+
+#include <algorithm>
+#include <utility>
+
+
+FlatArray::FlatArray():
+    ptr(nullptr), length(0)
+{}
+
+
+FlatArray::FlatArray(std::vector<double> &&values):
+    storage(std::move(values)),
+    ptr(storage.data()), length(storage.size())
+{}
+
+
+FlatArray::FlatArray(double const *data, std::size_t size):
+    ptr(data), length(size)
+{}
+
+
+FlatArray::FlatArray(FlatArray const &src):
+    storage(src.storage),
+    ptr((src.IsView()) ? src.ptr : storage.data()), length(src.length)
+{}
+
+
+FlatArray::FlatArray(FlatArray &&src) noexcept:
+    storage(std::move(src.storage)),
+    ptr(src.ptr), length(src.length)
+{
+    // Moving a vector preserves its buffer, so the pointer remains valid for an owning array
+    src.ptr = nullptr;
+    src.length = 0;
+}
+
+
+FlatArray &FlatArray::operator=(FlatArray const &src)
+{
+    if (this != &src)
+    {
+        storage = src.storage;
+        ptr = (src.IsView()) ? src.ptr : storage.data();
+        length = src.length;
+    }
+    
+    return *this;
+}
+
+
+FlatArray &FlatArray::operator=(FlatArray &&src) noexcept
+{
+    if (this != &src)
+    {
+        storage = std::move(src.storage);
+        ptr = src.ptr;
+        length = src.length;
+        
+        src.ptr = nullptr;
+        src.length = 0;
+    }
+    
+    return *this;
+}
+
+
+double const *FlatArray::begin() const
+{
+    return ptr;
+}
+
+
+double const *FlatArray::data() const
+{
+    return ptr;
+}
+
+
+double const *FlatArray::end() const
+{
+    return ptr + length;
+}
+
+
+bool FlatArray::IsView() const
+{
+    return (length > 0 and ptr != storage.data());
+}
+
+
+std::size_t FlatArray::size() const
+{
+    return length;
+}
+
+
+std::vector<double> FlatArray::ToVector() const
+{
+    return std::vector<double>(begin(), end());
+}
+
+
+unsigned FindBin(FlatArray const &edges, double x)
+{
+    // The index of the first edge above x coincides with the index of the bin in ROOT's numbering
+    return std::upper_bound(edges.begin(), edges.end(), x) - edges.begin();
+}
+
+
+double GetBinLowEdge(FlatArray const &edges, unsigned bin)
+{
+    unsigned const numBins = edges.size() - 1;
+    
+    if (bin > 0 and bin <= numBins)
+        return edges[bin - 1];
+    
+    double const meanWidth = (edges[numBins] - edges[0]) / numBins;
+    return edges[0] + (double(bin) - 1.) * meanWidth;
+}
+
+
+double GetBinCenter(FlatArray const &edges, unsigned bin)
+{
+    unsigned const numBins = edges.size() - 1;
+    
+    if (bin > 0 and bin <= numBins)
+        return (edges[bin - 1] + edges[bin]) / 2.;
+    
+    double const meanWidth = (edges[numBins] - edges[0]) / numBins;
+    return edges[0] + (double(bin) - 0.5) * meanWidth;
+}
+
+
+double GetBinWidth(FlatArray const &edges, unsigned bin)
+{
+    unsigned const numBins = edges.size() - 1;
+    bin = std::min(std::max(bin, 1u), numBins);
+    return edges[bin] - edges[bin - 1];
+}
@@ -0,0 +1,34 @@
+#include <Fluctuations.hpp>
+
+
+void FluctuateBalanceInputs(CounterRng &rng, bool isPtBal, std::vector<double> &numEvents,
+  std::vector<double> &meanBal, std::vector<double> const &meanBalUnc,
+  std::vector<double> &ptJetSumProj, unsigned rowLength)
+{
+    // Under- and overflow bins are not fluctuated
+    for (unsigned bin = 1; bin + 1 < numEvents.size(); ++bin)
+    {
+        double const nominalNumEvents = numEvents[bin];
+        
+        if (nominalNumEvents <= 0.)
+            continue;
+        
+        double const newNumEvents = rng.Poisson(nominalNumEvents);
+        double const nominalMeanBal = meanBal[bin];
+        double const shift = rng.Gaus(0., meanBalUnc[bin]);
+        
+        numEvents[bin] = newNumEvents;
+        meanBal[bin] += shift;
+        
+        
+        // Rescale the row of the sum of projections. With the pt balance method the mean balance
+        //in data is proportional to the sum divided by the number of events.
+        double scale = newNumEvents / nominalNumEvents;
+        
+        if (isPtBal and nominalMeanBal != 0.)
+            scale *= 1. + shift / nominalMeanBal;
+        
+        for (unsigned binJet = 0; binJet < rowLength; ++binJet)
+            ptJetSumProj[bin * rowLength + binJet] *= scale;
+    }
+}
@@ -0,0 +1,206 @@
+#include <HistFlattening.hpp>
+
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+
+namespace
+{
+/**
+ * \brief Reads sums stored in a profile
+ * 
+ * Type T is TProfile or TProfile2D. The given vector maps flat indices of bins to their global
+ * indices in ROOT. All sums are scaled with the given weight, and the sum of squared weights with
+ * its square.
+ */
+template<typename T>
+ProfileSums ReadSums(T const &profile, std::vector<int> const &globalBins, double weight)
+{
+    // Sums of weighted values are stored in the main array of the profile and sums of weighted
+    //squared values in the array normally used for squared weights. Sums of squared weights are
+    //only available if the profile has been filled with weights; otherwise they coincide with the
+    //sums of weights.
+    double const *arrayWY = profile.GetArray();
+    double const *arrayWY2 = profile.GetSumw2()->GetArray();
+    TArrayD const *binSumW2 = profile.GetBinSumw2();
+    bool const hasBinSumW2 = (binSumW2 and binSumW2->GetSize() > 0);
+    std::vector<double> sumW, sumW2, sumWY, sumWY2;
+    
+    for (auto const &bin: globalBins)
+    {
+        double const w = profile.GetBinEntries(bin);
+        sumW.emplace_back(weight * w);
+        sumW2.emplace_back(weight * weight * ((hasBinSumW2) ? binSumW2->GetArray()[bin] : w));
+        sumWY.emplace_back(weight * arrayWY[bin]);
+        sumWY2.emplace_back(weight * arrayWY2[bin]);
+    }
+    
+    std::string const errorOption(profile.GetErrorOption());
+    return ProfileSums(std::move(sumW), std::move(sumW2), std::move(sumWY), std::move(sumWY2),
+      (errorOption == "s" or errorOption == "S"));
+}
+
+
+/**
+ * \brief Stores sums in a profile
+ * 
+ * This is the inverse of ReadSums. Type T is TProfile or TProfile2D.
+ */
+template<typename T>
+void WriteSums(T &profile, std::vector<int> const &globalBins, ProfileSums const &sums)
+{
+    if (globalBins.size() != sums.GetNumBins())
+    {
+        std::ostringstream message;
+        message << "SetProfileSums: Profile \"" << profile.GetName() << "\" contains " <<
+          globalBins.size() << " bins while the sums are given for " << sums.GetNumBins() <<
+          " bins.";
+        throw std::runtime_error(message.str());
+    }
+    
+    
+    // Make sure the array of sums of squared weights is allocated. The layout of the other arrays
+    //is described in ReadSums.
+    if (profile.GetBinSumw2()->GetSize() != profile.GetNcells())
+        profile.Sumw2();
+    
+    double *arrayWY = profile.GetArray();
+    double *arrayWY2 = profile.GetSumw2()->GetArray();
+    double *binSumW2 = profile.GetBinSumw2()->GetArray();
+    double totalSumW = 0.;
+    
+    for (unsigned i = 0; i < globalBins.size(); ++i)
+    {
+        int const bin = globalBins[i];
+        profile.SetBinEntries(bin, sums.GetSumW()[i]);
+        binSumW2[bin] = sums.GetSumW2()[i];
+        arrayWY[bin] = sums.GetSumWY()[i];
+        arrayWY2[bin] = sums.GetSumWY2()[i];
+        totalSumW += sums.GetSumW()[i];
+    }
+    
+    profile.SetErrorOption((sums.HasSpreadErrors()) ? "s" : "");
+    profile.SetEntries(totalSumW);
+}
+}
+
+
+std::vector<double> GetBinEdges(TAxis const &axis)
+{
+    std::vector<double> edges;
+    edges.reserve(axis.GetNbins() + 1);
+    
+    for (int i = 1; i <= axis.GetNbins() + 1; ++i)
+        edges.emplace_back(axis.GetBinLowEdge(i));
+    
+    return edges;
+}
+
+
+std::vector<double> GetBinContents(TH1 const &hist, bool includeUnderOverflow)
+{
+    int const first = (includeUnderOverflow) ? 0 : 1;
+    int const last = (includeUnderOverflow) ? hist.GetNbinsX() + 1 : hist.GetNbinsX();
+    std::vector<double> contents;
+    contents.reserve(last - first + 1);
+    
+    for (int i = first; i <= last; ++i)
+        contents.emplace_back(hist.GetBinContent(i));
+    
+    return contents;
+}
+
+
+std::vector<double> GetBinContents2D(TH2 const &hist)
+{
+    std::vector<double> contents;
+    contents.reserve((hist.GetNbinsX() + 2) * (hist.GetNbinsY() + 2));
+    
+    for (int i = 0; i <= hist.GetNbinsX() + 1; ++i)
+        for (int j = 0; j <= hist.GetNbinsY() + 1; ++j)
+            contents.emplace_back(hist.GetBinContent(i, j));
+    
+    return contents;
+}
+
+
+ProfileSums ReadProfileSums(TProfile const &profile, double weight)
+{
+    std::vector<int> globalBins;
+    
+    for (int i = 0; i <= profile.GetNbinsX() + 1; ++i)
+        globalBins.emplace_back(i);
+    
+    return ReadSums(profile, globalBins, weight);
+}
+
+
+ProfileSums ReadProfileSums(TProfile2D const &profile, double weight)
+{
+    std::vector<int> globalBins;
+    
+    for (int i = 0; i <= profile.GetNbinsX() + 1; ++i)
+        for (int j = 0; j <= profile.GetNbinsY() + 1; ++j)
+            globalBins.emplace_back(profile.GetBin(i, j));
+    
+    return ReadSums(profile, globalBins, weight);
+}
+
+
+void SetBinContents(TH1 &hist, std::vector<double> const &contents)
+{
+    if (int(contents.size()) != hist.GetNbinsX() + 2)
+    {
+        std::ostringstream message;
+        message << "SetBinContents: Histogram \"" << hist.GetName() << "\" contains " <<
+          hist.GetNbinsX() + 2 << " bins while " << contents.size() << " contents are given.";
+        throw std::runtime_error(message.str());
+    }
+    
+    for (int i = 0; i <= hist.GetNbinsX() + 1; ++i)
+        hist.SetBinContent(i, contents[i]);
+}
+
+
+void SetBinContents2D(TH2 &hist, std::vector<double> const &contents)
+{
+    int const numBinsY = hist.GetNbinsY() + 2;
+    
+    if (int(contents.size()) != (hist.GetNbinsX() + 2) * numBinsY)
+    {
+        std::ostringstream message;
+        message << "SetBinContents2D: Histogram \"" << hist.GetName() << "\" contains " <<
+          (hist.GetNbinsX() + 2) * numBinsY << " bins while " << contents.size() <<
+          " contents are given.";
+        throw std::runtime_error(message.str());
+    }
+    
+    for (int i = 0; i <= hist.GetNbinsX() + 1; ++i)
+        for (int j = 0; j < numBinsY; ++j)
+            hist.SetBinContent(i, j, contents[i * numBinsY + j]);
+}
+
+
+void SetProfileSums(TProfile &profile, ProfileSums const &sums)
+{
+    std::vector<int> globalBins;
+    
+    for (int i = 0; i <= profile.GetNbinsX() + 1; ++i)
+        globalBins.emplace_back(i);
+    
+    WriteSums(profile, globalBins, sums);
+}
+
+
+void SetProfileSums(TProfile2D &profile, ProfileSums const &sums)
+{
+    std::vector<int> globalBins;
+    
+    for (int i = 0; i <= profile.GetNbinsX() + 1; ++i)
+        for (int j = 0; j <= profile.GetNbinsY() + 1; ++j)
+            globalBins.emplace_back(profile.GetBin(i, j));
+    
+    WriteSums(profile, globalBins, sums);
+}
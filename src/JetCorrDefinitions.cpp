@@ -2,6 +2,7 @@
 
 #include <algorithm>
 #include <cmath>
+#include <memory>
 #include <sstream>
 #include <stdexcept>
 
@@ -12,6 +13,12 @@ JetCorrStableLogLin::JetCorrStableLogLin(double ptMin_):
 {}
 
 
+std::unique_ptr<JetCorrBase> JetCorrStableLogLin::Clone() const
+{
+    return std::make_unique<JetCorrStableLogLin>(*this);
+}
+
+
 double JetCorrStableLogLin::Eval(double pt) const
 {
     double const b = 1.;
@@ -27,6 +34,12 @@ JetCorrStd2P::JetCorrStd2P():
 {}
 
 
+std::unique_ptr<JetCorrBase> JetCorrStd2P::Clone() const
+{
+    return std::make_unique<JetCorrStd2P>(*this);
+}
+
+
 double JetCorrStd2P::Eval(double pt) const
 {
     double response = 1. + parameters[0] + parameters[1] / 0.03 * (fSPR(pt) - fSPR(ptRef));
@@ -64,6 +77,12 @@ JetCorrStd3P::JetCorrStd3P():
 }
 
 
+std::unique_ptr<JetCorrBase> JetCorrStd3P::Clone() const
+{
+    return std::make_unique<JetCorrStd3P>(*this);
+}
+
+
 double JetCorrStd3P::Eval(double pt) const
 {
     double response = 1. + parameters[0] + \
@@ -0,0 +1,304 @@
+#include <LinearAlgebra.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <stdexcept>
+
+
+namespace
+{
+/**
+ * \brief Solves L L^T X = B for a matrix B with the given number of columns
+ * 
+ * Matrix B is overwritten with the solution.
+ */
+void CholeskySolveColumns(std::vector<double> const &l, unsigned n, std::vector<double> &b,
+  unsigned cols)
+{
+    std::vector<double> column(n);
+    
+    for (unsigned j = 0; j < cols; ++j)
+    {
+        for (unsigned i = 0; i < n; ++i)
+            column[i] = b[i * cols + j];
+        
+        CholeskySolve(l, n, column.data());
+        
+        for (unsigned i = 0; i < n; ++i)
+            b[i * cols + j] = column[i];
+    }
+}
+}
+
+
+bool CholeskyDecompose(std::vector<double> &a, unsigned n)
+{
+    for (unsigned j = 0; j < n; ++j)
+    {
+        double diag = a[j * n + j];
+        
+        for (unsigned k = 0; k < j; ++k)
+            diag -= a[j * n + k] * a[j * n + k];
+        
+        if (not (diag > 0.))
+            return false;
+        
+        diag = std::sqrt(diag);
+        a[j * n + j] = diag;
+        
+        for (unsigned i = j + 1; i < n; ++i)
+        {
+            double s = a[i * n + j];
+            
+            for (unsigned k = 0; k < j; ++k)
+                s -= a[i * n + k] * a[j * n + k];
+            
+            a[i * n + j] = s / diag;
+        }
+        
+        for (unsigned i = 0; i < j; ++i)
+            a[i * n + j] = 0.;
+    }
+    
+    return true;
+}
+
+
+void CholeskySolve(std::vector<double> const &l, unsigned n, double *b)
+{
+    // Forward substitution with L
+    for (unsigned i = 0; i < n; ++i)
+    {
+        double s = b[i];
+        
+        for (unsigned k = 0; k < i; ++k)
+            s -= l[i * n + k] * b[k];
+        
+        b[i] = s / l[i * n + i];
+    }
+    
+    // Backward substitution with L^T
+    for (unsigned i = n; i-- > 0;)
+    {
+        double s = b[i];
+        
+        for (unsigned k = i + 1; k < n; ++k)
+            s -= l[k * n + i] * b[k];
+        
+        b[i] = s / l[i * n + i];
+    }
+}
+
+
+std::vector<double> InvertSymmetric(std::vector<double> const &matrix, unsigned n)
+{
+    std::vector<double> l(matrix);
+    
+    if (not CholeskyDecompose(l, n))
+        throw std::runtime_error("InvertSymmetric: Matrix is not positive-definite.");
+    
+    std::vector<double> inverse(n * n, 0.);
+    std::vector<double> column(n);
+    
+    for (unsigned j = 0; j < n; ++j)
+    {
+        std::fill(column.begin(), column.end(), 0.);
+        column[j] = 1.;
+        CholeskySolve(l, n, column.data());
+        
+        for (unsigned i = 0; i < n; ++i)
+            inverse[i * n + j] = column[i];
+    }
+    
+    return inverse;
+}
+
+
+std::vector<double> SolveLeastSquares(std::vector<double> const &designMatrix,
+  std::vector<double> const &y, unsigned numCols)
+{
+    unsigned const numRows = y.size();
+    
+    if (numRows < numCols)
+    {
+        std::ostringstream message;
+        message << "SolveLeastSquares: Only " << numRows << " equations given for " << numCols <<
+          " unknowns.";
+        throw std::runtime_error(message.str());
+    }
+    
+    
+    // Build normal equations A^T A c = A^T y
+    std::vector<double> ata(numCols * numCols, 0.), aty(numCols, 0.);
+    
+    for (unsigned r = 0; r < numRows; ++r)
+    {
+        double const *row = designMatrix.data() + r * numCols;
+        
+        for (unsigned i = 0; i < numCols; ++i)
+        {
+            aty[i] += row[i] * y[r];
+            
+            for (unsigned j = 0; j <= i; ++j)
+                ata[i * numCols + j] += row[i] * row[j];
+        }
+    }
+    
+    for (unsigned i = 0; i < numCols; ++i)
+    {
+        ata[i * numCols + i] *= 1. + 1e-12;
+        
+        for (unsigned j = 0; j < i; ++j)
+            ata[j * numCols + i] = ata[i * numCols + j];
+    }
+    
+    
+    if (not CholeskyDecompose(ata, numCols))
+        throw std::runtime_error("SolveLeastSquares: Design matrix is degenerate.");
+    
+    CholeskySolve(ata, numCols, aty.data());
+    return aty;
+}
+
+
+std::vector<double> MultiplyMatrices(std::vector<double> const &a, std::vector<double> const &b,
+  unsigned rows, unsigned inner, unsigned cols)
+{
+    std::vector<double> product(rows * cols, 0.);
+    
+    for (unsigned i = 0; i < rows; ++i)
+        for (unsigned k = 0; k < inner; ++k)
+        {
+            double const aik = a[i * inner + k];
+            
+            for (unsigned j = 0; j < cols; ++j)
+                product[i * cols + j] += aik * b[k * cols + j];
+        }
+    
+    return product;
+}
+
+
+std::vector<double> Transpose(std::vector<double> const &matrix, unsigned rows, unsigned cols)
+{
+    std::vector<double> transposed(rows * cols);
+    
+    for (unsigned i = 0; i < rows; ++i)
+        for (unsigned j = 0; j < cols; ++j)
+            transposed[j * rows + i] = matrix[i * cols + j];
+    
+    return transposed;
+}
+
+
+bool SolveBlockTridiagonal(std::vector<unsigned> const &blockSizes,
+  std::vector<std::vector<double>> const &diagBlocks,
+  std::vector<std::vector<double>> const &offDiagBlocks, double lambda, std::vector<double> &rhs,
+  std::vector<std::vector<double>> *inverseBlocks)
+{
+    unsigned const nBins = blockSizes.size();
+    std::vector<unsigned> offsets(nBins, 0);
+    
+    for (unsigned k = 1; k < nBins; ++k)
+        offsets[k] = offsets[k - 1] + blockSizes[k - 1];
+    
+    
+    // Forward elimination. For each block compute the Cholesky factor of the Schur complement
+    //  S_k = D_k - U_{k-1}^T S_{k-1}^{-1} U_{k-1}
+    //and update the right-hand side accordingly. Matrices W_k = S_k^{-1} U_k are saved for the
+    //backward pass.
+    std::vector<std::vector<double>> choleskyFactors(nBins), w(nBins);
+    
+    for (unsigned k = 0; k < nBins; ++k)
+    {
+        unsigned const size = blockSizes[k];
+        unsigned const offset = offsets[k];
+        std::vector<double> s(diagBlocks[k]);
+        
+        for (unsigned i = 0; i < size; ++i)
+            s[i * size + i] *= 1. + lambda;
+        
+        if (k > 0)
+        {
+            unsigned const sizePrev = blockSizes[k - 1];
+            unsigned const offsetPrev = offsets[k - 1];
+            auto const &u = offDiagBlocks[k - 1];
+            
+            std::vector<double> const correction(MultiplyMatrices(Transpose(u, sizePrev, size),
+              w[k - 1], size, sizePrev, size));
+            
+            for (unsigned i = 0; i < size * size; ++i)
+                s[i] -= correction[i];
+            
+            for (unsigned i = 0; i < size; ++i)
+                for (unsigned j = 0; j < sizePrev; ++j)
+                    rhs[offset + i] -= w[k - 1][j * size + i] * rhs[offsetPrev + j];
+        }
+        
+        if (not CholeskyDecompose(s, size))
+            return false;
+        
+        choleskyFactors[k] = std::move(s);
+        
+        if (k + 1 < nBins)
+        {
+            w[k] = offDiagBlocks[k];
+            CholeskySolveColumns(choleskyFactors[k], size, w[k], blockSizes[k + 1]);
+        }
+    }
+    
+    
+    // Backward substitution, x_k = S_k^{-1} y_k - W_k x_{k+1}
+    for (unsigned k = nBins; k-- > 0;)
+    {
+        unsigned const size = blockSizes[k];
+        unsigned const offset = offsets[k];
+        
+        CholeskySolve(choleskyFactors[k], size, rhs.data() + offset);
+        
+        if (k + 1 < nBins)
+        {
+            unsigned const sizeNext = blockSizes[k + 1];
+            unsigned const offsetNext = offsets[k + 1];
+            
+            for (unsigned i = 0; i < size; ++i)
+                for (unsigned j = 0; j < sizeNext; ++j)
+                    rhs[offset + i] -= w[k][i * sizeNext + j] * rhs[offsetNext + j];
+        }
+    }
+    
+    
+    // Diagonal blocks of the inverse matrix are computed with the recursion
+    //  Sigma_k = S_k^{-1} + W_k Sigma_{k+1} W_k^T
+    if (inverseBlocks)
+    {
+        inverseBlocks->resize(nBins);
+        
+        for (unsigned k = nBins; k-- > 0;)
+        {
+            unsigned const size = blockSizes[k];
+            std::vector<double> sigma(size * size, 0.);
+            
+            for (unsigned i = 0; i < size; ++i)
+                sigma[i * size + i] = 1.;
+            
+            CholeskySolveColumns(choleskyFactors[k], size, sigma, size);
+            
+            if (k + 1 < nBins)
+            {
+                unsigned const sizeNext = blockSizes[k + 1];
+                std::vector<double> const correction(MultiplyMatrices(
+                  MultiplyMatrices(w[k], (*inverseBlocks)[k + 1], size, sizeNext, sizeNext),
+                  Transpose(w[k], size, sizeNext), size, sizeNext, size));
+                
+                for (unsigned i = 0; i < size * size; ++i)
+                    sigma[i] += correction[i];
+            }
+            
+            (*inverseBlocks)[k] = std::move(sigma);
+        }
+    }
+    
+    return true;
+}
@@ -0,0 +1,444 @@
+#include <LossScan.hpp>
+
+#include <LossSurrogate.hpp>
+#include <Parallel.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+
+
+namespace
+{
+/**
+ * \brief Returns index of the parameter of the jet correction with the given name
+ * 
+ * Parameters are referred to as "p0", "p1", etc. Returns -1 if the name does not follow this
+ * pattern or the index is out of range.
+ */
+int FindCorrParam(std::string const &name, unsigned numParams)
+{
+    if (name.size() < 2 or name[0] != 'p' or
+      not std::all_of(name.begin() + 1, name.end(), [](char c){return std::isdigit(c);}))
+        return -1;
+    
+    unsigned const index = std::stoul(name.substr(1));
+    return (index < numParams) ? int(index) : -1;
+}
+
+
+/// Returns pointer to the nuisance with the given name or null if there is no such nuisance
+double *FindNuisance(Nuisances &nuisances, std::string const &name)
+{
+    if (name == "photonScale")
+        return &nuisances.photonScale;
+    
+    for (auto const &entry: nuisances.Multijet_NuisanceCollection)
+    {
+        if (std::get<std::string>(entry) == name)
+            return std::get<double *>(entry);
+    }
+    
+    return nullptr;
+}
+
+
+/// Writes a 32-bit unsigned integer in binary format
+void WriteUInt(std::ostream &out, unsigned value)
+{
+    std::uint32_t const buffer = value;
+    out.write(reinterpret_cast<char const *>(&buffer), sizeof(buffer));
+}
+
+
+/// Writes a string in binary format, prefixed with its length
+void WriteString(std::ostream &out, std::string const &value)
+{
+    WriteUInt(out, value.size());
+    out.write(value.data(), value.size());
+}
+
+
+/// Reads a 32-bit unsigned integer written with WriteUInt
+unsigned ReadUInt(std::istream &in)
+{
+    std::uint32_t buffer = 0;
+    in.read(reinterpret_cast<char *>(&buffer), sizeof(buffer));
+    return buffer;
+}
+
+
+/// Reads a string written with WriteString
+std::string ReadString(std::istream &in)
+{
+    std::string value(ReadUInt(in), '\0');
+    in.read(&value[0], value.size());
+    return value;
+}
+}
+
+
+double ScanAxis::GetPoint(unsigned index) const
+{
+    if (numPoints < 2)
+        return min;
+    
+    return min + (max - min) * index / (numPoints - 1);
+}
+
+
+unsigned ScanResult::GetNumPoints() const
+{
+    unsigned numPoints = 1;
+    
+    for (auto const &axis: axes)
+        numPoints *= axis.numPoints;
+    
+    return numPoints;
+}
+
+
+void SaveScanResult(ScanResult const &result, std::string const &fileName)
+{
+    std::ofstream file(fileName, std::ios::binary);
+    
+    if (not file)
+    {
+        std::ostringstream message;
+        message << "SaveScanResult: Failed to open file \"" << fileName << "\" for writing.";
+        throw std::runtime_error(message.str());
+    }
+    
+    file.write("JECSCAN1", 8);
+    WriteUInt(file, result.axes.size());
+    
+    for (auto const &axis: result.axes)
+    {
+        WriteString(file, axis.name);
+        file.write(reinterpret_cast<char const *>(&axis.min), sizeof(double));
+        file.write(reinterpret_cast<char const *>(&axis.max), sizeof(double));
+        WriteUInt(file, axis.numPoints);
+    }
+    
+    WriteUInt(file, result.profiledNames.size());
+    
+    for (auto const &name: result.profiledNames)
+        WriteString(file, name);
+    
+    file.write(reinterpret_cast<char const *>(result.losses.data()),
+      result.losses.size() * sizeof(double));
+    file.write(reinterpret_cast<char const *>(result.profiledValues.data()),
+      result.profiledValues.size() * sizeof(double));
+    
+    for (auto const &status: result.statuses)
+    {
+        std::int32_t const buffer = status;
+        file.write(reinterpret_cast<char const *>(&buffer), sizeof(buffer));
+    }
+    
+    if (not file)
+    {
+        std::ostringstream message;
+        message << "SaveScanResult: Failed to write file \"" << fileName << "\".";
+        throw std::runtime_error(message.str());
+    }
+}
+
+
+ScanResult LoadScanResult(std::string const &fileName)
+{
+    std::ifstream file(fileName, std::ios::binary);
+    char signature[8];
+    file.read(signature, 8);
+    
+    if (not file or std::memcmp(signature, "JECSCAN1", 8) != 0)
+    {
+        std::ostringstream message;
+        message << "LoadScanResult: File \"" << fileName << "\" does not exist or is not in " <<
+          "the expected format.";
+        throw std::runtime_error(message.str());
+    }
+    
+    ScanResult result;
+    result.axes.resize(ReadUInt(file));
+    
+    for (auto &axis: result.axes)
+    {
+        axis.name = ReadString(file);
+        file.read(reinterpret_cast<char *>(&axis.min), sizeof(double));
+        file.read(reinterpret_cast<char *>(&axis.max), sizeof(double));
+        axis.numPoints = ReadUInt(file);
+    }
+    
+    result.profiledNames.resize(ReadUInt(file));
+    
+    for (auto &name: result.profiledNames)
+        name = ReadString(file);
+    
+    unsigned const numPoints = result.GetNumPoints();
+    result.losses.resize(numPoints);
+    file.read(reinterpret_cast<char *>(result.losses.data()), numPoints * sizeof(double));
+    
+    if (not result.profiledNames.empty())
+    {
+        result.profiledValues.resize(numPoints * result.profiledNames.size());
+        file.read(reinterpret_cast<char *>(result.profiledValues.data()),
+          result.profiledValues.size() * sizeof(double));
+        
+        result.statuses.reserve(numPoints);
+        
+        for (unsigned i = 0; i < numPoints; ++i)
+        {
+            std::int32_t buffer;
+            file.read(reinterpret_cast<char *>(&buffer), sizeof(buffer));
+            result.statuses.emplace_back(buffer);
+        }
+    }
+    
+    if (not file)
+    {
+        std::ostringstream message;
+        message << "LoadScanResult: Failed to parse file \"" << fileName << "\".";
+        throw std::runtime_error(message.str());
+    }
+    
+    return result;
+}
+
+
+LossScan::LossScan(CombLossFunction const &lossFunc_):
+    lossFunc(lossFunc_),
+    numThreads(1),
+    profile(false),
+    surrogateTolerance(0.)
+{
+    unsigned const nPars = lossFunc.GetNumParams();
+    
+    for (unsigned i = 0; i < nPars; ++i)
+        central.names.emplace_back("p" + std::to_string(i));
+    
+    central.values.assign(nPars, 0.);
+    central.errors.assign(nPars, 1e-2);
+}
+
+
+void LossScan::AddAxis(std::string const &name, double min, double max, unsigned numPoints)
+{
+    Nuisances probe(lossFunc.GetExternalNuisances());
+    
+    if (FindCorrParam(name, lossFunc.GetNumParams()) == -1 and not FindNuisance(probe, name))
+    {
+        std::ostringstream message;
+        message << "LossScan::AddAxis: Parameter \"" << name << "\" is neither a parameter of " <<
+          "the jet correction nor a nuisance.";
+        throw std::runtime_error(message.str());
+    }
+    
+    if (std::any_of(axes.begin(), axes.end(), [&name](ScanAxis const &a){return a.name == name;}))
+    {
+        std::ostringstream message;
+        message << "LossScan::AddAxis: Parameter \"" << name << "\" is already scanned.";
+        throw std::runtime_error(message.str());
+    }
+    
+    if (numPoints == 0)
+    {
+        std::ostringstream message;
+        message << "LossScan::AddAxis: No points requested for parameter \"" << name << "\".";
+        throw std::runtime_error(message.str());
+    }
+    
+    axes.emplace_back(ScanAxis{name, min, max, numPoints});
+}
+
+
+ScanResult LossScan::Run() const
+{
+    unsigned const nPars = lossFunc.GetNumParams();
+    
+    ScanResult result;
+    result.axes = axes;
+    
+    
+    // Find which parameters of the jet correction are scanned. Remaining ones are profiled if
+    //requested.
+    std::vector<int> corrIndices;
+    std::vector<bool> isScanned(nPars, false);
+    
+    for (auto const &axis: axes)
+    {
+        int const index = FindCorrParam(axis.name, nPars);
+        corrIndices.emplace_back(index);
+        
+        if (index != -1)
+            isScanned[index] = true;
+    }
+    
+    std::vector<unsigned> profiledIndices;
+    
+    if (profile)
+    {
+        for (unsigned i = 0; i < nPars; ++i)
+        {
+            if (not isScanned[i])
+            {
+                profiledIndices.emplace_back(i);
+                result.profiledNames.emplace_back(central.names[i]);
+            }
+        }
+    }
+    
+    unsigned const numProfiled = profiledIndices.size();
+    unsigned const numPoints = result.GetNumPoints();
+    result.losses.resize(numPoints);
+    result.profiledValues.resize(numPoints * numProfiled);
+    
+    if (numProfiled > 0)
+        result.statuses.resize(numPoints);
+    
+    
+    // Build the surrogate if requested. Within the scan it is only evaluated and never refined, so
+    //that the result does not depend on the order in which points are computed.
+    std::unique_ptr<LossSurrogate> surrogate;
+    
+    if (surrogateTolerance > 0.)
+    {
+        if (numProfiled > 0 or std::count(corrIndices.begin(), corrIndices.end(), -1) > 0)
+            throw std::runtime_error("LossScan::Run: The surrogate can only be used in scans of "
+              "parameters of the jet correction without profiling.");
+        
+        if (central.covariance.size() != nPars * nPars)
+            throw std::runtime_error("LossScan::Run: The surrogate requires central values with "
+              "the covariance matrix.");
+        
+        surrogate = std::make_unique<LossSurrogate>(lossFunc);
+        surrogate->SetTolerance(surrogateTolerance);
+        surrogate->Build(central.values, central.covariance);
+    }
+    
+    std::atomic<unsigned> numSurrogatePoints(0);
+    
+    
+    // Each thread evaluates its own copy of the loss function and takes chunks of consecutive
+    //points from the common queue
+    unsigned const chunkSize = (numProfiled > 0) ? 1 : 16;
+    std::atomic<unsigned> nextPoint(0);
+    
+    auto const worker = [&](unsigned)
+    {
+        auto const localLossFunc = lossFunc.Clone();
+        Nuisances nuisances(localLossFunc->GetExternalNuisances());
+        std::vector<double *> nuisancePointers;
+        
+        for (unsigned k = 0; k < axes.size(); ++k)
+            nuisancePointers.emplace_back((corrIndices[k] == -1) ?
+              FindNuisance(nuisances, axes[k].name) : nullptr);
+        
+        std::vector<double> params(central.values);
+        
+        while (true)
+        {
+            unsigned const begin = nextPoint.fetch_add(chunkSize);
+            
+            if (begin >= numPoints)
+                break;
+            
+            for (unsigned point = begin; point < std::min(begin + chunkSize, numPoints); ++point)
+            {
+                // Decode the index of the point. The last axis changes the fastest.
+                unsigned remainder = point;
+                
+                for (int k = axes.size() - 1; k >= 0; --k)
+                {
+                    double const value = axes[k].GetPoint(remainder % axes[k].numPoints);
+                    remainder /= axes[k].numPoints;
+                    
+                    if (corrIndices[k] != -1)
+                        params[corrIndices[k]] = value;
+                    else
+                        *nuisancePointers[k] = value;
+                }
+                
+                if (numProfiled == 0)
+                {
+                    if (surrogate and surrogate->IsInTrustRegion(params.data()))
+                    {
+                        result.losses[point] = surrogate->EvalPolynomialRawInput(params.data());
+                        ++numSurrogatePoints;
+                    }
+                    else
+                        result.losses[point] = localLossFunc->Eval(params, nuisances);
+                    
+                    continue;
+                }
+                
+                
+                // Minimize the loss function with respect to parameters that are not scanned
+                localLossFunc->SetExternalNuisances(nuisances);
+                Fitter fitter(*localLossFunc);
+                fitter.SetPrintLevel(0);
+                fitter.SetStartingPoint(central);
+                
+                for (unsigned k = 0; k < axes.size(); ++k)
+                {
+                    if (corrIndices[k] != -1)
+                        fitter.FixParameter(corrIndices[k], params[corrIndices[k]]);
+                }
+                
+                FitResult const fitResult = fitter.Fit();
+                result.losses[point] = fitResult.minValue;
+                result.statuses[point] = fitResult.status;
+                
+                for (unsigned j = 0; j < numProfiled; ++j)
+                    result.profiledValues[point * numProfiled + j] =
+                      fitResult.values[profiledIndices[j]];
+            }
+        }
+    };
+    
+    ParallelFor(numThreads, numThreads, worker);
+    result.numSurrogatePoints = numSurrogatePoints;
+    
+    return result;
+}
+
+
+void LossScan::SetCentralValues(FitResult const &central_)
+{
+    unsigned const nPars = lossFunc.GetNumParams();
+    
+    if (central_.values.size() != nPars or central_.errors.size() != nPars or
+      central_.names.size() != nPars)
+    {
+        std::ostringstream message;
+        message << "LossScan::SetCentralValues: Given point contains " << central_.values.size() <<
+          " parameters while " << nPars << " are expected.";
+        throw std::runtime_error(message.str());
+    }
+    
+    central = central_;
+}
+
+
+void LossScan::SetNumThreads(unsigned numThreads_)
+{
+    numThreads = std::max(numThreads_, 1u);
+}
+
+
+void LossScan::SetProfiling(bool enable)
+{
+    profile = enable;
+}
+
+
+void LossScan::SetSurrogate(double tolerance)
+{
+    surrogateTolerance = tolerance;
+}
@@ -0,0 +1,435 @@
+#include <LossSurrogate.hpp>
+
+#include <LinearAlgebra.hpp>
+#include <QuasiRandom.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+
+
+LossSurrogate::LossSurrogate(CombLossFunction const &lossFunc_):
+    lossFunc(lossFunc_),
+    dim(lossFunc.GetNumParams()),
+    numBasis(1 + 2 * dim + dim * (dim + 1) / 2),
+    trustRadius(0.),
+    initialRadius(3.),
+    failedShellRadius(std::numeric_limits<double>::infinity()),
+    tolerance(0.05),
+    sumDev2(0.), numDev(0),
+    numExactEvals(0), numSurrogateEvals(0)
+{}
+
+
+void LossSurrogate::Build(std::vector<double> const &center_,
+  std::vector<double> const &covariance)
+{
+    if (center_.size() != dim or covariance.size() != dim * dim)
+    {
+        std::ostringstream message;
+        message << "LossSurrogate::Build: Received a point with " << center_.size() <<
+          " parameters and a covariance matrix with " << covariance.size() <<
+          " elements while the loss function has " << dim << " parameters.";
+        throw std::runtime_error(message.str());
+    }
+    
+    center = center_;
+    cholesky = covariance;
+    
+    if (not CholeskyDecompose(cholesky, dim))
+        throw std::runtime_error("LossSurrogate::Build: Covariance matrix is not "
+          "positive-definite.");
+    
+    samples.clear();
+    sumDev2 = 0.;
+    numDev = 0;
+    trustRadius = 0.;
+    failedShellRadius = std::numeric_limits<double>::infinity();
+    
+    HaltonSequence validationPoints(dim, 16);
+    unsigned const numValidation = std::max(numBasis, 8u);
+    double radius = initialRadius;
+    std::vector<unsigned> validationIndices;
+    
+    while (true)
+    {
+        // Sample the loss function along the axes and pairwise diagonals. This fully determines
+        //the polynomial within a ball of the current radius. The centre only needs to be sampled
+        //once.
+        std::vector<double> u(dim, 0.);
+        
+        if (samples.empty())
+            EvalExact(u);
+        
+        for (unsigned i = 0; i < dim; ++i)
+        {
+            for (double const step: {-radius, -radius / 2, radius / 2, radius})
+            {
+                u[i] = step;
+                EvalExact(u);
+            }
+            
+            u[i] = 0.;
+            
+            for (unsigned j = i + 1; j < dim; ++j)
+            {
+                for (double const sign: {1., -1.})
+                {
+                    u[i] = radius / std::sqrt(2.);
+                    u[j] = sign * radius / std::sqrt(2.);
+                    EvalExact(u);
+                }
+                
+                u[i] = u[j] = 0.;
+            }
+        }
+        
+        FitPolynomial(radius);
+        
+        
+        // Validate the polynomial on quasi-random points within the ball. Points from the unit
+        //hypercube that fall outside of the unit ball are projected onto its surface, where the
+        //approximation is expected to be the least accurate.
+        double maxDeviation = 0.;
+        validationIndices.clear();
+        
+        for (unsigned iPoint = 0; iPoint < numValidation; ++iPoint)
+        {
+            std::vector<double> v = validationPoints.Next();
+            double norm2 = 0.;
+            
+            for (auto &c: v)
+            {
+                c = 2 * c - 1;
+                norm2 += c * c;
+            }
+            
+            double const scale = radius / std::max(1., std::sqrt(norm2));
+            
+            for (auto &c: v)
+                c *= scale;
+            
+            double const prediction = EvalPolynomial(v.data());
+            double const deviation = std::abs(EvalExact(v).loss - prediction);
+            validationIndices.emplace_back(samples.size() - 1);
+            maxDeviation = std::max(maxDeviation, deviation);
+        }
+        
+        if (maxDeviation <= tolerance)
+            break;
+        
+        
+        // The polynomial is not accurate enough. Shrink the trust region.
+        radius *= 0.6;
+        
+        if (radius < 1e-2 * initialRadius)
+        {
+            std::ostringstream message;
+            message << "LossSurrogate::Build: Failed to reach tolerance " << tolerance <<
+              " even for trust radius " << radius << ".";
+            throw std::runtime_error(message.str());
+        }
+    }
+    
+    
+    // Refit using also the validation points. Estimate the error of the final polynomial with
+    //the leave-one-out method: each validation point is compared to the polynomial fitted without
+    //it.
+    trustRadius = radius;
+    FitPolynomial(trustRadius);
+    
+    for (unsigned const index: validationIndices)
+    {
+        auto const &sample = samples[index];
+        std::vector<double> const looCoeffs(FitCoefficients(trustRadius, index));
+        UpdateErrorEstimate(std::abs(sample.loss - EvalPolynomial(sample.u.data(), looCoeffs)));
+    }
+}
+
+
+double LossSurrogate::Eval(std::vector<double> const &x)
+{
+    if (x.size() != dim)
+    {
+        std::ostringstream message;
+        message << "LossSurrogate::Eval: Received " << x.size() << " parameters while " <<
+          dim << " are expected.";
+        throw std::runtime_error(message.str());
+    }
+    
+    return EvalRawInput(x.data());
+}
+
+
+double LossSurrogate::EvalPolynomialRawInput(double const *x) const
+{
+    if (coeffs.empty())
+        throw std::logic_error("LossSurrogate::EvalPolynomialRawInput: Surrogate has not been "
+          "built.");
+    
+    std::vector<double> const u(ToScaled(x));
+    return EvalPolynomial(u.data());
+}
+
+
+double LossSurrogate::EvalRawInput(double const *x)
+{
+    if (coeffs.empty())
+        throw std::logic_error("LossSurrogate::EvalRawInput: Surrogate has not been built.");
+    
+    std::vector<double> const u(ToScaled(x));
+    double radius2 = 0.;
+    
+    for (auto const &c: u)
+        radius2 += c * c;
+    
+    double const radius = std::sqrt(radius2);
+    
+    if (radius <= trustRadius)
+    {
+        ++numSurrogateEvals;
+        return EvalPolynomial(u.data());
+    }
+    
+    
+    // The point is outside of the trust region. Evaluate the exact loss function. If the point is
+    //close to the trust region, check how well the polynomial describes it. A single point only
+    //probes one direction, so the trust region is extended only if the polynomial also describes
+    //points spread over the new shell. Points further away would never be used in the fit of the
+    //polynomial, and they are not stored.
+    double const extensionFactor = 1.5;
+    bool const isClose = (radius <= trustRadius * extensionFactor);
+    double const prediction = EvalPolynomial(u.data());
+    double const loss = EvalExact(u, isClose).loss;
+    
+    if (isClose)
+    {
+        double const deviation = std::abs(loss - prediction);
+        UpdateErrorEstimate(deviation);
+        
+        if (deviation <= tolerance and radius < failedShellRadius)
+        {
+            if (ValidateShell(radius))
+            {
+                trustRadius = radius;
+                FitPolynomial(trustRadius);
+            }
+            else
+                failedShellRadius = radius;
+        }
+    }
+    
+    return loss;
+}
+
+
+double LossSurrogate::GetErrorEstimate() const
+{
+    return (numDev > 0) ? std::sqrt(sumDev2 / numDev) : 0.;
+}
+
+
+unsigned LossSurrogate::GetNumExactEvals() const
+{
+    return numExactEvals;
+}
+
+
+unsigned LossSurrogate::GetNumSurrogateEvals() const
+{
+    return numSurrogateEvals;
+}
+
+
+double LossSurrogate::GetTrustRadius() const
+{
+    return trustRadius;
+}
+
+
+bool LossSurrogate::IsInTrustRegion(double const *x) const
+{
+    double radius2 = 0.;
+    
+    for (auto const &c: ToScaled(x))
+        radius2 += c * c;
+    
+    return (std::sqrt(radius2) <= trustRadius);
+}
+
+
+void LossSurrogate::SetInitialRadius(double radius)
+{
+    initialRadius = radius;
+}
+
+
+void LossSurrogate::SetTolerance(double tolerance_)
+{
+    tolerance = tolerance_;
+}
+
+
+LossSurrogate::Sample LossSurrogate::EvalExact(std::vector<double> const &u, bool store)
+{
+    // Translate the point into the original coordinates, x = x0 + L u
+    std::vector<double> x(center);
+    
+    for (unsigned i = 0; i < dim; ++i)
+        for (unsigned j = 0; j <= i; ++j)
+            x[i] += cholesky[i * dim + j] * u[j];
+    
+    Sample sample;
+    sample.u = u;
+    sample.radius = 0.;
+    
+    for (auto const &c: u)
+        sample.radius += c * c;
+    
+    sample.radius = std::sqrt(sample.radius);
+    sample.loss = lossFunc.EvalRawInput(x.data());
+    ++numExactEvals;
+    
+    if (store)
+        samples.emplace_back(sample);
+    
+    return sample;
+}
+
+
+double LossSurrogate::EvalPolynomial(double const *u) const
+{
+    return EvalPolynomial(u, coeffs);
+}
+
+
+double LossSurrogate::EvalPolynomial(double const *u,
+  std::vector<double> const &coefficients) const
+{
+    std::vector<double> basis(numBasis);
+    FillBasis(u, basis.data());
+    double value = 0.;
+    
+    for (unsigned i = 0; i < numBasis; ++i)
+        value += coefficients[i] * basis[i];
+    
+    return value;
+}
+
+
+std::vector<double> LossSurrogate::FitCoefficients(double maxRadius, unsigned excluded) const
+{
+    std::vector<double> designMatrix, y;
+    
+    for (unsigned i = 0; i < samples.size(); ++i)
+    {
+        auto const &sample = samples[i];
+        
+        // Allow for a small numerical tolerance since points of the design are placed exactly at
+        //the boundary
+        if (i == excluded or sample.radius > maxRadius * (1. + 1e-9))
+            continue;
+        
+        designMatrix.resize(designMatrix.size() + numBasis);
+        FillBasis(sample.u.data(), designMatrix.data() + designMatrix.size() - numBasis);
+        y.emplace_back(sample.loss);
+    }
+    
+    return SolveLeastSquares(designMatrix, y, numBasis);
+}
+
+
+void LossSurrogate::FitPolynomial(double maxRadius)
+{
+    coeffs = FitCoefficients(maxRadius);
+}
+
+
+void LossSurrogate::FillBasis(double const *u, double *basis) const
+{
+    *basis++ = 1.;
+    
+    for (unsigned i = 0; i < dim; ++i)
+        *basis++ = u[i];
+    
+    for (unsigned i = 0; i < dim; ++i)
+        for (unsigned j = i; j < dim; ++j)
+            *basis++ = u[i] * u[j];
+    
+    for (unsigned i = 0; i < dim; ++i)
+        *basis++ = u[i] * u[i] * u[i];
+}
+
+
+std::vector<double> LossSurrogate::ToScaled(double const *x) const
+{
+    // Solve L u = x - x0 with forward substitution
+    std::vector<double> u(dim);
+    
+    for (unsigned i = 0; i < dim; ++i)
+    {
+        double s = x[i] - center[i];
+        
+        for (unsigned j = 0; j < i; ++j)
+            s -= cholesky[i * dim + j] * u[j];
+        
+        u[i] = s / cholesky[i * dim + i];
+    }
+    
+    return u;
+}
+
+
+void LossSurrogate::UpdateErrorEstimate(double deviation)
+{
+    sumDev2 += deviation * deviation;
+    ++numDev;
+}
+
+
+bool LossSurrogate::ValidateShell(double radius)
+{
+    // Points are placed along the axes and the diagonals in each pair of axes, as in the initial
+    //design in Build. They lie outside of the current trust region, so they have not been used in
+    //the fit of the polynomial and give independent estimates of its error.
+    std::vector<std::vector<double>> points;
+    std::vector<double> u(dim, 0.);
+    
+    for (unsigned i = 0; i < dim; ++i)
+    {
+        for (double const step: {-radius, radius})
+        {
+            u[i] = step;
+            points.emplace_back(u);
+        }
+        
+        u[i] = 0.;
+        
+        for (unsigned j = i + 1; j < dim; ++j)
+        {
+            for (double const signI: {1., -1.})
+                for (double const signJ: {1., -1.})
+                {
+                    u[i] = signI * radius / std::sqrt(2.);
+                    u[j] = signJ * radius / std::sqrt(2.);
+                    points.emplace_back(u);
+                }
+            
+            u[i] = u[j] = 0.;
+        }
+    }
+    
+    bool valid = true;
+    
+    for (auto const &point: points)
+    {
+        double const prediction = EvalPolynomial(point.data());
+        double const deviation = std::abs(EvalExact(point).loss - prediction);
+        UpdateErrorEstimate(deviation);
+        valid &= (deviation <= tolerance);
+    }
+    
+    return valid;
+}
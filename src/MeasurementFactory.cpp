@@ -0,0 +1,149 @@
+#include <MeasurementFactory.hpp>
+
+#include <HistFlattening.hpp>
+#include <JetCorrDefinitions.hpp>
+#include <MultijetBinnedSum.hpp>
+#include <Parallel.hpp>
+#include <PhotonJetBinnedSum.hpp>
+#include <PhotonJetRun1.hpp>
+#include <Snapshot.hpp>
+#include <ZJetRun1.hpp>
+
+#include <algorithm>
+#include <cctype>
+#include <sstream>
+#include <stdexcept>
+
+
+std::vector<std::pair<std::string, std::string>> const &GetMeasurementTypes()
+{
+    static std::vector<std::pair<std::string, std::string>> const types{
+      {"photonjet-run1", "Input file for photon+jet analysis, Run 1 style"},
+      {"photonjet-binnedsum", "Input file(s) for photon+jet analysis, binned sum"},
+      {"zjet-run1", "Input file for Z+jet analysis, Run 1 style"},
+      {"multijet-binnedsum", "Input file(s) for multijet analysis, binned sum"}};
+    
+    return types;
+}
+
+
+std::unique_ptr<MeasurementBase> CreateMeasurement(std::string const &type,
+  std::string const &fileName, bool useMPF, unsigned numThreads)
+{
+    // The file name can be a comma-separated list of files with optional weights. A snapshot can
+    //only be given as a single file without a weight.
+    std::vector<WeightedFile> const files(ParseFileList(fileName));
+    bool const isSingleFile = (files.size() == 1 and files.front().weight == 1.);
+    
+    if (isSingleFile and SnapshotFile::IsSnapshot(files.front().name))
+        return LoadMeasurementSnapshot(type, files.front().name, useMPF);
+    
+    if ((type == "photonjet-run1" or type == "zjet-run1") and not isSingleFile)
+    {
+        std::ostringstream message;
+        message << "CreateMeasurement: Measurements of type \"" << type << "\" do not " <<
+          "support multiple or weighted input files.";
+        throw std::runtime_error(message.str());
+    }
+    
+    if (type == "photonjet-run1")
+        return std::make_unique<PhotonJetRun1>(files.front().name,
+          (useMPF) ? PhotonJetRun1::Method::MPF : PhotonJetRun1::Method::PtBal);
+    else if (type == "photonjet-binnedsum")
+        return std::make_unique<PhotonJetBinnedSum>(files,
+          (useMPF) ? PhotonJetBinnedSum::Method::MPF : PhotonJetBinnedSum::Method::PtBal,
+          numThreads);
+    else if (type == "zjet-run1")
+        return std::make_unique<ZJetRun1>(files.front().name,
+          (useMPF) ? ZJetRun1::Method::MPF : ZJetRun1::Method::PtBal);
+    else if (type == "multijet-binnedsum")
+        return std::make_unique<MultijetBinnedSum>(files,
+          (useMPF) ? MultijetBinnedSum::Method::MPF : MultijetBinnedSum::Method::PtBal,
+          numThreads);
+    else
+    {
+        std::ostringstream message;
+        message << "CreateMeasurement: Unsupported type of measurement \"" << type << "\".";
+        throw std::runtime_error(message.str());
+    }
+}
+
+
+std::vector<std::unique_ptr<MeasurementBase>> CreateMeasurements(
+  std::vector<std::pair<std::string, std::string>> const &descriptions, bool useMPF,
+  unsigned numThreads)
+{
+    // Measurements are constructed in parallel, and each of them can use all threads to read its
+    //inputs. Reading is dominated by input and output, so the moderate oversubscription is
+    //harmless.
+    std::vector<std::unique_ptr<MeasurementBase>> measurements(descriptions.size());
+    
+    ParallelFor(descriptions.size(), numThreads, [&](unsigned i)
+    {
+        measurements[i] = CreateMeasurement(descriptions[i].first, descriptions[i].second,
+          useMPF, numThreads);
+    });
+    
+    return measurements;
+}
+
+
+std::unique_ptr<MeasurementBase> LoadMeasurementSnapshot(std::string const &type,
+  std::string const &fileName, bool useMPF)
+{
+    auto const snapshot = std::make_shared<SnapshotFile const>(fileName);
+    bool isMPF;
+    std::unique_ptr<MeasurementBase> measurement;
+    
+    if (type == "photonjet-binnedsum")
+    {
+        auto photonJet = std::make_unique<PhotonJetBinnedSum>(snapshot);
+        isMPF = (photonJet->GetMethod() == PhotonJetBinnedSum::Method::MPF);
+        measurement = std::move(photonJet);
+    }
+    else if (type == "multijet-binnedsum")
+    {
+        auto multijet = std::make_unique<MultijetBinnedSum>(snapshot);
+        isMPF = (multijet->GetMethod() == MultijetBinnedSum::Method::MPF);
+        measurement = std::move(multijet);
+    }
+    else
+    {
+        std::ostringstream message;
+        message << "LoadMeasurementSnapshot: Snapshots are not supported for measurements of " <<
+          "type \"" << type << "\".";
+        throw std::runtime_error(message.str());
+    }
+    
+    if (isMPF != useMPF)
+    {
+        std::ostringstream message;
+        message << "LoadMeasurementSnapshot: Snapshot \"" << fileName << "\" has been created " <<
+          "for the " << ((isMPF) ? "MPF" : "pt balance") << " method, which does not match " <<
+          "the requested one.";
+        throw std::runtime_error(message.str());
+    }
+    
+    return measurement;
+}
+
+
+std::unique_ptr<JetCorrBase> CreateJetCorr(std::string const &name)
+{
+    std::string lowerName(name);
+    std::transform(lowerName.begin(), lowerName.end(), lowerName.begin(),
+      [](unsigned char c){return std::tolower(c);});
+    
+    if (lowerName == "std2p")
+        return std::make_unique<JetCorrStd2P>();
+    else if (lowerName == "std3p")
+        return std::make_unique<JetCorrStd3P>();
+    else if (lowerName == "stableloglin")
+        return std::make_unique<JetCorrStableLogLin>();
+    else
+    {
+        std::ostringstream message;
+        message << "CreateJetCorr: Unsupported jet correction \"" << name << "\".";
+        throw std::runtime_error(message.str());
+    }
+}
@@ -0,0 +1,201 @@
+#include <MultiEtaLossFunction.hpp>
+
+#include <Parallel.hpp>
+#include <Profiling.hpp>
+
+#include <sstream>
+#include <stdexcept>
+
+
+MultiEtaLossFunction::MultiEtaLossFunction():
+    offsets{0}
+{}
+
+
+void MultiEtaLossFunction::AddEtaBin(std::string const &label,
+  std::unique_ptr<CombLossFunction> &&lossFunc)
+{
+    for (auto const &c: constraints)
+    {
+        if (c.paramIndex >= lossFunc->GetNumParams())
+        {
+            std::ostringstream message;
+            message << "MultiEtaLossFunction::AddEtaBin: Bin \"" << label << "\" has only " <<
+              lossFunc->GetNumParams() << " parameters while a constraint is imposed on " <<
+              "parameter " << c.paramIndex << ".";
+            throw std::runtime_error(message.str());
+        }
+    }
+    
+    offsets.emplace_back(offsets.back() + lossFunc->GetNumParams());
+    labels.emplace_back(label);
+    etaBins.emplace_back(std::move(lossFunc));
+}
+
+
+void MultiEtaLossFunction::AddSmoothnessConstraint(unsigned paramIndex, double sigma)
+{
+    if (not (sigma > 0.))
+    {
+        std::ostringstream message;
+        message << "MultiEtaLossFunction::AddSmoothnessConstraint: Illegal scale " << sigma <<
+          " given for parameter " << paramIndex << ".";
+        throw std::runtime_error(message.str());
+    }
+    
+    for (unsigned k = 0; k < etaBins.size(); ++k)
+    {
+        if (paramIndex >= GetBlockSize(k))
+        {
+            std::ostringstream message;
+            message << "MultiEtaLossFunction::AddSmoothnessConstraint: Bin \"" << labels[k] <<
+              "\" has only " << GetBlockSize(k) << " parameters while a constraint is " <<
+              "requested for parameter " << paramIndex << ".";
+            throw std::runtime_error(message.str());
+        }
+    }
+    
+    constraints.emplace_back(Constraint{paramIndex, sigma});
+}
+
+
+void MultiEtaLossFunction::AddConstraintDerivatives(double const *x,
+  std::vector<double> &gradient, std::vector<std::vector<double>> &diagBlocks,
+  std::vector<std::vector<double>> &offDiagBlocks) const
+{
+    // For a penalty (p_{k+1} - p_k)^2 / sigma^2 the gradient with respect to p_k and p_{k+1} is
+    //-+2 (p_{k+1} - p_k) / sigma^2, the diagonal elements of the Hessian are 2 / sigma^2, and the
+    //off-diagonal element is -2 / sigma^2
+    for (unsigned k = 0; k + 1 < etaBins.size(); ++k)
+    {
+        unsigned const sizeCur = GetBlockSize(k), sizeNext = GetBlockSize(k + 1);
+        
+        for (auto const &c: constraints)
+        {
+            unsigned const i = offsets[k] + c.paramIndex;
+            unsigned const j = offsets[k + 1] + c.paramIndex;
+            double const w = 2. / (c.sigma * c.sigma);
+            
+            gradient[i] -= w * (x[j] - x[i]);
+            gradient[j] += w * (x[j] - x[i]);
+            
+            diagBlocks[k][c.paramIndex * sizeCur + c.paramIndex] += w;
+            diagBlocks[k + 1][c.paramIndex * sizeNext + c.paramIndex] += w;
+            offDiagBlocks[k][c.paramIndex * sizeNext + c.paramIndex] -= w;
+        }
+    }
+}
+
+
+double MultiEtaLossFunction::EvalBlock(unsigned etaBin, double const *blockParams) const
+{
+    return etaBins[etaBin]->EvalRawInput(blockParams);
+}
+
+
+double MultiEtaLossFunction::EvalConstraints(double const *x) const
+{
+    double penalty = 0.;
+    
+    for (unsigned k = 0; k + 1 < etaBins.size(); ++k)
+    {
+        for (auto const &c: constraints)
+        {
+            double const diff = x[offsets[k + 1] + c.paramIndex] - x[offsets[k] + c.paramIndex];
+            penalty += diff * diff / (c.sigma * c.sigma);
+        }
+    }
+    
+    return penalty;
+}
+
+
+double MultiEtaLossFunction::EvalRawInput(double const *x) const
+{
+    JECFIT_PROFILE_SCOPE("MultiEtaLossFunction", "EvalRawInput");
+    JECFIT_TRACE_SCOPE("MultiEtaLossFunction", "EvalRawInput");
+    std::vector<double> blockLosses(etaBins.size());
+    
+    RunTasks(threadPool.get(), etaBins.size(), [this, x, &blockLosses](unsigned k)
+    {
+        blockLosses[k] = EvalBlock(k, x + offsets[k]);
+    });
+    
+    double loss = 0.;
+    
+    for (auto const &l: blockLosses)
+        loss += l;
+    
+    return loss + EvalConstraints(x);
+}
+
+
+unsigned MultiEtaLossFunction::GetBlockOffset(unsigned etaBin) const
+{
+    return offsets.at(etaBin);
+}
+
+
+unsigned MultiEtaLossFunction::GetBlockSize(unsigned etaBin) const
+{
+    return offsets.at(etaBin + 1) - offsets[etaBin];
+}
+
+
+CombLossFunction const &MultiEtaLossFunction::GetEtaBin(unsigned etaBin) const
+{
+    return *etaBins.at(etaBin);
+}
+
+
+std::string const &MultiEtaLossFunction::GetLabel(unsigned etaBin) const
+{
+    return labels.at(etaBin);
+}
+
+
+unsigned MultiEtaLossFunction::GetNDF() const
+{
+    unsigned ndf = 0;
+    
+    for (auto const &etaBin: etaBins)
+        ndf += etaBin->GetNDF();
+    
+    if (not etaBins.empty())
+        ndf += (etaBins.size() - 1) * constraints.size();
+    
+    return ndf;
+}
+
+
+unsigned MultiEtaLossFunction::GetNumEtaBins() const
+{
+    return etaBins.size();
+}
+
+
+unsigned MultiEtaLossFunction::GetNumParams() const
+{
+    return offsets.back();
+}
+
+
+unsigned MultiEtaLossFunction::GetNumThreads() const
+{
+    return (threadPool) ? threadPool->GetNumThreads() : 1;
+}
+
+
+std::shared_ptr<ThreadPool> MultiEtaLossFunction::GetThreadPool() const
+{
+    return threadPool;
+}
+
+
+void MultiEtaLossFunction::SetNumThreads(unsigned numThreads)
+{
+    if (numThreads > 1)
+        threadPool = std::make_shared<ThreadPool>(numThreads);
+    else
+        threadPool.reset();
+}
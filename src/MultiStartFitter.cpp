@@ -0,0 +1,243 @@
+#include <MultiStartFitter.hpp>
+
+#include <Parallel.hpp>
+#include <QuasiRandom.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+
+
+namespace
+{
+/// Exception thrown to cancel a run of the minimizer
+class FitCancelled: public std::exception
+{
+public:
+    virtual char const *what() const noexcept override
+    {
+        return "Fit has been cancelled";
+    }
+};
+}
+
+
+FitResult const &MultiStartResult::GetBest() const
+{
+    return runs.at(bestIndex).result;
+}
+
+
+std::vector<unsigned> MultiStartResult::GetDistinctMinima(double tolerance) const
+{
+    std::vector<unsigned> indices;
+    
+    for (unsigned i = 0; i < runs.size(); ++i)
+    {
+        if (not runs[i].cancelled)
+            indices.emplace_back(i);
+    }
+    
+    std::sort(indices.begin(), indices.end(), [this](unsigned lhs, unsigned rhs)
+      {return (runs[lhs].result.minValue < runs[rhs].result.minValue);});
+    
+    std::vector<unsigned> distinctMinima;
+    
+    for (auto const &i: indices)
+    {
+        if (distinctMinima.empty() or
+          runs[i].result.minValue - runs[distinctMinima.back()].result.minValue >= tolerance)
+            distinctMinima.emplace_back(i);
+    }
+    
+    return distinctMinima;
+}
+
+
+unsigned MultiStartResult::GetNumCancelled() const
+{
+    return std::count_if(runs.begin(), runs.end(), [](Run const &run){return run.cancelled;});
+}
+
+
+MultiStartFitter::MultiStartFitter(CombLossFunction const &lossFunc_):
+    lossFunc(lossFunc_),
+    width(0.1),
+    cancelMargin(10.),
+    numStarts(8), numThreads(1),
+    strategy(2),  // high quality
+    printLevel(0)
+{
+    unsigned const nPars = lossFunc.GetNumParams();
+    
+    for (unsigned i = 0; i < nPars; ++i)
+        center.names.emplace_back("p" + std::to_string(i));
+    
+    center.values.assign(nPars, 0.);
+    center.errors.assign(nPars, 1e-2);
+}
+
+
+MultiStartResult MultiStartFitter::Fit()
+{
+    unsigned const nPars = lossFunc.GetNumParams();
+    
+    
+    // Construct starting points. The first one is the centre of the search region, and the others
+    //are distributed in the box around it.
+    MultiStartResult result;
+    result.runs.resize(numStarts);
+    HaltonSequence sequence(nPars);
+    
+    for (unsigned iRun = 0; iRun < numStarts; ++iRun)
+    {
+        auto &start = result.runs[iRun].start;
+        start = center.values;
+        
+        if (iRun > 0)
+        {
+            std::vector<double> const u(sequence.Next());
+            
+            for (unsigned i = 0; i < nPars; ++i)
+                start[i] += width * (2 * u[i] - 1);
+        }
+        
+        result.runs[iRun].cancelled = false;
+    }
+    
+    
+    // A run is not considered for cancellation until it has performed this number of evaluations
+    //of the loss function. This allows Minuit2 to compute the initial approximation of the
+    //Hessian and make several steps.
+    unsigned const minCallsBeforeCancel = 50 * (nPars + 1);
+    
+    // The lowest value of the loss function found by any run so far
+    std::atomic<double> globalMin(std::numeric_limits<double>::infinity());
+    
+    auto const runFit = [&](unsigned iRun)
+    {
+        auto &run = result.runs[iRun];
+        
+        // The copy shares inputs of measurements with the original loss function and can be
+        //evaluated concurrently with other copies
+        auto const localLossFunc = lossFunc.Clone();
+        Fitter fitter(*localLossFunc);
+        fitter.SetStrategy(strategy);
+        fitter.SetPrintLevel(printLevel);
+        
+        FitResult start(center);
+        start.values = run.start;
+        fitter.SetStartingPoint(start);
+        
+        fitter.SetMonitor([&](FitResult const &current)
+        {
+            double knownMin = globalMin.load();
+            
+            while (current.minValue < knownMin and
+              not globalMin.compare_exchange_weak(knownMin, current.minValue));
+            
+            if (current.numCalls >= minCallsBeforeCancel and
+              current.minValue > globalMin.load() + cancelMargin)
+            {
+                run.result = current;
+                throw FitCancelled();
+            }
+        });
+        
+        try
+        {
+            run.result = fitter.Fit();
+        }
+        catch (FitCancelled const &)
+        {
+            run.cancelled = true;
+        }
+    };
+    
+    ParallelFor(numStarts, numThreads, runFit);
+    
+    
+    // Find the best run. Cancelled runs are only considered if all runs have been cancelled,
+    //which cannot happen with a finite margin but is checked for safety.
+    result.bestIndex = 0;
+    double bestValue = std::numeric_limits<double>::infinity();
+    
+    for (bool const allowCancelled: {false, true})
+    {
+        for (unsigned iRun = 0; iRun < numStarts; ++iRun)
+        {
+            auto const &run = result.runs[iRun];
+            
+            if ((not run.cancelled or allowCancelled) and run.result.minValue < bestValue)
+            {
+                bestValue = run.result.minValue;
+                result.bestIndex = iRun;
+            }
+        }
+        
+        if (bestValue < std::numeric_limits<double>::infinity())
+            break;
+    }
+    
+    return result;
+}
+
+
+void MultiStartFitter::SetCancelMargin(double margin)
+{
+    cancelMargin = margin;
+}
+
+
+void MultiStartFitter::SetCenter(FitResult const &center_)
+{
+    unsigned const nPars = lossFunc.GetNumParams();
+    
+    if (center_.values.size() != nPars or center_.errors.size() != nPars or
+      center_.names.size() != nPars)
+    {
+        std::ostringstream message;
+        message << "MultiStartFitter::SetCenter: Given point contains " << center_.values.size() <<
+          " parameters while " << nPars << " are expected.";
+        throw std::runtime_error(message.str());
+    }
+    
+    center = center_;
+}
+
+
+void MultiStartFitter::SetNumStarts(unsigned numStarts_)
+{
+    if (numStarts_ == 0)
+        throw std::runtime_error("MultiStartFitter::SetNumStarts: At least one starting point is "
+          "required.");
+    
+    numStarts = numStarts_;
+}
+
+
+void MultiStartFitter::SetNumThreads(unsigned numThreads_)
+{
+    numThreads = numThreads_;
+}
+
+
+void MultiStartFitter::SetPrintLevel(int printLevel_)
+{
+    printLevel = printLevel_;
+}
+
+
+void MultiStartFitter::SetStrategy(unsigned strategy_)
+{
+    strategy = strategy_;
+}
+
+
+void MultiStartFitter::SetWidth(double width_)
+{
+    width = width_;
+}
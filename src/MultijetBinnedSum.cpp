@@ -1,308 +1,475 @@
 #include <MultijetBinnedSum.hpp>
 
+#include <Diagnostics.hpp>
+#include <Fluctuations.hpp>
+#include <Profiling.hpp>
 #include <Rebin.hpp>
 
-#include <TFile.h>
-#include <TKey.h>
-#include <TVectorD.h>
-
 #include <algorithm>
 #include <cmath>
-#include <cstring>
 #include <limits>
 #include <sstream>
-#include <iostream>
 #include <stdexcept>
 #include <utility>
 
 
-MultijetBinnedSum::MultijetBinnedSum(std::string const &fileName,
-  MultijetBinnedSum::Method method_):
+namespace
+{
+/// Type of the measurement recorded in snapshots
+char const *const snapshotType = "multijet-binnedsum";
+}
+
+
+MultijetBinnedSum::MultijetBinnedSum(InputSums &&sums, MultijetBinnedSum::Method method_):
     method(method_)
 {
-    std::string methodLabel;
-    
-    if (method == Method::PtBal)
-        methodLabel = "PtBal";
-    else if (method == Method::MPF)
-        methodLabel = "MPF";
-    
+    if (sums.triggerBins.empty())
+        throw std::runtime_error("MultijetBinnedSum::MultijetBinnedSum: No trigger bins given.");
     
-    std::unique_ptr<TFile> inputFile(TFile::Open(fileName.c_str()));
+    auto newInputs = std::make_shared<Inputs>();
+    newInputs->numThreads = 1;
+    newInputs->minPt = sums.minPt;
     
-    if (not inputFile or inputFile->IsZombie())
-    {
-        std::ostringstream message;
-        message << "MultijetBinnedSum::MultijetBinnedSum: Failed to open file \"" <<
-          fileName << "\".";
-        throw std::runtime_error(message.str());
-    }
+    for (auto &binSums: sums.triggerBins)
+        newInputs->triggerBins.emplace_back(FinalizeTriggerBin(std::move(binSums)));
     
+    inputs = newInputs;
     
-    // Read the jet pt threshold. It is not a free parameter and must be set to the same value as
-    //used to construct the inputs. For the pt balance method it affects the definition of the
-    //balance observable in simulation (while in data it can be recomputed for any not too low
-    //threshold). In the case of the MPF method the definition of the balance observable in both
-    //data and simulation is affected.
-    auto ptThreshold = dynamic_cast<TVectorD *>(inputFile->Get(("MinPt" + methodLabel).c_str()));
     
-    if (not ptThreshold or ptThreshold->GetNoElements() != 1)
+    // Select all trigger bins. This also computes the dimensionality.
+    SetTriggerBinRange(0);
+}
+
+
+MultijetBinnedSum::MultijetBinnedSum(unsigned numTriggerBins, double minPt,
+  std::function<TriggerBinSums(unsigned)> const &loadTriggerBin, Method method_,
+  unsigned numThreads):
+    method(method_)
+{
+    if (numTriggerBins == 0)
+        throw std::runtime_error("MultijetBinnedSum::MultijetBinnedSum: No trigger bins given.");
+    
+    auto newInputs = std::make_shared<Inputs>();
+    newInputs->numThreads = numThreads;
+    newInputs->minPt = minPt;
+    newInputs->triggerBins.resize(numTriggerBins);
+    newInputs->loadStates = std::vector<LoadState>(numTriggerBins);
+    newInputs->loadTriggerBin = loadTriggerBin;
+    inputs = newInputs;
+    
+    SetTriggerBinRange(0);
+}
+
+
+MultijetBinnedSum::MultijetBinnedSum(std::shared_ptr<SnapshotFile const> const &snapshot)
+{
+    if (snapshot->GetType() != snapshotType)
     {
         std::ostringstream message;
-        message << "MultijetBinnedSum::MultijetBinnedSum: Failed to read jet pt threshold " <<
-          "from file \"" << fileName << "\".";
+        message << "MultijetBinnedSum::MultijetBinnedSum: Snapshot \"" <<
+          snapshot->GetFileName() << "\" contains a measurement of type \"" <<
+          snapshot->GetType() << "\" while \"" << snapshotType << "\" is expected.";
         throw std::runtime_error(message.str());
     }
     
-    minPt = (*ptThreshold)[0];
+    SnapshotReader reader(snapshot);
+    auto newInputs = std::make_shared<Inputs>();
+    newInputs->snapshot = snapshot;
     
+    method = (reader.ReadValue() == 0.) ? Method::PtBal : Method::MPF;
+    newInputs->numThreads = 1;
+    newInputs->minPt = reader.ReadValue();
+    unsigned const numTriggerBins = reader.ReadValue();
     
-    // Loop over directories in the input file
-    TIter fileIter(inputFile->GetListOfKeys());
-    TKey *key;
     
-    while ((key = dynamic_cast<TKey *>(fileIter())))
+    // Read arrays for all trigger bins in the order defined in SaveSnapshot. Their sizes are
+    //checked for consistency, so that a malformed snapshot cannot lead to out-of-range accesses.
+    for (unsigned iBin = 0; iBin < numTriggerBins; ++iBin)
     {
-        if (strcmp(key->GetClassName(), "TDirectoryFile") != 0)
-            continue;
-        
-        TDirectoryFile *directory = dynamic_cast<TDirectoryFile *>(key->ReadObj());
-        
-        for (auto const &name: std::initializer_list<std::string>{"Sim" + methodLabel + "Profile",
-          "PtLead", "PtLeadProfile", methodLabel + "Profile", "PtJetSumProj"})
+        TriggerBin bin;
+        bin.binning = reader.ReadArray();
+        unsigned const numBins = bin.binning.size() + 1;
+        bin.numEvents = reader.ReadArray(numBins);
+        bin.meanPtLead = reader.ReadArray(numBins);
+        bin.meanBal = reader.ReadArray(numBins);
+        bin.meanBalUnc = reader.ReadArray(numBins);
+        bin.ptJetBinning = reader.ReadArray();
+        bin.ptJetSumProj = reader.ReadArray(numBins * (bin.ptJetBinning.size() + 1));
+        bin.simBinning = reader.ReadArray();
+        unsigned const numSimBins = bin.simBinning.size() - 1;
+        bin.simMeanBal = reader.ReadArray(numSimBins);
+        bin.simMeanBalUnc = reader.ReadArray(numSimBins);
+        bin.rebinnedMeanBal = reader.ReadArray(numSimBins);
+        bin.rebinnedMeanBalUnc = reader.ReadArray(numSimBins);
+        bin.totalUnc2 = reader.ReadArray(numSimBins);
+        
+        if (bin.binning.size() < 2 or bin.ptJetBinning.size() < 2 or bin.simBinning.size() < 2)
         {
-            if (not directory->Get(name.c_str()))
-            {
-                std::ostringstream message;
-                message << "MultijetBinnedSum::MultijetBinnedSum: Directory \"" <<
-                  key->GetName() << "\" in file \"" << fileName <<
-                  "\" does not contain required key \"" << name << "\".";
-                throw std::runtime_error(message.str());
-            }
+            std::ostringstream message;
+            message << "MultijetBinnedSum::MultijetBinnedSum: Snapshot \"" <<
+              snapshot->GetFileName() << "\" contains an empty binning.";
+            throw std::runtime_error(message.str());
         }
         
-        
-        TriggerBin bin;
-        
-        bin.simBalProfile.reset(dynamic_cast<TProfile *>(
-          directory->Get(("Sim" + methodLabel + "Profile").c_str())));
-        bin.balProfile.reset(dynamic_cast<TProfile *>(
-          directory->Get((methodLabel + "Profile").c_str())));
-        bin.ptLead.reset(dynamic_cast<TH1 *>(directory->Get("PtLead")));
-        bin.ptLeadProfile.reset(dynamic_cast<TProfile *>(directory->Get("PtLeadProfile")));
-        bin.ptJetSumProj.reset(dynamic_cast<TH2 *>(directory->Get("PtJetSumProj")));
-        
-        bin.simBalProfile->SetDirectory(nullptr);
-        bin.balProfile->SetDirectory(nullptr);
-        bin.ptLead->SetDirectory(nullptr);
-        bin.ptLeadProfile->SetDirectory(nullptr);
-        bin.ptJetSumProj->SetDirectory(nullptr);
-        
-        triggerBins.emplace_back(std::move(bin));
+        newInputs->triggerBins.emplace_back(std::move(bin));
     }
     
-    inputFile->Close();
-    
-    if (triggerBins.empty())
+    if (numTriggerBins == 0 or not reader.IsAtEnd())
     {
         std::ostringstream message;
-        message << "MultijetBinnedSum::MultijetBinnedSum: No data read from file \"" <<
-          fileName << "\".";
+        message << "MultijetBinnedSum::MultijetBinnedSum: Snapshot \"" <<
+          snapshot->GetFileName() << "\" is malformed.";
         throw std::runtime_error(message.str());
     }
     
+    inputs = newInputs;
+    SetTriggerBinRange(0);
+}
+
+
+std::unique_ptr<MeasurementBase> MultijetBinnedSum::Clone() const
+{
+    return std::make_unique<MultijetBinnedSum>(*this);
+}
+
+
+std::unique_ptr<MeasurementBase> MultijetBinnedSum::CloneFluctuated(CounterRng &rng) const
+{
+    // Only the selected trigger bins are fluctuated. Other bins are not available in the replica,
+    //so that the sequence of random numbers does not depend on which bins happen to have been
+    //loaded.
+    LoadTriggerBins(selectedTriggerBinsBegin, selectedTriggerBinsEnd);
+    
+    auto newInputs = std::make_shared<Inputs>();
+    newInputs->minPt = inputs->minPt;
+    newInputs->numThreads = 1;
+    newInputs->triggerBins.resize(inputs->triggerBins.size());
+    
+    newInputs->snapshot = inputs->snapshot;
     
-    // Construct remaining fields in trigger bins
-    for (auto &bin: triggerBins)
+    for (unsigned iBin = selectedTriggerBinsBegin; iBin < selectedTriggerBinsEnd; ++iBin)
     {
-        // Save binning in data in a handy format
-        bin.binning.reserve(bin.ptLead->GetNbinsX() + 1);
+        auto const &bin = inputs->triggerBins[iBin];
         
-        for (int i = 1; i <= bin.ptLead->GetNbinsX() + 1; ++i)
-            bin.binning.emplace_back(bin.ptLead->GetBinLowEdge(i));
+        // Arrays that are not fluctuated are copied. If they refer to a snapshot, only the
+        //reference is copied.
+        TriggerBin newBin(bin);
         
+        std::vector<double> numEvents(bin.numEvents.ToVector());
+        std::vector<double> meanBal(bin.meanBal.ToVector());
+        std::vector<double> ptJetSumProj(bin.ptJetSumProj.ToVector());
+        FluctuateBalanceInputs(rng, method == Method::PtBal, numEvents, meanBal,
+          bin.meanBalUnc.ToVector(), ptJetSumProj, bin.ptJetBinning.size() + 1);
         
-        // Compute combined (squared) uncertainty on the balance observable in data and simulation.
-        //The data profile is rebinned with the binning used for simulation. This is done assuming
-        //that bin edges of the two binnings are aligned, which should normally be the case.
-        std::unique_ptr<TH1> balRebinned(bin.balProfile->Rebin(
-          bin.simBalProfile->GetNbinsX(), "",
-          bin.simBalProfile->GetXaxis()->GetXbins()->GetArray()));
+        newBin.numEvents = std::move(numEvents);
+        newBin.meanBal = std::move(meanBal);
+        newBin.ptJetSumProj = std::move(ptJetSumProj);
         
-        for (int i = 1; i <= bin.simBalProfile->GetNbinsX() + 1; ++i)
-        {
-            double const unc2 = std::pow(bin.simBalProfile->GetBinError(i), 2) +
-              std::pow(balRebinned->GetBinError(i), 2);
-            bin.totalUnc2.emplace_back(unc2);
-        }
-        
-        
-        // Initialize recomputed mean balance observable with dummy values
-        bin.recompBal.resize(bin.simBalProfile->GetNbinsX());
+        newInputs->triggerBins[iBin] = std::move(newBin);
     }
     
+    auto replica = std::make_unique<MultijetBinnedSum>(*this);
+    replica->inputs = newInputs;
     
-    // Set the range of trigger bins to include all of them
-    selectedTriggerBinsBegin = 0;
-    selectedTriggerBinsEnd = triggerBins.size();
-    
-    
-    // Precompute dimensionality. It is given by binning of simulation.
-    dimensionality = 0;
-    
-    for (auto const &bin: triggerBins)
-        dimensionality += bin.simBalProfile->GetNbinsX();
+    return replica;
 }
 
 
 unsigned MultijetBinnedSum::GetDim() const
 {
+    LoadTriggerBins(selectedTriggerBinsBegin, selectedTriggerBinsEnd);
+    unsigned dimensionality = 0;
+    
+    for (unsigned i = selectedTriggerBinsBegin; i < selectedTriggerBinsEnd; ++i)
+        dimensionality += inputs->triggerBins[i].simMeanBal.size();
+    
     return dimensionality;
 }
 
 
-TH1D MultijetBinnedSum::GetRecompBalance(JetCorrBase const &corrector, Nuisances const &nuisances, HistReturnType histReturnType)
-  const
+MultijetBinnedSum::BalanceBand MultijetBinnedSum::ComputeBalanceBand(
+  JetCorrBase const &corrector, Nuisances const &nuisances,
+  std::vector<std::vector<double>> const &paramSamples, std::vector<double> const &probabilities,
+  unsigned numThreads) const
 {
-    // An auxiliary structure to aggregate information about a single bin. Consists of the lower
-    //bin edge, bin content, and its uncertainty.
-    using Bin = std::tuple<double, double, double>;
-    
-    
-    // Recompute mean balance observables
-    UpdateBalance(corrector, nuisances);
+    for (auto const &p: probabilities)
+    {
+        if (not (p >= 0. and p <= 1.))
+        {
+            std::ostringstream message;
+            message << "MultijetBinnedSum::ComputeBalanceBand: Probability " << p <<
+              " is outside of the range [0, 1].";
+            throw std::runtime_error(message.str());
+        }
+    }
     
+    LoadTriggerBins(selectedTriggerBinsBegin, selectedTriggerBinsEnd);
+    auto const &triggerBins = inputs->triggerBins;
     
-    // Read recomputed mean balance observables for all bins
-    std::vector<Bin> bins;
-    bins.reserve(dimensionality);
     
+    // Order bins from all selected trigger bins by their lower edges. Each bin is identified by
+    //the index of the trigger bin and its index in simBinning, starting from zero.
+    std::vector<std::pair<unsigned, unsigned>> order;
     double upperBoundary = -std::numeric_limits<double>::infinity();
     
     for (unsigned iTriggerBin = selectedTriggerBinsBegin; iTriggerBin < selectedTriggerBinsEnd;
       ++iTriggerBin)
     {
-        auto const &triggerBin = triggerBins[iTriggerBin];
-        
-        auto const &simBalProfile = triggerBin.simBalProfile;
-
-	std::unique_ptr<TH1> balRebinned(triggerBin.balProfile->Rebin(
-	  triggerBin.simBalProfile->GetNbinsX(), "",
-	  triggerBin.simBalProfile->GetXaxis()->GetXbins()->GetArray()));
-
-        for (unsigned i = 0; i < triggerBin.recompBal.size(); ++i){
-	  double ptLead = triggerBin.simBalProfile->GetBinCenter(i+1);
-	  double shifts=0;
-	  switch(histReturnType){
-	  case HistReturnType::bal: 
-            bins.emplace_back(std::make_tuple(simBalProfile->GetBinLowEdge(i + 1),
-					      balRebinned->GetBinContent(i+1), balRebinned->GetBinError(i+1)));
-	    break;
-	  case HistReturnType::recompBal: //triggerBin.recompBal is a plain vector, thus the offset of 1 w.r.t. bin contents
-            if (method == Method::PtBal){
-              for(unsigned MJBn_i = 0;  MJBn_i<nuisances.MJB_NuisanceCollection.size(); ++MJBn_i){
-                shifts+= * (std::get<double*>(nuisances.MJB_NuisanceCollection.at(MJBn_i))) * (std::get<TF1*>(nuisances.MJB_NuisanceCollection.at(MJBn_i)))->Eval(ptLead);
-              }
-            }
-            else if (method == Method::MPF){
-              for(unsigned MPFn_i = 0;  MPFn_i<nuisances.MPF_NuisanceCollection.size(); ++MPFn_i){
-                shifts+= * (std::get<double*>(nuisances.MPF_NuisanceCollection.at(MPFn_i))) * (std::get<TF1*>(nuisances.MPF_NuisanceCollection.at(MPFn_i)))->Eval(ptLead);
-              }
-            }
-	    
-            bins.emplace_back(std::make_tuple(simBalProfile->GetBinLowEdge(i + 1),
-					      triggerBin.recompBal[i]+shifts, std::sqrt(triggerBin.totalUnc2[i])));
-	    break;
-	  case HistReturnType::simBal:
-            bins.emplace_back(std::make_tuple(simBalProfile->GetBinLowEdge(i + 1),
-					      simBalProfile->GetBinContent(i+1), simBalProfile->GetBinError(i+1)));
-	    break;
-	  }
-
-	}
-        
+        auto const &simBinning = triggerBins[iTriggerBin].simBinning;
         
-        double const lastEdge = simBalProfile->GetBinLowEdge(simBalProfile->GetNbinsX() + 1);
+        for (unsigned i = 0; i < triggerBins[iTriggerBin].simMeanBal.size(); ++i)
+            order.emplace_back(iTriggerBin, i);
         
-        if (lastEdge > upperBoundary)
-            upperBoundary = lastEdge;
+        upperBoundary = std::max(upperBoundary, simBinning[simBinning.size() - 1]);
     }
     
+    std::stable_sort(order.begin(), order.end(), [&triggerBins](auto const &lhs, auto const &rhs)
+    {
+        return (triggerBins[lhs.first].simBinning[lhs.second] <
+          triggerBins[rhs.first].simBinning[rhs.second]);
+    });
     
-    // Different trigger bins might not have been ordered in pt. Sort the constructed list of bins.
-    std::sort(bins.begin(), bins.end(),
-      [](auto const &lhs, auto const &rhs){return (std::get<0>(lhs) < std::get<0>(rhs));});
     
+    // Collect the parts of the band that do not depend on the parameters of the correction
+    unsigned const numBins = order.size();
+    BalanceBand band;
+    band.probabilities = probabilities;
+    std::vector<double> shifts(numBins);
     
-    // Construct a histogram from the collection of bins
-    std::vector<double> edges;
-    edges.reserve(bins.size() + 1);
+    for (unsigned b = 0; b < numBins; ++b)
+    {
+        auto const &triggerBin = triggerBins[order[b].first];
+        unsigned const i = order[b].second;
+        
+        band.edges.emplace_back(triggerBin.simBinning[i]);
+        band.data.emplace_back(triggerBin.rebinnedMeanBal[i]);
+        band.dataUnc.emplace_back(triggerBin.rebinnedMeanBalUnc[i]);
+        band.sim.emplace_back(triggerBin.simMeanBal[i]);
+        band.simUnc.emplace_back(triggerBin.simMeanBalUnc[i]);
+        shifts[b] = ComputeNuisanceShift(GetBinCenter(triggerBin.simBinning, i + 1), nuisances);
+    }
     
-    for (unsigned i = 0; i < bins.size(); ++i)
-        edges.emplace_back(std::get<0>(bins[i]));
+    band.edges.emplace_back(upperBoundary);
     
-    edges.emplace_back(upperBoundary);
     
-    TH1D hist("RecompBalance", "", edges.size() - 1, edges.data());
-    hist.SetDirectory(nullptr);
+    // Recompute the balance for all samples. Each sample uses its own copy of the corrector.
+    //Results are stored with the sample index running fastest. When samples are processed in
+    //parallel, each of them is evaluated serially so that the threads are not oversubscribed.
+    unsigned const numSamples = paramSamples.size();
+    std::vector<double> values(numBins * numSamples);
+    ThreadPool *const samplePool = (numThreads > 1) ? nullptr : threadPool.get();
     
-    for (unsigned i = 0; i < bins.size(); ++i)
+    ParallelFor(numSamples, numThreads, [&](unsigned k)
     {
-        hist.SetBinContent(i + 1, std::get<1>(bins[i]));
-        hist.SetBinError(i + 1, std::get<2>(bins[i]));
-    }
+        auto sampleCorrector = corrector.Clone();
+        sampleCorrector->SetParams(paramSamples[k]);
+        
+        std::vector<std::vector<double>> recompBal;
+        UpdateBalance(*sampleCorrector, nuisances, recompBal, samplePool);
+        
+        for (unsigned b = 0; b < numBins; ++b)
+            values[b * numSamples + k] = recompBal[order[b].first][order[b].second] + shifts[b];
+    });
+    
     
+    // Compute the quantiles in each bin
+    band.quantiles.assign(probabilities.size(),
+      std::vector<double>(numBins, std::numeric_limits<double>::quiet_NaN()));
+    
+    for (unsigned b = 0; b < numBins; ++b)
+    {
+        auto const begin = values.begin() + b * numSamples;
+        auto const end = std::remove_if(begin, begin + numSamples,
+          [](double x){return std::isnan(x);});
+        unsigned const numDefined = end - begin;
+        
+        if (numDefined == 0)
+            continue;
+        
+        std::sort(begin, end);
+        
+        for (unsigned q = 0; q < probabilities.size(); ++q)
+        {
+            double const pos = probabilities[q] * (numDefined - 1);
+            unsigned const lower = std::min<unsigned>(pos, numDefined - 1);
+            unsigned const upper = std::min(lower + 1, numDefined - 1);
+            double const frac = pos - lower;
+            band.quantiles[q][b] = (1. - frac) * begin[lower] + frac * begin[upper];
+        }
+    }
     
-    return hist;
+    return band;
+}
+
+
+unsigned MultijetBinnedSum::GetNumTriggerBins() const
+{
+    return inputs->triggerBins.size();
 }
 
 
 double MultijetBinnedSum::Eval(JetCorrBase const &corrector, Nuisances const &nuisances) const
 {
-    UpdateBalance(corrector, nuisances);
-    double chi2 = 0.;
+    JECFIT_PROFILE_SCOPE("MultijetBinnedSum", "Eval");
+    JECFIT_TRACE_SCOPE("MultijetBinnedSum", "Eval");
+    auto const &triggerBins = inputs->triggerBins;
+    std::vector<std::vector<double>> recompBal;
+    UpdateBalance(corrector, nuisances, recompBal, threadPool.get());
     
-    for (unsigned iTriggerBin = selectedTriggerBinsBegin; iTriggerBin < selectedTriggerBinsEnd;
-      ++iTriggerBin)
+    
+    // Compute contributions of individual trigger bins, possibly in parallel, and sum them up in a
+    //fixed order. Thus the result does not depend on the number of threads.
+    std::vector<double> partialChi2s(selectedTriggerBinsEnd - selectedTriggerBinsBegin, 0.);
+    
+    RunTasks(threadPool.get(), partialChi2s.size(), [&](unsigned iTask)
     {
+        JECFIT_PROFILE_SCOPE("MultijetBinnedSum", "chi2");
+        unsigned const iTriggerBin = selectedTriggerBinsBegin + iTask;
+        double &partialChi2 = partialChi2s[iTask];
+        
         auto const &triggerBin = triggerBins[iTriggerBin];
         
-        for (unsigned binIndex = 1; binIndex <= triggerBin.recompBal.size(); ++binIndex)
+        for (unsigned binIndex = 1; binIndex <= recompBal[iTriggerBin].size(); ++binIndex)
         {
-            double const meanBal = triggerBin.recompBal[binIndex - 1];
-            double const simMeanBal = triggerBin.simBalProfile->GetBinContent(binIndex);
-            double ptLead = triggerBin.simBalProfile->GetBinCenter(binIndex);
-            double shifts=0;
-            if(std::isnan(meanBal) || std::isnan(simMeanBal)){
-              std::cout << "\n \033[1;31m ERROR: \033[0m\n NaN in binIndex" << binIndex << " in triggerBin " << iTriggerBin<< std::endl;
-              std::cout << "will skip this bin and try to continue" << std::endl;
-              continue;
-            }
-
-            if (method == Method::PtBal){
-              for(unsigned MJBn_i = 0;  MJBn_i<nuisances.MJB_NuisanceCollection.size(); ++MJBn_i){
-                shifts+= * (std::get<double*>(nuisances.MJB_NuisanceCollection.at(MJBn_i))) * (std::get<TF1*>(nuisances.MJB_NuisanceCollection.at(MJBn_i)))->Eval(ptLead);
-              }
-            }
-            else if (method == Method::MPF){
-              for(unsigned MPFn_i = 0;  MPFn_i<nuisances.MPF_NuisanceCollection.size(); ++MPFn_i){
-                shifts+= * (std::get<double*>(nuisances.MPF_NuisanceCollection.at(MPFn_i))) * (std::get<TF1*>(nuisances.MPF_NuisanceCollection.at(MPFn_i)))->Eval(ptLead);
-              }
+            double const meanBal = recompBal[iTriggerBin][binIndex - 1];
+            double const simMeanBal = triggerBin.simMeanBal[binIndex - 1];
+            double ptLead = GetBinCenter(triggerBin.simBinning, binIndex);
+            double const shifts = ComputeNuisanceShift(ptLead, nuisances);
+            
+            // Bins with undefined balance are skipped. Occurrences are counted and reported at the
+            //end of the fit.
+            if (std::isnan(meanBal) or std::isnan(simMeanBal))
+            {
+                static DiagnosticCounter const &nanCounter = GetDiagnosticCounter(
+                  "MultijetBinnedSum", "bins skipped in chi2 because of NaN in mean balance",
+                  {"trigger bin", "bin", "pt", "simulated balance"});
+                nanCounter.Record((std::uint64_t(iTriggerBin) << 32) | binIndex,
+                  {double(iTriggerBin), double(binIndex), ptLead, simMeanBal});
+                continue;
             }
-            //          std::cout << "ptLead " << ptLead << " meanBal " << meanBal << " shifts " << shifts  << " simMeanBal " << simMeanBal  << " totalunc2 " << triggerBin.totalUnc2[binIndex - 1] << " chi2 " << chi2 <<  std::endl;
             
-            chi2 += std::pow(meanBal +shifts - simMeanBal, 2) / triggerBin.totalUnc2[binIndex - 1];
+            partialChi2 += std::pow(meanBal + shifts - simMeanBal, 2) /
+              triggerBin.totalUnc2[binIndex - 1];
+        }
+    });
+    
+    double chi2 = 0.;
+    
+    for (auto const &partialChi2: partialChi2s)
+        chi2 += partialChi2;
+    
+    return chi2;
+}
+
 
+std::vector<ResidualGroup> MultijetBinnedSum::EvalResiduals(JetCorrBase const &corrector,
+  Nuisances const &nuisances) const
+{
+    auto const &triggerBins = inputs->triggerBins;
+    std::vector<std::vector<double>> recompBal;
+    UpdateBalance(corrector, nuisances, recompBal, threadPool.get());
+    
+    std::vector<ResidualGroup> groups(selectedTriggerBinsEnd - selectedTriggerBinsBegin);
+    
+    RunTasks(threadPool.get(), groups.size(), [&](unsigned iTask)
+    {
+        unsigned const iTriggerBin = selectedTriggerBinsBegin + iTask;
+        auto const &triggerBin = triggerBins[iTriggerBin];
+        auto &group = groups[iTask];
+        
+        group.label = (inputs->directoryNames.empty()) ? std::to_string(iTriggerBin) :
+          inputs->directoryNames[iTriggerBin];
+        group.chi2 = 0.;
+        group.bins.reserve(recompBal[iTriggerBin].size());
+        
+        for (unsigned binIndex = 1; binIndex <= recompBal[iTriggerBin].size(); ++binIndex)
+        {
+            unsigned const i = binIndex - 1;
+            double const ptLead = GetBinCenter(triggerBin.simBinning, binIndex);
+            
+            ResidualBin bin;
+            bin.ptMin = GetBinLowEdge(triggerBin.simBinning, binIndex);
+            bin.ptMax = GetBinLowEdge(triggerBin.simBinning, binIndex + 1);
+            bin.data = triggerBin.rebinnedMeanBal[i];
+            bin.dataUnc = triggerBin.rebinnedMeanBalUnc[i];
+            bin.recomputed = recompBal[iTriggerBin][i] + ComputeNuisanceShift(ptLead, nuisances);
+            bin.sim = triggerBin.simMeanBal[i];
+            bin.simUnc = triggerBin.simMeanBalUnc[i];
+            bin.totalUnc = std::sqrt(triggerBin.totalUnc2[i]);
+            bin.pull = (bin.recomputed - bin.sim) / bin.totalUnc;
             
+            // Bins with undefined balance are skipped in the loss function, as done in Eval
+            if (not std::isnan(recompBal[iTriggerBin][i]) and not std::isnan(bin.sim))
+                group.chi2 += std::pow(bin.recomputed - bin.sim, 2) / triggerBin.totalUnc2[i];
+            
+            group.bins.emplace_back(bin);
         }
+    });
+    
+    return groups;
+}
+
+
+MultijetBinnedSum::Method MultijetBinnedSum::GetMethod() const
+{
+    return method;
+}
+
+
+std::size_t MultijetBinnedSum::GetTriggerBinMemory(unsigned index) const
+{
+    if (not IsTriggerBinLoaded(index))
+        return 0;
+    
+    auto const &bin = inputs->triggerBins.at(index);
+    std::size_t size = 0;
+    
+    for (auto const *array: {&bin.binning, &bin.numEvents, &bin.meanPtLead, &bin.meanBal,
+      &bin.meanBalUnc, &bin.ptJetBinning, &bin.ptJetSumProj, &bin.simBinning, &bin.simMeanBal,
+      &bin.simMeanBalUnc, &bin.rebinnedMeanBal, &bin.rebinnedMeanBalUnc, &bin.totalUnc2})
+    {
+        if (not array->IsView())
+            size += array->size() * sizeof(double);
     }
     
-    return chi2;
+    return size;
+}
+
+
+bool MultijetBinnedSum::IsTriggerBinLoaded(unsigned index) const
+{
+    if (inputs->loadStates.empty())
+        return true;
+    
+    return inputs->loadStates.at(index).loaded.load(std::memory_order_acquire);
+}
+
+
+void MultijetBinnedSum::SaveSnapshot(std::string const &fileName) const
+{
+    LoadTriggerBins(0, inputs->triggerBins.size());
+    
+    SnapshotWriter writer(snapshotType);
+    writer.Add((method == Method::PtBal) ? 0. : 1.);
+    writer.Add(inputs->minPt);
+    writer.Add(double(inputs->triggerBins.size()));
+    
+    for (auto const &bin: inputs->triggerBins)
+    {
+        for (auto const *array: {&bin.binning, &bin.numEvents, &bin.meanPtLead, &bin.meanBal,
+          &bin.meanBalUnc, &bin.ptJetBinning, &bin.ptJetSumProj, &bin.simBinning,
+          &bin.simMeanBal, &bin.simMeanBalUnc, &bin.rebinnedMeanBal, &bin.rebinnedMeanBalUnc,
+          &bin.totalUnc2})
+            writer.Add(*array);
+    }
+    
+    writer.Write(fileName);
 }
 
 
 void MultijetBinnedSum::SetTriggerBinRange(unsigned begin, unsigned end)
 {
+    auto const &triggerBins = inputs->triggerBins;
     unsigned const numTriggerBins = triggerBins.size();
     
     if (end == unsigned(-1))
@@ -335,47 +502,62 @@ void MultijetBinnedSum::SetTriggerBinRange(unsigned begin, unsigned end)
     }
     
     
-    selectedTriggerBinsBegin = begin;
-    selectedTriggerBinsEnd = end;
-    
+    // Unless the inputs are loaded lazily, all trigger bins must be available. This is not the
+    //case in replicas created with CloneFluctuated.
+    if (inputs->loadStates.empty())
+    {
+        for (unsigned i = begin; i < end; ++i)
+        {
+            if (triggerBins[i].binning.size() == 0)
+            {
+                std::ostringstream message;
+                message << "MultijetBinnedSum::SetTriggerBinRange: Trigger bin " << i <<
+                  " is not available.";
+                throw std::runtime_error(message.str());
+            }
+        }
+    }
     
-    // Have to recompute cached dimensionality
-    dimensionality = 0;
     
-    for (unsigned i = selectedTriggerBinsBegin; i < selectedTriggerBinsEnd; ++i)
-        dimensionality += triggerBins[i].simBalProfile->GetNbinsX();
+    // The selected bins will be loaded when they are accessed for the first time
+    selectedTriggerBinsBegin = begin;
+    selectedTriggerBinsEnd = end;
 }
 
 
 double MultijetBinnedSum::ComputeMPF(TriggerBin const &triggerBin, FracBin const &ptLeadStart,
   FracBin const &ptLeadEnd, FracBin const &ptJetStart, JetCorrBase const &corrector)
 {
+    auto const &ptJetBinning = triggerBin.ptJetBinning;
+    unsigned const numPtJetBins = ptJetBinning.size() - 1;
+    unsigned const rowLength = numPtJetBins + 2;
+    
     double sumBal = 0., sumWeight = 0.;
     
     // Loop over bins in ptlead
     for (unsigned iPtLead = ptLeadStart.index; iPtLead <= ptLeadEnd.index; ++iPtLead)
     {
-        unsigned numEvents = triggerBin.ptLead->GetBinContent(iPtLead);
+        double const numEvents = triggerBin.numEvents[iPtLead];
         
         if (numEvents == 0)
             continue;
         
-        double const ptLead = triggerBin.ptLeadProfile->GetBinContent(iPtLead);
+        double const ptLead = triggerBin.meanPtLead[iPtLead];
+        double const *sumProj = triggerBin.ptJetSumProj.data() + iPtLead * rowLength;
         
         
         // Sum over other jets. Consider separately the starting bin, which is only partly
         //included, and the remaining ones
         double sumJets = 0.;
         
-        double pt = triggerBin.ptJetSumProj->GetYaxis()->GetBinCenter(ptJetStart.index);
-        double s = triggerBin.ptJetSumProj->GetBinContent(iPtLead, ptJetStart.index);
+        double pt = GetBinCenter(ptJetBinning, ptJetStart.index);
+        double s = sumProj[ptJetStart.index];
         sumJets += (1 - corrector.Eval(pt)) * s * ptJetStart.frac;
         
-        for (int iPtJ = ptJetStart.index + 1; iPtJ < triggerBin.ptJetSumProj->GetNbinsY() + 1;
-          ++iPtJ)
+        for (unsigned iPtJ = ptJetStart.index + 1; iPtJ < numPtJetBins + 1; ++iPtJ)
         {
-            pt = triggerBin.ptJetSumProj->GetYaxis()->GetBinCenter(iPtJ);
-            s = triggerBin.ptJetSumProj->GetBinContent(iPtLead, iPtJ);
+            pt = GetBinCenter(ptJetBinning, iPtJ);
+            s = sumProj[iPtJ];
             sumJets += (1 - corrector.Eval(pt)) * s;
         }
         
@@ -391,7 +573,7 @@ double MultijetBinnedSum::ComputeMPF(TriggerBin const &triggerBin, FracBin const
             fraction = ptLeadEnd.frac;
         
         
-        sumBal += triggerBin.balProfile->GetBinContent(iPtLead) * numEvents /
+        sumBal += triggerBin.meanBal[iPtLead] * numEvents /
           corrector.Eval(ptLead) * fraction;
         sumBal += sumJets / (ptLead * corrector.Eval(ptLead)) * fraction;
         sumWeight += numEvents * fraction;
@@ -401,35 +583,52 @@ double MultijetBinnedSum::ComputeMPF(TriggerBin const &triggerBin, FracBin const
 }
 
 
+double MultijetBinnedSum::ComputeNuisanceShift(double ptLead, Nuisances const &nuisances) const
+{
+    auto const &collection = (method == Method::PtBal) ? nuisances.MJB_NuisanceCollection :
+      nuisances.MPF_NuisanceCollection;
+    double shift = 0.;
+    
+    for (auto const &nuisance: collection)
+        shift += *std::get<double *>(nuisance) * std::get<NuisanceShape *>(nuisance)->Eval(ptLead);
+    
+    return shift;
+}
+
+
 double MultijetBinnedSum::ComputePtBal(TriggerBin const &triggerBin, FracBin const &ptLeadStart,
   FracBin const &ptLeadEnd, FracBin const &ptJetStart, JetCorrBase const &corrector)
 {
+    auto const &ptJetBinning = triggerBin.ptJetBinning;
+    unsigned const numPtJetBins = ptJetBinning.size() - 1;
+    unsigned const rowLength = numPtJetBins + 2;
+    
     double sumBal = 0., sumWeight = 0.;
     
     // Loop over bins in ptlead
     for (unsigned iPtLead = ptLeadStart.index; iPtLead <= ptLeadEnd.index; ++iPtLead)
     {
-        unsigned numEvents = triggerBin.ptLead->GetBinContent(iPtLead);
+        double const numEvents = triggerBin.numEvents[iPtLead];
         
         if (numEvents == 0)
             continue;
         
-        double const ptLead = triggerBin.ptLeadProfile->GetBinContent(iPtLead);
+        double const ptLead = triggerBin.meanPtLead[iPtLead];
+        double const *sumProj = triggerBin.ptJetSumProj.data() + iPtLead * rowLength;
         
         
         // Sum over other jets. Consider separately the starting bin, which is only partly
         //included, and the remaining ones
         double sumJets = 0.;
         
-        double pt = triggerBin.ptJetSumProj->GetYaxis()->GetBinCenter(ptJetStart.index);
-        double s = triggerBin.ptJetSumProj->GetBinContent(iPtLead, ptJetStart.index);
+        double pt = GetBinCenter(ptJetBinning, ptJetStart.index);
+        double s = sumProj[ptJetStart.index];
         sumJets += s * corrector.Eval(pt) * ptJetStart.frac;
         
-        for (int iPtJ = ptJetStart.index + 1; iPtJ < triggerBin.ptJetSumProj->GetNbinsY() + 1;
-          ++iPtJ)
+        for (unsigned iPtJ = ptJetStart.index + 1; iPtJ < numPtJetBins + 1; ++iPtJ)
         {
-            pt = triggerBin.ptJetSumProj->GetYaxis()->GetBinCenter(iPtJ);
-            s = triggerBin.ptJetSumProj->GetBinContent(iPtLead, iPtJ);
+            pt = GetBinCenter(ptJetBinning, iPtJ);
+            s = sumProj[iPtJ];
             sumJets += s * corrector.Eval(pt);
         }
         
@@ -453,11 +652,90 @@ double MultijetBinnedSum::ComputePtBal(TriggerBin const &triggerBin, FracBin con
 }
 
 
-void MultijetBinnedSum::UpdateBalance(JetCorrBase const &corrector, Nuisances const &) const
+MultijetBinnedSum::TriggerBin MultijetBinnedSum::FinalizeTriggerBin(TriggerBinSums &&sums)
 {
+    TriggerBin bin;
+    
+    bin.binning = std::move(sums.binning);
+    bin.numEvents = std::move(sums.numEvents);
+    bin.meanPtLead = sums.ptLead.GetMeans();
+    bin.meanBal = sums.bal.GetMeans();
+    bin.meanBalUnc = sums.bal.GetErrors();
+    bin.ptJetBinning = std::move(sums.ptJetBinning);
+    bin.ptJetSumProj = std::move(sums.ptJetSumProj);
+    bin.simBinning = std::move(sums.simBinning);
+    bin.simMeanBal = StripUnderOverflow(sums.simBal.GetMeans());
+    bin.simMeanBalUnc = StripUnderOverflow(sums.simBal.GetErrors());
+    
+    
+    // Compute combined (squared) uncertainty on the balance observable in data and simulation.
+    //The data profile is rebinned with the binning used for simulation. This is done assuming
+    //that bin edges of the two binnings are aligned, which should normally be the case.
+    ProfileSums const balRebinned(sums.bal.Rebin(bin.binning, bin.simBinning));
+    bin.rebinnedMeanBal = StripUnderOverflow(balRebinned.GetMeans());
+    bin.rebinnedMeanBalUnc = StripUnderOverflow(balRebinned.GetErrors());
+    
+    std::vector<double> totalUnc2;
+    
+    for (unsigned i = 0; i < bin.simMeanBalUnc.size(); ++i)
+        totalUnc2.emplace_back(std::pow(bin.simMeanBalUnc[i], 2) +
+          std::pow(bin.rebinnedMeanBalUnc[i], 2));
+    
+    bin.totalUnc2 = std::move(totalUnc2);
+    
+    return bin;
+}
+
+
+void MultijetBinnedSum::LoadTriggerBins(unsigned begin, unsigned end) const
+{
+    auto const &loadStates = inputs->loadStates;
+    
+    if (loadStates.empty())
+        return;
+    
+    
+    // Find bins that still need to be loaded. Normally all of them have been loaded already, and
+    //this check is cheap.
+    std::vector<unsigned> toLoad;
+    
+    for (unsigned i = begin; i < end; ++i)
+    {
+        if (not loadStates[i].loaded.load(std::memory_order_acquire))
+            toLoad.emplace_back(i);
+    }
+    
+    if (toLoad.empty())
+        return;
+    
+    
+    // Read the bins in parallel. If another thread is loading the same bin, std::call_once
+    //blocks until it has finished.
+    Inputs const &in = *inputs;
+    
+    ParallelFor(toLoad.size(), in.numThreads, [&in, &toLoad](unsigned iTask)
+    {
+        unsigned const iBin = toLoad[iTask];
+        
+        std::call_once(in.loadStates[iBin].flag, [&in, iBin]()
+        {
+            in.triggerBins[iBin] = FinalizeTriggerBin(in.loadTriggerBin(iBin));
+            in.loadStates[iBin].loaded.store(true, std::memory_order_release);
+        });
+    });
+}
+
+
+void MultijetBinnedSum::UpdateBalance(JetCorrBase const &corrector, Nuisances const &,
+  std::vector<std::vector<double>> &recompBal, ThreadPool *pool) const
+{
+    LoadTriggerBins(selectedTriggerBinsBegin, selectedTriggerBinsEnd);
+    
+    auto const &triggerBins = inputs->triggerBins;
+    double const minPt = inputs->minPt;
     double minPtUncorr = corrector.UndoCorr(minPt);
     
-    if (triggerBins.front().ptJetSumProj->GetYaxis()->FindFixBin(minPtUncorr) == 0)
+    if (FindBin(triggerBins[selectedTriggerBinsBegin].ptJetBinning, minPtUncorr) == 0)
     {
         std::ostringstream message;
         message << "MultijetBinnedSum::UpdateBalance: With the current correction " <<
@@ -467,46 +745,92 @@ void MultijetBinnedSum::UpdateBalance(JetCorrBase const &corrector, Nuisances co
     }
     
     
-    for (unsigned iTriggerBin = selectedTriggerBinsBegin; iTriggerBin < selectedTriggerBinsEnd;
-      ++iTriggerBin)
+    recompBal.resize(triggerBins.size());
+    
+    // Bin maps and starting bins in pt of other jets, indexed with the trigger bin
+    std::vector<BinMap> binMaps(triggerBins.size());
+    std::vector<FracBin> ptJetStarts(triggerBins.size());
+    
+    
+    // First build the bin maps for all trigger bins. This is relatively cheap, but the
+    //computation can still be parallelized over trigger bins.
+    RunTasks(pool, selectedTriggerBinsEnd - selectedTriggerBinsBegin, [&](unsigned iTask)
     {
+        unsigned const iTriggerBin = selectedTriggerBinsBegin + iTask;
         auto const &triggerBin = triggerBins[iTriggerBin];
+        recompBal[iTriggerBin].resize(triggerBin.simMeanBal.size());
         
         // The binning in pt of the leading jet in the profile for simulation corresponds to
         //corrected jets. Translate it into a binning in uncorrected pt.
         std::vector<double> uncorrPtBinning;
+        uncorrPtBinning.reserve(triggerBin.simBinning.size());
         
-        for (int i = 1; i <= triggerBin.simBalProfile->GetNbinsX() + 1; ++i)
         {
-            double const pt = triggerBin.simBalProfile->GetBinLowEdge(i);
-            uncorrPtBinning.emplace_back(corrector.UndoCorr(pt));
+            JECFIT_PROFILE_SCOPE("MultijetBinnedSum", "inversion");
+            
+            for (auto const &pt: triggerBin.simBinning)
+                uncorrPtBinning.emplace_back(corrector.UndoCorr(pt));
         }
         
         
         // Build a map from this translated binning to the fine binning in data histograms. It
         //accounts both for the migration in pt of the leading jet due to the jet correction and
         //the typically larger size of bins used for computation of chi2.
-        auto binMap = mapBinning(triggerBin.binning, uncorrPtBinning);
+        auto &binMap = binMaps[iTriggerBin];
+        
+        {
+            JECFIT_PROFILE_SCOPE("MultijetBinnedSum", "bin mapping");
+            binMap = mapBinning(triggerBin.binning.data(), triggerBin.binning.size(),
+              uncorrPtBinning.data(), uncorrPtBinning.size());
+        }
         
         // Under- and overflow bins in pt are included in other trigger bins and must be dropped
         binMap.erase(0);
-        binMap.erase(triggerBin.simBalProfile->GetNbinsX() + 1);
+        binMap.erase(triggerBin.simMeanBal.size() + 1);
         
         
         // Find bin in pt of other jets that contains minPtUncorr, and the corresponding inclusion
         //fraction
-        auto const *axis = triggerBin.ptJetSumProj->GetYaxis();
-        unsigned const minPtBin = axis->FindFixBin(minPtUncorr);
-        double const minPtFrac = (minPtUncorr - axis->GetBinLowEdge(minPtBin)) /
-          axis->GetBinWidth(minPtBin);
-        FracBin const ptJetStart{minPtBin, 1. - minPtFrac};
+        auto const &ptJetBinning = triggerBin.ptJetBinning;
+        unsigned const minPtBin = FindBin(ptJetBinning, minPtUncorr);
+        double const minPtFrac = (minPtUncorr - GetBinLowEdge(ptJetBinning, minPtBin)) /
+          GetBinWidth(ptJetBinning, minPtBin);
+        ptJetStarts[iTriggerBin] = FracBin{minPtBin, 1. - minPtFrac};
+    });
+    
+    
+    // Split bins of all trigger bins into chunks of a few consecutive bins. The recomputation of
+    //the mean balance, which dominates the computing time, is then performed for each chunk
+    //separately. Trigger bins differ a lot in size, and the chunks allow to share the work in a
+    //large trigger bin among several threads. Each bin is written to its own place in the output
+    //buffer, so the result does not depend on the number of threads.
+    unsigned const chunkSize = 4;
+    std::vector<std::pair<unsigned, BinMap::const_iterator>> chunkStarts;
+    
+    for (unsigned iTriggerBin = selectedTriggerBinsBegin; iTriggerBin < selectedTriggerBinsEnd;
+      ++iTriggerBin)
+    {
+        unsigned binCount = 0;
         
+        for (auto it = binMaps[iTriggerBin].cbegin(); it != binMaps[iTriggerBin].cend(); ++it)
+        {
+            if (binCount++ % chunkSize == 0)
+                chunkStarts.emplace_back(iTriggerBin, it);
+        }
+    }
+    
+    RunTasks(pool, chunkStarts.size(), [&](unsigned iChunk)
+    {
+        JECFIT_PROFILE_SCOPE("MultijetBinnedSum", "recomputation");
+        unsigned const iTriggerBin = chunkStarts[iChunk].first;
+        auto const &triggerBin = triggerBins[iTriggerBin];
+        auto const &ptJetStart = ptJetStarts[iTriggerBin];
+        auto it = chunkStarts[iChunk].second;
         
-        // Compute mean balance with the translated binning
-        for (auto const &binMapPair: binMap)
+        for (unsigned i = 0; i < chunkSize and it != binMaps[iTriggerBin].cend(); ++i, ++it)
         {
-            auto const &binIndex = binMapPair.first;
-            auto const &binRange = binMapPair.second;
+            auto const &binIndex = it->first;
+            auto const &binRange = it->second;
             
             double meanBal;
             
@@ -514,8 +838,24 @@ void MultijetBinnedSum::UpdateBalance(JetCorrBase const &corrector, Nuisances co
                 meanBal = ComputePtBal(triggerBin, binRange[0], binRange[1], ptJetStart, corrector);
             else
                 meanBal = ComputeMPF(triggerBin, binRange[0], binRange[1], ptJetStart, corrector);
-            if(std::isnan(meanBal))std::cout << "NaN in binIndex" << binIndex << std::endl;
-            triggerBin.recompBal[binIndex - 1] = meanBal;
+            
+            if (std::isnan(meanBal))
+            {
+                static DiagnosticCounter const &nanCounter = GetDiagnosticCounter(
+                  "MultijetBinnedSum", "NaN in recomputed mean balance",
+                  {"trigger bin", "bin", "pt"});
+                nanCounter.Record((std::uint64_t(iTriggerBin) << 32) | binIndex,
+                  {double(iTriggerBin), double(binIndex),
+                  GetBinCenter(triggerBin.simBinning, binIndex)});
+            }
+            
+            recompBal[iTriggerBin][binIndex - 1] = meanBal;
         }
-    }
+    });
+}
+
+
+void MultijetBinnedSum::SetThreadPool(std::shared_ptr<ThreadPool> const &threadPool_)
+{
+    threadPool = threadPool_;
 }
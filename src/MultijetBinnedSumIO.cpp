@@ -0,0 +1,328 @@
+#include <MultijetBinnedSum.hpp>
+
+#include <HistFlattening.hpp>
+#include <Rebin.hpp>
+
+#include <TFile.h>
+#include <TH1D.h>
+#include <TH2.h>
+#include <TKey.h>
+#include <TProfile.h>
+#include <TVectorD.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <tuple>
+
+
+
+MultijetBinnedSum::MultijetBinnedSum(std::string const &fileName,
+  MultijetBinnedSum::Method method_, unsigned numThreads):
+    MultijetBinnedSum(std::vector<WeightedFile>{{fileName, 1.}}, method_, numThreads)
+{}
+
+
+MultijetBinnedSum::MultijetBinnedSum(std::vector<WeightedFile> const &files,
+  MultijetBinnedSum::Method method_, unsigned numThreads):
+    method(method_)
+{
+    std::string methodLabel;
+    
+    if (method == Method::PtBal)
+        methodLabel = "PtBal";
+    else if (method == Method::MPF)
+        methodLabel = "MPF";
+    
+    if (files.empty())
+        throw std::runtime_error("MultijetBinnedSum::MultijetBinnedSum: No input files given.");
+    
+    
+    auto const openFile = [](std::string const &fileName)
+    {
+        std::unique_ptr<TFile> file(TFile::Open(fileName.c_str()));
+        
+        if (not file or file->IsZombie())
+        {
+            std::ostringstream message;
+            message << "MultijetBinnedSum::MultijetBinnedSum: Failed to open file \"" <<
+              fileName << "\".";
+            throw std::runtime_error(message.str());
+        }
+        
+        return file;
+    };
+    
+    std::vector<std::unique_ptr<TFile>> inputFiles;
+    
+    for (auto const &file: files)
+        inputFiles.emplace_back(openFile(file.name));
+    
+    
+    auto newInputs = std::make_shared<Inputs>();
+    newInputs->numThreads = numThreads;
+    
+    
+    // Read the jet pt threshold. It is not a free parameter and must be set to the same value as
+    //used to construct the inputs. For the pt balance method it affects the definition of the
+    //balance observable in simulation (while in data it can be recomputed for any not too low
+    //threshold). In the case of the MPF method the definition of the balance observable in both
+    //data and simulation is affected. Inputs with different thresholds cannot be combined.
+    for (unsigned iFile = 0; iFile < files.size(); ++iFile)
+    {
+        auto ptThreshold = dynamic_cast<TVectorD *>(
+          inputFiles[iFile]->Get(("MinPt" + methodLabel).c_str()));
+        
+        if (not ptThreshold or ptThreshold->GetNoElements() != 1)
+        {
+            std::ostringstream message;
+            message << "MultijetBinnedSum::MultijetBinnedSum: Failed to read jet pt threshold " <<
+              "from file \"" << files[iFile].name << "\".";
+            throw std::runtime_error(message.str());
+        }
+        
+        if (iFile == 0)
+            newInputs->minPt = (*ptThreshold)[0];
+        else if ((*ptThreshold)[0] != newInputs->minPt)
+        {
+            std::ostringstream message;
+            message << "MultijetBinnedSum::MultijetBinnedSum: Jet pt threshold in file \"" <<
+              files[iFile].name << "\" differs from the one in file \"" << files[0].name <<
+              "\".";
+            throw std::runtime_error(message.str());
+        }
+    }
+    
+    
+    // Find names of directories in the first input file, which correspond to trigger bins. All
+    //other files must contain the same directories, which is checked when the bins are read.
+    auto &directoryNames = newInputs->directoryNames;
+    TIter fileIter(inputFiles.front()->GetListOfKeys());
+    TKey *key;
+    
+    while ((key = dynamic_cast<TKey *>(fileIter())))
+    {
+        if (strcmp(key->GetClassName(), "TDirectoryFile") == 0)
+            directoryNames.emplace_back(key->GetName());
+    }
+    
+    if (directoryNames.empty())
+    {
+        std::ostringstream message;
+        message << "MultijetBinnedSum::MultijetBinnedSum: No data read from file \"" <<
+          files.front().name << "\".";
+        throw std::runtime_error(message.str());
+    }
+    
+    for (auto &file: inputFiles)
+        file->Close();
+    
+    
+    // Trigger bins are not read here but only when they are accessed for the first time. The
+    //loader owns copies of the list of files and directory names, so that it does not refer to
+    //the inputs themselves.
+    newInputs->triggerBins.resize(directoryNames.size());
+    newInputs->loadStates = std::vector<LoadState>(directoryNames.size());
+    newInputs->loadTriggerBin = [files, directoryNames, method = method](unsigned index)
+    {
+        return ReadTriggerBin(files, directoryNames[index], method);
+    };
+    
+    inputs = newInputs;
+    SetTriggerBinRange(0);
+}
+
+
+TH1D MultijetBinnedSum::GetRecompBalance(JetCorrBase const &corrector,
+  Nuisances const &nuisances, HistReturnType histReturnType) const
+{
+    // An auxiliary structure to aggregate information about a single bin. Consists of the lower
+    //bin edge, bin content, and its uncertainty.
+    using Bin = std::tuple<double, double, double>;
+    
+    
+    auto const &triggerBins = inputs->triggerBins;
+    
+    
+    // Recompute mean balance observables
+    std::vector<std::vector<double>> recompBal;
+    UpdateBalance(corrector, nuisances, recompBal, threadPool.get());
+    
+    
+    // Read recomputed mean balance observables for all bins
+    std::vector<Bin> bins;
+    bins.reserve(GetDim());
+    
+    double upperBoundary = -std::numeric_limits<double>::infinity();
+    
+    for (unsigned iTriggerBin = selectedTriggerBinsBegin; iTriggerBin < selectedTriggerBinsEnd;
+      ++iTriggerBin)
+    {
+        auto const &triggerBin = triggerBins[iTriggerBin];
+        
+        auto const &simBinning = triggerBin.simBinning;
+        
+        for (unsigned i = 0; i < recompBal[iTriggerBin].size(); ++i)
+        {
+            switch (histReturnType)
+            {
+                case HistReturnType::bal:
+                    bins.emplace_back(simBinning[i], triggerBin.rebinnedMeanBal[i],
+                      triggerBin.rebinnedMeanBalUnc[i]);
+                    break;
+                
+                case HistReturnType::recompBal:
+                {
+                    double const ptLead = GetBinCenter(simBinning, i + 1);
+                    bins.emplace_back(simBinning[i],
+                      recompBal[iTriggerBin][i] + ComputeNuisanceShift(ptLead, nuisances),
+                      std::sqrt(triggerBin.totalUnc2[i]));
+                    break;
+                }
+                
+                case HistReturnType::simBal:
+                    bins.emplace_back(simBinning[i], triggerBin.simMeanBal[i],
+                      triggerBin.simMeanBalUnc[i]);
+                    break;
+            }
+        }
+        
+        double const lastEdge = simBinning[simBinning.size() - 1];
+        
+        if (lastEdge > upperBoundary)
+            upperBoundary = lastEdge;
+    }
+    
+    
+    // Different trigger bins might not have been ordered in pt. Sort the constructed list of bins.
+    std::sort(bins.begin(), bins.end(),
+      [](auto const &lhs, auto const &rhs){return (std::get<0>(lhs) < std::get<0>(rhs));});
+    
+    
+    // Construct a histogram from the collection of bins
+    std::vector<double> edges;
+    edges.reserve(bins.size() + 1);
+    
+    for (unsigned i = 0; i < bins.size(); ++i)
+        edges.emplace_back(std::get<0>(bins[i]));
+    
+    edges.emplace_back(upperBoundary);
+    
+    TH1D hist("RecompBalance", "", edges.size() - 1, edges.data());
+    hist.SetDirectory(nullptr);
+    
+    for (unsigned i = 0; i < bins.size(); ++i)
+    {
+        hist.SetBinContent(i + 1, std::get<1>(bins[i]));
+        hist.SetBinError(i + 1, std::get<2>(bins[i]));
+    }
+    
+    
+    return hist;
+}
+
+
+MultijetBinnedSum::TriggerBinSums MultijetBinnedSum::ReadTriggerBin(
+  std::vector<WeightedFile> const &files, std::string const &directoryName,
+  MultijetBinnedSum::Method method)
+{
+    std::string const methodLabel((method == Method::PtBal) ? "PtBal" : "MPF");
+    TriggerBinSums bin;
+    
+    for (unsigned iFile = 0; iFile < files.size(); ++iFile)
+    {
+        std::string const &fileName = files[iFile].name;
+        double const weight = files[iFile].weight;
+        std::unique_ptr<TFile> file(TFile::Open(fileName.c_str()));
+        
+        if (not file or file->IsZombie())
+        {
+            std::ostringstream message;
+            message << "MultijetBinnedSum::ReadTriggerBin: Failed to open file \"" <<
+              fileName << "\".";
+            throw std::runtime_error(message.str());
+        }
+        
+        auto *directory = dynamic_cast<TDirectoryFile *>(file->Get(directoryName.c_str()));
+        
+        if (not directory)
+        {
+            std::ostringstream message;
+            message << "MultijetBinnedSum::ReadTriggerBin: File \"" << fileName <<
+              "\" does not contain directory \"" << directoryName << "\".";
+            throw std::runtime_error(message.str());
+        }
+        
+        for (auto const &name: std::initializer_list<std::string>{
+          "Sim" + methodLabel + "Profile", "PtLead", "PtLeadProfile", methodLabel + "Profile",
+          "PtJetSumProj"})
+        {
+            if (not directory->Get(name.c_str()))
+            {
+                std::ostringstream message;
+                message << "MultijetBinnedSum::ReadTriggerBin: Directory \"" <<
+                  directoryName << "\" in file \"" << fileName <<
+                  "\" does not contain required key \"" << name << "\".";
+                throw std::runtime_error(message.str());
+            }
+        }
+        
+        
+        std::unique_ptr<TProfile> simBalProfile(dynamic_cast<TProfile *>(
+          directory->Get(("Sim" + methodLabel + "Profile").c_str())));
+        std::unique_ptr<TProfile> balProfile(dynamic_cast<TProfile *>(
+          directory->Get((methodLabel + "Profile").c_str())));
+        std::unique_ptr<TH1> ptLead(dynamic_cast<TH1 *>(directory->Get("PtLead")));
+        std::unique_ptr<TProfile> ptLeadProfile(dynamic_cast<TProfile *>(
+          directory->Get("PtLeadProfile")));
+        std::unique_ptr<TH2> ptJetSumProjHist(dynamic_cast<TH2 *>(
+          directory->Get("PtJetSumProj")));
+        
+        simBalProfile->SetDirectory(nullptr);
+        balProfile->SetDirectory(nullptr);
+        ptLead->SetDirectory(nullptr);
+        ptLeadProfile->SetDirectory(nullptr);
+        ptJetSumProjHist->SetDirectory(nullptr);
+        
+        
+        // Check that binnings agree within the file and with previous files
+        std::vector<double> const curBinning(GetBinEdges(*ptLead->GetXaxis()));
+        std::vector<double> const curPtJetBinning(GetBinEdges(*ptJetSumProjHist->GetYaxis()));
+        std::vector<double> const curSimBinning(GetBinEdges(*simBalProfile->GetXaxis()));
+        
+        if (ptJetSumProjHist->GetNbinsX() != ptLead->GetNbinsX() or
+          (iFile > 0 and (curBinning != bin.binning or curPtJetBinning != bin.ptJetBinning or
+          curSimBinning != bin.simBinning)))
+        {
+            std::ostringstream message;
+            message << "MultijetBinnedSum::ReadTriggerBin: Binnings of histograms in " <<
+              "directory \"" << directoryName << "\" in file \"" << fileName <<
+              "\" are not compatible.";
+            throw std::runtime_error(message.str());
+        }
+        
+        if (iFile == 0)
+        {
+            bin.binning = curBinning;
+            bin.ptJetBinning = curPtJetBinning;
+            bin.simBinning = curSimBinning;
+        }
+        
+        
+        // Accumulate contents of the histograms in flat arrays. The original objects are
+        //deleted at the end of the iteration, so that at most one set of histograms is held in
+        //memory at a time.
+        AddScaled(bin.numEvents, GetBinContents(*ptLead), weight);
+        AddScaled(bin.ptJetSumProj, GetBinContents2D(*ptJetSumProjHist), weight);
+        bin.ptLead.Add(ReadProfileSums(*ptLeadProfile, weight));
+        bin.bal.Add(ReadProfileSums(*balProfile, weight));
+        bin.simBal.Add(ReadProfileSums(*simBalProfile, weight));
+        
+        file->Close();
+    }
+    
+    return bin;
+}
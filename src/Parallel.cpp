@@ -0,0 +1,331 @@
+#include <Parallel.hpp>
+
+#include <algorithm>
+
+
+void ParallelFor(unsigned numTasks, unsigned numThreads,
+  std::function<void(unsigned)> const &task)
+{
+    numThreads = std::max(1u, std::min(numThreads, numTasks));
+    
+    std::atomic<unsigned> nextTask(0);
+    std::atomic<bool> failed(false);
+    std::exception_ptr firstException;
+    std::mutex exceptionMutex;
+    
+    auto const worker = [&]()
+    {
+        while (not failed)
+        {
+            unsigned const taskIndex = nextTask++;
+            
+            if (taskIndex >= numTasks)
+                break;
+            
+            try
+            {
+                task(taskIndex);
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock(exceptionMutex);
+                
+                if (not firstException)
+                    firstException = std::current_exception();
+                
+                failed = true;
+            }
+        }
+    };
+    
+    std::vector<std::thread> threads;
+    threads.reserve(numThreads - 1);
+    
+    for (unsigned i = 1; i < numThreads; ++i)
+        threads.emplace_back(worker);
+    
+    worker();
+    
+    for (auto &t: threads)
+        t.join();
+    
+    if (firstException)
+        std::rethrow_exception(firstException);
+}
+
+
+void RunTasks(ThreadPool *threadPool, unsigned numTasks,
+  std::function<void(unsigned)> const &task)
+{
+    if (threadPool)
+        threadPool->Run(numTasks, task);
+    else
+    {
+        for (unsigned i = 0; i < numTasks; ++i)
+            task(i);
+    }
+}
+
+
+ThreadPool::ThreadPool(unsigned numThreads):
+    numQueued(0),
+    stop(false)
+{
+    for (unsigned i = 1; i < numThreads; ++i)
+        workers.emplace_back(&ThreadPool::WorkerLoop, this);
+}
+
+
+ThreadPool::~ThreadPool() noexcept
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stop = true;
+    }
+    
+    wakeCondition.notify_all();
+    
+    for (auto &worker: workers)
+        worker.join();
+}
+
+
+unsigned ThreadPool::GetNumThreads() const
+{
+    return workers.size() + 1;
+}
+
+
+void ThreadPool::Run(unsigned numTasks, std::function<void(unsigned)> const &task)
+{
+    if (numTasks == 0)
+        return;
+    
+    // Execute serially if there is nothing to share
+    if (workers.empty() or numTasks == 1)
+    {
+        for (unsigned i = 0; i < numTasks; ++i)
+            task(i);
+        
+        return;
+    }
+    
+    Job job;
+    job.task = &task;
+    job.numTasks = numTasks;
+    job.numRanges = GetNumThreads();
+    job.ranges.reset(new Range[job.numRanges]);
+    
+    for (unsigned i = 0; i < job.numRanges; ++i)
+        job.ranges[i].begin = job.ranges[i].end = 0;
+    
+    job.ranges[0].end = numTasks;
+    job.numParticipants = 1;
+    job.numFinished = 0;
+    job.numHelpers = 0;
+    job.failed = false;
+    
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.emplace_back(&job);
+        ++numQueued;
+    }
+    
+    wakeCondition.notify_all();
+    
+    
+    // Take part in the execution of the own job
+    Participate(job, 0);
+    
+    
+    // Make sure no worker can join the job any more and wait until the remaining tasks have been
+    //finished and all workers have left the job
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        Dequeue(&job);
+    }
+    
+    std::unique_lock<std::mutex> lock(job.mutex);
+    job.finishedCondition.wait(lock,
+      [&job](){return (job.numFinished == job.numTasks and job.numHelpers == 0);});
+    
+    if (job.exception)
+        std::rethrow_exception(job.exception);
+}
+
+
+void ThreadPool::Execute(Job &job, unsigned taskIndex)
+{
+    std::exception_ptr exception;
+    
+    // Once some task has failed, remaining ones are skipped but still counted as finished
+    if (not job.failed)
+    {
+        try
+        {
+            (*job.task)(taskIndex);
+        }
+        catch (...)
+        {
+            exception = std::current_exception();
+            job.failed = true;
+        }
+    }
+    
+    std::lock_guard<std::mutex> lock(job.mutex);
+    
+    if (exception and not job.exception)
+        job.exception = exception;
+    
+    if (++job.numFinished == job.numTasks and job.numHelpers == 0)
+        job.finishedCondition.notify_all();
+}
+
+
+void ThreadPool::Participate(Job &job, unsigned rangeIndex)
+{
+    Range &range = job.ranges[rangeIndex];
+    
+    while (true)
+    {
+        unsigned taskIndex;
+        bool found = false;
+        
+        {
+            std::lock_guard<std::mutex> lock(range.mutex);
+            
+            if (range.begin < range.end)
+            {
+                taskIndex = range.begin++;
+                found = true;
+            }
+        }
+        
+        if (found)
+            Execute(job, taskIndex);
+        else if (not Steal(job, rangeIndex))
+            break;
+    }
+}
+
+
+bool ThreadPool::Steal(Job &job, unsigned rangeIndex)
+{
+    while (true)
+    {
+        // Find the largest range. The sizes can change concurrently, so this is only a hint.
+        unsigned victim = rangeIndex, largestSize = 0;
+        
+        for (unsigned i = 0; i < job.numRanges; ++i)
+        {
+            if (i == rangeIndex)
+                continue;
+            
+            std::lock_guard<std::mutex> lock(job.ranges[i].mutex);
+            unsigned const size = job.ranges[i].end - job.ranges[i].begin;
+            
+            if (size > largestSize)
+            {
+                largestSize = size;
+                victim = i;
+            }
+        }
+        
+        if (largestSize == 0)
+            return false;
+        
+        
+        // Take the upper half of the range, rounding up so that a single remaining task can also
+        //be stolen. If the range has been emptied in the meantime, try again.
+        unsigned begin, end;
+        
+        {
+            Range &victimRange = job.ranges[victim];
+            std::lock_guard<std::mutex> lock(victimRange.mutex);
+            unsigned const size = victimRange.end - victimRange.begin;
+            
+            if (size == 0)
+                continue;
+            
+            end = victimRange.end;
+            begin = end - (size + 1) / 2;
+            victimRange.end = begin;
+        }
+        
+        Range &ownRange = job.ranges[rangeIndex];
+        std::lock_guard<std::mutex> lock(ownRange.mutex);
+        ownRange.begin = begin;
+        ownRange.end = end;
+        
+        return true;
+    }
+}
+
+
+void ThreadPool::Dequeue(Job *job)
+{
+    auto const it = std::find(jobs.begin(), jobs.end(), job);
+    
+    if (it != jobs.end())
+    {
+        jobs.erase(it);
+        --numQueued;
+    }
+}
+
+
+void ThreadPool::WorkerLoop()
+{
+    unsigned const maxSpins = 2000;
+    
+    while (true)
+    {
+        // Poll the queue for a while before going to sleep
+        for (unsigned i = 0; i < maxSpins and numQueued == 0; ++i)
+            std::this_thread::yield();
+        
+        Job *job = nullptr;
+        unsigned rangeIndex;
+        
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wakeCondition.wait(lock, [this](){return (stop or not jobs.empty());});
+            
+            if (stop)
+                return;
+            
+            // Join the oldest job. If all its ranges have already been assigned, it does not need
+            //more threads.
+            Job *const candidate = jobs.front();
+            rangeIndex = candidate->numParticipants++;
+            
+            if (rangeIndex < candidate->numRanges)
+            {
+                job = candidate;
+                std::lock_guard<std::mutex> jobLock(job->mutex);
+                ++job->numHelpers;
+            }
+            else
+                Dequeue(candidate);
+        }
+        
+        if (not job)
+            continue;
+        
+        Participate(*job, rangeIndex);
+        
+        
+        // No work is left to share in the job. Remove it from the queue and leave it. The job may
+        //be destroyed by the submitting thread as soon as its mutex is released, so it must not be
+        //accessed afterwards.
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            Dequeue(job);
+        }
+        
+        std::lock_guard<std::mutex> lock(job->mutex);
+        
+        if (--job->numHelpers == 0 and job->numFinished == job->numTasks)
+            job->finishedCondition.notify_all();
+    }
+}
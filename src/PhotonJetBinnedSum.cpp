@@ -1,120 +1,173 @@
 #include <PhotonJetBinnedSum.hpp>
+
+#include <Fluctuations.hpp>
+#include <Profiling.hpp>
 #include <Rebin.hpp>
 
 #include <cmath>
 #include <memory>
 #include <sstream>
-#include <TVectorD.h>
+#include <stdexcept>
+#include <utility>
 
-#include <TFile.h>
 
+namespace
+{
+/// Type of the measurement recorded in snapshots
+char const *const snapshotType = "photonjet-binnedsum";
+}
 
-PhotonJetBinnedSum::PhotonJetBinnedSum(std::string const &fileName,
+
+PhotonJetBinnedSum::PhotonJetBinnedSum(PhotonJetBinnedSum::InputSums &&sums,
   PhotonJetBinnedSum::Method method_):
     method(method_)
 {
-    std::string methodLabel;
+    if (sums.binning.empty() or sums.simBinning.empty())
+        throw std::runtime_error("PhotonJetBinnedSum::PhotonJetBinnedSum: Empty binning given.");
     
-    if (method == Method::PtBal)
-        methodLabel = "Bal";
-    else if (method == Method::MPF)
-        methodLabel = "MPF";
+    inputs = FinalizeInputs(std::move(sums));
+}
+
+
+PhotonJetBinnedSum::PhotonJetBinnedSum(std::shared_ptr<SnapshotFile const> const &snapshot)
+{
+    if (snapshot->GetType() != snapshotType)
+    {
+        std::ostringstream message;
+        message << "PhotonJetBinnedSum::PhotonJetBinnedSum: Snapshot \"" <<
+          snapshot->GetFileName() << "\" contains a measurement of type \"" <<
+          snapshot->GetType() << "\" while \"" << snapshotType << "\" is expected.";
+        throw std::runtime_error(message.str());
+    }
+    
+    SnapshotReader reader(snapshot);
+    auto newInputs = std::make_shared<Inputs>();
+    newInputs->snapshot = snapshot;
     
     
-    std::unique_ptr<TFile> inputFile(TFile::Open(fileName.c_str()));
+    // Read arrays in the order defined in SaveSnapshot and check their sizes for consistency
+    method = (reader.ReadValue() == 0.) ? Method::PtBal : Method::MPF;
+    newInputs->jetPtMin = reader.ReadValue();
+    newInputs->binning = reader.ReadArray();
+    unsigned const numBins = newInputs->binning.size() + 1;
+    newInputs->numEvents = reader.ReadArray(numBins);
+    newInputs->meanPtPhoton = reader.ReadArray(numBins);
+    newInputs->meanBal = reader.ReadArray(numBins);
+    newInputs->meanBalUnc = reader.ReadArray(numBins);
+    newInputs->ptJetBinning = reader.ReadArray();
+    unsigned const numCells = numBins * (newInputs->ptJetBinning.size() + 1);
+    newInputs->ptJetSumProj = reader.ReadArray(numCells);
+    newInputs->meanPtJet = reader.ReadArray(numCells);
+    newInputs->simBinning = reader.ReadArray();
+    unsigned const numSimBins = newInputs->simBinning.size() - 1;
+    newInputs->simMeanBal = reader.ReadArray(numSimBins);
+    newInputs->totalUnc2 = reader.ReadArray(numSimBins);
     
-    if (not inputFile or inputFile->IsZombie())
+    if (newInputs->binning.size() < 2 or newInputs->ptJetBinning.size() < 2 or
+      newInputs->simBinning.size() < 2 or not reader.IsAtEnd())
     {
         std::ostringstream message;
-        message << "PhotonJetBinnedSum::PhotonJetBinnedSum: Failed to open file \"" <<
-          fileName << "\".";
+        message << "PhotonJetBinnedSum::PhotonJetBinnedSum: Snapshot \"" <<
+          snapshot->GetFileName() << "\" is malformed.";
         throw std::runtime_error(message.str());
     }
     
-    auto ptThreshold = dynamic_cast<TVectorD *>(inputFile->Get(("MC_MinPt" + methodLabel).c_str()));
+    inputs = newInputs;
+}
 
-    if (not ptThreshold or ptThreshold->GetNoElements() != 1)
-     {
-        std::ostringstream message;
-        message << "PhotonJetBinnedSum::PhotonJetBinnedSum: Failed to read jet pt threshold " <<
-           "from file \"" << fileName << "\".";
-        throw std::runtime_error(message.str());
-      }
 
-    jetPtMin = (*ptThreshold)[1];
-  
-    simBalProfile.reset(dynamic_cast<TProfile *>(inputFile->Get(
-      ("MC_new" + methodLabel + "_vs_ptphoton").c_str())));
-    balProfile.reset(dynamic_cast<TProfile *>(inputFile->Get(
-      ("DATA_new" + methodLabel + "_vs_ptphoton").c_str())));
-    ptPhoton.reset(dynamic_cast<TH1 *>(inputFile->Get("DATA_phopt_for_nevts")));
-    ptPhotonProfile.reset(dynamic_cast<TProfile *>(inputFile->Get("DATA_ptphoton_vs_ptphoton")));
-    ptJetSumProj.reset(dynamic_cast<TH2 *>(inputFile->Get("DATA_Skl_phopt_vs_jetpt")));
-    ptJet2DProfile.reset(dynamic_cast<TProfile2D *>(inputFile->Get("DATA_jetpt_phopt_vs_jetpt")));
-    
-    
-    simBalProfile->SetDirectory(nullptr);
-    balProfile->SetDirectory(nullptr);
-    ptPhoton->SetDirectory(nullptr);
-    ptPhotonProfile->SetDirectory(nullptr);
-    ptJetSumProj->SetDirectory(nullptr);
-    ptJet2DProfile->SetDirectory(nullptr);
+std::unique_ptr<MeasurementBase> PhotonJetBinnedSum::Clone() const
+{
+    return std::make_unique<PhotonJetBinnedSum>(*this);
+}
+
+
+std::unique_ptr<MeasurementBase> PhotonJetBinnedSum::CloneFluctuated(CounterRng &rng) const
+{
+    // Arrays that are not fluctuated are copied. If they refer to a snapshot, only the reference
+    //is copied.
+    auto newInputs = std::make_shared<Inputs>(*inputs);
     
-    inputFile->Close();
+    std::vector<double> numEvents(inputs->numEvents.ToVector());
+    std::vector<double> meanBal(inputs->meanBal.ToVector());
+    std::vector<double> ptJetSumProj(inputs->ptJetSumProj.ToVector());
+    FluctuateBalanceInputs(rng, method == Method::PtBal, numEvents, meanBal,
+      inputs->meanBalUnc.ToVector(), ptJetSumProj, inputs->ptJetBinning.size() + 1);
     
+    newInputs->numEvents = std::move(numEvents);
+    newInputs->meanBal = std::move(meanBal);
+    newInputs->ptJetSumProj = std::move(ptJetSumProj);
     
-    // Compute combined (squared) uncertainty on the balance observable in data and simulation.
-    //The data profile is rebinned with the binning used for simulation. This is done assuming that
-    //bin edges of the two binnings are aligned, which should normally be the case.
-    std::unique_ptr<TH1> balRebinned(balProfile->Rebin(simBalProfile->GetNbinsX(), "",
-      simBalProfile->GetXaxis()->GetXbins()->GetArray()));
+    auto replica = std::make_unique<PhotonJetBinnedSum>(*this);
+    replica->inputs = newInputs;
     
-    for (int i = 1; i <= simBalProfile->GetNbinsX(); ++i)
-    {
-        double const unc2 = std::pow(simBalProfile->GetBinError(i), 2) +
-          std::pow(balRebinned->GetBinError(i), 2);
-        totalUnc2.emplace_back(unc2);
-    }
-    
-    
-    recompBal.resize(simBalProfile->GetNbinsX());
+    return replica;
 }
 
 
 unsigned PhotonJetBinnedSum::GetDim() const
 {
-    return simBalProfile->GetNbinsX();
+    return inputs->simMeanBal.size();
 }
 
 
 double PhotonJetBinnedSum::Eval(JetCorrBase const &corrector, Nuisances const &nuisances) const
 {
-    UpdateBalance(corrector, nuisances);
+    JECFIT_PROFILE_SCOPE("PhotonJetBinnedSum", "Eval");
+    JECFIT_TRACE_SCOPE("PhotonJetBinnedSum", "Eval");
+    std::vector<double> recompBal;
+    UpdateBalance(corrector, nuisances, recompBal);
+    
+    JECFIT_PROFILE_SCOPE("PhotonJetBinnedSum", "chi2");
     double chi2 = 0.;
     
-    for (int photonBinIndex = 1; photonBinIndex <= simBalProfile->GetNbinsX(); ++photonBinIndex)
+    for (unsigned photonBinIndex = 1; photonBinIndex <= inputs->simMeanBal.size();
+      ++photonBinIndex)
     {
         double const meanBal = recompBal[photonBinIndex - 1];
-        double const simMeanBal = simBalProfile->GetBinContent(photonBinIndex);
-        chi2 += std::pow(meanBal - simMeanBal, 2) / totalUnc2[photonBinIndex - 1];
+        double const simMeanBal = inputs->simMeanBal[photonBinIndex - 1];
+        chi2 += std::pow(meanBal - simMeanBal, 2) / inputs->totalUnc2[photonBinIndex - 1];
     }
     
     return chi2;
 }
 
 
+PhotonJetBinnedSum::Method PhotonJetBinnedSum::GetMethod() const
+{
+    return method;
+}
+
+
+void PhotonJetBinnedSum::SaveSnapshot(std::string const &fileName) const
+{
+    SnapshotWriter writer(snapshotType);
+    writer.Add((method == Method::PtBal) ? 0. : 1.);
+    writer.Add(inputs->jetPtMin);
+    
+    for (auto const *array: {&inputs->binning, &inputs->numEvents, &inputs->meanPtPhoton,
+      &inputs->meanBal, &inputs->meanBalUnc, &inputs->ptJetBinning, &inputs->ptJetSumProj,
+      &inputs->meanPtJet, &inputs->simBinning, &inputs->simMeanBal, &inputs->totalUnc2})
+        writer.Add(*array);
+    
+    writer.Write(fileName);
+}
+
+
 double PhotonJetBinnedSum::ComputeMPF(FracBin const &ptPhotonStart, FracBin const &ptPhotonEnd,
   JetCorrBase const &corrector, Nuisances const &nuisances) const
 {
-    
+
     // Find the bin in jet pt that includes the value of pt that, after the current correction,
     // would give the nominal minimal pt threshold. Compute also the fraction of this bin that
     // should included in the sum.
-    TAxis const *ptJetAxis = ptJetSumProj->GetYaxis();
-    double const uncorrJetPtMin = corrector.UndoCorr(jetPtMin);
-    int const startBin = ptJetAxis->FindBin(uncorrJetPtMin);
-    double const fracStartBin = 1. - (uncorrJetPtMin - ptJetAxis->GetBinLowEdge(startBin)) /
-      ptJetAxis->GetBinWidth(startBin);
+    auto const &ptJetBinning = inputs->ptJetBinning;
+    unsigned const numPtJetBins = ptJetBinning.size() - 1;
+    unsigned const rowLength = numPtJetBins + 2;
+    double const uncorrJetPtMin = corrector.UndoCorr(inputs->jetPtMin);
+    unsigned const startBin = FindBin(ptJetBinning, uncorrJetPtMin);
+    double const fracStartBin = 1. - (uncorrJetPtMin - GetBinLowEdge(ptJetBinning, startBin)) /
+      GetBinWidth(ptJetBinning, startBin);
     
     
     double sumBal = 0., sumWeight = 0.,  sumJets = 0.;
@@ -122,29 +175,31 @@ double PhotonJetBinnedSum::ComputeMPF(FracBin const &ptPhotonStart, FracBin cons
     for (unsigned photonBinIndex = ptPhotonStart.index; photonBinIndex <= ptPhotonEnd.index;
       ++photonBinIndex)
     {
-        double const numEvents = ptPhoton->GetBinContent(photonBinIndex);
+        double const numEvents = inputs->numEvents[photonBinIndex];
         
         if (numEvents == 0)
             continue;
         
-        double const meanPhotonPt = ptPhotonProfile->GetBinContent(photonBinIndex) *
+        double const meanPhotonPt = inputs->meanPtPhoton[photonBinIndex] *
           (1 + nuisances.photonScale);
+        double const *sumProj = inputs->ptJetSumProj.data() + photonBinIndex * rowLength;
+        double const *meanPtJet = inputs->meanPtJet.data() + photonBinIndex * rowLength;
         
         
         // Recompute mean value for the MPF observable in data by summing over all jet pt bins
-        sumBal += balProfile->GetBinContent(photonBinIndex) * numEvents ;
+        sumBal += inputs->meanBal[photonBinIndex] * numEvents ;
         sumWeight += numEvents ;
         
         sumJets = 0.;
         
-        for (int jetBinIndex = startBin; jetBinIndex <= ptJetSumProj->GetNbinsY(); ++jetBinIndex)
+        for (unsigned jetBinIndex = startBin; jetBinIndex <= numPtJetBins; ++jetBinIndex)
         {
-            double const s = ptJetSumProj->GetBinContent(photonBinIndex, jetBinIndex);
+            double const s = sumProj[jetBinIndex];
             
             if (s == 0.)
                 continue;
             
-            double const meanJetPt = ptJet2DProfile->GetBinContent(photonBinIndex, jetBinIndex);
+            double const meanJetPt = meanPtJet[jetBinIndex];
             
             if (jetBinIndex == startBin)
                 sumJets -= s * (1. - corrector.Eval(meanJetPt)) * fracStartBin;
@@ -163,15 +218,17 @@ double PhotonJetBinnedSum::ComputeMPF(FracBin const &ptPhotonStart, FracBin cons
 double PhotonJetBinnedSum::ComputePtBal(FracBin const &ptPhotonStart, FracBin const &ptPhotonEnd,
  JetCorrBase const &corrector, Nuisances const &nuisances) const
 {
-    
+
     // Find the bin in jet pt that includes the value of pt that, after the current correction,
     // would give the nominal minimal pt threshold. Compute also the fraction of this bin that
     // should included in the sum.
-    TAxis const *ptJetAxis = ptJetSumProj->GetYaxis();
-    double const uncorrJetPtMin = corrector.UndoCorr(jetPtMin);
-    int const startBin = ptJetAxis->FindBin(uncorrJetPtMin);
-    double const fracStartBin = 1. - (uncorrJetPtMin - ptJetAxis->GetBinLowEdge(startBin)) /
-      ptJetAxis->GetBinWidth(startBin);
+    auto const &ptJetBinning = inputs->ptJetBinning;
+    unsigned const numPtJetBins = ptJetBinning.size() - 1;
+    unsigned const rowLength = numPtJetBins + 2;
+    double const uncorrJetPtMin = corrector.UndoCorr(inputs->jetPtMin);
+    unsigned const startBin = FindBin(ptJetBinning, uncorrJetPtMin);
+    double const fracStartBin = 1. - (uncorrJetPtMin - GetBinLowEdge(ptJetBinning, startBin)) /
+      GetBinWidth(ptJetBinning, startBin);
     
     
     // Recompute mean value for the balance observable in data by summing over all jet pt bins
@@ -181,7 +238,7 @@ double PhotonJetBinnedSum::ComputePtBal(FracBin const &ptPhotonStart, FracBin co
     for (unsigned photonBinIndex = ptPhotonStart.index; photonBinIndex <= ptPhotonEnd.index;
       ++photonBinIndex)
     {
-        double const numEvents = ptPhoton->GetBinContent(photonBinIndex);
+        double const numEvents = inputs->numEvents[photonBinIndex];
         
         if(numEvents == 0)
             continue;
@@ -189,24 +246,26 @@ double PhotonJetBinnedSum::ComputePtBal(FracBin const &ptPhotonStart, FracBin co
         sumWeight += numEvents;
         double meanBalInBin = 0.;
         
-        double const meanPhotonPt = ptPhotonProfile->GetBinContent(photonBinIndex) *
+        double const meanPhotonPt = inputs->meanPtPhoton[photonBinIndex] *
           (1 + nuisances.photonScale);
+        double const *sumProj = inputs->ptJetSumProj.data() + photonBinIndex * rowLength;
+        double const *meanPtJet = inputs->meanPtJet.data() + photonBinIndex * rowLength;
         
-        for (int jetBinIndex = startBin; jetBinIndex <= ptJetSumProj->GetNbinsY(); ++jetBinIndex)
+        for (unsigned jetBinIndex = startBin; jetBinIndex <= numPtJetBins; ++jetBinIndex)
         {
-            double const s = ptJetSumProj->GetBinContent(photonBinIndex, jetBinIndex);
+            double const s = sumProj[jetBinIndex];
             
             if (s == 0.)
                 continue;
             
-            double const meanJetPt = ptJet2DProfile->GetBinContent(photonBinIndex, jetBinIndex);
+            double const meanJetPt = meanPtJet[jetBinIndex];
             
             if(jetBinIndex == startBin)
                 meanBalInBin += s * corrector.Eval(meanJetPt) * fracStartBin;
             else
                 meanBalInBin += s * corrector.Eval(meanJetPt);
         }
-    
+        
         meanBalInBin /= meanPhotonPt;
         meanBal += meanBalInBin;
     }
@@ -215,29 +274,62 @@ double PhotonJetBinnedSum::ComputePtBal(FracBin const &ptPhotonStart, FracBin co
     return meanBal;
 }
 
-void PhotonJetBinnedSum::UpdateBalance(JetCorrBase const &corrector, Nuisances const &nuisances)
-  const
+
+std::shared_ptr<PhotonJetBinnedSum::Inputs const> PhotonJetBinnedSum::FinalizeInputs(
+  PhotonJetBinnedSum::InputSums &&sum)
 {
-    std::vector<double> simPtBinning;
-    std::vector<double> dataPtBinning;
+    // Convert the accumulated sums into arrays used in the computation
+    auto newInputs = std::make_shared<Inputs>();
     
-    for (int i = 1; i <= simBalProfile->GetNbinsX() + 1; ++i)
-    {
-        double const pt = simBalProfile->GetBinLowEdge(i);
-        simPtBinning.emplace_back(pt);
-    }
+    newInputs->jetPtMin = sum.jetPtMin;
+    newInputs->binning = std::move(sum.binning);
+    newInputs->numEvents = std::move(sum.numEvents);
+    newInputs->meanPtPhoton = sum.ptPhoton.GetMeans();
+    newInputs->meanBal = sum.bal.GetMeans();
+    newInputs->meanBalUnc = sum.bal.GetErrors();
+    newInputs->ptJetBinning = std::move(sum.ptJetBinning);
+    newInputs->ptJetSumProj = std::move(sum.ptJetSumProj);
+    newInputs->meanPtJet = sum.ptJet.GetMeans();
+    newInputs->simBinning = std::move(sum.simBinning);
+    newInputs->simMeanBal = StripUnderOverflow(sum.simBal.GetMeans());
     
-    for (int i = 1; i <= balProfile->GetNbinsX() + 1; ++i)
-    {
-        double const pt = balProfile->GetBinLowEdge(i);
-        dataPtBinning.emplace_back(pt);
-    }
     
+    // Compute combined (squared) uncertainty on the balance observable in data and simulation.
+    //The data profile is rebinned with the binning used for simulation. This is done assuming that
+    //bin edges of the two binnings are aligned, which should normally be the case.
+    std::vector<double> const simBalUnc(StripUnderOverflow(sum.simBal.GetErrors()));
+    std::vector<double> const rebinnedBalUnc(StripUnderOverflow(
+      sum.bal.Rebin(newInputs->binning, newInputs->simBinning).GetErrors()));
+    std::vector<double> totalUnc2;
+    
+    for (unsigned i = 0; i < simBalUnc.size(); ++i)
+        totalUnc2.emplace_back(std::pow(simBalUnc[i], 2) + std::pow(rebinnedBalUnc[i], 2));
     
+    newInputs->totalUnc2 = std::move(totalUnc2);
+    return newInputs;
+}
+
+
+void PhotonJetBinnedSum::UpdateBalance(JetCorrBase const &corrector, Nuisances const &nuisances,
+  std::vector<double> &recompBal) const
+{
     // Build a map from the simulation (wide) binning to the fine binning used in data
-    auto binMap = mapBinning(dataPtBinning, simPtBinning);
+    BinMap binMap;
+    
+    {
+        JECFIT_PROFILE_SCOPE("PhotonJetBinnedSum", "bin mapping");
+        binMap = mapBinning(inputs->binning.data(), inputs->binning.size(),
+          inputs->simBinning.data(), inputs->simBinning.size());
+    }
+    
     binMap.erase(0);
-    binMap.erase(simBalProfile->GetNbinsX() + 1);
+    binMap.erase(inputs->simMeanBal.size() + 1);
+    
+    
+    // The inversion of the correction needed to find the jet pt threshold is done for each bin
+    //and is included in the recomputation
+    JECFIT_PROFILE_SCOPE("PhotonJetBinnedSum", "recomputation");
+    recompBal.assign(inputs->simMeanBal.size(), 0.);
     
     for (auto const &binMapPair: binMap)
     {
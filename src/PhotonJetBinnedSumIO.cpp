@@ -0,0 +1,158 @@
+#include <PhotonJetBinnedSum.hpp>
+
+#include <HistFlattening.hpp>
+#include <Parallel.hpp>
+
+#include <TFile.h>
+#include <TH2.h>
+#include <TProfile.h>
+#include <TProfile2D.h>
+#include <TVectorD.h>
+
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+
+
+
+PhotonJetBinnedSum::PhotonJetBinnedSum(std::string const &fileName,
+  PhotonJetBinnedSum::Method method_):
+    PhotonJetBinnedSum(std::vector<WeightedFile>{{fileName, 1.}}, method_)
+{}
+
+
+PhotonJetBinnedSum::PhotonJetBinnedSum(std::vector<WeightedFile> const &files,
+  PhotonJetBinnedSum::Method method_, unsigned numThreads):
+    method(method_)
+{
+    std::string methodLabel;
+    
+    if (method == Method::PtBal)
+        methodLabel = "Bal";
+    else if (method == Method::MPF)
+        methodLabel = "MPF";
+    
+    if (files.empty())
+        throw std::runtime_error("PhotonJetBinnedSum::PhotonJetBinnedSum: No input files given.");
+    
+    
+    // Read the files in parallel. Each file is converted into flat arrays on its own, with the
+    //weight applied, and the partial results are then added in the order in which the files are
+    //given, so that the result does not depend on the number of threads.
+    std::vector<InputSums> partials(files.size());
+    
+    ParallelFor(files.size(), numThreads, [&](unsigned iFile)
+    {
+        partials[iFile] = ReadFile(files[iFile].name, files[iFile].weight, methodLabel);
+    });
+    
+    InputSums &sum = partials.front();
+    
+    for (unsigned iFile = 1; iFile < partials.size(); ++iFile)
+    {
+        InputSums const &partial = partials[iFile];
+        
+        if (partial.jetPtMin != sum.jetPtMin)
+        {
+            std::ostringstream message;
+            message << "PhotonJetBinnedSum::PhotonJetBinnedSum: Jet pt threshold in file \"" <<
+              files[iFile].name << "\" differs from the one in file \"" << files[0].name <<
+              "\".";
+            throw std::runtime_error(message.str());
+        }
+        
+        if (partial.binning != sum.binning or partial.ptJetBinning != sum.ptJetBinning or
+          partial.simBinning != sum.simBinning)
+        {
+            std::ostringstream message;
+            message << "PhotonJetBinnedSum::PhotonJetBinnedSum: Binnings of histograms in " <<
+              "file \"" << files[iFile].name << "\" differ from those in file \"" <<
+              files[0].name << "\".";
+            throw std::runtime_error(message.str());
+        }
+        
+        AddScaled(sum.numEvents, partial.numEvents, 1.);
+        AddScaled(sum.ptJetSumProj, partial.ptJetSumProj, 1.);
+        sum.ptPhoton.Add(partial.ptPhoton);
+        sum.bal.Add(partial.bal);
+        sum.simBal.Add(partial.simBal);
+        sum.ptJet.Add(partial.ptJet);
+    }
+    
+    
+    inputs = FinalizeInputs(std::move(sum));
+}
+
+
+PhotonJetBinnedSum::InputSums PhotonJetBinnedSum::ReadFile(std::string const &fileName,
+  double weight, std::string const &methodLabel)
+{
+    std::unique_ptr<TFile> inputFile(TFile::Open(fileName.c_str()));
+    
+    if (not inputFile or inputFile->IsZombie())
+    {
+        std::ostringstream message;
+        message << "PhotonJetBinnedSum::ReadFile: Failed to open file \"" << fileName << "\".";
+        throw std::runtime_error(message.str());
+    }
+    
+    InputSums partial;
+    
+    auto ptThreshold = dynamic_cast<TVectorD *>(inputFile->Get(("MC_MinPt" + methodLabel).c_str()));
+    
+    if (not ptThreshold or ptThreshold->GetNoElements() != 1)
+    {
+        std::ostringstream message;
+        message << "PhotonJetBinnedSum::ReadFile: Failed to read jet pt threshold " <<
+          "from file \"" << fileName << "\".";
+        throw std::runtime_error(message.str());
+    }
+    
+    partial.jetPtMin = (*ptThreshold)[1];
+    
+    std::unique_ptr<TProfile> simBalProfile(dynamic_cast<TProfile *>(inputFile->Get(
+      ("MC_new" + methodLabel + "_vs_ptphoton").c_str())));
+    std::unique_ptr<TProfile> balProfile(dynamic_cast<TProfile *>(inputFile->Get(
+      ("DATA_new" + methodLabel + "_vs_ptphoton").c_str())));
+    std::unique_ptr<TH1> ptPhoton(dynamic_cast<TH1 *>(inputFile->Get("DATA_phopt_for_nevts")));
+    std::unique_ptr<TProfile> ptPhotonProfile(dynamic_cast<TProfile *>(
+      inputFile->Get("DATA_ptphoton_vs_ptphoton")));
+    std::unique_ptr<TH2> ptJetSumProj(dynamic_cast<TH2 *>(
+      inputFile->Get("DATA_Skl_phopt_vs_jetpt")));
+    std::unique_ptr<TProfile2D> ptJet2DProfile(dynamic_cast<TProfile2D *>(
+      inputFile->Get("DATA_jetpt_phopt_vs_jetpt")));
+    
+    if (not simBalProfile or not balProfile or not ptPhoton or not ptPhotonProfile or
+      not ptJetSumProj or not ptJet2DProfile)
+    {
+        std::ostringstream message;
+        message << "PhotonJetBinnedSum::ReadFile: File \"" << fileName << "\" does not " <<
+          "contain some of the required histograms.";
+        throw std::runtime_error(message.str());
+    }
+    
+    simBalProfile->SetDirectory(nullptr);
+    balProfile->SetDirectory(nullptr);
+    ptPhoton->SetDirectory(nullptr);
+    ptPhotonProfile->SetDirectory(nullptr);
+    ptJetSumProj->SetDirectory(nullptr);
+    ptJet2DProfile->SetDirectory(nullptr);
+    
+    inputFile->Close();
+    
+    
+    // Convert the histograms into flat arrays and sums of profiles. The binning of the data
+    //profile of the balance observable is used for all data histograms.
+    partial.binning = GetBinEdges(*balProfile->GetXaxis());
+    partial.ptJetBinning = GetBinEdges(*ptJetSumProj->GetYaxis());
+    partial.simBinning = GetBinEdges(*simBalProfile->GetXaxis());
+    AddScaled(partial.numEvents, GetBinContents(*ptPhoton), weight);
+    AddScaled(partial.ptJetSumProj, GetBinContents2D(*ptJetSumProj), weight);
+    partial.ptPhoton = ReadProfileSums(*ptPhotonProfile, weight);
+    partial.bal = ReadProfileSums(*balProfile, weight);
+    partial.simBal = ReadProfileSums(*simBalProfile, weight);
+    partial.ptJet = ReadProfileSums(*ptJet2DProfile, weight);
+    
+    return partial;
+}
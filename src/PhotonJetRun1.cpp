@@ -1,5 +1,7 @@
 #include <PhotonJetRun1.hpp>
 
+#include <Profiling.hpp>
+
 #include <cmath>
 #include <memory>
 #include <sstream>
@@ -34,7 +36,8 @@ PhotonJetRun1::PhotonJetRun1(std::string const &fileName, Method method)
     inputFile->Close();
     
     
-    bins.reserve(extrapRatio->GetN());
+    auto newBins = std::make_shared<std::vector<PtBin>>();
+    newBins->reserve(extrapRatio->GetN());
     
     for (int i = 0; i < extrapRatio->GetN(); ++i)
     {
@@ -46,22 +49,46 @@ PhotonJetRun1::PhotonJetRun1(std::string const &fileName, Method method)
         bin.balanceRatio = y;
         bin.unc2 = pow(extrapRatio->GetErrorY(i), 2);
         
-        bins.push_back(bin);
+        newBins->push_back(bin);
     }
+    
+    bins = newBins;
+}
+
+
+std::unique_ptr<MeasurementBase> PhotonJetRun1::Clone() const
+{
+    return std::make_unique<PhotonJetRun1>(*this);
+}
+
+
+std::unique_ptr<MeasurementBase> PhotonJetRun1::CloneFluctuated(CounterRng &rng) const
+{
+    auto newBins = std::make_shared<std::vector<PtBin>>(*bins);
+    
+    for (auto &bin: *newBins)
+        bin.balanceRatio = rng.Gaus(bin.balanceRatio, std::sqrt(bin.unc2));
+    
+    auto replica = std::make_unique<PhotonJetRun1>(*this);
+    replica->bins = newBins;
+    
+    return replica;
 }
 
 
 unsigned PhotonJetRun1::GetDim() const
 {
-    return bins.size();
+    return bins->size();
 }
 
 
 double PhotonJetRun1::Eval(JetCorrBase const &corrector, Nuisances const &nuisances) const
 {
+    JECFIT_PROFILE_SCOPE("PhotonJetRun1", "Eval");
+    JECFIT_TRACE_SCOPE("PhotonJetRun1", "Eval");
     double chi2 = 0.;
     
-    for (auto const &bin: bins)
+    for (auto const &bin: *bins)
     {
         // Correct the balance ratio and photon pt for the potential offset in the photon pt scale
         double const balanceRatioCorr = bin.balanceRatio / (1 + nuisances.photonScale);
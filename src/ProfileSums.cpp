@@ -0,0 +1,177 @@
+#include <ProfileSums.hpp>
+
+#include <cmath>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+
+
+std::vector<double> StripUnderOverflow(std::vector<double> const &values)
+{
+    if (values.size() < 2)
+        return {};
+    
+    return std::vector<double>(values.begin() + 1, values.end() - 1);
+}
+
+
+void AddScaled(std::vector<double> &dest, std::vector<double> const &src, double scale)
+{
+    if (dest.empty())
+        dest.assign(src.size(), 0.);
+    
+    for (unsigned i = 0; i < src.size(); ++i)
+        dest[i] += scale * src[i];
+}
+
+
+ProfileSums::ProfileSums():
+    spreadErrors(false)
+{}
+
+
+ProfileSums::ProfileSums(unsigned numBins, bool spreadErrors_):
+    sumW(numBins, 0.), sumW2(numBins, 0.), sumWY(numBins, 0.), sumWY2(numBins, 0.),
+    spreadErrors(spreadErrors_)
+{}
+
+
+ProfileSums::ProfileSums(std::vector<double> &&sumW_, std::vector<double> &&sumW2_,
+  std::vector<double> &&sumWY_, std::vector<double> &&sumWY2_, bool spreadErrors_):
+    sumW(std::move(sumW_)), sumW2(std::move(sumW2_)),
+    sumWY(std::move(sumWY_)), sumWY2(std::move(sumWY2_)),
+    spreadErrors(spreadErrors_)
+{}
+
+
+void ProfileSums::Add(ProfileSums const &other)
+{
+    if (sumW.empty())
+    {
+        *this = other;
+        return;
+    }
+    
+    if (other.sumW.size() != sumW.size())
+    {
+        std::ostringstream message;
+        message << "ProfileSums::Add: Cannot add profile with " << other.sumW.size() <<
+          " bins to profile with " << sumW.size() << " bins.";
+        throw std::runtime_error(message.str());
+    }
+    
+    for (unsigned i = 0; i < sumW.size(); ++i)
+    {
+        sumW[i] += other.sumW[i];
+        sumW2[i] += other.sumW2[i];
+        sumWY[i] += other.sumWY[i];
+        sumWY2[i] += other.sumWY2[i];
+    }
+}
+
+
+void ProfileSums::Fill(unsigned bin, double y, double weight)
+{
+    sumW[bin] += weight;
+    sumW2[bin] += weight * weight;
+    sumWY[bin] += weight * y;
+    sumWY2[bin] += weight * y * y;
+}
+
+
+std::vector<double> ProfileSums::GetErrors() const
+{
+    std::vector<double> errors(sumW.size(), 0.);
+    
+    for (unsigned i = 0; i < sumW.size(); ++i)
+    {
+        if (sumW[i] == 0.)
+            continue;
+        
+        double const mean = sumWY[i] / sumW[i];
+        double const spread = std::sqrt(std::abs(sumWY2[i] / sumW[i] - mean * mean));
+        
+        if (spreadErrors)
+            errors[i] = spread;
+        else
+        {
+            // Effective number of entries
+            double const numEff = sumW[i] * sumW[i] / sumW2[i];
+            errors[i] = spread / std::sqrt(numEff);
+        }
+    }
+    
+    return errors;
+}
+
+
+std::vector<double> ProfileSums::GetMeans() const
+{
+    std::vector<double> means(sumW.size(), 0.);
+    
+    for (unsigned i = 0; i < sumW.size(); ++i)
+    {
+        if (sumW[i] != 0.)
+            means[i] = sumWY[i] / sumW[i];
+    }
+    
+    return means;
+}
+
+
+unsigned ProfileSums::GetNumBins() const
+{
+    return sumW.size();
+}
+
+
+std::vector<double> const &ProfileSums::GetSumW() const
+{
+    return sumW;
+}
+
+
+std::vector<double> const &ProfileSums::GetSumW2() const
+{
+    return sumW2;
+}
+
+
+std::vector<double> const &ProfileSums::GetSumWY() const
+{
+    return sumWY;
+}
+
+
+std::vector<double> const &ProfileSums::GetSumWY2() const
+{
+    return sumWY2;
+}
+
+
+bool ProfileSums::HasSpreadErrors() const
+{
+    return spreadErrors;
+}
+
+
+ProfileSums ProfileSums::Rebin(FlatArray const &sourceEdges, FlatArray const &targetEdges) const
+{
+    ProfileSums result;
+    result.spreadErrors = spreadErrors;
+    unsigned const numTargetBins = targetEdges.size() + 1;
+    
+    for (auto *sums: {&result.sumW, &result.sumW2, &result.sumWY, &result.sumWY2})
+        sums->assign(numTargetBins, 0.);
+    
+    for (unsigned i = 0; i < sumW.size(); ++i)
+    {
+        unsigned const target = FindBin(targetEdges, GetBinCenter(sourceEdges, i));
+        result.sumW[target] += sumW[i];
+        result.sumW2[target] += sumW2[i];
+        result.sumWY[target] += sumWY[i];
+        result.sumWY2[target] += sumWY2[i];
+    }
+    
+    return result;
+}
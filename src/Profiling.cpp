@@ -0,0 +1,345 @@
+#include <Profiling.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+
+namespace
+{
+/// Number of calls of ProfiledJetCorr::Eval represented by each timed call
+unsigned const evalSamplingPeriod = 64;
+
+
+/// Number of times the correction is evaluated in a timed call of ProfiledJetCorr::Eval
+unsigned const evalRepetitions = 16;
+
+
+/**
+ * \brief Returns the overhead of reading the clock, in ns
+ * 
+ * Estimated once as the shortest interval between two consecutive readings.
+ */
+std::uint64_t GetClockOverhead()
+{
+    static std::uint64_t const overhead = []()
+    {
+        std::chrono::steady_clock::duration minDuration = std::chrono::hours(1);
+        
+        for (unsigned i = 0; i < 1000; ++i)
+        {
+            auto const start = std::chrono::steady_clock::now();
+            minDuration = std::min(minDuration, std::chrono::steady_clock::now() - start);
+        }
+        
+        return std::uint64_t(
+          std::chrono::duration_cast<std::chrono::nanoseconds>(minDuration).count());
+    }();
+    
+    return overhead;
+}
+
+
+/// Statistics registered for a component and a stage
+struct RegistryEntry
+{
+    /// Names of the component and the stage
+    std::string component, stage;
+    
+    /// Statistics
+    std::unique_ptr<TimingStats> stats;
+};
+
+
+/// Registry of all statistics
+struct Registry
+{
+    /// Mutex that protects the entries
+    std::mutex mutex;
+    
+    /// Entries in the order of registration
+    std::vector<RegistryEntry> entries;
+};
+
+
+/// Returns the global registry
+Registry &GetRegistry()
+{
+    static Registry registry;
+    return registry;
+}
+
+
+/// Summary of a single stage, with times in us
+struct StageSummary
+{
+    /// Names of the component and the stage
+    std::string component, stage;
+    
+    /// Number of calls
+    std::uint64_t count;
+    
+    /// Total time, mean time per call, and quantiles
+    double total, mean, p50, p90, p99;
+};
+
+
+/**
+ * \brief Collects summaries of all stages that have been called at least once
+ * 
+ * Stages are grouped by component, preserving the order of registration otherwise.
+ */
+std::vector<StageSummary> CollectSummaries()
+{
+    Registry &registry = GetRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    std::vector<StageSummary> summaries;
+    
+    for (auto const &entry: registry.entries)
+    {
+        TimingStats const &stats = *entry.stats;
+        std::uint64_t const count = stats.GetCount();
+        
+        if (count == 0)
+            continue;
+        
+        double const total = stats.GetTotal() * 1e-3;
+        summaries.push_back({entry.component, entry.stage, count, total, total / count,
+          stats.GetQuantile(0.5) * 1e-3, stats.GetQuantile(0.9) * 1e-3,
+          stats.GetQuantile(0.99) * 1e-3});
+    }
+    
+    std::stable_sort(summaries.begin(), summaries.end(),
+      [](StageSummary const &a, StageSummary const &b){return a.component < b.component;});
+    
+    return summaries;
+}
+}
+
+
+TimingStats::TimingStats():
+    count(0), total(0)
+{
+    for (auto &bucket: buckets)
+        bucket.store(0, std::memory_order_relaxed);
+}
+
+
+void TimingStats::Add(std::uint64_t duration, std::uint64_t weight)
+{
+    count.fetch_add(weight, std::memory_order_relaxed);
+    total.fetch_add(duration * weight, std::memory_order_relaxed);
+    buckets[FindBucket(duration)].fetch_add(weight, std::memory_order_relaxed);
+}
+
+
+std::uint64_t TimingStats::GetCount() const
+{
+    return count.load(std::memory_order_relaxed);
+}
+
+
+double TimingStats::GetQuantile(double probability) const
+{
+    // Buckets are read one by one while other threads may be adding to them. The result is then
+    //approximate, which is acceptable for a summary.
+    std::uint64_t numCalls = 0;
+    
+    for (auto const &bucket: buckets)
+        numCalls += bucket.load(std::memory_order_relaxed);
+    
+    if (numCalls == 0)
+        return 0.;
+    
+    double const target = probability * numCalls;
+    std::uint64_t cumSum = 0;
+    
+    for (unsigned i = 0; i < numBuckets; ++i)
+    {
+        cumSum += buckets[i].load(std::memory_order_relaxed);
+        
+        if (cumSum >= target)
+            return GetBucketCentre(i);
+    }
+    
+    return GetBucketCentre(numBuckets - 1);
+}
+
+
+std::uint64_t TimingStats::GetTotal() const
+{
+    return total.load(std::memory_order_relaxed);
+}
+
+
+unsigned TimingStats::FindBucket(std::uint64_t duration)
+{
+    // Durations below 4 ns have their own buckets. Each following range [2^k, 2^(k+1)) is split
+    //into four buckets of equal width, which are identified by the two bits that follow the
+    //leading one.
+    if (duration < 4)
+        return duration;
+    
+    unsigned const exponent = 63 - __builtin_clzll(duration);
+    unsigned const mantissa = (duration >> (exponent - 2)) & 3;
+    
+    return std::min(4 * (exponent - 1) + mantissa, numBuckets - 1);
+}
+
+
+double TimingStats::GetBucketCentre(unsigned bucket)
+{
+    if (bucket < 4)
+        return bucket;
+    
+    unsigned const exponent = bucket / 4 + 1;
+    double const width = std::ldexp(1., exponent - 2);
+    
+    return (4 + bucket % 4) * width + width / 2;
+}
+
+
+ScopedTimer::ScopedTimer(TimingStats &stats_):
+    stats(stats_), start(std::chrono::steady_clock::now())
+{}
+
+
+ScopedTimer::~ScopedTimer() noexcept
+{
+    auto const duration = std::chrono::steady_clock::now() - start;
+    stats.Add(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count());
+}
+
+
+ProfiledJetCorr::ProfiledJetCorr(JetCorrBase const &corrector_):
+    JetCorrBase(corrector_.GetNumParams()),
+    corrector(corrector_), stats(GetTimingStats("JetCorrBase", "Eval")),
+    clockOverhead(GetClockOverhead())
+{}
+
+
+std::unique_ptr<JetCorrBase> ProfiledJetCorr::Clone() const
+{
+    return corrector.Clone();
+}
+
+
+double ProfiledJetCorr::Eval(double pt) const
+{
+    thread_local unsigned callIndex = 0;
+    
+    if (++callIndex % evalSamplingPeriod != 0)
+        return corrector.Eval(pt);
+    
+    // A single evaluation takes about as long as reading the clock. To reduce the effect of the
+    //overhead, the evaluation is repeated several times, and the overhead is subtracted.
+    auto const start = std::chrono::steady_clock::now();
+    double value = corrector.Eval(pt);
+    
+    for (unsigned i = 1; i < evalRepetitions; ++i)
+        value = std::min(value, corrector.Eval(pt));
+    
+    auto const duration = std::chrono::steady_clock::now() - start;
+    std::uint64_t const ns = std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+    stats.Add((ns > clockOverhead) ? (ns - clockOverhead) / evalRepetitions : 0,
+      evalSamplingPeriod);
+    
+    return value;
+}
+
+
+double ProfiledJetCorr::UndoCorr(double pt, double tolerance) const
+{
+    return corrector.UndoCorr(pt, tolerance);
+}
+
+
+TimingStats &GetTimingStats(std::string const &component, std::string const &stage)
+{
+    Registry &registry = GetRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    
+    for (auto const &entry: registry.entries)
+    {
+        if (entry.component == component and entry.stage == stage)
+            return *entry.stats;
+    }
+    
+    registry.entries.push_back({component, stage, std::make_unique<TimingStats>()});
+    return *registry.entries.back().stats;
+}
+
+
+void PrintTimingSummary(std::ostream &out)
+{
+    std::vector<StageSummary> const summaries(CollectSummaries());
+    
+    if (summaries.empty())
+    {
+        out << "No timing information recorded.\n";
+        return;
+    }
+    
+    std::ios_base::fmtflags const oldFlags(out.flags());
+    std::streamsize const oldPrecision(out.precision());
+    
+    out << "Timing summary (times in us; stages run in parallel are summed over threads):\n";
+    out << std::left << std::setw(22) << " Component" << std::setw(16) << "Stage" << std::right <<
+      std::setw(12) << "Calls" << std::setw(14) << "Total" << std::setw(11) << "Mean" <<
+      std::setw(11) << "p50" << std::setw(11) << "p90" << std::setw(11) << "p99" << '\n';
+    out << std::fixed << std::setprecision(1);
+    
+    for (auto const &s: summaries)
+        out << ' ' << std::left << std::setw(21) << s.component << std::setw(16) << s.stage <<
+          std::right << std::setw(12) << s.count << std::setw(14) << s.total << std::setw(11) <<
+          s.mean << std::setw(11) << s.p50 << std::setw(11) << s.p90 << std::setw(11) << s.p99 <<
+          '\n';
+    
+    out.flags(oldFlags);
+    out.precision(oldPrecision);
+}
+
+
+void SaveTimingSummary(std::string const &fileName)
+{
+    std::ofstream out(fileName);
+    
+    if (not out)
+    {
+        std::ostringstream message;
+        message << "SaveTimingSummary: Failed to open file \"" << fileName << "\" for writing.";
+        throw std::runtime_error(message.str());
+    }
+    
+    out << std::setprecision(9);
+    out << "{\"unit\":\"us\",\"stages\":[";
+    bool first = true;
+    
+    for (auto const &s: CollectSummaries())
+    {
+        if (not first)
+            out << ',';
+        
+        first = false;
+        
+        // Names are fixed identifiers in the code and need no escaping
+        out << "\n{\"component\":\"" << s.component << "\",\"stage\":\"" << s.stage <<
+          "\",\"calls\":" << s.count << ",\"total\":" << s.total << ",\"mean\":" << s.mean <<
+          ",\"p50\":" << s.p50 << ",\"p90\":" << s.p90 << ",\"p99\":" << s.p99 << '}';
+    }
+    
+    out << "\n]}\n";
+    
+    if (not out)
+    {
+        std::ostringstream message;
+        message << "SaveTimingSummary: Failed to write file \"" << fileName << "\".";
+        throw std::runtime_error(message.str());
+    }
+}
@@ -0,0 +1,59 @@
+#include <QuasiRandom.hpp>
+
+
+HaltonSequence::HaltonSequence(unsigned dim, unsigned skip):
+    index(skip + 1)
+{
+    // Find the required number of primes
+    bases.reserve(dim);
+    
+    for (unsigned candidate = 2; bases.size() < dim; ++candidate)
+    {
+        bool isPrime = true;
+        
+        for (auto const &p: bases)
+        {
+            if (p * p > candidate)
+                break;
+            
+            if (candidate % p == 0)
+            {
+                isPrime = false;
+                break;
+            }
+        }
+        
+        if (isPrime)
+            bases.emplace_back(candidate);
+    }
+}
+
+
+unsigned HaltonSequence::GetDim() const
+{
+    return bases.size();
+}
+
+
+std::vector<double> HaltonSequence::Next()
+{
+    std::vector<double> point;
+    point.reserve(bases.size());
+    
+    for (auto const &base: bases)
+    {
+        // Compute the radical inverse of the index in the current base
+        double value = 0., scale = 1.;
+        
+        for (unsigned i = index; i > 0; i /= base)
+        {
+            scale /= base;
+            value += (i % base) * scale;
+        }
+        
+        point.emplace_back(value);
+    }
+    
+    ++index;
+    return point;
+}
@@ -5,15 +5,22 @@
 
 
 BinMap mapBinning(std::vector<double> const &source, std::vector<double> const &target)
+{
+    return mapBinning(source.data(), source.size(), target.data(), target.size());
+}
+
+
+BinMap mapBinning(double const *source, unsigned numSourceEdges, double const *target,
+  unsigned numTargetEdges)
 {
     // Verify that the full range of the target binning is containted within the range of the
     //source binning
-    if (target[0] < source[0] or target[target.size() - 1] > source[source.size() - 1])
+    if (target[0] < source[0] or target[numTargetEdges - 1] > source[numSourceEdges - 1])
     {
         std::ostringstream message;
         message << "mapBinning: Range of target binning (" << target[0] << ", " <<
-          target[target.size() - 1] << ") is not included in the range of source binning (" <<
-          source[0] << ", " << source[source.size() - 1] << ").";
+          target[numTargetEdges - 1] << ") is not included in the range of source binning (" <<
+          source[0] << ", " << source[numSourceEdges - 1] << ").";
         throw std::logic_error(message.str());
     }
     
@@ -23,13 +30,15 @@ BinMap mapBinning(std::vector<double> const &source, std::vector<double> const &
     //and its position within that bin, which is expressed in terms of the bin width. Bins are
     //numbered by the indices of their lower boundaries. The underflow bin has index -1.
     std::vector<FracBin> matchedEdges;
-    matchedEdges.reserve(target.size());
+    matchedEdges.reserve(numTargetEdges);
     int curSrcBin = -1;
     
-    for (auto const &x: target)
+    for (unsigned iEdge = 0; iEdge < numTargetEdges; ++iEdge)
     {
+        double const x = target[iEdge];
+        
         // Scroll to the bin of the source binning that contains value x
-        while (curSrcBin < int(source.size()) - 1 and source[curSrcBin + 1] < x)
+        while (curSrcBin < int(numSourceEdges) - 1 and source[curSrcBin + 1] < x)
             ++curSrcBin;
         
         // Find the relative position inside the source bin. The two  special cases can only occur
@@ -39,7 +48,7 @@ BinMap mapBinning(std::vector<double> const &source, std::vector<double> const &
         
         if (curSrcBin == -1)
             relPos = 1.;
-        else if (curSrcBin == int(source.size()) - 1)
+        else if (curSrcBin == int(numSourceEdges) - 1)
             relPos = 0.;
         else
         {
@@ -55,7 +64,7 @@ BinMap mapBinning(std::vector<double> const &source, std::vector<double> const &
     // Turn the collection of matched edges into a collection of ranges of bins of the source
     //binning. Such a range is built for each target bin.
     std::vector<FracBin> boundaries;
-    boundaries.reserve(2 * target.size() + 2);
+    boundaries.reserve(2 * numTargetEdges + 2);
     unsigned srcBin;
     double fraction;
     
@@ -122,7 +131,7 @@ BinMap mapBinning(std::vector<double> const &source, std::vector<double> const &
     // The last closing boundary is the overflow bin of the source binning. As done for other
     //closing boundaries, set the inclusion fraction to zero when it corresponds to the same source
     //bin as the last opening boundary.
-    srcBin = source.size() - 1;
+    srcBin = numSourceEdges - 1;
     fraction = (srcBin == boundaries[boundaries.size() - 1].index) ? 0. : 1.;
     boundaries.emplace_back(FracBin{srcBin, fraction});
     
@@ -131,7 +140,7 @@ BinMap mapBinning(std::vector<double> const &source, std::vector<double> const &
     //convention of ROOT, where the underflow bin gets an index of zero.
     BinMap binMap;
     
-    for (unsigned targetBin = 0; targetBin < target.size() + 1; ++targetBin)
+    for (unsigned targetBin = 0; targetBin < numTargetEdges + 1; ++targetBin)
     {
         auto const &start = boundaries[targetBin * 2];
         auto const &end = boundaries[targetBin * 2 + 1];
@@ -0,0 +1,231 @@
+#include <ResultCache.hpp>
+
+#include <Snapshot.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+
+namespace
+{
+/// Multipliers of the two lanes of the hash
+std::uint64_t const laneMultipliers[2] = {1099511628211ull, 0x9e3779b97f4a7c15ull};
+
+
+/// Mixes a 64-bit word into one lane of the hash
+inline std::uint64_t MixWord(std::uint64_t hash, std::uint64_t word, unsigned lane)
+{
+    hash ^= word;
+    hash *= laneMultipliers[lane];
+    hash ^= hash >> ((lane == 0) ? 32 : 29);
+    return hash;
+}
+
+
+/// Final avalanche step of a lane (the finalizer of SplitMix64)
+inline std::uint64_t Finalize(std::uint64_t hash)
+{
+    hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ull;
+    hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebull;
+    return hash ^ (hash >> 31);
+}
+}
+
+
+std::string ComputeFileDigest(std::string const &fileName)
+{
+    CacheKey key;
+    
+    if (SnapshotFile::IsSnapshot(fileName))
+    {
+        key.Add("snapshot");
+        key.Add(std::to_string(SnapshotFile::ReadChecksum(fileName)));
+        return key.GetDigest();
+    }
+    
+    std::ifstream in(fileName, std::ios::binary);
+    
+    if (not in)
+    {
+        std::ostringstream message;
+        message << "ComputeFileDigest: Failed to open file \"" << fileName << "\". Only local " <<
+          "files can be hashed.";
+        throw std::runtime_error(message.str());
+    }
+    
+    
+    // Hash the file in blocks of a fixed size
+    key.Add("file");
+    std::vector<char> buffer(1 << 20);
+    
+    while (in)
+    {
+        in.read(buffer.data(), buffer.size());
+        
+        if (in.gcount() > 0)
+            key.AddData(buffer.data(), in.gcount());
+    }
+    
+    if (in.bad())
+    {
+        std::ostringstream message;
+        message << "ComputeFileDigest: Failed to read file \"" << fileName << "\".";
+        throw std::runtime_error(message.str());
+    }
+    
+    return key.GetDigest();
+}
+
+
+CacheKey::CacheKey():
+    state{14695981039346656037ull, 0x6a09e667f3bcc908ull}
+{}
+
+
+void CacheKey::Add(std::string const &text)
+{
+    std::uint64_t const header[2] = {1, text.size()};
+    AddBytes(header, sizeof(header));
+    AddBytes(text.data(), text.size());
+}
+
+
+void CacheKey::Add(double value)
+{
+    // Normalize the sign of zero so that 0. and -0. give the same key
+    if (value == 0.)
+        value = 0.;
+    
+    std::uint64_t header[2] = {2, sizeof(value)};
+    AddBytes(header, sizeof(header));
+    AddBytes(&value, sizeof(value));
+}
+
+
+void CacheKey::AddData(void const *data, std::size_t size)
+{
+    std::uint64_t const header[2] = {3, size};
+    AddBytes(header, sizeof(header));
+    AddBytes(data, size);
+}
+
+
+std::string CacheKey::GetDigest() const
+{
+    std::ostringstream digest;
+    digest << std::hex << std::setfill('0');
+    
+    for (unsigned lane = 0; lane < 2; ++lane)
+        digest << std::setw(16) << Finalize(state[lane] ^ Finalize(state[1 - lane]));
+    
+    return digest.str();
+}
+
+
+void CacheKey::AddBytes(void const *data, std::size_t size)
+{
+    // Process the data in 64-bit words. The last incomplete word is padded with zeros, which is
+    //unambiguous because all pieces are prefixed with their lengths.
+    char const *bytes = reinterpret_cast<char const *>(data);
+    
+    for (std::size_t offset = 0; offset < size; offset += sizeof(std::uint64_t))
+    {
+        std::uint64_t word = 0;
+        std::memcpy(&word, bytes + offset, std::min(sizeof(word), size - offset));
+        
+        for (unsigned lane = 0; lane < 2; ++lane)
+            state[lane] = MixWord(state[lane], word, lane);
+    }
+}
+
+
+ResultCache::ResultCache(std::string const &directory_):
+    directory(directory_)
+{
+    if (mkdir(directory.c_str(), 0755) != 0 and errno != EEXIST)
+    {
+        std::ostringstream message;
+        message << "ResultCache::ResultCache: Failed to create directory \"" << directory <<
+          "\": " << std::strerror(errno) << ".";
+        throw std::runtime_error(message.str());
+    }
+}
+
+
+std::string ResultCache::GetPath(CacheKey const &key) const
+{
+    return directory + "/" + key.GetDigest() + ".fit";
+}
+
+
+bool ResultCache::Load(CacheKey const &key, FitResult &result, unsigned &ndf) const
+{
+    std::string const path(GetPath(key));
+    std::ifstream file(path);
+    
+    if (not file)
+        return false;
+    
+    try
+    {
+        result = LoadFitResult(path);
+    }
+    catch (std::exception const &)
+    {
+        return false;
+    }
+    
+    
+    // The number of degrees of freedom is given in the last non-empty line
+    std::string line, lastLine;
+    
+    while (std::getline(file, line))
+    {
+        if (not line.empty())
+            lastLine = line;
+    }
+    
+    std::istringstream lineStream(lastLine);
+    std::string label;
+    
+    if (not (lineStream >> label >> ndf) or label != "ndf")
+        return false;
+    
+    return true;
+}
+
+
+void ResultCache::Store(CacheKey const &key, FitResult const &result, unsigned ndf) const
+{
+    // The same entry can be written concurrently by several threads or processes. Each of them
+    //writes its own file first, and the entry is then replaced atomically.
+    static std::atomic<unsigned> counter(0);
+    std::string const path(GetPath(key));
+    std::string const uniquePath(path + "." + std::to_string(getpid()) + "." +
+      std::to_string(counter++));
+    SaveFitResult(result, uniquePath);
+    
+    std::ofstream file(uniquePath, std::ios::app);
+    file << "ndf " << ndf << '\n';
+    file.close();
+    
+    if (not file or std::rename(uniquePath.c_str(), path.c_str()) != 0)
+    {
+        std::remove(uniquePath.c_str());
+        std::ostringstream message;
+        message << "ResultCache::Store: Failed to write file \"" << path << "\".";
+        throw std::runtime_error(message.str());
+    }
+}
@@ -0,0 +1,336 @@
+#include <Snapshot.hpp>
+
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include <cstdio>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+namespace
+{
+/// Header of a snapshot file
+struct Header
+{
+    /// Magic string that identifies the format
+    char magic[8];
+    
+    /// Version of the format
+    std::uint32_t version;
+    
+    /// Marker to detect a mismatch in the byte order
+    std::uint32_t byteOrderMarker;
+    
+    /// Size of the payload, in 64-bit words
+    std::uint64_t payloadSize;
+    
+    /// Checksum of the payload
+    std::uint64_t checksum;
+    
+    /// Type of the measurement, zero-terminated
+    char type[32];
+};
+
+static_assert(sizeof(Header) == 64, "Unexpected size of snapshot header.");
+
+char const snapshotMagic[8] = {'J', 'E', 'C', 'S', 'N', 'A', 'P', '\0'};
+std::uint32_t const snapshotByteOrderMarker = 0x01020304;
+
+
+/**
+ * \brief Computes checksum of the given words
+ * 
+ * Uses a variant of the FNV-1a hash that processes 64-bit words instead of bytes, with an
+ * additional shift to propagate high bits. This is sufficient to detect corrupted or truncated
+ * files and fast enough not to dominate the start-up time.
+ */
+std::uint64_t ComputeChecksum(std::uint64_t const *words, std::size_t size)
+{
+    std::uint64_t hash = 14695981039346656037ull;
+    
+    for (std::size_t i = 0; i < size; ++i)
+    {
+        hash ^= words[i];
+        hash *= 1099511628211ull;
+        hash ^= hash >> 32;
+    }
+    
+    return hash;
+}
+}
+
+
+SnapshotWriter::SnapshotWriter(std::string const &type_):
+    type(type_)
+{
+    if (type.size() >= sizeof(Header::type))
+    {
+        std::ostringstream message;
+        message << "SnapshotWriter::SnapshotWriter: Type \"" << type << "\" is too long.";
+        throw std::runtime_error(message.str());
+    }
+}
+
+
+void SnapshotWriter::Add(double const *data, std::size_t size)
+{
+    std::size_t const start = payload.size();
+    payload.resize(start + 1 + size);
+    payload[start] = size;
+    std::memcpy(payload.data() + start + 1, data, size * sizeof(double));
+}
+
+
+void SnapshotWriter::Add(FlatArray const &array)
+{
+    Add(array.data(), array.size());
+}
+
+
+void SnapshotWriter::Add(std::vector<double> const &array)
+{
+    Add(array.data(), array.size());
+}
+
+
+void SnapshotWriter::Add(double value)
+{
+    Add(&value, 1);
+}
+
+
+void SnapshotWriter::Write(std::string const &fileName) const
+{
+    Header header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, snapshotMagic, sizeof(header.magic));
+    header.version = SnapshotFile::version;
+    header.byteOrderMarker = snapshotByteOrderMarker;
+    header.payloadSize = payload.size();
+    header.checksum = ComputeChecksum(payload.data(), payload.size());
+    std::strncpy(header.type, type.c_str(), sizeof(header.type) - 1);
+    
+    
+    // Write into a temporary file and rename it afterwards. Renaming is atomic, and processes
+    //that have mapped the old file keep using it.
+    std::string const tmpFileName(fileName + ".tmp" + std::to_string(getpid()));
+    std::ofstream out(tmpFileName, std::ios::binary);
+    
+    if (not out)
+    {
+        std::ostringstream message;
+        message << "SnapshotWriter::Write: Failed to create file \"" << tmpFileName << "\".";
+        throw std::runtime_error(message.str());
+    }
+    
+    out.write(reinterpret_cast<char const *>(&header), sizeof(header));
+    out.write(reinterpret_cast<char const *>(payload.data()),
+      payload.size() * sizeof(std::uint64_t));
+    out.close();
+    
+    if (not out or std::rename(tmpFileName.c_str(), fileName.c_str()) != 0)
+    {
+        std::remove(tmpFileName.c_str());
+        std::ostringstream message;
+        message << "SnapshotWriter::Write: Failed to write file \"" << fileName << "\".";
+        throw std::runtime_error(message.str());
+    }
+}
+
+
+std::uint32_t const SnapshotFile::version = 1;
+
+
+SnapshotFile::SnapshotFile(std::string const &fileName_):
+    fileName(fileName_),
+    mapping(nullptr), mappingSize(0)
+{
+    int const fd = open(fileName.c_str(), O_RDONLY);
+    struct stat fileStat;
+    
+    if (fd < 0 or fstat(fd, &fileStat) != 0)
+    {
+        if (fd >= 0)
+            close(fd);
+        
+        std::ostringstream message;
+        message << "SnapshotFile::SnapshotFile: Failed to open file \"" << fileName << "\".";
+        throw std::runtime_error(message.str());
+    }
+    
+    if (std::size_t(fileStat.st_size) < sizeof(Header))
+    {
+        close(fd);
+        std::ostringstream message;
+        message << "SnapshotFile::SnapshotFile: File \"" << fileName << "\" is too short to " <<
+          "be a snapshot.";
+        throw std::runtime_error(message.str());
+    }
+    
+    mappingSize = fileStat.st_size;
+    mapping = mmap(nullptr, mappingSize, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    
+    if (mapping == MAP_FAILED)
+    {
+        std::ostringstream message;
+        message << "SnapshotFile::SnapshotFile: Failed to map file \"" << fileName << "\".";
+        throw std::runtime_error(message.str());
+    }
+    
+    
+    // Verify the header and the checksum. The destructor is not called if the constructor
+    //throws, so unmap the file explicitly in case of an error.
+    Header const &header = *reinterpret_cast<Header const *>(mapping);
+    std::ostringstream message;
+    
+    if (std::memcmp(header.magic, snapshotMagic, sizeof(header.magic)) != 0)
+        message << "File \"" << fileName << "\" is not a snapshot.";
+    else if (header.byteOrderMarker != snapshotByteOrderMarker)
+        message << "Snapshot \"" << fileName << "\" has been written on a machine with a " <<
+          "different byte order.";
+    else if (header.version != version)
+        message << "Snapshot \"" << fileName << "\" has version " << header.version <<
+          " while version " << version << " is expected. Please recreate it.";
+    else if (header.payloadSize * sizeof(std::uint64_t) != mappingSize - sizeof(Header))
+        message << "Snapshot \"" << fileName << "\" is truncated.";
+    else if (header.type[sizeof(header.type) - 1] != '\0')
+        message << "Snapshot \"" << fileName << "\" has a malformed header.";
+    else if (ComputeChecksum(GetPayload(), GetPayloadSize()) != header.checksum)
+        message << "Checksum mismatch in snapshot \"" << fileName << "\".";
+    
+    if (not message.str().empty())
+    {
+        munmap(mapping, mappingSize);
+        throw std::runtime_error("SnapshotFile::SnapshotFile: " + message.str());
+    }
+    
+    type = header.type;
+}
+
+
+SnapshotFile::~SnapshotFile()
+{
+    munmap(mapping, mappingSize);
+}
+
+
+std::string const &SnapshotFile::GetFileName() const
+{
+    return fileName;
+}
+
+
+std::uint64_t const *SnapshotFile::GetPayload() const
+{
+    return reinterpret_cast<std::uint64_t const *>(
+      reinterpret_cast<char const *>(mapping) + sizeof(Header));
+}
+
+
+std::size_t SnapshotFile::GetPayloadSize() const
+{
+    return (mappingSize - sizeof(Header)) / sizeof(std::uint64_t);
+}
+
+
+std::string const &SnapshotFile::GetType() const
+{
+    return type;
+}
+
+
+bool SnapshotFile::IsSnapshot(std::string const &fileName)
+{
+    std::ifstream in(fileName, std::ios::binary);
+    char magic[sizeof(snapshotMagic)];
+    
+    if (not in.read(magic, sizeof(magic)))
+        return false;
+    
+    return (std::memcmp(magic, snapshotMagic, sizeof(magic)) == 0);
+}
+
+
+std::uint64_t SnapshotFile::ReadChecksum(std::string const &fileName)
+{
+    std::ifstream in(fileName, std::ios::binary);
+    Header header;
+    
+    if (not in.read(reinterpret_cast<char *>(&header), sizeof(header)) or
+      std::memcmp(header.magic, snapshotMagic, sizeof(header.magic)) != 0)
+    {
+        std::ostringstream message;
+        message << "SnapshotFile::ReadChecksum: File \"" << fileName << "\" is not a snapshot.";
+        throw std::runtime_error(message.str());
+    }
+    
+    return header.checksum;
+}
+
+
+SnapshotReader::SnapshotReader(std::shared_ptr<SnapshotFile const> const &file_):
+    file(file_),
+    position(0)
+{}
+
+
+std::shared_ptr<SnapshotFile const> const &SnapshotReader::GetFile() const
+{
+    return file;
+}
+
+
+bool SnapshotReader::IsAtEnd() const
+{
+    return (position == file->GetPayloadSize());
+}
+
+
+FlatArray SnapshotReader::ReadArray()
+{
+    std::uint64_t const *payload = file->GetPayload();
+    std::size_t const payloadSize = file->GetPayloadSize();
+    
+    if (position >= payloadSize or payload[position] > payloadSize - position - 1)
+    {
+        std::ostringstream message;
+        message << "SnapshotReader::ReadArray: Unexpected end of payload in snapshot \"" <<
+          file->GetFileName() << "\".";
+        throw std::runtime_error(message.str());
+    }
+    
+    std::size_t const size = payload[position];
+    FlatArray array(reinterpret_cast<double const *>(payload + position + 1), size);
+    position += 1 + size;
+    
+    return array;
+}
+
+
+FlatArray SnapshotReader::ReadArray(std::size_t expectedSize)
+{
+    FlatArray array(ReadArray());
+    
+    if (array.size() != expectedSize)
+    {
+        std::ostringstream message;
+        message << "SnapshotReader::ReadArray: Array of size " << array.size() <<
+          " found in snapshot \"" << file->GetFileName() << "\" while size " << expectedSize <<
+          " is expected.";
+        throw std::runtime_error(message.str());
+    }
+    
+    return array;
+}
+
+
+double SnapshotReader::ReadValue()
+{
+    return ReadArray(1)[0];
+}
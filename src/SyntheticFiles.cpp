@@ -0,0 +1,211 @@
+#include <SyntheticFiles.hpp>
+
+#include <HistFlattening.hpp>
+
+#include <TFile.h>
+#include <TGraphErrors.h>
+#include <TH1D.h>
+#include <TH2D.h>
+#include <TProfile.h>
+#include <TProfile2D.h>
+#include <TVectorD.h>
+
+#include <iomanip>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+
+
+namespace
+{
+/// Ranges in pt of the reference object and relative uncertainties of Run 1 measurements
+double const photonJetRun1PtRange[2] = {40., 1000.}, photonJetRun1RelUnc = 0.005;
+double const zJetRun1PtRange[2] = {30., 500.}, zJetRun1RelUnc = 0.01;
+
+
+/// Creates a new file, throwing an exception on failure
+std::unique_ptr<TFile> CreateFile(std::string const &fileName, std::string const &caller)
+{
+    std::unique_ptr<TFile> file(TFile::Open(fileName.c_str(), "RECREATE"));
+    
+    if (not file or file->IsZombie())
+    {
+        std::ostringstream message;
+        message << caller << ": Failed to create file \"" << fileName << "\".";
+        throw std::runtime_error(message.str());
+    }
+    
+    return file;
+}
+
+
+/// Writes a histogram with the given binning and contents into the given directory
+void WriteHist(TDirectory &directory, std::string const &name, std::vector<double> const &binning,
+  std::vector<double> const &contents)
+{
+    TH1D hist(name.c_str(), "", binning.size() - 1, binning.data());
+    hist.SetDirectory(nullptr);
+    SetBinContents(hist, contents);
+    directory.WriteTObject(&hist);
+}
+
+
+/// Writes a two-dimensional histogram with the given binnings and contents
+void WriteHist2D(TDirectory &directory, std::string const &name,
+  std::vector<double> const &binningX, std::vector<double> const &binningY,
+  std::vector<double> const &contents)
+{
+    TH2D hist(name.c_str(), "", binningX.size() - 1, binningX.data(), binningY.size() - 1,
+      binningY.data());
+    hist.SetDirectory(nullptr);
+    SetBinContents2D(hist, contents);
+    directory.WriteTObject(&hist);
+}
+
+
+/// Writes a profile with the given binning and sums into the given directory
+void WriteProfile(TDirectory &directory, std::string const &name,
+  std::vector<double> const &binning, ProfileSums const &sums)
+{
+    TProfile profile(name.c_str(), "", binning.size() - 1, binning.data());
+    profile.SetDirectory(nullptr);
+    SetProfileSums(profile, sums);
+    directory.WriteTObject(&profile);
+}
+
+
+/// Writes a two-dimensional profile with the given binnings and sums
+void WriteProfile2D(TDirectory &directory, std::string const &name,
+  std::vector<double> const &binningX, std::vector<double> const &binningY,
+  ProfileSums const &sums)
+{
+    TProfile2D profile(name.c_str(), "", binningX.size() - 1, binningX.data(),
+      binningY.size() - 1, binningY.data());
+    profile.SetDirectory(nullptr);
+    SetProfileSums(profile, sums);
+    directory.WriteTObject(&profile);
+}
+}
+
+
+void WriteMultijetFile(SyntheticInputGenerator const &generator, std::string const &fileName)
+{
+    using Method = MultijetBinnedSum::Method;
+    auto const ptBalSums = generator.GenerateMultijet(Method::PtBal);
+    auto const mpfSums = generator.GenerateMultijet(Method::MPF);
+    
+    auto file = CreateFile(fileName, "WriteMultijetFile");
+    
+    // The threshold is the same for both methods
+    TVectorD minPt(1);
+    minPt[0] = ptBalSums.minPt;
+    file->WriteTObject(&minPt, "MinPtPtBal");
+    file->WriteTObject(&minPt, "MinPtMPF");
+    
+    
+    // Histograms that do not depend on the method are taken from the inputs for the pt balance
+    for (unsigned iBin = 0; iBin < ptBalSums.triggerBins.size(); ++iBin)
+    {
+        auto const &bin = ptBalSums.triggerBins[iBin];
+        auto const &mpfBin = mpfSums.triggerBins[iBin];
+        
+        std::ostringstream directoryName;
+        directoryName << "TriggerBin" << std::setfill('0') << std::setw(3) << iBin;
+        TDirectory *directory = file->mkdir(directoryName.str().c_str());
+        
+        WriteProfile(*directory, "SimPtBalProfile", bin.simBinning, bin.simBal);
+        WriteProfile(*directory, "SimMPFProfile", mpfBin.simBinning, mpfBin.simBal);
+        WriteProfile(*directory, "PtBalProfile", bin.binning, bin.bal);
+        WriteProfile(*directory, "MPFProfile", mpfBin.binning, mpfBin.bal);
+        WriteHist(*directory, "PtLead", bin.binning, bin.numEvents);
+        WriteProfile(*directory, "PtLeadProfile", bin.binning, bin.ptLead);
+        WriteHist2D(*directory, "PtJetSumProj", bin.binning, bin.ptJetBinning,
+          bin.ptJetSumProj);
+    }
+    
+    file->Close();
+}
+
+
+void WritePhotonJetFile(SyntheticInputGenerator const &generator, std::string const &fileName)
+{
+    using Method = PhotonJetBinnedSum::Method;
+    auto const ptBalSums = generator.GeneratePhotonJet(Method::PtBal);
+    auto const mpfSums = generator.GeneratePhotonJet(Method::MPF);
+    
+    auto file = CreateFile(fileName, "WritePhotonJetFile");
+    
+    // The threshold is read from the second element of a vector whose index starts from 1
+    TVectorD minPt(1, 1);
+    minPt[1] = ptBalSums.jetPtMin;
+    file->WriteTObject(&minPt, "MC_MinPtBal");
+    file->WriteTObject(&minPt, "MC_MinPtMPF");
+    
+    
+    // Histograms that do not depend on the method are taken from the inputs for the pt balance
+    auto const &sums = ptBalSums;
+    WriteProfile(*file, "MC_newBal_vs_ptphoton", sums.simBinning, sums.simBal);
+    WriteProfile(*file, "MC_newMPF_vs_ptphoton", mpfSums.simBinning, mpfSums.simBal);
+    WriteProfile(*file, "DATA_newBal_vs_ptphoton", sums.binning, sums.bal);
+    WriteProfile(*file, "DATA_newMPF_vs_ptphoton", mpfSums.binning, mpfSums.bal);
+    WriteHist(*file, "DATA_phopt_for_nevts", sums.binning, sums.numEvents);
+    WriteProfile(*file, "DATA_ptphoton_vs_ptphoton", sums.binning, sums.ptPhoton);
+    WriteHist2D(*file, "DATA_Skl_phopt_vs_jetpt", sums.binning, sums.ptJetBinning,
+      sums.ptJetSumProj);
+    WriteProfile2D(*file, "DATA_jetpt_phopt_vs_jetpt", sums.binning, sums.ptJetBinning,
+      sums.ptJet);
+    
+    file->Close();
+}
+
+
+void WritePhotonJetRun1File(SyntheticInputGenerator const &generator,
+  std::string const &fileName)
+{
+    auto file = CreateFile(fileName, "WritePhotonJetRun1File");
+    std::string const methodLabels[] = {"PtBal", "MPF"};
+    
+    for (unsigned iMethod = 0; iMethod < 2; ++iMethod)
+    {
+        RatioPoints const points = generator.GenerateRatio(iMethod, photonJetRun1PtRange[0],
+          photonJetRun1PtRange[1], photonJetRun1RelUnc);
+        TGraphErrors graph(points.pt.size(), points.pt.data(), points.ratio.data(), nullptr,
+          points.ratioUnc.data());
+        file->WriteTObject(&graph,
+          ("resp_" + methodLabels[iMethod] + "chs_extrap_a30_eta00_13").c_str());
+    }
+    
+    file->Close();
+}
+
+
+void WriteZJetRun1File(SyntheticInputGenerator const &generator, std::string const &fileName)
+{
+    auto file = CreateFile(fileName, "WriteZJetRun1File");
+    std::string const methodLabels[] = {"ptbal", "mpf"};
+    
+    for (unsigned iMethod = 0; iMethod < 2; ++iMethod)
+    {
+        RatioPoints const points = generator.GenerateRatio(2 + iMethod, zJetRun1PtRange[0],
+          zJetRun1PtRange[1], zJetRun1RelUnc);
+        
+        // Append the bin that is ignored by ZJetRun1. It has the same logarithmic width as the
+        //last genuine bin.
+        std::vector<double> edges(points.edges);
+        edges.emplace_back(edges.back() * edges.back() / edges[edges.size() - 2]);
+        
+        TH1D hist((methodLabels[iMethod] + "_Ratio_eta_0-13_zpt_30-Inf_alpha_0_L1L2L3").c_str(),
+          "", edges.size() - 1, edges.data());
+        hist.SetDirectory(nullptr);
+        
+        for (unsigned i = 0; i < points.pt.size(); ++i)
+        {
+            hist.SetBinContent(i + 1, points.ratio[i]);
+            hist.SetBinError(i + 1, points.ratioUnc[i]);
+        }
+        
+        file->WriteTObject(&hist);
+    }
+    
+    file->Close();
+}
@@ -0,0 +1,396 @@
+#include <SyntheticInputs.hpp>
+
+#include <CounterRng.hpp>
+#include <FlatArray.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+
+
+namespace
+{
+/**
+ * \brief Identifiers of streams of random numbers
+ * 
+ * Combined with the index of the measurement into the first index of the stream.
+ */
+enum Stream: std::uint32_t
+{
+    dataStream = 0,
+    simStream = 1,
+    sparsityStream = 2,
+    numStreams = 3
+};
+
+
+/// Indices of measurements used to label streams of random numbers
+enum MeasurementIndex: std::uint32_t
+{
+    multijetIndex = 0,
+    photonJetIndex = 1,
+    firstRatioIndex = 2
+};
+
+
+/// Minimal true pt of jets that are reconstructed
+double const minRecoJetPt = 5.;
+
+
+/// Constructs a binning with logarithmically spaced edges
+std::vector<double> MakeLogBinning(double min, double max, unsigned numBins)
+{
+    std::vector<double> edges;
+    edges.reserve(numBins + 1);
+    
+    for (unsigned i = 0; i <= numBins; ++i)
+        edges.emplace_back(min * std::pow(max / min, double(i) / numBins));
+    
+    return edges;
+}
+
+
+/// Returns a random number distributed uniformly in logarithm within the given range
+inline double LogUniform(CounterRng &rng, double min, double max)
+{
+    return min * std::pow(max / min, rng.Uniform());
+}
+}
+
+
+SyntheticInputGenerator::SyntheticInputGenerator(JetCorrBase const &trueCorrection_,
+  std::uint64_t seed_):
+    trueCorrection(trueCorrection_.Clone()), seed(seed_),
+    numTriggerBins(8), numSimBins(10), rebinFactor(4), numPtJetBins(60), numEventsPerBin(500),
+    sparsity(0.)
+{}
+
+
+MultijetBinnedSum::InputSums SyntheticInputGenerator::GenerateMultijet(
+  MultijetBinnedSum::Method method) const
+{
+    MultijetBinnedSum::InputSums sums;
+    sums.minPt = 15.;
+    
+    std::vector<double> const ptJetBinning(MakeLogBinning(10., 2500., numPtJetBins));
+    FlatArray const ptJetEdges(ptJetBinning.data(), ptJetBinning.size());
+    unsigned const rowLength = ptJetBinning.size() + 1;
+    JetCorrBase const &corrector = *trueCorrection;
+    
+    
+    // Trigger bins split the range in pt of the leading jet into parts of equal logarithmic size
+    double const ptLeadMin = 200., ptLeadMax = 2000.;
+    
+    for (unsigned iTrigger = 0; iTrigger < numTriggerBins; ++iTrigger)
+    {
+        MultijetBinnedSum::TriggerBinSums bin;
+        MakeBinnings(ptLeadMin * std::pow(ptLeadMax / ptLeadMin, double(iTrigger) / numTriggerBins),
+          ptLeadMin * std::pow(ptLeadMax / ptLeadMin, double(iTrigger + 1) / numTriggerBins),
+          bin.binning, bin.simBinning);
+        bin.ptJetBinning = ptJetBinning;
+        
+        unsigned const numBins = bin.binning.size() + 1;
+        bin.numEvents.assign(numBins, 0.);
+        bin.ptJetSumProj.assign(numBins * rowLength, 0.);
+        bin.ptLead = ProfileSums(numBins);
+        bin.bal = ProfileSums(numBins);
+        bin.simBal = ProfileSums(bin.simBinning.size() + 1);
+        
+        FlatArray const simBinning(bin.simBinning.data(), bin.simBinning.size());
+        std::uint32_t const streamOffset = multijetIndex * numStreams;
+        CounterRng sparsityRng(seed, streamOffset + sparsityStream, iTrigger);
+        std::vector<bool> const emptyBins(ChooseEmptyBins(sparsityRng, bin.binning,
+          bin.simBinning));
+        
+        
+        // Generate events in each bin of the data binning. In data, pt of the leading jet is
+        //sampled in the measured scale, and true pt is obtained from the correction.
+        for (unsigned iPtLead = 1; iPtLead < numBins - 1; ++iPtLead)
+        {
+            double const binMin = bin.binning[iPtLead - 1], binMax = bin.binning[iPtLead];
+            std::uint32_t const binIndex = iTrigger * numBins + iPtLead;
+            CounterRng dataRng(seed, streamOffset + dataStream, binIndex);
+            CounterRng simRng(seed, streamOffset + simStream, binIndex);
+            
+            for (unsigned iEvent = 0; iEvent < numEventsPerBin; ++iEvent)
+            {
+                Event const simEvent(GenerateEvent(simRng, LogUniform(simRng, binMin, binMax),
+                  sums.minPt));
+                bin.simBal.Fill(FindBin(simBinning, simEvent.ptRef), simEvent.balance);
+                
+                if (emptyBins[iPtLead])
+                    continue;
+                
+                double const ptLead = LogUniform(dataRng, binMin, binMax);
+                double const corrLead = corrector.Eval(ptLead);
+                Event const event(GenerateEvent(dataRng, ptLead * corrLead, sums.minPt));
+                
+                
+                // Convert pt of other jets into the measured scale. Their projections onto the
+                //leading jet are negative.
+                double *sumProj = bin.ptJetSumProj.data() + iPtLead * rowLength;
+                double sumMeasured = 0., sumResidual = 0.;
+                
+                for (unsigned j = 0; j < event.jetPt.size(); ++j)
+                {
+                    double const pt = corrector.UndoCorr(event.jetPt[j]);
+                    double const proj = -event.jetPtProj[j] * pt / event.jetPt[j];
+                    sumProj[FindBin(ptJetEdges, pt)] += proj;
+                    
+                    if (pt >= sums.minPt)
+                        sumMeasured += proj;
+                    
+                    if (event.jetPt[j] >= sums.minPt)
+                        sumResidual += (1. - event.jetPt[j] / pt) * proj;
+                }
+                
+                
+                // The balance observable in data is chosen such that the recomputation with
+                //the true correction reproduces the balance observable of the event
+                double balance;
+                
+                if (method == MultijetBinnedSum::Method::PtBal)
+                    balance = -sumMeasured / ptLead;
+                else
+                    balance = corrLead * event.balance - sumResidual / ptLead;
+                
+                bin.numEvents[iPtLead] += 1.;
+                bin.ptLead.Fill(iPtLead, ptLead);
+                bin.bal.Fill(iPtLead, balance);
+            }
+        }
+        
+        sums.triggerBins.emplace_back(std::move(bin));
+    }
+    
+    return sums;
+}
+
+
+PhotonJetBinnedSum::InputSums SyntheticInputGenerator::GeneratePhotonJet(
+  PhotonJetBinnedSum::Method method) const
+{
+    PhotonJetBinnedSum::InputSums sums;
+    sums.jetPtMin = 15.;
+    MakeBinnings(40., 1000., sums.binning, sums.simBinning);
+    sums.ptJetBinning = MakeLogBinning(10., 1500., numPtJetBins);
+    
+    unsigned const numBins = sums.binning.size() + 1;
+    unsigned const rowLength = sums.ptJetBinning.size() + 1;
+    sums.numEvents.assign(numBins, 0.);
+    sums.ptJetSumProj.assign(numBins * rowLength, 0.);
+    sums.ptPhoton = ProfileSums(numBins);
+    sums.bal = ProfileSums(numBins);
+    sums.simBal = ProfileSums(sums.simBinning.size() + 1);
+    sums.ptJet = ProfileSums(numBins * rowLength);
+    
+    FlatArray const ptJetBinning(sums.ptJetBinning.data(), sums.ptJetBinning.size());
+    FlatArray const simBinning(sums.simBinning.data(), sums.simBinning.size());
+    JetCorrBase const &corrector = *trueCorrection;
+    std::uint32_t const streamOffset = photonJetIndex * numStreams;
+    CounterRng sparsityRng(seed, streamOffset + sparsityStream, 0);
+    std::vector<bool> const emptyBins(ChooseEmptyBins(sparsityRng, sums.binning,
+      sums.simBinning));
+    
+    for (unsigned iPhoton = 1; iPhoton < numBins - 1; ++iPhoton)
+    {
+        double const binMin = sums.binning[iPhoton - 1], binMax = sums.binning[iPhoton];
+        CounterRng dataRng(seed, streamOffset + dataStream, iPhoton);
+        CounterRng simRng(seed, streamOffset + simStream, iPhoton);
+        
+        for (unsigned iEvent = 0; iEvent < numEventsPerBin; ++iEvent)
+        {
+            Event const simEvent(GenerateEvent(simRng, LogUniform(simRng, binMin, binMax),
+              sums.jetPtMin));
+            sums.simBal.Fill(FindBin(simBinning, simEvent.ptRef), simEvent.balance);
+            
+            if (emptyBins[iPhoton])
+                continue;
+            
+            
+            // The photon is measured exactly, while pt of jets is converted into the measured
+            //scale. Their projections onto the photon are positive.
+            Event const event(GenerateEvent(dataRng, LogUniform(dataRng, binMin, binMax),
+              sums.jetPtMin));
+            double sumMeasured = 0., sumResidual = 0.;
+            
+            for (unsigned j = 0; j < event.jetPt.size(); ++j)
+            {
+                double const pt = corrector.UndoCorr(event.jetPt[j]);
+                double const proj = event.jetPtProj[j] * pt / event.jetPt[j];
+                unsigned const index = iPhoton * rowLength + FindBin(ptJetBinning, pt);
+                sums.ptJetSumProj[index] += proj;
+                sums.ptJet.Fill(index, pt);
+                
+                if (pt >= sums.jetPtMin)
+                    sumMeasured += proj;
+                
+                if (event.jetPt[j] >= sums.jetPtMin)
+                    sumResidual += (1. - event.jetPt[j] / pt) * proj;
+            }
+            
+            double balance;
+            
+            if (method == PhotonJetBinnedSum::Method::PtBal)
+                balance = sumMeasured / event.ptRef;
+            else
+                balance = event.balance + sumResidual / event.ptRef;
+            
+            sums.numEvents[iPhoton] += 1.;
+            sums.ptPhoton.Fill(iPhoton, event.ptRef);
+            sums.bal.Fill(iPhoton, balance);
+        }
+    }
+    
+    return sums;
+}
+
+
+RatioPoints SyntheticInputGenerator::GenerateRatio(unsigned index, double ptMin, double ptMax,
+  double relUnc) const
+{
+    RatioPoints points;
+    points.edges = MakeLogBinning(ptMin, ptMax, numSimBins);
+    CounterRng rng(seed, (firstRatioIndex + index) * numStreams + dataStream, 0);
+    
+    for (unsigned i = 0; i < numSimBins; ++i)
+    {
+        double const pt = (points.edges[i] + points.edges[i + 1]) / 2.;
+        double const ratio = 1. / trueCorrection->Eval(pt);
+        
+        points.pt.emplace_back(pt);
+        points.ratio.emplace_back(rng.Gaus(ratio, relUnc * ratio));
+        points.ratioUnc.emplace_back(relUnc * ratio);
+    }
+    
+    return points;
+}
+
+
+void SyntheticInputGenerator::SetBinning(unsigned numSimBins_, unsigned rebinFactor_,
+  unsigned numPtJetBins_)
+{
+    if (numSimBins_ == 0 or rebinFactor_ == 0 or numPtJetBins_ == 0)
+        throw std::runtime_error("SyntheticInputGenerator::SetBinning: Numbers of bins must be "
+          "positive.");
+    
+    numSimBins = numSimBins_;
+    rebinFactor = rebinFactor_;
+    numPtJetBins = numPtJetBins_;
+}
+
+
+void SyntheticInputGenerator::SetNumEventsPerBin(unsigned numEventsPerBin_)
+{
+    numEventsPerBin = numEventsPerBin_;
+}
+
+
+void SyntheticInputGenerator::SetNumTriggerBins(unsigned numTriggerBins_)
+{
+    if (numTriggerBins_ == 0)
+        throw std::runtime_error("SyntheticInputGenerator::SetNumTriggerBins: Number of "
+          "trigger bins must be positive.");
+    
+    numTriggerBins = numTriggerBins_;
+}
+
+
+void SyntheticInputGenerator::SetSparsity(double sparsity_)
+{
+    if (sparsity_ < 0. or sparsity_ >= 1.)
+    {
+        std::ostringstream message;
+        message << "SyntheticInputGenerator::SetSparsity: Sparsity " << sparsity_ <<
+          " is outside of the range [0, 1).";
+        throw std::runtime_error(message.str());
+    }
+    
+    sparsity = sparsity_;
+}
+
+
+SyntheticInputGenerator::Event SyntheticInputGenerator::GenerateEvent(CounterRng &rng,
+  double ptRef, double jetPtMin)
+{
+    // The reference object is balanced by two or more jets. Their projections onto it share
+    //a fluctuated pt of the reference object at random, and their directions deviate from the
+    //back-to-back configuration by up to 0.5 rad.
+    Event event;
+    event.ptRef = ptRef;
+    
+    unsigned const numJets = 2 + rng.Poisson(1.);
+    double const recoil = ptRef * rng.Gaus(1., 0.1);
+    std::vector<double> shares;
+    double sumShares = 0.;
+    
+    for (unsigned j = 0; j < numJets; ++j)
+    {
+        shares.emplace_back(-std::log(rng.Uniform()));
+        sumShares += shares.back();
+    }
+    
+    event.balance = 0.;
+    
+    for (unsigned j = 0; j < numJets; ++j)
+    {
+        double const proj = recoil * shares[j] / sumShares;
+        double const pt = proj / std::cos(0.5 * rng.Uniform());
+        
+        // Very soft jets are not reconstructed. Apart from being unphysical, they would make the
+        //inversion of the correction unstable.
+        if (pt < minRecoJetPt)
+            continue;
+        
+        event.jetPt.emplace_back(pt);
+        event.jetPtProj.emplace_back(proj);
+        
+        if (pt >= jetPtMin)
+            event.balance += proj / ptRef;
+    }
+    
+    return event;
+}
+
+
+void SyntheticInputGenerator::MakeBinnings(double ptMin, double ptMax,
+  std::vector<double> &binning, std::vector<double> &simBinning) const
+{
+    // Data bins have equal logarithmic sizes. Enough of them are added on both sides of the
+    //range of the simulation binning to extend it by at least 10%.
+    unsigned const numInnerBins = numSimBins * rebinFactor;
+    double const step = std::log(ptMax / ptMin) / numInnerBins;
+    int const margin = std::ceil(std::log(1.1) / step);
+    
+    binning.clear();
+    simBinning.clear();
+    
+    for (int k = -margin; k <= int(numInnerBins) + margin; ++k)
+    {
+        binning.emplace_back(ptMin * std::exp(step * k));
+        
+        if (k >= 0 and k <= int(numInnerBins) and k % rebinFactor == 0)
+            simBinning.emplace_back(binning.back());
+    }
+}
+
+
+std::vector<bool> SyntheticInputGenerator::ChooseEmptyBins(CounterRng &rng,
+  std::vector<double> const &binning, std::vector<double> const &simBinning) const
+{
+    std::vector<bool> emptyBins(binning.size() + 1, false);
+    
+    for (unsigned i = 1; i < binning.size(); ++i)
+    {
+        // A random number is drawn for every bin so that the choice for a given bin does not
+        //depend on the bins that are always kept
+        bool const empty = (rng.Uniform() < sparsity);
+        
+        if (not std::binary_search(simBinning.begin(), simBinning.end(), binning[i - 1]))
+            emptyBins[i] = empty;
+    }
+    
+    return emptyBins;
+}
@@ -0,0 +1,145 @@
+#include <ToyFitter.hpp>
+
+#include <Parallel.hpp>
+
+#include <iomanip>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+
+
+ToyFitter::ToyFitter(CombLossFunction const &lossFunc_):
+    lossFunc(lossFunc_),
+    seed(1),
+    firstToy(0),
+    numThreads(1),
+    strategy(1)
+{
+    unsigned const nPars = lossFunc.GetNumParams();
+    
+    for (unsigned i = 0; i < nPars; ++i)
+        start.names.emplace_back("p" + std::to_string(i));
+    
+    start.values.assign(nPars, 0.);
+    start.errors.assign(nPars, 1e-2);
+}
+
+
+void ToyFitter::Run(unsigned numToys,
+  std::function<void(unsigned, FitResult const &)> const &consumer) const
+{
+    // Results of toys that have been fitted but cannot be reported yet because some preceding toy
+    //is still running
+    std::map<unsigned, FitResult> pending;
+    unsigned nextToReport = 0;
+    std::mutex mutex;
+    
+    auto const fitToy = [&](unsigned iTask)
+    {
+        // Failures to generate the toy, e.g. because some measurement does not support
+        //pseudo-experiments, are propagated to the caller
+        auto const toyLossFunc = lossFunc.CloneFluctuated(seed, firstToy + iTask);
+        FitResult result;
+        
+        try
+        {
+            Fitter fitter(*toyLossFunc);
+            fitter.SetStrategy(strategy);
+            fitter.SetPrintLevel(0);
+            fitter.SetStartingPoint(start);
+            result = fitter.Fit();
+        }
+        catch (std::exception const &)
+        {
+            result = FitResult();
+            result.status = -2;
+        }
+        
+        
+        // Report all results that are ready. The lock is held while the consumer is running, so
+        //it is never called concurrently.
+        std::lock_guard<std::mutex> lock(mutex);
+        pending.emplace(iTask, std::move(result));
+        
+        while (not pending.empty() and pending.begin()->first == nextToReport)
+        {
+            consumer(firstToy + nextToReport, pending.begin()->second);
+            pending.erase(pending.begin());
+            ++nextToReport;
+        }
+    };
+    
+    // Toys are handed out in increasing order of indices, so a result only waits for preceding
+    //toys that are being fitted at the moment, and not for whole ranges of toys that have not
+    //started yet
+    ParallelFor(numToys, numThreads, fitToy);
+}
+
+
+void ToyFitter::Run(unsigned numToys, std::ostream &out) const
+{
+    out << "# toy status minValue";
+    
+    for (auto const &name: start.names)
+        out << " " << name << " " << name << "_err";
+    
+    out << std::endl;
+    out << std::setprecision(10);
+    
+    Run(numToys, [&out, this](unsigned toyIndex, FitResult const &result)
+    {
+        out << toyIndex << " " << result.status << " " << result.minValue;
+        
+        for (unsigned i = 0; i < start.names.size(); ++i)
+        {
+            if (result.values.empty())
+                out << " nan nan";
+            else
+                out << " " << result.values[i] << " " << result.errors[i];
+        }
+        
+        out << std::endl;
+    });
+}
+
+
+void ToyFitter::SetFirstToy(unsigned firstToy_)
+{
+    firstToy = firstToy_;
+}
+
+
+void ToyFitter::SetNumThreads(unsigned numThreads_)
+{
+    numThreads = numThreads_;
+}
+
+
+void ToyFitter::SetSeed(std::uint64_t seed_)
+{
+    seed = seed_;
+}
+
+
+void ToyFitter::SetStartingPoint(FitResult const &start_)
+{
+    unsigned const nPars = lossFunc.GetNumParams();
+    
+    if (start_.values.size() != nPars or start_.errors.size() != nPars or
+      start_.names.size() != nPars)
+    {
+        std::ostringstream message;
+        message << "ToyFitter::SetStartingPoint: Given point contains " << start_.values.size() <<
+          " parameters while " << nPars << " are expected.";
+        throw std::runtime_error(message.str());
+    }
+    
+    start = start_;
+}
+
+
+void ToyFitter::SetStrategy(unsigned strategy_)
+{
+    strategy = strategy_;
+}
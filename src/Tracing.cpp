@@ -0,0 +1,466 @@
+#include <Tracing.hpp>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+
+namespace
+{
+/// Number of spans that fit in the buffer of a single thread
+unsigned const bufferCapacity = 1 << 14;
+
+
+/// Interval between writes of recorded spans into the file
+std::chrono::milliseconds const flushPeriod(50);
+
+
+/// Flag indicating that tracing is active
+std::atomic<bool> tracingEnabled(false);
+
+
+/// Returns the current time in ns
+std::uint64_t Now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+/// A recorded span, with times in ns
+struct SpanRecord
+{
+    /// Category and name
+    char const *category, *name;
+    
+    /// Start and duration
+    std::uint64_t start, duration;
+};
+
+
+/**
+ * \brief Ring buffer of spans recorded in a single thread
+ * 
+ * Spans are added by the owning thread and removed by the thread that writes them into the file.
+ * Each of the two counters is modified by only one of these threads, so no locks are needed. The
+ * counters only grow, and positions in the buffer are found modulo its capacity.
+ */
+struct ThreadBuffer
+{
+    /// Index of the thread in the trace
+    unsigned index;
+    
+    /// Numbers of spans added and removed since the creation of the buffer
+    std::atomic<std::uint64_t> head, tail;
+    
+    /// Storage for spans
+    std::array<SpanRecord, bufferCapacity> spans;
+};
+
+
+/**
+ * \class Tracer
+ * \brief Owns buffers of all threads and the file into which the trace is written
+ */
+class Tracer
+{
+public:
+    /// Constructor
+    Tracer();
+    
+    /// Destructor that stops tracing, ignoring errors
+    ~Tracer() noexcept;
+    
+public:
+    /// Returns the number of dropped spans
+    std::uint64_t GetNumDropped() const;
+    
+    /// Adds a span to the buffer of the calling thread
+    void Record(SpanRecord const &span);
+    
+    /**
+     * \brief Makes the buffer of a thread that is exiting available to other threads
+     * 
+     * Spans that remain in the buffer are still written into the file.
+     */
+    void ReleaseThreadBuffer(ThreadBuffer *buffer);
+    
+    /// Creates the file and starts the background thread
+    void Start(std::string const &fileName);
+    
+    /// Stops the background thread, writes remaining spans, and closes the file
+    void Stop();
+    
+private:
+    /**
+     * \brief Writes all spans from all buffers into the file and removes them from the buffers
+     * 
+     * Must not be called concurrently with itself.
+     */
+    void Flush();
+    
+    /**
+     * \brief Returns the buffer of the calling thread
+     * 
+     * If the thread has no buffer yet, it takes one released by a thread that has exited, with
+     * the same index in the trace, or a new buffer is created.
+     */
+    ThreadBuffer &GetThreadBuffer();
+    
+    /// Periodically calls Flush until a stop is requested
+    void RunFlusher();
+    
+private:
+    /// All buffers that have been created, indexed with thread indices
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+    
+    /// Buffers released by threads that have exited, to be reused by new threads
+    std::vector<ThreadBuffer *> freeBuffers;
+    
+    /// Mutex that protects the vectors of buffers (but not their contents)
+    std::mutex buffersMutex;
+    
+    /// Number of spans dropped because buffers were full
+    std::atomic<std::uint64_t> numDropped;
+    
+    /// Mutex that serializes calls to Start and Stop
+    std::mutex controlMutex;
+    
+    /// Output file
+    std::ofstream out;
+    
+    /// Name of the output file
+    std::string fileName;
+    
+    /// Time at which tracing has been started, in ns
+    std::uint64_t startTime;
+    
+    /// Indicates that no event has been written into the file yet
+    bool firstEvent;
+    
+    /// Number of threads whose names have been written into the file
+    unsigned numNamedThreads;
+    
+    /// Background thread that writes spans into the file
+    std::thread flusher;
+    
+    /// Mutex and condition variable to request a stop of the background thread
+    std::mutex stopMutex;
+    std::condition_variable stopCondition;
+    
+    /// Indicates that the background thread should stop
+    bool stopRequested;
+};
+
+
+/**
+ * \struct ThreadBufferOwner
+ * \brief Holds the buffer of a thread and releases it when the thread exits
+ * 
+ * Without the release, each short-lived thread would keep a buffer for the whole lifetime of the
+ * program.
+ */
+struct ThreadBufferOwner
+{
+    /// Destructor that releases the buffer
+    ~ThreadBufferOwner() noexcept;
+    
+    /// Buffer of the thread, or null if the thread has not recorded any spans yet
+    ThreadBuffer *buffer = nullptr;
+};
+
+
+/// Owner of the buffer of the calling thread
+thread_local ThreadBufferOwner threadBufferOwner;
+
+
+Tracer::Tracer():
+    numDropped(0), startTime(0), firstEvent(true), numNamedThreads(0), stopRequested(false)
+{}
+
+
+Tracer::~Tracer() noexcept
+{
+    try
+    {
+        Stop();
+    }
+    catch (...)
+    {}
+}
+
+
+std::uint64_t Tracer::GetNumDropped() const
+{
+    return numDropped.load(std::memory_order_relaxed);
+}
+
+
+void Tracer::Record(SpanRecord const &span)
+{
+    ThreadBuffer &buffer = GetThreadBuffer();
+    std::uint64_t const head = buffer.head.load(std::memory_order_relaxed);
+    
+    if (head - buffer.tail.load(std::memory_order_acquire) >= bufferCapacity)
+    {
+        numDropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    
+    buffer.spans[head % bufferCapacity] = span;
+    buffer.head.store(head + 1, std::memory_order_release);
+}
+
+
+void Tracer::Start(std::string const &fileName_)
+{
+    std::lock_guard<std::mutex> lock(controlMutex);
+    
+    if (flusher.joinable())
+    {
+        std::ostringstream message;
+        message << "StartTracing: Tracing into file \"" << fileName << "\" is already active.";
+        throw std::runtime_error(message.str());
+    }
+    
+    out.open(fileName_);
+    
+    if (not out)
+    {
+        std::ostringstream message;
+        message << "StartTracing: Failed to open file \"" << fileName_ << "\" for writing.";
+        throw std::runtime_error(message.str());
+    }
+    
+    fileName = fileName_;
+    out << std::fixed << std::setprecision(3);
+    out << "{\"traceEvents\":[";
+    firstEvent = true;
+    numNamedThreads = 0;
+    numDropped.store(0, std::memory_order_relaxed);
+    
+    
+    // Register the calling thread before any other one so that it gets the lowest index. Discard
+    //spans that might have been recorded after a previous session had been stopped.
+    GetThreadBuffer();
+    
+    {
+        std::lock_guard<std::mutex> buffersLock(buffersMutex);
+        
+        for (auto &buffer: buffers)
+            buffer->tail.store(buffer->head.load(std::memory_order_acquire),
+              std::memory_order_release);
+    }
+    
+    stopRequested = false;
+    startTime = Now();
+    flusher = std::thread(&Tracer::RunFlusher, this);
+    tracingEnabled.store(true, std::memory_order_relaxed);
+}
+
+
+void Tracer::Stop()
+{
+    std::lock_guard<std::mutex> lock(controlMutex);
+    
+    if (not flusher.joinable())
+        return;
+    
+    tracingEnabled.store(false, std::memory_order_relaxed);
+    
+    {
+        std::lock_guard<std::mutex> stopLock(stopMutex);
+        stopRequested = true;
+    }
+    
+    stopCondition.notify_one();
+    flusher.join();
+    
+    Flush();
+    out << "\n],\"displayTimeUnit\":\"ms\",\"otherData\":{\"droppedSpans\":" <<
+      GetNumDropped() << "}}\n";
+    out.close();
+    
+    if (not out)
+    {
+        std::ostringstream message;
+        message << "StopTracing: Failed to write file \"" << fileName << "\".";
+        throw std::runtime_error(message.str());
+    }
+}
+
+
+void Tracer::Flush()
+{
+    // Buffers are never destroyed, so pointers to them stay valid after the lock is released
+    std::vector<ThreadBuffer *> currentBuffers;
+    
+    {
+        std::lock_guard<std::mutex> lock(buffersMutex);
+        
+        for (auto const &buffer: buffers)
+            currentBuffers.emplace_back(buffer.get());
+    }
+    
+    
+    // Names of threads are given as metadata events. Category and names of spans are fixed
+    //identifiers in the code and need no escaping.
+    for (ThreadBuffer *buffer: currentBuffers)
+    {
+        if (buffer->index >= numNamedThreads)
+        {
+            out << ((firstEvent) ? "\n" : ",\n");
+            firstEvent = false;
+            out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->index <<
+              ",\"args\":{\"name\":\"thread " << buffer->index << "\"}}";
+            numNamedThreads = buffer->index + 1;
+        }
+        
+        std::uint64_t const head = buffer->head.load(std::memory_order_acquire);
+        std::uint64_t tail = buffer->tail.load(std::memory_order_relaxed);
+        
+        for (; tail < head; ++tail)
+        {
+            SpanRecord const &span = buffer->spans[tail % bufferCapacity];
+            
+            // Spans started before this session are dropped
+            if (span.start < startTime)
+                continue;
+            
+            out << ((firstEvent) ? "\n" : ",\n");
+            firstEvent = false;
+            out << "{\"name\":\"" << span.name << "\",\"cat\":\"" << span.category <<
+              "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->index << ",\"ts\":" <<
+              (span.start - startTime) * 1e-3 << ",\"dur\":" << span.duration * 1e-3 << '}';
+        }
+        
+        buffer->tail.store(head, std::memory_order_release);
+    }
+}
+
+
+ThreadBuffer &Tracer::GetThreadBuffer()
+{
+    ThreadBuffer *&threadBuffer = threadBufferOwner.buffer;
+    
+    if (not threadBuffer)
+    {
+        std::lock_guard<std::mutex> lock(buffersMutex);
+        
+        // A released buffer is taken as is. Its counters are kept, so that the spans recorded by
+        //the previous owner and not yet written stay valid.
+        if (not freeBuffers.empty())
+        {
+            threadBuffer = freeBuffers.back();
+            freeBuffers.pop_back();
+        }
+        else
+        {
+            buffers.emplace_back(std::make_unique<ThreadBuffer>());
+            threadBuffer = buffers.back().get();
+            threadBuffer->index = buffers.size() - 1;
+            threadBuffer->head.store(0, std::memory_order_relaxed);
+            threadBuffer->tail.store(0, std::memory_order_relaxed);
+        }
+    }
+    
+    return *threadBuffer;
+}
+
+
+void Tracer::ReleaseThreadBuffer(ThreadBuffer *buffer)
+{
+    std::lock_guard<std::mutex> lock(buffersMutex);
+    freeBuffers.emplace_back(buffer);
+}
+
+
+void Tracer::RunFlusher()
+{
+    std::unique_lock<std::mutex> lock(stopMutex);
+    
+    while (not stopRequested)
+    {
+        stopCondition.wait_for(lock, flushPeriod);
+        
+        // Writing the file can take a while, and the lock is only needed to check the flag
+        lock.unlock();
+        Flush();
+        lock.lock();
+    }
+}
+
+
+/// Returns the global tracer
+Tracer &GetTracer()
+{
+    static Tracer tracer;
+    return tracer;
+}
+
+
+ThreadBufferOwner::~ThreadBufferOwner() noexcept
+{
+    if (buffer)
+        GetTracer().ReleaseThreadBuffer(buffer);
+}
+}
+
+
+void StartTracing(std::string const &fileName)
+{
+    GetTracer().Start(fileName);
+}
+
+
+void StopTracing()
+{
+    GetTracer().Stop();
+}
+
+
+std::uint64_t GetNumDroppedSpans()
+{
+    return GetTracer().GetNumDropped();
+}
+
+
+bool IsTracingEnabled()
+{
+    return tracingEnabled.load(std::memory_order_relaxed);
+}
+
+
+TraceSpan::TraceSpan(char const *category_, char const *name_):
+    category(category_), name(name_), start((IsTracingEnabled()) ? Now() : 0)
+{}
+
+
+TraceSpan::~TraceSpan() noexcept
+{
+    Finish();
+}
+
+
+void TraceSpan::Finish() noexcept
+{
+    if (start == 0)
+        return;
+    
+    std::uint64_t const end = Now();
+    
+    // Spans that are still open when tracing is stopped are not recorded
+    if (IsTracingEnabled())
+        GetTracer().Record({category, name, start, end - start});
+    
+    start = 0;
+}
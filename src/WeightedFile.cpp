@@ -0,0 +1,68 @@
+#include <WeightedFile.hpp>
+
+#include <sstream>
+#include <stdexcept>
+
+
+std::vector<WeightedFile> ParseFileList(std::string const &list)
+{
+    std::vector<WeightedFile> files;
+    std::istringstream listStream(list);
+    std::string element;
+    
+    while (std::getline(listStream, element, ','))
+    {
+        // Strip surrounding whitespace
+        auto const begin = element.find_first_not_of(" \t");
+        
+        if (begin == std::string::npos)
+            continue;
+        
+        element = element.substr(begin, element.find_last_not_of(" \t") - begin + 1);
+        
+        
+        // Split off the weight if given
+        auto const separatorPos = element.rfind('@');
+        
+        if (separatorPos == std::string::npos)
+        {
+            files.emplace_back(WeightedFile{element, 1.});
+            continue;
+        }
+        
+        std::string const weightText(element.substr(separatorPos + 1));
+        std::size_t numParsed = 0;
+        double weight = 0.;
+        
+        try
+        {
+            weight = std::stod(weightText, &numParsed);
+        }
+        catch (std::exception const &)
+        {
+            numParsed = 0;
+        }
+        
+        // If the text after the separator is not a number, the character is a part of the file
+        //name, as in URLs with a user name
+        if (numParsed == 0 or numParsed != weightText.size())
+            files.emplace_back(WeightedFile{element, 1.});
+        else if (separatorPos == 0)
+        {
+            std::ostringstream message;
+            message << "ParseFileList: No file name given in element \"" << element << "\".";
+            throw std::runtime_error(message.str());
+        }
+        else
+            files.emplace_back(WeightedFile{element.substr(0, separatorPos), weight});
+    }
+    
+    if (files.empty())
+    {
+        std::ostringstream message;
+        message << "ParseFileList: No files found in list \"" << list << "\".";
+        throw std::runtime_error(message.str());
+    }
+    
+    return files;
+}
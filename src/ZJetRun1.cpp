@@ -1,5 +1,7 @@
 #include <ZJetRun1.hpp>
 
+#include <Profiling.hpp>
+
 #include <cmath>
 #include <memory>
 #include <sstream>
@@ -35,7 +37,8 @@ ZJetRun1::ZJetRun1(std::string const &fileName, Method method)
     inputFile->Close();
   
   
-    bins.reserve(extrapRatioZ->GetNbinsX());
+    auto newBins = std::make_shared<std::vector<PtBin>>();
+    newBins->reserve(extrapRatioZ->GetNbinsX());
     
     for (int i = 1; i < extrapRatioZ->GetNbinsX(); ++i)
     //^ The last bin of the histogram is excluded temporarily because of a problem with inputs
@@ -45,22 +48,46 @@ ZJetRun1::ZJetRun1(std::string const &fileName, Method method)
         bin.balanceRatio = extrapRatioZ->GetBinContent(i);
         bin.unc2 = pow(extrapRatioZ->GetBinError(i), 2);
         
-        bins.push_back(bin);
+        newBins->push_back(bin);
     }
+    
+    bins = newBins;
+}
+
+
+std::unique_ptr<MeasurementBase> ZJetRun1::Clone() const
+{
+    return std::make_unique<ZJetRun1>(*this);
+}
+
+
+std::unique_ptr<MeasurementBase> ZJetRun1::CloneFluctuated(CounterRng &rng) const
+{
+    auto newBins = std::make_shared<std::vector<PtBin>>(*bins);
+    
+    for (auto &bin: *newBins)
+        bin.balanceRatio = rng.Gaus(bin.balanceRatio, std::sqrt(bin.unc2));
+    
+    auto replica = std::make_unique<ZJetRun1>(*this);
+    replica->bins = newBins;
+    
+    return replica;
 }
 
 
 unsigned ZJetRun1::GetDim() const
 {
-    return bins.size();
+    return bins->size();
 }
 
 
 double ZJetRun1::Eval(JetCorrBase const &corrector, Nuisances const &) const
 {
+    JECFIT_PROFILE_SCOPE("ZJetRun1", "Eval");
+    JECFIT_TRACE_SCOPE("ZJetRun1", "Eval");
     double chi2 = 0.;
     
-    for (auto const &bin: bins)
+    for (auto const &bin: *bins)
     {
         // Assume that pt of the jet is the same as pt of the Z
         chi2 += std::pow(bin.balanceRatio - 1 / corrector.Eval(bin.ptZ), 2) / bin.unc2;
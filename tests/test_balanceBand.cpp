@@ -0,0 +1,248 @@
+/**
+ * A unit test for uncertainty bands of the recomputed balance in the multijet measurement.
+ * 
+ * The band is compared to quantiles computed from the recomputed balance obtained by evaluating
+ * the measurement repeatedly, once for each sample of parameters. The band must also not depend on
+ * the number of threads and on whether a pool of threads is set for the measurement.
+ */
+
+#include <MultijetBinnedSum.hpp>
+#include <Parallel.hpp>
+#include <SyntheticInputs.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+
+using namespace std;
+
+
+class JetCorr: public JetCorrBase
+{
+public:
+    JetCorr();
+    
+public:
+    virtual std::unique_ptr<JetCorrBase> Clone() const override;
+    virtual double Eval(double pt) const override;
+};
+
+
+JetCorr::JetCorr():
+    JetCorrBase(2)
+{}
+
+
+std::unique_ptr<JetCorrBase> JetCorr::Clone() const
+{
+    return std::make_unique<JetCorr>(*this);
+}
+
+
+double JetCorr::Eval(double pt) const
+{
+    return 1. + parameters[0] + parameters[1] * std::log(pt / 100.);
+}
+
+
+void printResult(bool pass)
+{
+    if (pass)
+        cout << "\e[1;32mTest passed.\e[0m";
+    else
+        cout << "\e[1;31mTest failed.\e[0m";
+    
+    cout << endl;
+}
+
+
+/**
+ * \brief Recomputes the balance for the given parameters
+ * 
+ * Bins from all trigger bins are ordered by their lower edges, as done in the band.
+ */
+vector<double> RecomputeBalance(MultijetBinnedSum const &measurement,
+  vector<double> const &params)
+{
+    JetCorr jetCorr;
+    jetCorr.SetParams(params);
+    Nuisances dummyNuisances;
+    vector<ResidualBin> bins;
+    
+    for (auto const &group: measurement.EvalResiduals(jetCorr, dummyNuisances))
+        bins.insert(bins.end(), group.bins.begin(), group.bins.end());
+    
+    stable_sort(bins.begin(), bins.end(),
+      [](ResidualBin const &lhs, ResidualBin const &rhs){return lhs.ptMin < rhs.ptMin;});
+    vector<double> values;
+    
+    for (auto const &bin: bins)
+        values.emplace_back(bin.recomputed);
+    
+    return values;
+}
+
+
+/// Computes a quantile with linear interpolation between order statistics, ignoring NaN
+double ComputeQuantile(vector<double> values, double probability)
+{
+    values.erase(remove_if(values.begin(), values.end(), [](double x){return std::isnan(x);}),
+      values.end());
+    
+    if (values.empty())
+        return NAN;
+    
+    sort(values.begin(), values.end());
+    double const pos = probability * (values.size() - 1);
+    unsigned const lower = pos;
+    unsigned const upper = min<unsigned>(lower + 1, values.size() - 1);
+    double const frac = pos - lower;
+    return (1. - frac) * values[lower] + frac * values[upper];
+}
+
+
+/// Checks if two values are equal within a small tolerance or are both NaN
+bool AreClose(double a, double b)
+{
+    if (std::isnan(a) or std::isnan(b))
+        return std::isnan(a) and std::isnan(b);
+    
+    return abs(a - b) <= 1e-12 * max(1., abs(a));
+}
+
+
+int main()
+{
+    bool failure = false;
+    
+    JetCorr trueCorr;
+    trueCorr.SetParams({0.01, 0.005});
+    SyntheticInputGenerator generator(trueCorr, 1);
+    generator.SetNumTriggerBins(4);
+    
+    auto const method = MultijetBinnedSum::Method::PtBal;
+    MultijetBinnedSum multijet(generator.GenerateMultijet(method), method);
+    
+    mt19937 rng(314);
+    normal_distribution<double> normal(0., 0.01);
+    vector<vector<double>> samples(25);
+    
+    for (auto &sample: samples)
+        sample = {0.01 + normal(rng), 0.005 + normal(rng)};
+    
+    vector<double> const probabilities{0., 0.16, 0.5, 0.84, 1.};
+    JetCorr prototype;
+    Nuisances dummyNuisances;
+    
+    
+    cout << "Compare the band to repeated recomputation of the balance:\n";
+    auto const band = multijet.ComputeBalanceBand(prototype, dummyNuisances, samples,
+      probabilities);
+    vector<vector<double>> recomputed;
+    
+    for (auto const &sample: samples)
+        recomputed.emplace_back(RecomputeBalance(multijet, sample));
+    
+    unsigned const numBins = recomputed.front().size();
+    bool status = (band.edges.size() == numBins + 1 and
+      band.quantiles.size() == probabilities.size());
+    double maxDeviation = 0.;
+    
+    for (unsigned q = 0; status and q < probabilities.size(); ++q)
+        for (unsigned b = 0; b < numBins; ++b)
+        {
+            vector<double> values;
+            
+            for (auto const &r: recomputed)
+                values.emplace_back(r[b]);
+            
+            double const expected = ComputeQuantile(values, probabilities[q]);
+            status &= AreClose(band.quantiles[q][b], expected);
+            
+            if (not std::isnan(expected))
+                maxDeviation = max(maxDeviation, abs(band.quantiles[q][b] - expected));
+        }
+    
+    cout << "  " << numBins << " bins, maximal deviation: " << maxDeviation << '\n';
+    printResult(status);
+    failure |= not status;
+    
+    
+    cout << "\nCheck that a band from identical samples collapses to the recomputed balance:\n";
+    vector<vector<double>> const repeated(5, samples.front());
+    auto const narrowBand = multijet.ComputeBalanceBand(prototype, dummyNuisances, repeated,
+      probabilities);
+    status = (narrowBand.quantiles.size() == probabilities.size());
+    
+    for (unsigned q = 0; status and q < probabilities.size(); ++q)
+        for (unsigned b = 0; b < numBins; ++b)
+            status &= AreClose(narrowBand.quantiles[q][b], recomputed.front()[b]);
+    
+    printResult(status);
+    failure |= not status;
+    
+    
+    cout << "\nCompute the band with different numbers of threads:\n";
+    status = true;
+    
+    for (unsigned poolSize: {0, 3})
+    {
+        if (poolSize > 0)
+            multijet.SetThreadPool(make_shared<ThreadPool>(poolSize));
+        
+        for (unsigned numThreads: {1, 4})
+        {
+            auto const otherBand = multijet.ComputeBalanceBand(prototype, dummyNuisances, samples,
+              probabilities, numThreads);
+            bool identical = (otherBand.quantiles.size() == band.quantiles.size());
+            
+            for (unsigned q = 0; identical and q < band.quantiles.size(); ++q)
+                for (unsigned b = 0; b < numBins; ++b)
+                    identical &= (otherBand.quantiles[q][b] == band.quantiles[q][b] or
+                      (std::isnan(otherBand.quantiles[q][b]) and std::isnan(band.quantiles[q][b])));
+            
+            cout << "  Pool of " << poolSize << " threads, " << numThreads << " thread(s): " <<
+              ((identical) ? "identical" : "different") << '\n';
+            status &= identical;
+        }
+    }
+    
+    printResult(status);
+    failure |= not status;
+    
+    
+    cout << "\nCheck that a probability outside of [0, 1] is rejected:\n";
+    
+    try
+    {
+        multijet.ComputeBalanceBand(prototype, dummyNuisances, samples, {1.5});
+        status = false;
+    }
+    catch (runtime_error const &)
+    {
+        status = true;
+    }
+    
+    printResult(status);
+    failure |= not status;
+    
+    
+    cout << endl;
+    
+    if (not failure)
+    {
+        cout << "\e[1;32mAll tests passed.\e[0m\n";
+        return EXIT_SUCCESS;
+    }
+    else
+    {
+        cout << "\e[1;31mSome tests failed.\e[0m\n";
+        return EXIT_FAILURE;
+    }
+}
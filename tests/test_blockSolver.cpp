@@ -0,0 +1,179 @@
+/**
+ * A unit test for the solver of linear systems with block-tridiagonal matrices.
+ * 
+ * The solution and the diagonal blocks of the inverse matrix are compared to the ones obtained
+ * with a dense Cholesky decomposition of the same matrix.
+ */
+
+#include <LinearAlgebra.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+
+using namespace std;
+
+
+void printResult(bool pass)
+{
+    if (pass)
+        cout << "\e[1;32mTest passed.\e[0m";
+    else
+        cout << "\e[1;31mTest failed.\e[0m";
+    
+    cout << endl;
+}
+
+
+int main()
+{
+    bool failure = false;
+    
+    
+    // Construct a random positive-definite block-tridiagonal matrix with blocks of different
+    //sizes. The diagonal blocks are made dominant to guarantee positive definiteness.
+    vector<unsigned> const blockSizes{3, 2, 4, 1, 3};
+    unsigned const nBlocks = blockSizes.size();
+    vector<unsigned> offsets(nBlocks, 0);
+    
+    for (unsigned k = 1; k < nBlocks; ++k)
+        offsets[k] = offsets[k - 1] + blockSizes[k - 1];
+    
+    unsigned const n = offsets.back() + blockSizes.back();
+    
+    mt19937 generator(2718);
+    uniform_real_distribution<double> uniform(-1., 1.);
+    
+    vector<vector<double>> diagBlocks(nBlocks), offDiagBlocks(nBlocks - 1);
+    
+    for (unsigned k = 0; k < nBlocks; ++k)
+    {
+        unsigned const size = blockSizes[k];
+        vector<double> r(size * size);
+        
+        for (auto &x: r)
+            x = uniform(generator);
+        
+        diagBlocks[k] = MultiplyMatrices(r, Transpose(r, size, size), size, size, size);
+        
+        for (unsigned i = 0; i < size; ++i)
+            diagBlocks[k][i * size + i] += 2. * n;
+        
+        if (k + 1 < nBlocks)
+        {
+            offDiagBlocks[k].resize(size * blockSizes[k + 1]);
+            
+            for (auto &x: offDiagBlocks[k])
+                x = uniform(generator);
+        }
+    }
+    
+    vector<double> rhs(n);
+    
+    for (auto &x: rhs)
+        x = uniform(generator);
+    
+    
+    // Assemble the dense matrix, including the damping of the diagonal
+    double const lambda = 0.1;
+    vector<double> dense(n * n, 0.);
+    
+    for (unsigned k = 0; k < nBlocks; ++k)
+    {
+        unsigned const size = blockSizes[k];
+        unsigned const offset = offsets[k];
+        
+        for (unsigned i = 0; i < size; ++i)
+            for (unsigned j = 0; j < size; ++j)
+                dense[(offset + i) * n + offset + j] = diagBlocks[k][i * size + j] *
+                  ((i == j) ? 1. + lambda : 1.);
+        
+        if (k + 1 < nBlocks)
+        {
+            unsigned const sizeNext = blockSizes[k + 1];
+            unsigned const offsetNext = offsets[k + 1];
+            
+            for (unsigned i = 0; i < size; ++i)
+                for (unsigned j = 0; j < sizeNext; ++j)
+                {
+                    double const value = offDiagBlocks[k][i * sizeNext + j];
+                    dense[(offset + i) * n + offsetNext + j] = value;
+                    dense[(offsetNext + j) * n + offset + i] = value;
+                }
+        }
+    }
+    
+    
+    cout << "Solve the system and compare to a dense Cholesky decomposition:\n";
+    vector<double> solution(rhs);
+    vector<vector<double>> inverseBlocks;
+    bool const success = SolveBlockTridiagonal(blockSizes, diagBlocks, offDiagBlocks, lambda,
+      solution, &inverseBlocks);
+    
+    vector<double> decomposition(dense);
+    CholeskyDecompose(decomposition, n);
+    vector<double> denseSolution(rhs);
+    CholeskySolve(decomposition, n, denseSolution.data());
+    
+    double maxDeviation = 0.;
+    
+    for (unsigned i = 0; i < n; ++i)
+        maxDeviation = max(maxDeviation, abs(solution[i] - denseSolution[i]));
+    
+    cout << "  Maximal deviation: " << maxDeviation << '\n';
+    bool status = (success and maxDeviation < 1e-12);
+    printResult(status);
+    failure |= not status;
+    
+    
+    cout << "\nCompare diagonal blocks of the inverse matrix:\n";
+    vector<double> const denseInverse(InvertSymmetric(dense, n));
+    maxDeviation = 0.;
+    
+    for (unsigned k = 0; k < nBlocks; ++k)
+    {
+        unsigned const size = blockSizes[k];
+        unsigned const offset = offsets[k];
+        
+        for (unsigned i = 0; i < size; ++i)
+            for (unsigned j = 0; j < size; ++j)
+                maxDeviation = max(maxDeviation, abs(inverseBlocks[k][i * size + j] -
+                  denseInverse[(offset + i) * n + offset + j]));
+    }
+    
+    cout << "  Maximal deviation: " << maxDeviation << '\n';
+    status = (inverseBlocks.size() == nBlocks and maxDeviation < 1e-12);
+    printResult(status);
+    failure |= not status;
+    
+    
+    cout << "\nCheck that a matrix that is not positive-definite is rejected:\n";
+    vector<vector<double>> negativeBlocks(diagBlocks);
+    
+    for (auto &x: negativeBlocks[2])
+        x = -x;
+    
+    solution = rhs;
+    status = not SolveBlockTridiagonal(blockSizes, negativeBlocks, offDiagBlocks, lambda,
+      solution);
+    printResult(status);
+    failure |= not status;
+    
+    
+    cout << endl;
+    
+    if (not failure)
+    {
+        cout << "\e[1;32mAll tests passed.\e[0m\n";
+        return EXIT_SUCCESS;
+    }
+    else
+    {
+        cout << "\e[1;31mSome tests failed.\e[0m\n";
+        return EXIT_FAILURE;
+    }
+}
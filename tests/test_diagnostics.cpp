@@ -0,0 +1,93 @@
+/**
+ * A unit test for counting of problems with DiagnosticCounter.
+ * 
+ * Occurrences are recorded from many short-lived threads, which exit before the counts are
+ * checked. Their counts must be kept, and the summary must report the context of the earliest
+ * occurrence in each bin.
+ */
+
+#include <Diagnostics.hpp>
+
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+using namespace std;
+
+
+void printResult(bool pass)
+{
+    if (pass)
+        cout << "\e[1;32mTest passed.\e[0m";
+    else
+        cout << "\e[1;31mTest failed.\e[0m";
+    
+    cout << endl;
+}
+
+
+int main()
+{
+    bool failure = false;
+    
+    auto const &counter = GetDiagnosticCounter("test", "problem", {"bin", "thread"});
+    
+    
+    cout << "Record occurrences in the main thread:\n";
+    counter.Record(0, {0., -1.});
+    bool status = (GetNumDiagnosticEvents() == 1);
+    printResult(status);
+    failure |= not status;
+    
+    
+    cout << "\nRecord occurrences from short-lived threads:\n";
+    unsigned const numRounds = 50, numThreads = 4, numPerThread = 10;
+    
+    for (unsigned round = 0; round < numRounds; ++round)
+    {
+        vector<thread> threads;
+        
+        for (unsigned t = 0; t < numThreads; ++t)
+            threads.emplace_back([&counter, t](){
+                for (unsigned i = 0; i < numPerThread; ++i)
+                    counter.Record(i % 2, {double(i % 2), double(t)});
+            });
+        
+        for (auto &t: threads)
+            t.join();
+    }
+    
+    uint64_t const expected = 1 + numRounds * numThreads * numPerThread;
+    cout << "  " << GetNumDiagnosticEvents() << " occurrence(s), " << expected << " expected\n";
+    status = (GetNumDiagnosticEvents() == expected);
+    printResult(status);
+    failure |= not status;
+    
+    
+    cout << "\nCheck the summary:\n";
+    ostringstream summary;
+    PrintDiagnosticsSummary(summary);
+    cout << summary.str();
+    status = (summary.str().find(to_string(expected) + " occurrence(s) in 2 bin(s)") !=
+      string::npos and summary.str().find("bin 0, thread -1: ") != string::npos);
+    printResult(status);
+    failure |= not status;
+    
+    
+    cout << endl;
+    
+    if (not failure)
+    {
+        cout << "\e[1;32mAll tests passed.\e[0m\n";
+        return EXIT_SUCCESS;
+    }
+    else
+    {
+        cout << "\e[1;31mSome tests failed.\e[0m\n";
+        return EXIT_FAILURE;
+    }
+}
@@ -0,0 +1,223 @@
+/**
+ * A unit test for requests of uncertainty bands served by FitServer.
+ * 
+ * The server is run on a temporary socket with a loss function constructed from synthetic inputs.
+ * After a fit, bands are requested with the default probabilities and with explicitly given
+ * ones, and the sizes of the responses are checked.
+ */
+
+#include <FitBase.hpp>
+#include <FitServer.hpp>
+#include <MultijetBinnedSum.hpp>
+#include <SyntheticInputs.hpp>
+
+#include <TROOT.h>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+using namespace std;
+
+
+class JetCorr: public JetCorrBase
+{
+public:
+    JetCorr();
+    
+public:
+    virtual std::unique_ptr<JetCorrBase> Clone() const override;
+    virtual double Eval(double pt) const override;
+};
+
+
+JetCorr::JetCorr():
+    JetCorrBase(2)
+{}
+
+
+std::unique_ptr<JetCorrBase> JetCorr::Clone() const
+{
+    return std::make_unique<JetCorr>(*this);
+}
+
+
+double JetCorr::Eval(double pt) const
+{
+    return 1. + parameters[0] + parameters[1] * std::log(pt / 100.);
+}
+
+
+void printResult(bool pass)
+{
+    if (pass)
+        cout << "\e[1;32mTest passed.\e[0m";
+    else
+        cout << "\e[1;31mTest failed.\e[0m";
+    
+    cout << endl;
+}
+
+
+/// Connects to the server, retrying while it is starting up; returns -1 on failure
+int Connect(string const &socketPath)
+{
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, socketPath.c_str());
+    
+    for (unsigned attempt = 0; attempt < 100; ++attempt)
+    {
+        int const s = socket(AF_UNIX, SOCK_STREAM, 0);
+        
+        if (connect(s, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == 0)
+            return s;
+        
+        close(s);
+        this_thread::sleep_for(chrono::milliseconds(50));
+    }
+    
+    return -1;
+}
+
+
+/// Sends a request and returns the tokens of the response
+vector<string> Request(int s, string const &request)
+{
+    string const line(request + '\n');
+    send(s, line.data(), line.size(), MSG_NOSIGNAL);
+    
+    string response;
+    char c;
+    
+    while (recv(s, &c, 1, 0) == 1 and c != '\n')
+        response += c;
+    
+    istringstream responseStream(response);
+    vector<string> tokens;
+    string token;
+    
+    while (responseStream >> token)
+        tokens.emplace_back(token);
+    
+    return tokens;
+}
+
+
+/**
+ * \brief Checks the response to a band request
+ * 
+ * The response must contain the number of bins, the bin edges, and the given number of quantiles
+ * in each bin, and quantiles must not decrease with the probability.
+ */
+bool CheckBand(vector<string> const &tokens, unsigned numProbabilities)
+{
+    if (tokens.size() < 2 or tokens[0] != "ok")
+        return false;
+    
+    unsigned const numBins = stoul(tokens[1]);
+    cout << "  " << numBins << " bins, " << tokens.size() << " tokens\n";
+    
+    if (numBins == 0 or tokens.size() != 2 + (numBins + 1) + numProbabilities * numBins)
+        return false;
+    
+    unsigned const first = 2 + numBins + 1;
+    
+    for (unsigned q = 1; q < numProbabilities; ++q)
+        for (unsigned b = 0; b < numBins; ++b)
+        {
+            double const lower = stod(tokens[first + (q - 1) * numBins + b]);
+            double const upper = stod(tokens[first + q * numBins + b]);
+            
+            if (upper < lower)
+                return false;
+        }
+    
+    return true;
+}
+
+
+int main()
+{
+    bool failure = false;
+    ROOT::EnableThreadSafety();
+    
+    JetCorr trueCorr;
+    trueCorr.SetParams({0.01, 0.005});
+    SyntheticInputGenerator generator(trueCorr, 1);
+    generator.SetNumTriggerBins(4);
+    
+    auto const method = MultijetBinnedSum::Method::PtBal;
+    MultijetBinnedSum multijet(generator.GenerateMultijet(method), method);
+    CombLossFunction lossFunc(make_unique<JetCorr>());
+    lossFunc.AddMeasurement(&multijet);
+    
+    string const socketPath("/tmp/test_fitServer_" + to_string(getpid()) + ".sock");
+    FitServer server(lossFunc);
+    thread serverThread([&server, &socketPath](){server.Serve(socketPath);});
+    int const s = Connect(socketPath);
+    
+    if (s < 0)
+    {
+        cout << "\e[1;31mFailed to connect to the server.\e[0m\n";
+        serverThread.detach();
+        return EXIT_FAILURE;
+    }
+    
+    
+    cout << "Fit the loss function:\n";
+    auto tokens = Request(s, "fit");
+    bool status = (not tokens.empty() and tokens[0] == "ok");
+    printResult(status);
+    failure |= not status;
+    
+    
+    cout << "\nRequest a band with the default probabilities:\n";
+    status = CheckBand(Request(s, "band 0 50"), 3);
+    printResult(status);
+    failure |= not status;
+    
+    
+    cout << "\nRequest a band with two probabilities:\n";
+    status = CheckBand(Request(s, "band 0 50 0.05 0.95"), 2);
+    printResult(status);
+    failure |= not status;
+    
+    
+    cout << "\nCheck that a probability outside of (0, 1) is rejected:\n";
+    tokens = Request(s, "band 0 50 1.5");
+    status = (not tokens.empty() and tokens[0] == "error");
+    printResult(status);
+    failure |= not status;
+    
+    
+    Request(s, "shutdown");
+    close(s);
+    serverThread.join();
+    
+    cout << endl;
+    
+    if (not failure)
+    {
+        cout << "\e[1;32mAll tests passed.\e[0m\n";
+        return EXIT_SUCCESS;
+    }
+    else
+    {
+        cout << "\e[1;31mSome tests failed.\e[0m\n";
+        return EXIT_FAILURE;
+    }
+}
@@ -0,0 +1,151 @@
+/**
+ * A unit test for lazy loading of trigger bins in the multijet measurement.
+ * 
+ * Trigger bins are provided on demand from synthetic inputs. After a subrange of trigger bins has
+ * been selected and the measurement evaluated, only the selected bins must have been loaded, and
+ * the result must agree with a measurement constructed from all inputs at once.
+ */
+
+#include <MultijetBinnedSum.hpp>
+#include <SyntheticInputs.hpp>
+
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+
+using namespace std;
+
+
+class JetCorr: public JetCorrBase
+{
+public:
+    JetCorr();
+    
+public:
+    virtual std::unique_ptr<JetCorrBase> Clone() const override;
+    virtual double Eval(double pt) const override;
+};
+
+
+JetCorr::JetCorr():
+    JetCorrBase(1)
+{}
+
+
+std::unique_ptr<JetCorrBase> JetCorr::Clone() const
+{
+    return std::make_unique<JetCorr>(*this);
+}
+
+
+double JetCorr::Eval(double pt) const
+{
+    return 1. + parameters[0] * std::log(pt / 100.);
+}
+
+
+void printResult(bool pass)
+{
+    if (pass)
+        cout << "\e[1;32mTest passed.\e[0m";
+    else
+        cout << "\e[1;31mTest failed.\e[0m";
+    
+    cout << endl;
+}
+
+
+int main()
+{
+    bool failure = false;
+    
+    JetCorr trueCorr;
+    trueCorr.SetParams({0.01});
+    SyntheticInputGenerator generator(trueCorr, 1);
+    unsigned const numTriggerBins = 5;
+    generator.SetNumTriggerBins(numTriggerBins);
+    
+    auto const method = MultijetBinnedSum::Method::PtBal;
+    auto const sums = generator.GenerateMultijet(method);
+    vector<atomic<unsigned>> numLoads(numTriggerBins);
+    
+    for (auto &n: numLoads)
+        n = 0;
+    
+    MultijetBinnedSum lazy(numTriggerBins, sums.minPt, [&sums, &numLoads](unsigned index)
+    {
+        ++numLoads[index];
+        return sums.triggerBins[index];
+    }, method, 2);
+    
+    auto sumsCopy = sums;
+    MultijetBinnedSum eager(move(sumsCopy), method);
+    
+    
+    cout << "Check that no trigger bins are loaded on construction:\n";
+    bool status = true;
+    
+    for (unsigned i = 0; i < numTriggerBins; ++i)
+        status &= (not lazy.IsTriggerBinLoaded(i) and lazy.GetTriggerBinMemory(i) == 0 and
+          numLoads[i] == 0);
+    
+    printResult(status);
+    failure |= not status;
+    
+    
+    cout << "\nSelect trigger bins [1, 3) and evaluate the measurement:\n";
+    lazy.SetTriggerBinRange(1, 3);
+    eager.SetTriggerBinRange(1, 3);
+    
+    JetCorr jetCorr;
+    jetCorr.SetParams({0.005});
+    Nuisances dummyNuisances;
+    double const lazyChi2 = lazy.Eval(jetCorr, dummyNuisances);
+    double const eagerChi2 = eager.Eval(jetCorr, dummyNuisances);
+    cout << "  chi^2: " << lazyChi2 << " (lazy), " << eagerChi2 << " (eager)\n";
+    status = (lazyChi2 == eagerChi2 and lazy.GetDim() == eager.GetDim());
+    
+    for (unsigned i = 0; i < numTriggerBins; ++i)
+    {
+        bool const selected = (i >= 1 and i < 3);
+        cout << "  Trigger bin " << i << ": " <<
+          ((lazy.IsTriggerBinLoaded(i)) ? "loaded" : "not loaded") << ", " <<
+          lazy.GetTriggerBinMemory(i) << " B, " << numLoads[i] << " load(s)\n";
+        status &= (lazy.IsTriggerBinLoaded(i) == selected);
+        status &= ((lazy.GetTriggerBinMemory(i) > 0) == selected);
+        status &= (numLoads[i] == ((selected) ? 1u : 0u));
+    }
+    
+    printResult(status);
+    failure |= not status;
+    
+    
+    cout << "\nCheck that clones share loaded trigger bins:\n";
+    auto const clone = lazy.Clone();
+    clone->Eval(jetCorr, dummyNuisances);
+    status = true;
+    
+    for (unsigned i = 0; i < numTriggerBins; ++i)
+        status &= (numLoads[i] == ((i >= 1 and i < 3) ? 1u : 0u));
+    
+    printResult(status);
+    failure |= not status;
+    
+    
+    cout << endl;
+    
+    if (not failure)
+    {
+        cout << "\e[1;32mAll tests passed.\e[0m\n";
+        return EXIT_SUCCESS;
+    }
+    else
+    {
+        cout << "\e[1;31mSome tests failed.\e[0m\n";
+        return EXIT_FAILURE;
+    }
+}
@@ -1,15 +1,20 @@
 /**
- * A unit test to check evaluation of the multijet loss function.
+ * A unit test to check evaluation of the binned-sum loss functions.
  * 
- * This is currently a draft. Will put a small ROOT file into the repository and check computed
- * values of the loss function against a reference.
+ * Inputs are generated with a known jet correction injected into the data, and the loss functions
+ * evaluated for a range of corrections are required to be minimal at the true one.
  */
 
 #include <FitBase.hpp>
 #include <MultijetBinnedSum.hpp>
+#include <PhotonJetBinnedSum.hpp>
+#include <SyntheticInputs.hpp>
 
+#include <cmath>
 #include <iostream>
+#include <memory>
 #include <string>
+#include <vector>
 
 
 class JetCorr: public JetCorrBase
@@ -18,6 +23,7 @@ public:
     JetCorr();
     
 public:
+    virtual std::unique_ptr<JetCorrBase> Clone() const override;
     virtual double Eval(double pt) const override;
 };
 
@@ -27,6 +33,12 @@ JetCorr::JetCorr():
 {}
 
 
+std::unique_ptr<JetCorrBase> JetCorr::Clone() const
+{
+    return std::make_unique<JetCorr>(*this);
+}
+
+
 double JetCorr::Eval(double pt) const
 {
     double const b = 1.;
@@ -36,29 +48,72 @@ double JetCorr::Eval(double pt) const
 }
 
 
-int main()
+/**
+ * \brief Evaluates the given measurement for a range of corrections and checks the minimum
+ * 
+ * Returns true if the smallest value of the loss function is found at the true value of the
+ * parameter.
+ */
+bool CheckMinimum(std::string const &label, MeasurementBase const &measurement,
+  std::vector<double> const &paramValues, double trueParam)
 {
     JetCorr jetCorr;
     Nuisances dummyNuisances;
-    std::string inputFile("~/workspace/Analyses/JetMET/2017.09.07_New-method-real-setup/Analysis/multijet.root");
+    double minLoss = INFINITY, bestParam = 0.;
     
-    std::cout << "Loss function for pt balancing with various jet corrections:\n";
-    MultijetBinnedSum lossFuncPtBal(inputFile, MultijetBinnedSum::Method::PtBal);
+    std::cout << "Loss function for " << label << " with various jet corrections:\n";
     
-    for (auto const &p: {-2e-2, -1e-2, -5e-3, 0., 5e-3, 1e-2, 2e-2})
+    for (auto const &p: paramValues)
     {
         jetCorr.SetParams({p});
-        std::cout << "  " << lossFuncPtBal.Eval(jetCorr, dummyNuisances) << std::endl;
+        double const loss = measurement.Eval(jetCorr, dummyNuisances);
+        std::cout << "  " << p << ": " << loss << std::endl;
+        
+        if (loss < minLoss)
+        {
+            minLoss = loss;
+            bestParam = p;
+        }
     }
     
-    std::cout << "\nLoss function for MPF with various jet corrections:\n";
-    MultijetBinnedSum lossFuncMPF(inputFile, MultijetBinnedSum::Method::MPF);
-    
-    for (auto const &p: {-2e-2, -1e-2, -5e-3, 0., 5e-3, 1e-2, 2e-2})
+    if (bestParam != trueParam)
     {
-        jetCorr.SetParams({p});
-        std::cout << "  " << lossFuncMPF.Eval(jetCorr, dummyNuisances) << std::endl;
+        std::cout << "Minimum found at " << bestParam << " instead of " << trueParam << ".\n";
+        return false;
     }
     
-    return EXIT_SUCCESS;
+    std::cout << std::endl;
+    return true;
+}
+
+
+int main()
+{
+    double const trueParam = 1e-2;
+    std::vector<double> const paramValues{-2e-2, -1e-2, -5e-3, 0., 5e-3, 1e-2, 2e-2};
+    
+    JetCorr trueCorr;
+    trueCorr.SetParams({trueParam});
+    SyntheticInputGenerator generator(trueCorr, 1);
+    
+    bool success = true;
+    
+    MultijetBinnedSum multijetPtBal(generator.GenerateMultijet(MultijetBinnedSum::Method::PtBal),
+      MultijetBinnedSum::Method::PtBal);
+    success &= CheckMinimum("multijet pt balancing", multijetPtBal, paramValues, trueParam);
+    
+    MultijetBinnedSum multijetMPF(generator.GenerateMultijet(MultijetBinnedSum::Method::MPF),
+      MultijetBinnedSum::Method::MPF);
+    success &= CheckMinimum("multijet MPF", multijetMPF, paramValues, trueParam);
+    
+    PhotonJetBinnedSum photonJetPtBal(
+      generator.GeneratePhotonJet(PhotonJetBinnedSum::Method::PtBal),
+      PhotonJetBinnedSum::Method::PtBal);
+    success &= CheckMinimum("photon+jet pt balancing", photonJetPtBal, paramValues, trueParam);
+    
+    PhotonJetBinnedSum photonJetMPF(generator.GeneratePhotonJet(PhotonJetBinnedSum::Method::MPF),
+      PhotonJetBinnedSum::Method::MPF);
+    success &= CheckMinimum("photon+jet MPF", photonJetMPF, paramValues, trueParam);
+    
+    return (success) ? EXIT_SUCCESS : EXIT_FAILURE;
 }
@@ -0,0 +1,196 @@
+/**
+ * A unit test to check that parallel evaluation of loss functions is reproducible.
+ * 
+ * Loss functions are evaluated serially and with pools of threads of different sizes, and the
+ * results are required to be identical bit by bit.
+ */
+
+#include <FitBase.hpp>
+#include <MultijetBinnedSum.hpp>
+#include <Parallel.hpp>
+#include <PhotonJetBinnedSum.hpp>
+#include <SyntheticInputs.hpp>
+
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+
+using namespace std;
+
+
+class JetCorr: public JetCorrBase
+{
+public:
+    JetCorr();
+    
+public:
+    virtual std::unique_ptr<JetCorrBase> Clone() const override;
+    virtual double Eval(double pt) const override;
+};
+
+
+JetCorr::JetCorr():
+    JetCorrBase(2)
+{}
+
+
+std::unique_ptr<JetCorrBase> JetCorr::Clone() const
+{
+    return std::make_unique<JetCorr>(*this);
+}
+
+
+double JetCorr::Eval(double pt) const
+{
+    return 1. + parameters[0] + parameters[1] * std::log(pt / 100.);
+}
+
+
+void printResult(bool pass)
+{
+    if (pass)
+        cout << "\e[1;32mTest passed.\e[0m";
+    else
+        cout << "\e[1;31mTest failed.\e[0m";
+    
+    cout << endl;
+}
+
+
+/// Evaluates the measurement with the given corrections
+vector<double> EvalMeasurement(MeasurementBase const &measurement,
+  vector<vector<double>> const &points)
+{
+    JetCorr jetCorr;
+    Nuisances dummyNuisances;
+    vector<double> values;
+    
+    for (auto const &p: points)
+    {
+        jetCorr.SetParams(p);
+        values.emplace_back(measurement.Eval(jetCorr, dummyNuisances));
+    }
+    
+    return values;
+}
+
+
+/// Evaluates the combined loss function at the given points
+vector<double> EvalLossFunc(CombLossFunction const &lossFunc, vector<vector<double>> const &points)
+{
+    vector<double> values;
+    
+    for (auto const &p: points)
+        values.emplace_back(lossFunc.EvalRawInput(p.data()));
+    
+    return values;
+}
+
+
+/// Prints the given values with all significant digits
+void PrintValues(vector<double> const &values)
+{
+    cout << setprecision(17);
+    
+    for (auto const &v: values)
+        cout << ' ' << v;
+    
+    cout << setprecision(6) << '\n';
+}
+
+
+int main()
+{
+    bool failure = false;
+    
+    JetCorr trueCorr;
+    trueCorr.SetParams({0.01, 0.005});
+    SyntheticInputGenerator generator(trueCorr, 1);
+    generator.SetNumTriggerBins(4);
+    
+    vector<vector<double>> const points{{0., 0.}, {0.01, 0.005}, {-0.02, 0.01}, {0.03, -0.01}};
+    vector<unsigned> const poolSizes{2, 4, 7};
+    
+    
+    cout << "Evaluate multijet measurements serially and with pools of threads:\n";
+    
+    for (auto const method: {MultijetBinnedSum::Method::PtBal, MultijetBinnedSum::Method::MPF})
+    {
+        MultijetBinnedSum multijet(generator.GenerateMultijet(method), method);
+        vector<double> const reference(EvalMeasurement(multijet, points));
+        cout << "  Serial:";
+        PrintValues(reference);
+        bool status = true;
+        
+        for (unsigned numThreads: poolSizes)
+        {
+            multijet.SetThreadPool(make_shared<ThreadPool>(numThreads));
+            
+            // Evaluate twice to make sure that the cached state does not depend on the order
+            //in which tasks have been executed
+            for (unsigned repetition = 0; repetition < 2; ++repetition)
+            {
+                vector<double> const values(EvalMeasurement(multijet, points));
+                cout << "  " << numThreads << " threads:";
+                PrintValues(values);
+                status &= (values == reference);
+            }
+        }
+        
+        printResult(status);
+        failure |= not status;
+    }
+    
+    
+    cout << "\nEvaluate the combined loss function serially and with pools of threads:\n";
+    MultijetBinnedSum multijetPtBal(generator.GenerateMultijet(MultijetBinnedSum::Method::PtBal),
+      MultijetBinnedSum::Method::PtBal);
+    MultijetBinnedSum multijetMPF(generator.GenerateMultijet(MultijetBinnedSum::Method::MPF),
+      MultijetBinnedSum::Method::MPF);
+    PhotonJetBinnedSum photonJet(generator.GeneratePhotonJet(PhotonJetBinnedSum::Method::MPF),
+      PhotonJetBinnedSum::Method::MPF);
+    vector<MeasurementBase *> const measurements{&multijetPtBal, &multijetMPF, &photonJet};
+    
+    CombLossFunction lossFunc(make_unique<JetCorr>());
+    
+    for (auto const &measurement: measurements)
+        lossFunc.AddMeasurement(measurement);
+    
+    vector<double> const reference(EvalLossFunc(lossFunc, points));
+    cout << "  Serial:";
+    PrintValues(reference);
+    bool status = true;
+    
+    for (unsigned numThreads: poolSizes)
+    {
+        lossFunc.SetNumThreads(numThreads);
+        
+        for (auto const &measurement: measurements)
+            measurement->SetThreadPool(lossFunc.GetThreadPool());
+        
+        vector<double> const values(EvalLossFunc(lossFunc, points));
+        cout << "  " << numThreads << " threads:";
+        PrintValues(values);
+        status &= (values == reference);
+    }
+    
+    printResult(status);
+    failure |= not status;
+    
+    
+    cout << endl;
+    
+    if (not failure)
+    {
+        cout << "\e[1;32mAll tests passed.\e[0m\n";
+        return EXIT_SUCCESS;
+    }
+    else
+    {
+        cout << "\e[1;31mSome tests failed.\e[0m\n";
+        return EXIT_FAILURE;
+    }
+}
@@ -0,0 +1,214 @@
+/**
+ * A unit test for the polynomial surrogate of the loss function.
+ * 
+ * Uses a toy measurement, for which the loss function is computed analytically.
+ */
+
+#include <FitBase.hpp>
+#include <LossSurrogate.hpp>
+
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+
+using namespace std;
+
+
+class JetCorr: public JetCorrBase
+{
+public:
+    JetCorr();
+    
+public:
+    virtual std::unique_ptr<JetCorrBase> Clone() const override;
+    virtual double Eval(double pt) const override;
+};
+
+
+JetCorr::JetCorr():
+    JetCorrBase(2)
+{}
+
+
+std::unique_ptr<JetCorrBase> JetCorr::Clone() const
+{
+    return std::make_unique<JetCorr>(*this);
+}
+
+
+double JetCorr::Eval(double pt) const
+{
+    return 1. + parameters[0] + parameters[1] * std::log(pt / 100.);
+}
+
+
+/**
+ * Measurement of the inverse correction in several bins in pt. The resulting loss function is not
+ * quadratic in parameters of the correction.
+ */
+class ToyMeasurement: public MeasurementBase
+{
+public:
+    ToyMeasurement();
+    
+public:
+    virtual std::unique_ptr<MeasurementBase> Clone() const override;
+    virtual unsigned GetDim() const override;
+    virtual double Eval(JetCorrBase const &corrector, Nuisances const &) const override;
+    
+private:
+    vector<double> pts, values;
+    double unc;
+};
+
+
+ToyMeasurement::ToyMeasurement():
+    unc(5e-3)
+{
+    JetCorr trueCorr;
+    trueCorr.SetParams({0.02, 0.01});
+    
+    for (double pt = 30.; pt < 2000.; pt *= 1.5)
+    {
+        pts.emplace_back(pt);
+        values.emplace_back(1. / trueCorr.Eval(pt));
+    }
+}
+
+
+std::unique_ptr<MeasurementBase> ToyMeasurement::Clone() const
+{
+    return std::make_unique<ToyMeasurement>(*this);
+}
+
+
+unsigned ToyMeasurement::GetDim() const
+{
+    return pts.size();
+}
+
+
+double ToyMeasurement::Eval(JetCorrBase const &corrector, Nuisances const &) const
+{
+    double chi2 = 0.;
+    
+    for (unsigned i = 0; i < pts.size(); ++i)
+        chi2 += std::pow(values[i] - 1. / corrector.Eval(pts[i]), 2) / (unc * unc);
+    
+    return chi2;
+}
+
+
+void printResult(bool pass)
+{
+    if (pass)
+        cout << "\e[1;32mTest passed.\e[0m";
+    else
+        cout << "\e[1;31mTest failed.\e[0m";
+    
+    cout << endl;
+}
+
+
+int main()
+{
+    bool failure = false;
+    
+    ToyMeasurement measurement;
+    CombLossFunction lossFunc(make_unique<JetCorr>());
+    lossFunc.AddMeasurement(&measurement);
+    
+    
+    // The minimum is known by construction. Approximate the covariance matrix with a diagonal one.
+    vector<double> const center{0.02, 0.01};
+    vector<double> const covariance{1e-6, 0., 0., 1e-6};
+    
+    LossSurrogate surrogate(lossFunc);
+    surrogate.SetTolerance(1e-2);
+    surrogate.Build(center, covariance);
+    
+    cout << "Surrogate built with trust radius " << surrogate.GetTrustRadius() <<
+      " and error estimate " << surrogate.GetErrorEstimate() << " using " <<
+      surrogate.GetNumExactEvals() << " exact evaluations.\n";
+    
+    
+    cout << "\nCompare the surrogate to the exact loss function within the trust region:\n";
+    double const radius = surrogate.GetTrustRadius();
+    double maxDeviation = 0.;
+    unsigned const numExactBefore = surrogate.GetNumExactEvals();
+    
+    for (double phi = 0.; phi < 2 * M_PI; phi += 0.3)
+    {
+        vector<double> const x{center[0] + 0.9 * radius * 1e-3 * std::cos(phi),
+          center[1] + 0.9 * radius * 1e-3 * std::sin(phi)};
+        maxDeviation = max(maxDeviation, std::abs(surrogate.Eval(x) - lossFunc.Eval(x)));
+    }
+    
+    cout << "  Maximal deviation: " << maxDeviation << '\n';
+    bool status = (maxDeviation < 2e-2 and surrogate.GetNumExactEvals() == numExactBefore);
+    printResult(status);
+    failure |= not status;
+    
+    
+    cout << "\nEvaluate the surrogate close to the trust region:\n";
+    unsigned const numExactClose = surrogate.GetNumExactEvals();
+    unsigned const numShellPoints = 2 * center.size() * center.size();
+    vector<double> const closePoint{center[0] + 1.2 * radius * 1e-3, center[1]};
+    surrogate.Eval(closePoint);
+    double const newRadius = surrogate.GetTrustRadius();
+    unsigned const numNewExact = surrogate.GetNumExactEvals() - numExactClose;
+    cout << "  Trust radius " << newRadius << " after " << numNewExact <<
+      " exact evaluation(s)\n";
+    
+    // The trust region may only be extended after points along the axes and the diagonal
+    //directions have been checked. If it has been extended, the polynomial must describe the loss
+    //function in all directions on the new boundary.
+    if (newRadius > radius)
+    {
+        status = (numNewExact == 1 + numShellPoints);
+        maxDeviation = 0.;
+        
+        for (double phi = 0.; phi < 2 * M_PI; phi += 0.3)
+        {
+            vector<double> const x{center[0] + newRadius * 1e-3 * std::cos(phi),
+              center[1] + newRadius * 1e-3 * std::sin(phi)};
+            maxDeviation = max(maxDeviation, std::abs(surrogate.Eval(x) - lossFunc.Eval(x)));
+        }
+        
+        cout << "  Maximal deviation on the new boundary: " << maxDeviation << '\n';
+        status &= (maxDeviation < 2e-2);
+    }
+    else
+        status = (newRadius == radius and
+          (numNewExact == 1 or numNewExact == 1 + numShellPoints));
+    
+    printResult(status);
+    failure |= not status;
+    
+    
+    cout << "\nEvaluate the surrogate far away from the minimum:\n";
+    unsigned const numExactFar = surrogate.GetNumExactEvals();
+    vector<double> const farPoint{center[0] + 10 * radius * 1e-3, center[1]};
+    double const farValue = surrogate.Eval(farPoint);
+    cout << "  Surrogate: " << farValue << ", exact: " << lossFunc.Eval(farPoint) << '\n';
+    status = (farValue == lossFunc.Eval(farPoint) and
+      surrogate.GetNumExactEvals() == numExactFar + 1);
+    printResult(status);
+    failure |= not status;
+    
+    
+    cout << endl;
+    
+    if (not failure)
+    {
+        cout << "\e[1;32mAll tests passed.\e[0m\n";
+        return EXIT_SUCCESS;
+    }
+    else
+    {
+        cout << "\e[1;31mSome tests failed.\e[0m\n";
+        return EXIT_FAILURE;
+    }
+}